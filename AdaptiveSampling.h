@@ -0,0 +1,312 @@
+// AdaptiveSampling.h
+// Samples a group faster while it reports trouble, within node-read budgets per camera and per link
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef ADAPTIVESAMPLING_H
+#define ADAPTIVESAMPLING_H
+
+#include "StatisticsSnapshot.h"
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+// No pylon dependency.
+//
+// A group is sampled at its base period (CStatistician::SetSamplingPeriod()) while it is healthy.
+// When a sample finds a trouble statistic changed (SStatisticInfo::trouble: a failure counter went
+// up, an error text changed), the group switches to its fast period and stays there until it has
+// been quiet for the hold time. Then the period grows by the backoff factor with every sample,
+// back to the base period.
+//
+// Fast samples cost node reads, so they are only taken while the camera's budget, and the link's
+// budget if one is set, have room. Every sample is charged to the budgets, but a sample that is
+// due by the base period is never refused: the reads of a camera stay within its budget or its
+// base rate, whichever is higher.
+namespace Statistician
+{
+	// A node-read budget: 'readsPerSecond' on average, with bursts of up to 'burst' worth of reads.
+	// It keeps one atomic deadline (the generic cell rate algorithm), so statisticians on
+	// different threads can share one budget without a lock, e.g. all cameras on one GigE link.
+	class CSamplingBudget
+	{
+	private:
+		std::atomic<int64_t> m_readyNs;		// when the reads charged so far are paid off
+		std::atomic<int64_t> m_intervalNs;	// per read, 0 = unlimited
+		std::atomic<int64_t> m_burstNs;
+		std::atomic<uint64_t> m_reads;
+		std::atomic<uint64_t> m_denied;
+
+		void Add(uint32_t reads, int64_t nowNs);
+
+	public:
+		explicit CSamplingBudget(double readsPerSecond = 0.0, std::chrono::milliseconds burst = std::chrono::milliseconds(100));
+
+		// 0 reads per second means unlimited. Can be changed while sampling is running.
+		void SetLimit(double readsPerSecond, std::chrono::milliseconds burst);
+
+		// Takes 'reads' from the budget if it has room for them at 'nowUs'.
+		bool TryAcquire(uint32_t reads, int64_t nowUs);
+
+		// Takes 'reads' from the budget even if it is exhausted.
+		void Charge(uint32_t reads, int64_t nowUs);
+
+		// Gives back 'reads' taken by TryAcquire() for reads that were not made after all.
+		void Refund(uint32_t reads);
+
+		uint64_t GetReadCount() const;
+		uint64_t GetDeniedCount() const;
+	};
+
+	// The adaptive period of every group of one statistician. Used by the sampling thread only.
+	class CAdaptiveSampling
+	{
+	private:
+		struct SGroupState
+		{
+			int64_t fastPeriodUs;		// 0 = the group is not adaptive
+			int64_t periodUs;			// current period, 0 = the base period
+			int64_t lastTroubleUs;
+			int64_t lastSampleUs;		// min() before the first sample
+		};
+
+		SGroupState m_groups[StatisticGroup_Count];
+		int64_t m_holdUs;
+		double m_backoff;
+		CSamplingBudget m_budget;
+		CSamplingBudget *m_linkBudget;
+
+	public:
+		CAdaptiveSampling();
+
+		// Period while the group has trouble. 0 (the default for every group) turns it off.
+		void SetFastPeriod(EStatisticGroup group, std::chrono::milliseconds period);
+		std::chrono::milliseconds GetFastPeriod(EStatisticGroup group) const;
+
+		// How long a group stays fast after the last trouble, and how fast it backs off after that.
+		void SetBackoff(std::chrono::milliseconds hold, double factor);
+
+		CSamplingBudget &GetBudget();
+		void SetLinkBudget(CSamplingBudget *budget);
+
+		// Every group back to its base period, e.g. after the periods changed.
+		void Reset();
+
+		// Whether a due group is read now. A sample that is due by the base period is always
+		// admitted (and charged); a fast one only if the budgets have room. 'isFast' tells which.
+		bool Admit(EStatisticGroup group, int64_t basePeriodUs, uint32_t reads, int64_t nowUs, bool &isFast);
+
+		// After a sample: returns the period until the group's next sample.
+		int64_t Update(EStatisticGroup group, int64_t basePeriodUs, bool trouble, int64_t nowUs);
+
+		// The period of a group that was not admitted.
+		int64_t GetPeriodUs(EStatisticGroup group, int64_t basePeriodUs) const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CSamplingBudget::CSamplingBudget(double readsPerSecond, std::chrono::milliseconds burst)
+	: m_readyNs(0)
+	, m_intervalNs(0)
+	, m_burstNs(0)
+	, m_reads(0)
+	, m_denied(0)
+{
+	SetLimit(readsPerSecond, burst);
+}
+
+inline void Statistician::CSamplingBudget::SetLimit(double readsPerSecond, std::chrono::milliseconds burst)
+{
+	m_intervalNs.store((readsPerSecond > 0.0) ? std::max<int64_t>(1, static_cast<int64_t>(1e9 / readsPerSecond)) : 0);
+	m_burstNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(burst).count());
+}
+
+inline bool Statistician::CSamplingBudget::TryAcquire(uint32_t reads, int64_t nowUs)
+{
+	int64_t intervalNs = m_intervalNs.load(std::memory_order_relaxed);
+	if (intervalNs == 0)
+	{
+		m_reads.fetch_add(reads, std::memory_order_relaxed);
+		return true;
+	}
+
+	int64_t nowNs = nowUs * 1000;
+	int64_t burstNs = m_burstNs.load(std::memory_order_relaxed);
+	int64_t ready = m_readyNs.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		int64_t next = std::max(ready, nowNs) + intervalNs * reads;
+		if (next - nowNs > burstNs + intervalNs * reads)
+		{
+			m_denied.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		if (m_readyNs.compare_exchange_weak(ready, next, std::memory_order_relaxed) == true)
+			break;
+	}
+	m_reads.fetch_add(reads, std::memory_order_relaxed);
+	return true;
+}
+
+inline void Statistician::CSamplingBudget::Charge(uint32_t reads, int64_t nowUs)
+{
+	Add(reads, nowUs * 1000);
+	m_reads.fetch_add(reads, std::memory_order_relaxed);
+}
+
+inline void Statistician::CSamplingBudget::Refund(uint32_t reads)
+{
+	// the deadline moves back by what the reads added; one that was already in the past stays
+	// there, which is the same as no reads.
+	int64_t intervalNs = m_intervalNs.load(std::memory_order_relaxed);
+	if (intervalNs != 0)
+		m_readyNs.fetch_sub(intervalNs * reads, std::memory_order_relaxed);
+	m_reads.fetch_sub(reads, std::memory_order_relaxed);
+}
+
+inline void Statistician::CSamplingBudget::Add(uint32_t reads, int64_t nowNs)
+{
+	int64_t intervalNs = m_intervalNs.load(std::memory_order_relaxed);
+	if (intervalNs == 0)
+		return;
+
+	int64_t ready = m_readyNs.load(std::memory_order_relaxed);
+	while (m_readyNs.compare_exchange_weak(ready, std::max(ready, nowNs) + intervalNs * reads, std::memory_order_relaxed) == false)
+	{
+	}
+}
+
+inline uint64_t Statistician::CSamplingBudget::GetReadCount() const
+{
+	return m_reads.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Statistician::CSamplingBudget::GetDeniedCount() const
+{
+	return m_denied.load(std::memory_order_relaxed);
+}
+
+inline Statistician::CAdaptiveSampling::CAdaptiveSampling()
+	: m_holdUs(2000000)
+	, m_backoff(2.0)
+	, m_linkBudget(NULL)
+{
+	for (int i = 0; i < StatisticGroup_Count; i++)
+		m_groups[i].fastPeriodUs = 0;
+	Reset();
+}
+
+inline void Statistician::CAdaptiveSampling::SetFastPeriod(EStatisticGroup group, std::chrono::milliseconds period)
+{
+	if (group < 0 || group >= StatisticGroup_Count)
+		return;
+
+	m_groups[group].fastPeriodUs = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(period).count());
+}
+
+inline std::chrono::milliseconds Statistician::CAdaptiveSampling::GetFastPeriod(EStatisticGroup group) const
+{
+	if (group < 0 || group >= StatisticGroup_Count)
+		return std::chrono::milliseconds(0);
+
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::microseconds(m_groups[group].fastPeriodUs));
+}
+
+inline void Statistician::CAdaptiveSampling::SetBackoff(std::chrono::milliseconds hold, double factor)
+{
+	m_holdUs = std::chrono::duration_cast<std::chrono::microseconds>(hold).count();
+	m_backoff = std::max(1.01, factor);
+}
+
+inline Statistician::CSamplingBudget &Statistician::CAdaptiveSampling::GetBudget()
+{
+	return m_budget;
+}
+
+inline void Statistician::CAdaptiveSampling::SetLinkBudget(CSamplingBudget *budget)
+{
+	m_linkBudget = budget;
+}
+
+inline void Statistician::CAdaptiveSampling::Reset()
+{
+	for (int i = 0; i < StatisticGroup_Count; i++)
+	{
+		m_groups[i].periodUs = 0;
+		m_groups[i].lastTroubleUs = std::numeric_limits<int64_t>::min();
+		m_groups[i].lastSampleUs = std::numeric_limits<int64_t>::min();
+	}
+}
+
+inline bool Statistician::CAdaptiveSampling::Admit(EStatisticGroup group, int64_t basePeriodUs, uint32_t reads, int64_t nowUs, bool &isFast)
+{
+	SGroupState &state = m_groups[group];
+
+	// the base period leaves at most one scheduling jitter of slack, so a fast deadline that
+	// lands right on a base deadline counts as the base sample.
+	isFast = (state.lastSampleUs != std::numeric_limits<int64_t>::min() && nowUs - state.lastSampleUs < basePeriodUs - basePeriodUs / 8);
+	if (isFast == false)
+	{
+		m_budget.Charge(reads, nowUs);
+		if (m_linkBudget != NULL)
+			m_linkBudget->Charge(reads, nowUs);
+		return true;
+	}
+
+	if (m_budget.TryAcquire(reads, nowUs) == false)
+		return false;
+	if (m_linkBudget != NULL && m_linkBudget->TryAcquire(reads, nowUs) == false)
+	{
+		// the camera's budget was charged for reads that are not made.
+		m_budget.Refund(reads);
+		return false;
+	}
+	return true;
+}
+
+inline int64_t Statistician::CAdaptiveSampling::Update(EStatisticGroup group, int64_t basePeriodUs, bool trouble, int64_t nowUs)
+{
+	SGroupState &state = m_groups[group];
+	state.lastSampleUs = nowUs;
+	if (state.fastPeriodUs <= 0 || state.fastPeriodUs >= basePeriodUs)
+		return basePeriodUs;
+
+	if (trouble == true)
+	{
+		state.lastTroubleUs = nowUs;
+		state.periodUs = state.fastPeriodUs;
+	}
+	else if (state.periodUs != 0 && nowUs - state.lastTroubleUs >= m_holdUs)
+	{
+		// quiet for the hold time: back off towards the base period.
+		state.periodUs = static_cast<int64_t>(state.periodUs * m_backoff);
+		if (state.periodUs >= basePeriodUs)
+			state.periodUs = 0;
+	}
+	return GetPeriodUs(group, basePeriodUs);
+}
+
+inline int64_t Statistician::CAdaptiveSampling::GetPeriodUs(EStatisticGroup group, int64_t basePeriodUs) const
+{
+	const SGroupState &state = m_groups[group];
+	return (state.periodUs != 0 && state.periodUs < basePeriodUs) ? state.periodUs : basePeriodUs;
+}
+
+// *********************************************************************************************************
+#endif
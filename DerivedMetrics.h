@@ -0,0 +1,198 @@
+// DerivedMetrics.h
+// Loss ratios, effective frame rate and BlockID gaps, computed from the counters on every sample
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DERIVEDMETRICS_H
+#define DERIVEDMETRICS_H
+
+#include "StatisticsSnapshot.h"
+#include <vector>
+#include <cstring>
+
+// No pylon dependency.
+//
+// Every metric is one operation over one or two counters, declared in GetDerivedMetricInfo(). The
+// table is compiled once, when the statistician is initialized, into the steps that apply to the
+// camera's device class; a sample then costs a few subtractions per step, with no look back into
+// the history. Each step keeps the counter values it saw last and at its first sample.
+//
+// Metrics are only updated when their group was sampled, so an interval always spans two reads of
+// the counters. The counters are the stitched ones (see SLifecycleStatistics), so a camera that
+// counts from zero again does not show as a negative interval.
+namespace Statistician
+{
+	enum EDerivedOperation
+	{
+		DerivedOperation_Ratio,		// delta a / delta b; the total is a / b
+		DerivedOperation_Rate,		// delta a per second
+		DerivedOperation_Gap		// delta a - delta b; an interval in which a went down is skipped
+	};
+
+	struct SDerivedMetricInfo
+	{
+		const char *name;			// as used by the output formats
+		const char *label;			// human-readable
+		EDerivedOperation operation;
+		ECounter a;
+		ECounter b;					// not used by DerivedOperation_Rate
+		unsigned deviceClasses;		// DeviceClass_* mask of the cameras that have the counters
+		EStatisticGroup group;		// the group the counters are sampled in
+		int decimals;				// when formatted
+	};
+
+	inline const SDerivedMetricInfo &GetDerivedMetricInfo(EDerivedMetric metric)
+	{
+		static const SDerivedMetricInfo info[DerivedMetric_Count] =
+		{
+			{ "packetLossRatio", "Packet Loss Ratio", DerivedOperation_Ratio, Counter_FailedPackets, Counter_TotalPackets, DeviceClass_GigE, StatisticGroup_Grabber, 6 },
+			{ "resendRatio", "Resend Ratio", DerivedOperation_Ratio, Counter_ResendPackets, Counter_TotalPackets, DeviceClass_GigE, StatisticGroup_Grabber, 6 },
+			{ "effectiveFrameRate", "Effective Frame Rate [fps]", DerivedOperation_Rate, Counter_TotalBuffers, Counter_TotalBuffers, DeviceClass_All, StatisticGroup_Grabber, 2 },
+			{ "blockIdGap", "BlockID Gap (frames never delivered)", DerivedOperation_Gap, Counter_LastBlockID, Counter_TotalBuffers, DeviceClass_Usb, StatisticGroup_Grabber, 0 },
+			{ "bufferFailureRate", "Buffer Failure Rate", DerivedOperation_Ratio, Counter_FailedBuffers, Counter_TotalBuffers, DeviceClass_All, StatisticGroup_Grabber, 6 }
+		};
+		return info[metric];
+	}
+
+	// Computes the derived metrics of one camera. Used by the sampling thread only.
+	class CDerivedMetrics
+	{
+	private:
+		// one compiled metric and what it has seen so far
+		struct SStep
+		{
+			EDerivedMetric metric;
+			EDerivedOperation operation;
+			ECounter a;
+			ECounter b;
+			uint32_t groupBit;
+			bool hasBase;
+			int64_t firstA;
+			int64_t firstTimeUs;
+			int64_t lastA;
+			int64_t lastB;
+			int64_t lastTimeUs;
+			double gap;
+		};
+		std::vector<SStep> m_steps;
+
+	public:
+		// Keeps the metrics that apply to a device class and forgets what was seen so far.
+		void Compile(unsigned deviceClass);
+		size_t GetStepCount() const;
+
+		// 'counters' holds a value per ECounter, -1 if not available. 'sampledGroups' has bit
+		// (1 << EStatisticGroup) for every group read since the last update.
+		void Update(const int64_t *counters, int64_t timestampUs, uint32_t sampledGroups, SDerivedStatistics &derived);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline void Statistician::CDerivedMetrics::Compile(unsigned deviceClass)
+{
+	m_steps.clear();
+	for (int i = 0; i < DerivedMetric_Count; i++)
+	{
+		const SDerivedMetricInfo &info = GetDerivedMetricInfo(static_cast<EDerivedMetric>(i));
+		if ((info.deviceClasses & deviceClass) == 0)
+			continue;
+
+		SStep step;
+		memset(&step, 0, sizeof(step));
+		step.metric = static_cast<EDerivedMetric>(i);
+		step.operation = info.operation;
+		step.a = info.a;
+		step.b = info.b;
+		step.groupBit = static_cast<uint32_t>(1) << info.group;
+		step.hasBase = false;
+		m_steps.push_back(step);
+	}
+}
+
+inline size_t Statistician::CDerivedMetrics::GetStepCount() const
+{
+	return m_steps.size();
+}
+
+inline void Statistician::CDerivedMetrics::Update(const int64_t *counters, int64_t timestampUs, uint32_t sampledGroups, SDerivedStatistics &derived)
+{
+	for (size_t i = 0; i < m_steps.size(); i++)
+	{
+		SStep &step = m_steps[i];
+		int64_t a = counters[step.a];
+		int64_t b = counters[step.b];
+		if ((step.groupBit & sampledGroups) == 0 || a < 0 || b < 0)
+			continue;
+
+		if (step.hasBase == false)
+		{
+			// a BlockID of 0 is either no frame yet or the first one, so a gap is counted from a
+			// delivered frame on.
+			if (step.operation == DerivedOperation_Gap && b == 0)
+				continue;
+
+			step.hasBase = true;
+			step.firstA = a;
+			step.firstTimeUs = timestampUs;
+			step.lastA = a;
+			step.lastB = b;
+			step.lastTimeUs = timestampUs;
+			continue;
+		}
+
+		int64_t deltaA = a - step.lastA;
+		int64_t deltaB = b - step.lastB;
+		double value = 0.0;
+		double total = 0.0;
+		switch (step.operation)
+		{
+		case DerivedOperation_Ratio:
+			value = (deltaB > 0) ? static_cast<double>(deltaA) / deltaB : 0.0;
+			total = (b > 0) ? static_cast<double>(a) / b : 0.0;
+			break;
+
+		case DerivedOperation_Rate:
+			{
+				int64_t intervalUs = timestampUs - step.lastTimeUs;
+				int64_t elapsedUs = timestampUs - step.firstTimeUs;
+				value = (intervalUs > 0) ? deltaA * 1e6 / intervalUs : 0.0;
+				total = (elapsedUs > 0) ? (a - step.firstA) * 1e6 / elapsedUs : 0.0;
+			}
+			break;
+
+		case DerivedOperation_Gap:
+			// a gauge like the BlockID starts from zero with every acquisition.
+			if (deltaA >= 0)
+			{
+				value = static_cast<double>(deltaA - deltaB);
+				step.gap += value;
+			}
+			total = step.gap;
+			break;
+		}
+
+		step.lastA = a;
+		step.lastB = b;
+		step.lastTimeUs = timestampUs;
+		derived.values[step.metric] = value;
+		derived.totals[step.metric] = total;
+		derived.available |= static_cast<uint32_t>(1) << step.metric;
+	}
+}
+
+// *********************************************************************************************************
+#endif
@@ -0,0 +1,158 @@
+// ErrorDictionary.h
+// Interns error texts and logs when they change, without allocating
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef ERRORDICTIONARY_H
+#define ERRORDICTIONARY_H
+
+#include "StatisticsSnapshot.h"
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// No pylon dependency.
+//
+// The sampler hashes every error text it reads and compares the hash with the previous one of
+// the statistic, so an unchanged text costs no string comparison. Only a changed text is looked
+// up here: by hash in a small open-addressing index, confirmed with one string comparison, and
+// copied into the log the first time it is seen. The log lives in the snapshot, so readers get
+// the texts, counts and changes with the rest of the statistics.
+namespace Statistician
+{
+	class CErrorDictionary
+	{
+	private:
+		static const size_t c_indexSize = 64;	// power of two, larger than c_maxErrorTexts
+		uint16_t m_index[c_indexSize];			// error ID + 1, 0 = empty slot
+		StatisticsErrorLog *m_log;
+
+		uint16_t Intern(uint32_t statistic, const char *text, uint64_t hash, int64_t timestampUs);
+		void AddTransition(uint32_t statistic, uint16_t error, int64_t timestampUs);
+
+	public:
+		CErrorDictionary();
+
+		// Clears the log and keeps writing to it. The log must outlive the dictionary.
+		void Attach(StatisticsErrorLog &log);
+
+		// The statistic's text changed to 'text' (not empty), or to "no error". Returns the error
+		// ID, c_droppedError if the dictionary is full.
+		uint16_t OnText(uint32_t statistic, const char *text, uint64_t hash, int64_t timestampUs);
+		void OnNoError(uint32_t statistic, int64_t timestampUs);
+
+		// 64-bit FNV-1a of a terminated text. Never returns 0, so 0 can mean "nothing read yet".
+		static uint64_t Hash(const char *text);
+	};
+
+	// The text of an error ID, or NULL for c_noError, c_droppedError and unknown IDs.
+	inline const char *GetErrorText(const StatisticsErrorLog &log, uint16_t error)
+	{
+		return (error < log.errorCount) ? log.errors[error].text : NULL;
+	}
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CErrorDictionary::CErrorDictionary()
+	: m_log(NULL)
+{
+	memset(m_index, 0, sizeof(m_index));
+}
+
+inline void Statistician::CErrorDictionary::Attach(StatisticsErrorLog &log)
+{
+	m_log = &log;
+	memset(m_log, 0, sizeof(*m_log));
+	memset(m_index, 0, sizeof(m_index));
+}
+
+inline uint16_t Statistician::CErrorDictionary::OnText(uint32_t statistic, const char *text, uint64_t hash, int64_t timestampUs)
+{
+	uint16_t error = Intern(statistic, text, hash, timestampUs);
+	if (error == c_droppedError)
+		m_log->droppedTexts++;
+	else
+	{
+		SErrorText &entry = m_log->errors[error];
+		entry.occurrences++;
+		entry.lastUs = timestampUs;
+	}
+
+	AddTransition(statistic, error, timestampUs);
+	return error;
+}
+
+inline void Statistician::CErrorDictionary::OnNoError(uint32_t statistic, int64_t timestampUs)
+{
+	AddTransition(statistic, c_noError, timestampUs);
+}
+
+inline uint16_t Statistician::CErrorDictionary::Intern(uint32_t statistic, const char *text, uint64_t hash, int64_t timestampUs)
+{
+	// the same text of two statistics is two entries, so the statistic is part of the key.
+	size_t slot = static_cast<size_t>(hash ^ (statistic * 0x9E3779B97F4A7C15ULL)) & (c_indexSize - 1);
+
+	for (size_t probe = 0; probe < c_indexSize; probe++, slot = (slot + 1) & (c_indexSize - 1))
+	{
+		if (m_index[slot] == 0)
+		{
+			if (m_log->errorCount >= c_maxErrorTexts)
+				return c_droppedError;
+
+			uint16_t error = static_cast<uint16_t>(m_log->errorCount++);
+			SErrorText &entry = m_log->errors[error];
+			entry.hash = hash;
+			entry.statistic = statistic;
+			entry.occurrences = 0;
+			entry.firstUs = timestampUs;
+			entry.lastUs = timestampUs;
+			size_t length = std::min(strlen(text), c_maxTextLength - 1);
+			memcpy(entry.text, text, length);
+			entry.text[length] = '\0';
+			m_index[slot] = static_cast<uint16_t>(error + 1);
+			return error;
+		}
+
+		const SErrorText &entry = m_log->errors[m_index[slot] - 1];
+		if (entry.hash == hash && entry.statistic == statistic && strncmp(entry.text, text, c_maxTextLength - 1) == 0)
+			return static_cast<uint16_t>(m_index[slot] - 1);
+	}
+	return c_droppedError;
+}
+
+inline void Statistician::CErrorDictionary::AddTransition(uint32_t statistic, uint16_t error, int64_t timestampUs)
+{
+	SErrorTransition &transition = m_log->transitions[m_log->transitionCount % c_errorLogLength];
+	transition.timestampUs = timestampUs;
+	transition.statistic = static_cast<uint16_t>(statistic);
+	transition.error = error;
+	m_log->transitionCount++;
+}
+
+inline uint64_t Statistician::CErrorDictionary::Hash(const char *text)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (const unsigned char *c = reinterpret_cast<const unsigned char*>(text); *c != '\0'; c++)
+	{
+		hash ^= *c;
+		hash *= 1099511628211ULL;
+	}
+	return (hash != 0) ? hash : 1;
+}
+
+// *********************************************************************************************************
+#endif
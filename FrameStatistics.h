@@ -0,0 +1,425 @@
+// FrameStatistics.h
+// Per-frame timing and BlockID statistics of the grab path
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef FRAMESTATISTICS_H
+#define FRAMESTATISTICS_H
+
+#ifndef STATISTICIAN_NO_PYLON
+#include <pylon/PylonIncludes.h>
+#endif
+#include "StatisticsFormatter.h"
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#ifdef _MSC_VER
+#    include <intrin.h>
+#endif
+
+namespace Statistician
+{
+	// Log-linear histogram of unsigned values, in the style of HdrHistogram: values below 32 are
+	// exact, above that every power of two is split into 16 buckets, so any value is recorded
+	// with at most 6.25% error. Fixed size, never allocates.
+	// One thread records; any thread may read at the same time (counts are relaxed atomics, so a
+	// reader sees each bucket whole, but the buckets of one read may be a few frames apart).
+	class CHdrHistogram
+	{
+	private:
+		static const int c_subBucketBits = 4;
+		static const int c_subBuckets = 1 << c_subBucketBits;
+		static const int c_bucketCount = (64 - c_subBucketBits) * c_subBuckets + c_subBuckets;
+
+		std::atomic<uint64_t> m_buckets[c_bucketCount];
+		std::atomic<uint64_t> m_count;
+		std::atomic<uint64_t> m_sum;
+		std::atomic<uint64_t> m_min;
+		std::atomic<uint64_t> m_max;
+		static int GetBucket(uint64_t value);
+		static uint64_t GetBucketValue(int bucket);	// middle of the bucket
+		static int GetHighestBit(uint64_t value);
+
+	public:
+		CHdrHistogram();
+		void Record(uint64_t value);
+		void Clear();	// only while nothing is recorded
+
+		uint64_t GetCount() const;
+		uint64_t GetMin() const;
+		uint64_t GetMax() const;
+		double GetMean() const;
+		uint64_t GetPercentile(double percentile) const;	// 0 to 100
+	};
+
+	enum EFrameHistogram
+	{
+		FrameHistogram_Latency,			// host arrival - camera timestamp, relative to the smallest seen (ns)
+		FrameHistogram_Interval,		// host arrival of a frame - host arrival of the previous frame (ns)
+		FrameHistogram_Jitter,			// |host interval - camera timestamp interval| (ns)
+		FrameHistogram_BlockIdGap,		// missing BlockIDs between two frames, only when there is a gap
+		FrameHistogram_Count
+	};
+
+	// Instruments the grab loop. Call OnFrame() (or OnGrabResult()) for every grab result, from the
+	// thread that retrieves the results; CFrameStatisticsHandler does that from an image event handler.
+	// The per-frame cost is one clock read and a few histogram updates, tens of nanoseconds, so it
+	// can stay enabled at high frame rates. Any thread may read the results at any time.
+	//
+	// Camera and host clocks are not synchronized, so latency is measured against the smallest
+	// camera-to-host offset seen so far: it shows how much later than the best case a frame
+	// arrived, not the absolute transfer time. Clock drift between camera and host adds a slow trend.
+	class CFrameStatistics
+	{
+	private:
+		CHdrHistogram m_histograms[FrameHistogram_Count];
+		std::atomic<uint64_t> m_frames;
+		std::atomic<uint64_t> m_failedFrames;
+		std::atomic<uint64_t> m_missingFrames;	// sum of all BlockID gaps
+		std::atomic<uint64_t> m_blockIdResets;	// BlockID went backwards (restart or wrap)
+		double m_nsPerTick;
+		bool m_hasPrevious;
+		uint64_t m_previousBlockId;
+		int64_t m_previousHostNs;
+		int64_t m_previousCameraNs;
+		int64_t m_minOffsetNs;
+
+	public:
+		CFrameStatistics();
+
+		// Camera timestamp ticks per second: 1 GHz for USB3 Vision cameras (the default), the
+		// GevTimestampTickFrequency of GigE cameras (typically 125 MHz).
+		void SetTimestampTickFrequency(double ticksPerSecond);
+
+		// blockId: UINT64_MAX if the camera does not send one. hostNs: steady clock nanoseconds;
+		// the first overload reads the clock itself.
+		void OnFrame(uint64_t cameraTimestamp, uint64_t blockId, bool succeeded);
+		void OnFrame(uint64_t cameraTimestamp, uint64_t blockId, bool succeeded, int64_t hostNs);
+#ifndef STATISTICIAN_NO_PYLON
+		void OnGrabResult(const Pylon::CGrabResultPtr &ptrGrabResult);
+#endif
+
+		// Clears everything; only while no frames arrive.
+		void Clear();
+
+		uint64_t GetFrameCount() const;
+		uint64_t GetFailedFrameCount() const;
+		uint64_t GetMissingFrameCount() const;
+		uint64_t GetBlockIdResetCount() const;
+		const CHdrHistogram &GetHistogram(EFrameHistogram histogram) const;
+
+		// Readable summary (count, mean, percentiles) into a caller-provided buffer, like
+		// FormatStatistics(). Returns the length of the complete output.
+		size_t Print(char *buffer, size_t size) const;
+	};
+
+#ifndef STATISTICIAN_NO_PYLON
+	// Feeds every grab result of a camera into a CFrameStatistics. Register it with
+	// camera.RegisterImageEventHandler(&handler, Pylon::RegistrationMode_Append, Pylon::Cleanup_None).
+	class CFrameStatisticsHandler : public Pylon::CImageEventHandler
+	{
+	private:
+		CFrameStatistics &m_statistics;
+
+	public:
+		CFrameStatisticsHandler(CFrameStatistics &statistics) : m_statistics(statistics) {}
+		virtual void OnImageGrabbed(Pylon::CInstantCamera & /*camera*/, const Pylon::CGrabResultPtr &ptrGrabResult) { m_statistics.OnGrabResult(ptrGrabResult); }
+	};
+#endif
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CHdrHistogram::CHdrHistogram()
+{
+	Clear();
+}
+
+inline int Statistician::CHdrHistogram::GetHighestBit(uint64_t value)
+{
+	// value is never 0 here.
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long bit;
+	_BitScanReverse64(&bit, value);
+	return static_cast<int>(bit);
+#elif defined(_MSC_VER)
+	unsigned long bit;
+	if (_BitScanReverse(&bit, static_cast<unsigned long>(value >> 32)))
+		return static_cast<int>(bit) + 32;
+	_BitScanReverse(&bit, static_cast<unsigned long>(value));
+	return static_cast<int>(bit);
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+inline int Statistician::CHdrHistogram::GetBucket(uint64_t value)
+{
+	if (value < static_cast<uint64_t>(2 * c_subBuckets))
+		return static_cast<int>(value);
+
+	int shift = GetHighestBit(value) - c_subBucketBits;
+	return (shift + 1) * c_subBuckets + static_cast<int>((value >> shift) & (c_subBuckets - 1));
+}
+
+inline uint64_t Statistician::CHdrHistogram::GetBucketValue(int bucket)
+{
+	if (bucket < 2 * c_subBuckets)
+		return static_cast<uint64_t>(bucket);
+
+	int shift = bucket / c_subBuckets - 1;
+	uint64_t lower = static_cast<uint64_t>(c_subBuckets + bucket % c_subBuckets) << shift;
+	return lower + ((static_cast<uint64_t>(1) << shift) >> 1);
+}
+
+inline void Statistician::CHdrHistogram::Record(uint64_t value)
+{
+	// single writer: plain load and store instead of read-modify-write instructions.
+	std::atomic<uint64_t> &bucket = m_buckets[GetBucket(value)];
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	if (value < m_min.load(std::memory_order_relaxed))
+		m_min.store(value, std::memory_order_relaxed);
+	if (value > m_max.load(std::memory_order_relaxed))
+		m_max.store(value, std::memory_order_relaxed);
+	m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+inline void Statistician::CHdrHistogram::Clear()
+{
+	for (int i = 0; i < c_bucketCount; i++)
+		m_buckets[i].store(0, std::memory_order_relaxed);
+	m_count.store(0);
+	m_sum.store(0);
+	m_min.store(UINT64_MAX);
+	m_max.store(0);
+}
+
+inline uint64_t Statistician::CHdrHistogram::GetCount() const
+{
+	return m_count.load(std::memory_order_acquire);
+}
+
+inline uint64_t Statistician::CHdrHistogram::GetMin() const
+{
+	return GetCount() > 0 ? m_min.load(std::memory_order_relaxed) : 0;
+}
+
+inline uint64_t Statistician::CHdrHistogram::GetMax() const
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+inline double Statistician::CHdrHistogram::GetMean() const
+{
+	uint64_t count = GetCount();
+	return count > 0 ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / static_cast<double>(count) : 0.0;
+}
+
+inline uint64_t Statistician::CHdrHistogram::GetPercentile(double percentile) const
+{
+	// count the buckets themselves, since m_count may be a frame ahead of them.
+	uint64_t total = 0;
+	for (int i = 0; i < c_bucketCount; i++)
+		total += m_buckets[i].load(std::memory_order_relaxed);
+	if (total == 0)
+		return 0;
+
+	uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < c_bucketCount; i++)
+	{
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return std::min(GetBucketValue(i), GetMax());
+	}
+	return GetMax();
+}
+
+inline Statistician::CFrameStatistics::CFrameStatistics()
+	: m_nsPerTick(1.0)
+{
+	Clear();
+}
+
+inline void Statistician::CFrameStatistics::SetTimestampTickFrequency(double ticksPerSecond)
+{
+	if (ticksPerSecond > 0.0)
+		m_nsPerTick = 1e9 / ticksPerSecond;
+}
+
+inline void Statistician::CFrameStatistics::Clear()
+{
+	for (int i = 0; i < FrameHistogram_Count; i++)
+		m_histograms[i].Clear();
+	m_frames.store(0);
+	m_failedFrames.store(0);
+	m_missingFrames.store(0);
+	m_blockIdResets.store(0);
+	m_hasPrevious = false;
+	m_previousBlockId = 0;
+	m_previousHostNs = 0;
+	m_previousCameraNs = 0;
+	m_minOffsetNs = INT64_MAX;
+}
+
+inline void Statistician::CFrameStatistics::OnFrame(uint64_t cameraTimestamp, uint64_t blockId, bool succeeded)
+{
+	OnFrame(cameraTimestamp, blockId, succeeded, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline void Statistician::CFrameStatistics::OnFrame(uint64_t cameraTimestamp, uint64_t blockId, bool succeeded, int64_t hostNs)
+{
+	m_frames.store(m_frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (succeeded == false)
+	{
+		// a failed frame has no usable timestamp, but its BlockID still counts.
+		m_failedFrames.store(m_failedFrames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	if (blockId != UINT64_MAX)
+	{
+		if (m_hasPrevious == true)
+		{
+			if (blockId > m_previousBlockId + 1)
+			{
+				uint64_t gap = blockId - m_previousBlockId - 1;
+				m_histograms[FrameHistogram_BlockIdGap].Record(gap);
+				m_missingFrames.store(m_missingFrames.load(std::memory_order_relaxed) + gap, std::memory_order_relaxed);
+			}
+			else if (blockId <= m_previousBlockId)
+				m_blockIdResets.store(m_blockIdResets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		m_previousBlockId = blockId;
+	}
+
+	if (succeeded == false)
+	{
+		m_hasPrevious = true;
+		return;
+	}
+
+	int64_t cameraNs = static_cast<int64_t>(static_cast<double>(cameraTimestamp) * m_nsPerTick);
+	int64_t offsetNs = hostNs - cameraNs;
+	if (offsetNs < m_minOffsetNs)
+		m_minOffsetNs = offsetNs;
+	m_histograms[FrameHistogram_Latency].Record(static_cast<uint64_t>(offsetNs - m_minOffsetNs));
+
+	if (m_hasPrevious == true && m_previousHostNs != 0)
+	{
+		int64_t hostInterval = hostNs - m_previousHostNs;
+		int64_t cameraInterval = cameraNs - m_previousCameraNs;
+		if (hostInterval >= 0)
+			m_histograms[FrameHistogram_Interval].Record(static_cast<uint64_t>(hostInterval));
+		int64_t jitter = hostInterval - cameraInterval;
+		m_histograms[FrameHistogram_Jitter].Record(static_cast<uint64_t>(jitter < 0 ? -jitter : jitter));
+	}
+
+	m_hasPrevious = true;
+	m_previousHostNs = hostNs;
+	m_previousCameraNs = cameraNs;
+}
+
+#ifndef STATISTICIAN_NO_PYLON
+inline void Statistician::CFrameStatistics::OnGrabResult(const Pylon::CGrabResultPtr &ptrGrabResult)
+{
+	if (ptrGrabResult.IsValid() == false)
+		return;
+
+	OnFrame(ptrGrabResult->GetTimeStamp(), ptrGrabResult->GetBlockID(), ptrGrabResult->GrabSucceeded());
+}
+#endif
+
+inline uint64_t Statistician::CFrameStatistics::GetFrameCount() const
+{
+	return m_frames.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Statistician::CFrameStatistics::GetFailedFrameCount() const
+{
+	return m_failedFrames.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Statistician::CFrameStatistics::GetMissingFrameCount() const
+{
+	return m_missingFrames.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Statistician::CFrameStatistics::GetBlockIdResetCount() const
+{
+	return m_blockIdResets.load(std::memory_order_relaxed);
+}
+
+inline const Statistician::CHdrHistogram &Statistician::CFrameStatistics::GetHistogram(EFrameHistogram histogram) const
+{
+	return m_histograms[histogram];
+}
+
+inline size_t Statistician::CFrameStatistics::Print(char *buffer, size_t size) const
+{
+	CTextWriter out(buffer, size);
+	out.Append(" Frame Statistics:\n");
+
+	out.AppendPadded("  Frames", 41);
+	out.Append(": ");
+	out.AppendUnsigned(GetFrameCount());
+	out.Append('\n');
+	out.AppendPadded("  Failed Frames", 41);
+	out.Append(": ");
+	out.AppendUnsigned(GetFailedFrameCount());
+	out.Append('\n');
+	out.AppendPadded("  Missing Frames (BlockID gaps)", 41);
+	out.Append(": ");
+	out.AppendUnsigned(GetMissingFrameCount());
+	out.Append('\n');
+	out.AppendPadded("  BlockID Resets", 41);
+	out.Append(": ");
+	out.AppendUnsigned(GetBlockIdResetCount());
+	out.Append('\n');
+
+	const char *labels[FrameHistogram_Count] = { "  Latency above best (us)", "  Frame Interval (us)", "  Jitter (us)", "  BlockID Gap (frames)" };
+	const double percentiles[4] = { 50.0, 90.0, 99.0, 99.9 };
+	const char *percentileLabels[4] = { " p50 ", " p90 ", " p99 ", " p99.9 " };
+
+	for (int i = 0; i < FrameHistogram_Count; i++)
+	{
+		const CHdrHistogram &histogram = m_histograms[i];
+		uint64_t divider = (i == FrameHistogram_BlockIdGap) ? 1 : 1000;
+
+		out.AppendPadded(labels[i], 41);
+		out.Append(": n ");
+		out.AppendUnsigned(histogram.GetCount());
+		out.Append(" mean ");
+		out.AppendUnsigned(static_cast<uint64_t>(histogram.GetMean() / divider + 0.5));
+		for (int p = 0; p < 4; p++)
+		{
+			out.Append(percentileLabels[p]);
+			out.AppendUnsigned(histogram.GetPercentile(percentiles[p]) / divider);
+		}
+		out.Append(" max ");
+		out.AppendUnsigned(histogram.GetMax() / divider);
+		out.Append('\n');
+	}
+
+	return out.Finish();
+}
+
+// *********************************************************************************************************
+#endif
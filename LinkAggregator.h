@@ -0,0 +1,580 @@
+// LinkAggregator.h
+// Sums the counters of the cameras on each network link and flags error bursts that hit several at once
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef LINKAGGREGATOR_H
+#define LINKAGGREGATOR_H
+
+#include "Statistician.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <limits>
+
+namespace Statistician
+{
+	// Counters summed per link.
+	enum ELinkCounter
+	{
+		LinkCounter_TotalBuffers,
+		LinkCounter_FailedBuffers,
+		LinkCounter_BufferUnderruns,
+		LinkCounter_TotalPackets,
+		LinkCounter_ResendRequests,
+		LinkCounter_ResendPackets,
+		LinkCounter_FailedPackets,
+		LinkCounter_Count
+	};
+
+	inline ECounter GetLinkCounterSource(ELinkCounter counter)
+	{
+		static const ECounter source[LinkCounter_Count] =
+		{
+			Counter_TotalBuffers, Counter_FailedBuffers, Counter_BufferUnderruns, Counter_TotalPackets,
+			Counter_ResendRequests, Counter_ResendPackets, Counter_FailedPackets
+		};
+		return source[counter];
+	}
+
+	// One link (network interface or subnet) at the newest aggregation pass. Counters of -1 (not
+	// available for the camera) are skipped, so a link of USB cameras has no packet counts.
+	struct StatisticsLinkSnapshot
+	{
+		std::string name;
+		size_t cameras;
+		size_t burstingCameras;					// cameras whose error counters went up in the newest interval
+		bool burst;								// a link-level burst is going on
+		uint64_t burstCount;					// link-level bursts so far
+		int64_t timestampUs;					// steady clock time of the aggregation pass
+		int64_t totals[LinkCounter_Count];		// summed counters
+		double rates[LinkCounter_Count];		// per second over the newest interval, 0 after the first pass
+	};
+
+	// A burst on a link started (raised) or ended.
+	struct SLinkEvent
+	{
+		const char *link;
+		bool raised;
+		size_t cameras;
+		size_t burstingCameras;
+		int64_t errors;							// error counter increase of the link in the interval
+		int64_t timestampUs;
+	};
+
+	// Called on the thread that runs the aggregation (Start()'s thread, or whoever calls Update()).
+	class ILinkEventHandler
+	{
+	public:
+		virtual ~ILinkEventHandler() {}
+		virtual void OnLinkEvent(const SLinkEvent &event) = 0;
+	};
+
+	// Cameras that share a network interface share its bandwidth, so a resend storm on the link shows
+	// up on several statisticians at once. Every pass reads the snapshot of every camera (lock-free),
+	// sums the counters per link, and turns the increase since the previous pass into rates. A
+	// camera whose failed buffers, buffer underruns, resend requests and failed packets went up by at
+	// least 'minErrors' in the interval is bursting; when at least 'minCameras' cameras of one link
+	// burst in the same interval, that is a link-level burst and the handlers are told.
+	//
+	// The pass is a parallel reduction: the cameras are split into contiguous ranges, each range is
+	// summed into per-link partial totals by its own worker, and the partials are added up at the
+	// end. Workers only start for large fleets (see SetWorkerCount()).
+	//
+	// Add cameras and handlers first, then Start() or call Update() periodically:
+	//   links.AddCamera(camera.GetDeviceInfo(), myStatistician);
+	//   links.AddHandler(&myHandler);
+	//   links.Start(std::chrono::seconds(1));
+	class CLinkAggregator
+	{
+	private:
+		struct SCamera
+		{
+			const CStatistician *statistician;
+			size_t link;
+			bool hasPrevious;
+			int64_t previous[LinkCounter_Count];
+		};
+
+		// What one worker summed over its range of cameras.
+		struct SPartial
+		{
+			std::vector<int64_t> totals;		// link * LinkCounter_Count
+			std::vector<int64_t> deltas;		// link * LinkCounter_Count
+			std::vector<size_t> bursting;		// per link
+			std::vector<int64_t> errors;		// per link
+			StatisticsSnapshot snapshot;		// scratch, so a pass does not allocate
+		};
+
+		static const size_t c_camerasPerWorker = 32;	// fewer cameras than this are summed on one thread
+
+		std::vector<SCamera> m_cameras;
+		std::vector<std::string> m_linkNames;
+		std::vector<ILinkEventHandler*> m_handlers;
+		std::vector<std::unique_ptr<SPartial> > m_partials;	// one per range
+		int64_t m_minErrors;
+		size_t m_minCameras;
+		size_t m_workerCount;			// 0 = by fleet size
+		int64_t m_previousUs;
+
+		// results
+		mutable std::mutex m_mtxLinks;
+		std::vector<StatisticsLinkSnapshot> m_links;
+
+		// workers of the parallel reduction; range 0 is summed by the thread calling Update().
+		std::vector<std::thread> m_workers;
+		std::mutex m_mtxWork;
+		std::condition_variable m_cvWork;
+		std::condition_variable m_cvDone;
+		uint64_t m_generation;
+		size_t m_pending;
+		bool m_stopWorkers;
+
+		// Start()'s thread
+		std::thread m_thread;
+		std::mutex m_mtxThread;
+		std::condition_variable m_cvThread;
+		bool m_stop;
+		std::chrono::milliseconds m_period;
+
+		size_t AddLink(const char *link);
+		void StartWorkers();
+		void StopWorkers();
+		void Work(size_t range);
+		void Reduce(size_t range);
+		void Run();
+#ifndef STATISTICIAN_NO_PYLON
+		static bool ParseAddress(const char *text, uint32_t &address);
+#endif
+
+		// not copyable
+		CLinkAggregator(const CLinkAggregator&);
+		CLinkAggregator &operator=(const CLinkAggregator&);
+
+	public:
+		CLinkAggregator();
+		~CLinkAggregator();
+
+		// Adds a camera to a link. Cameras and handlers are added before the first pass. The
+		// statistician must outlive the aggregator.
+		void AddCamera(const char *link, const CStatistician &statistician);
+#ifndef STATISTICIAN_NO_PYLON
+		void AddCamera(const Pylon::CDeviceInfo &info, const CStatistician &statistician);
+
+		// The link a camera is reached through: the address of the host's network interface, or
+		// the camera's subnet if pylon does not report the interface, or the device class (USB).
+		static std::string GetLinkName(const Pylon::CDeviceInfo &info);
+#endif
+		void AddHandler(ILinkEventHandler *handler);
+
+		// A camera bursts when its error counters went up by at least 'minErrors' in one interval;
+		// a link bursts when at least 'minCameras' of its cameras do. Defaults: 1 and 2.
+		void SetBurstDetection(int64_t minErrors, size_t minCameras);
+
+		// Threads that sum ranges of cameras, including the calling one. 0, the default, uses one
+		// per c_camerasPerWorker cameras, up to the number of cores. Set it before the first pass.
+		void SetWorkerCount(size_t workerCount);
+
+		// One aggregation pass at 'nowUs' (steady clock microseconds). Called by Start()'s thread;
+		// without Start(), call it from one thread at a time.
+		void Update(int64_t nowUs);
+
+		bool Start(std::chrono::milliseconds period);
+		bool Stop();
+
+		// The links of the newest pass, in the order they were first named.
+		std::vector<StatisticsLinkSnapshot> GetLinks() const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CLinkAggregator::CLinkAggregator()
+	: m_minErrors(1)
+	, m_minCameras(2)
+	, m_workerCount(0)
+	, m_previousUs(std::numeric_limits<int64_t>::min())
+	, m_generation(0)
+	, m_pending(0)
+	, m_stopWorkers(false)
+	, m_stop(true)
+	, m_period(1000)
+{
+}
+
+inline Statistician::CLinkAggregator::~CLinkAggregator()
+{
+	this->Stop();
+	StopWorkers();
+}
+
+inline size_t Statistician::CLinkAggregator::AddLink(const char *link)
+{
+	std::string name = (link != NULL) ? link : "";
+	for (size_t i = 0; i < m_linkNames.size(); i++)
+	{
+		if (m_linkNames[i] == name)
+			return i;
+	}
+	m_linkNames.push_back(name);
+	return m_linkNames.size() - 1;
+}
+
+inline void Statistician::CLinkAggregator::AddCamera(const char *link, const CStatistician &statistician)
+{
+	SCamera camera;
+	camera.statistician = &statistician;
+	camera.link = AddLink(link);
+	camera.hasPrevious = false;
+	for (int i = 0; i < LinkCounter_Count; i++)
+		camera.previous[i] = -1;
+	m_cameras.push_back(camera);
+}
+
+#ifndef STATISTICIAN_NO_PYLON
+inline void Statistician::CLinkAggregator::AddCamera(const Pylon::CDeviceInfo &info, const CStatistician &statistician)
+{
+	AddCamera(GetLinkName(info).c_str(), statistician);
+}
+
+inline std::string Statistician::CLinkAggregator::GetLinkName(const Pylon::CDeviceInfo &info)
+{
+	try
+	{
+		if (info.IsInterfaceAvailable() == true && info.GetInterface().empty() == false)
+			return std::string(info.GetInterface().c_str());
+
+		uint32_t ip = 0;
+		uint32_t mask = 0;
+		if (info.IsIpAddressAvailable() == true && info.IsSubnetMaskAvailable() == true
+			&& ParseAddress(info.GetIpAddress().c_str(), ip) == true && ParseAddress(info.GetSubnetMask().c_str(), mask) == true)
+		{
+			char subnet[64];
+			CTextWriter writer(subnet, sizeof(subnet));
+			for (int shift = 24; shift >= 0; shift -= 8)
+			{
+				writer.AppendUnsigned(((ip & mask) >> shift) & 0xFF);
+				if (shift > 0)
+					writer.Append('.');
+			}
+			writer.Append('/');
+			writer.Append(info.GetSubnetMask().c_str());
+			writer.Finish();
+			return std::string(subnet);
+		}
+
+		return std::string(info.GetDeviceClass().c_str());
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
+		return std::string();
+	}
+}
+
+inline bool Statistician::CLinkAggregator::ParseAddress(const char *text, uint32_t &address)
+{
+	// dotted IPv4 address, e.g. "192.168.0.10"
+	address = 0;
+	for (int part = 0; part < 4; part++)
+	{
+		if (part > 0 && *text++ != '.')
+			return false;
+		if (*text < '0' || *text > '9')
+			return false;
+		uint32_t value = 0;
+		while (*text >= '0' && *text <= '9')
+		{
+			value = value * 10 + (*text++ - '0');
+			if (value > 255)
+				return false;
+		}
+		address = (address << 8) | value;
+	}
+	return *text == '\0';
+}
+#endif
+
+inline void Statistician::CLinkAggregator::AddHandler(ILinkEventHandler *handler)
+{
+	if (handler != NULL)
+		m_handlers.push_back(handler);
+}
+
+inline void Statistician::CLinkAggregator::SetBurstDetection(int64_t minErrors, size_t minCameras)
+{
+	m_minErrors = std::max<int64_t>(1, minErrors);
+	m_minCameras = std::max<size_t>(1, minCameras);
+}
+
+inline void Statistician::CLinkAggregator::SetWorkerCount(size_t workerCount)
+{
+	m_workerCount = workerCount;
+}
+
+inline void Statistician::CLinkAggregator::StartWorkers()
+{
+	size_t ranges = m_workerCount;
+	if (ranges == 0)
+	{
+		ranges = (m_cameras.size() + c_camerasPerWorker - 1) / c_camerasPerWorker;
+		ranges = std::min<size_t>(ranges, std::max<unsigned>(1, std::thread::hardware_concurrency()));
+	}
+	ranges = std::max<size_t>(1, std::min(ranges, std::max<size_t>(1, m_cameras.size())));
+
+	size_t cells = m_linkNames.size() * LinkCounter_Count;
+	for (size_t i = 0; i < ranges; i++)
+	{
+		std::unique_ptr<SPartial> partial(new SPartial());
+		partial->totals.resize(cells);
+		partial->deltas.resize(cells);
+		partial->bursting.resize(m_linkNames.size());
+		partial->errors.resize(m_linkNames.size());
+		m_partials.push_back(std::move(partial));
+	}
+
+	m_links.resize(m_linkNames.size());
+	for (size_t link = 0; link < m_links.size(); link++)
+	{
+		StatisticsLinkSnapshot &snapshot = m_links[link];
+		snapshot.name = m_linkNames[link];
+		snapshot.cameras = 0;
+		snapshot.burstingCameras = 0;
+		snapshot.burst = false;
+		snapshot.burstCount = 0;
+		snapshot.timestampUs = 0;
+		for (int i = 0; i < LinkCounter_Count; i++)
+		{
+			snapshot.totals[i] = 0;
+			snapshot.rates[i] = 0.0;
+		}
+	}
+	for (size_t i = 0; i < m_cameras.size(); i++)
+		m_links[m_cameras[i].link].cameras++;
+
+	m_stopWorkers = false;
+	for (size_t i = 1; i < ranges; i++)
+		m_workers.push_back(std::thread(&Statistician::CLinkAggregator::Work, this, i));
+}
+
+inline void Statistician::CLinkAggregator::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxWork);
+		m_stopWorkers = true;
+	}
+	m_cvWork.notify_all();
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+	m_workers.clear();
+}
+
+inline void Statistician::CLinkAggregator::Work(size_t range)
+{
+	uint64_t done = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mtxWork);
+			m_cvWork.wait(lock, [this, done] { return m_stopWorkers == true || m_generation != done; });
+			if (m_stopWorkers == true)
+				return;
+			done = m_generation;
+		}
+
+		Reduce(range);
+
+		std::lock_guard<std::mutex> lock(m_mtxWork);
+		if (--m_pending == 0)
+			m_cvDone.notify_one();
+	}
+}
+
+inline void Statistician::CLinkAggregator::Reduce(size_t range)
+{
+	SPartial &partial = *m_partials[range];
+	std::fill(partial.totals.begin(), partial.totals.end(), 0);
+	std::fill(partial.deltas.begin(), partial.deltas.end(), 0);
+	std::fill(partial.bursting.begin(), partial.bursting.end(), 0);
+	std::fill(partial.errors.begin(), partial.errors.end(), 0);
+
+	size_t ranges = m_partials.size();
+	size_t begin = m_cameras.size() * range / ranges;
+	size_t end = m_cameras.size() * (range + 1) / ranges;
+	for (size_t c = begin; c < end; c++)
+	{
+		SCamera &camera = m_cameras[c];
+		camera.statistician->GetSnapshot(partial.snapshot);
+
+		int64_t *totals = &partial.totals[camera.link * LinkCounter_Count];
+		int64_t *deltas = &partial.deltas[camera.link * LinkCounter_Count];
+		int64_t errors = 0;
+		for (int i = 0; i < LinkCounter_Count; i++)
+		{
+			int64_t value = partial.snapshot.*GetCounterInfo(GetLinkCounterSource(static_cast<ELinkCounter>(i))).field;
+			if (value < 0)
+				continue;
+
+			totals[i] += value;
+			// a counter that went down (camera reconnected) counts from zero.
+			int64_t delta = 0;
+			if (camera.hasPrevious == true && camera.previous[i] >= 0)
+				delta = (value >= camera.previous[i]) ? value - camera.previous[i] : value;
+			deltas[i] += delta;
+			camera.previous[i] = value;
+
+			if (i != LinkCounter_TotalBuffers && i != LinkCounter_TotalPackets && i != LinkCounter_ResendPackets)
+				errors += delta;
+		}
+		camera.hasPrevious = true;
+
+		partial.errors[camera.link] += errors;
+		if (errors >= m_minErrors)
+			partial.bursting[camera.link]++;
+	}
+}
+
+inline void Statistician::CLinkAggregator::Update(int64_t nowUs)
+{
+	if (m_partials.empty() == true)
+		StartWorkers();
+
+	// hand the other ranges to the workers, sum range 0 here, then wait for the rest.
+	{
+		std::lock_guard<std::mutex> lock(m_mtxWork);
+		m_pending = m_partials.size() - 1;
+		m_generation++;
+	}
+	m_cvWork.notify_all();
+	Reduce(0);
+	{
+		std::unique_lock<std::mutex> lock(m_mtxWork);
+		m_cvDone.wait(lock, [this] { return m_pending == 0; });
+	}
+
+	double seconds = (m_previousUs != std::numeric_limits<int64_t>::min() && nowUs > m_previousUs) ? (nowUs - m_previousUs) / 1e6 : 0.0;
+	m_previousUs = nowUs;
+
+	std::vector<SLinkEvent> events;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxLinks);
+		for (size_t link = 0; link < m_links.size(); link++)
+		{
+			StatisticsLinkSnapshot &snapshot = m_links[link];
+			int64_t deltas[LinkCounter_Count];
+			int64_t errors = 0;
+			snapshot.burstingCameras = 0;
+			for (int i = 0; i < LinkCounter_Count; i++)
+			{
+				snapshot.totals[i] = 0;
+				deltas[i] = 0;
+			}
+			for (size_t r = 0; r < m_partials.size(); r++)
+			{
+				const SPartial &partial = *m_partials[r];
+				for (int i = 0; i < LinkCounter_Count; i++)
+				{
+					snapshot.totals[i] += partial.totals[link * LinkCounter_Count + i];
+					deltas[i] += partial.deltas[link * LinkCounter_Count + i];
+				}
+				snapshot.burstingCameras += partial.bursting[link];
+				errors += partial.errors[link];
+			}
+			for (int i = 0; i < LinkCounter_Count; i++)
+				snapshot.rates[i] = (seconds > 0.0) ? deltas[i] / seconds : 0.0;
+			snapshot.timestampUs = nowUs;
+
+			bool burst = (snapshot.burstingCameras >= m_minCameras);
+			if (burst != snapshot.burst)
+			{
+				snapshot.burst = burst;
+				if (burst == true)
+					snapshot.burstCount++;
+
+				SLinkEvent event;
+				event.link = m_linkNames[link].c_str();
+				event.raised = burst;
+				event.cameras = snapshot.cameras;
+				event.burstingCameras = snapshot.burstingCameras;
+				event.errors = errors;
+				event.timestampUs = nowUs;
+				events.push_back(event);
+			}
+		}
+	}
+
+	// handlers are called without the lock, so they can call GetLinks().
+	for (size_t e = 0; e < events.size(); e++)
+	{
+		for (size_t h = 0; h < m_handlers.size(); h++)
+			m_handlers[h]->OnLinkEvent(events[e]);
+	}
+}
+
+inline void Statistician::CLinkAggregator::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mtxThread);
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	while (m_stop == false)
+	{
+		lock.unlock();
+		Update(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		lock.lock();
+
+		next += m_period;
+		m_cvThread.wait_until(lock, next, [this] { return m_stop == true; });
+	}
+}
+
+inline bool Statistician::CLinkAggregator::Start(std::chrono::milliseconds period)
+{
+	std::lock_guard<std::mutex> lock(m_mtxThread);
+	if (m_stop == false || period.count() <= 0)
+		return false;
+
+	m_period = period;
+	m_stop = false;
+	m_thread = std::thread(&Statistician::CLinkAggregator::Run, this);
+	return true;
+}
+
+inline bool Statistician::CLinkAggregator::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxThread);
+		m_stop = true;
+	}
+	m_cvThread.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+	return true;
+}
+
+inline std::vector<Statistician::StatisticsLinkSnapshot> Statistician::CLinkAggregator::GetLinks() const
+{
+	std::lock_guard<std::mutex> lock(m_mtxLinks);
+	return m_links;
+}
+
+// *********************************************************************************************************
+#endif
@@ -0,0 +1,613 @@
+// MetricsServer.h
+// Serves live statistics over HTTP on localhost or a Unix domain socket
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+// On Windows, include this header before pylon (or define WIN32_LEAN_AND_MEAN in the project),
+// so windows.h does not pull in the old winsock.h.
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+
+#include "Statistician.h"
+#include "StatisticianPool.h"
+#include "StatisticsFormatter.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+// GET /metrics        Prometheus text format
+// GET /metrics.json   JSON array, one object per camera
+// GET /               list of the endpoints
+//
+// One thread runs a non-blocking poll() loop over the listening socket and every connection.
+// It only reads published snapshots (CStatistician::GetSnapshot), which never blocks the
+// samplers. A response is rendered once per format and reused until a camera publishes a new
+// sample, so a high scrape rate costs little more than sending the bytes. Connections are
+// kept alive (HTTP/1.1), so a scraper does not pay a TCP handshake per request. A connection
+// that neither sends nor takes any bytes for the idle timeout is closed, so clients that stay
+// connected without scraping, or stop reading a response, do not hold the connection slots.
+namespace Statistician
+{
+	namespace Detail
+	{
+#ifdef _WIN32
+		typedef SOCKET socket_type;
+		typedef WSAPOLLFD pollfd_type;
+		static const socket_type c_invalidSocket = INVALID_SOCKET;
+		inline void CloseSocket(socket_type socket) { closesocket(socket); }
+		inline bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+		inline int PollSockets(pollfd_type *fds, size_t count, int timeoutMs) { return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs); }
+		inline bool SetNonBlocking(socket_type socket) { u_long enable = 1; return ioctlsocket(socket, FIONBIO, &enable) == 0; }
+		static const int c_sendFlags = 0;
+#else
+		typedef int socket_type;
+		typedef struct pollfd pollfd_type;
+		static const socket_type c_invalidSocket = -1;
+		inline void CloseSocket(socket_type socket) { close(socket); }
+		inline bool WouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+		inline int PollSockets(pollfd_type *fds, size_t count, int timeoutMs) { return poll(fds, static_cast<nfds_t>(count), timeoutMs); }
+		inline bool SetNonBlocking(socket_type socket) { int flags = fcntl(socket, F_GETFL, 0); return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0; }
+#ifdef MSG_NOSIGNAL
+		static const int c_sendFlags = MSG_NOSIGNAL;	// a closed peer must not raise SIGPIPE
+#else
+		static const int c_sendFlags = 0;
+#endif
+#endif
+	}
+
+	class CMetricsServer
+	{
+	private:
+		struct SConnection
+		{
+			Detail::socket_type socket;
+			std::string input;
+			std::vector<char> output;
+			size_t written;
+			bool closeAfterWrite;
+			std::chrono::steady_clock::time_point lastActivity;	// bytes last received or sent
+		};
+
+		// a rendered body and the samples it was rendered from.
+		struct SRendering
+		{
+			std::vector<uint64_t> sequences;
+			std::vector<char> body;
+			size_t length;
+		};
+
+		static const size_t c_maxConnections = 64;
+		static const size_t c_maxRequestLength = 8 * 1024;
+
+		std::vector<std::string> m_sourceNames;
+		std::vector<const CStatistician*> m_sources;
+		std::vector<const CStatisticianPool*> m_pools;
+		Detail::socket_type m_listener;
+		std::string m_unixPath;
+		uint16_t m_port;
+		std::thread m_thread;
+		std::atomic<bool> m_stop;
+		std::atomic<uint64_t> m_requests;
+		bool m_isWinsockStarted;
+		std::chrono::milliseconds m_idleTimeout;
+
+		// used by the server thread only.
+		std::vector<SConnection> m_connections;
+		std::vector<StatisticsSnapshot> m_snapshots;
+		std::vector<std::string> m_names;
+		std::vector<const char*> m_namePointers;
+		SRendering m_renderings[2];	// Prometheus, JSON
+
+		bool Listen(Detail::socket_type listener);
+		void Run();
+		void Accept();
+		bool Receive(SConnection &connection);
+		bool Send(SConnection &connection);
+		void HandleRequest(SConnection &connection, const std::string &request);
+		void AppendResponse(SConnection &connection, const char *status, const char *contentType, const char *body, size_t length, bool isHead);
+		const SRendering &Render(EOutputFormat format);
+
+	public:
+		CMetricsServer();
+		~CMetricsServer();
+
+		// What is served. Add sources before Start; a pool's cameras are looked up on every
+		// request, so cameras registered later are served too. Everything added must outlive the server.
+		void AddSource(const char *name, const CStatistician &statistician);
+		void AddPool(const CStatisticianPool &pool);
+
+		// Listens on a TCP port, by default on the loopback interface only. Port 0 picks a free
+		// port; GetPort() tells which.
+		bool StartTcp(uint16_t port, const char *address = "127.0.0.1");
+
+		// Listens on a Unix domain socket. Not available on Windows (returns false).
+		bool StartUnix(const char *path);
+
+		bool Stop();
+
+		// Closes connections that have not sent or taken any bytes for this long: idle keep-alive
+		// connections, and clients that leave a response unread. Set it before starting (default 30 s).
+		void SetIdleTimeout(std::chrono::milliseconds timeout);
+
+		uint16_t GetPort() const;
+		uint64_t GetRequestCount() const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CMetricsServer::CMetricsServer()
+	: m_listener(Detail::c_invalidSocket)
+	, m_port(0)
+	, m_stop(true)
+	, m_requests(0)
+	, m_isWinsockStarted(false)
+	, m_idleTimeout(30000)
+{
+#ifdef _WIN32
+	WSADATA data;
+	m_isWinsockStarted = (WSAStartup(MAKEWORD(2, 2), &data) == 0);
+#endif
+	for (int i = 0; i < 2; i++)
+		m_renderings[i].length = 0;
+}
+
+inline Statistician::CMetricsServer::~CMetricsServer()
+{
+	this->Stop();
+#ifdef _WIN32
+	if (m_isWinsockStarted == true)
+		WSACleanup();
+#endif
+}
+
+inline void Statistician::CMetricsServer::AddSource(const char *name, const CStatistician &statistician)
+{
+	m_sourceNames.push_back((name != NULL) ? name : "");
+	m_sources.push_back(&statistician);
+}
+
+inline void Statistician::CMetricsServer::AddPool(const CStatisticianPool &pool)
+{
+	m_pools.push_back(&pool);
+}
+
+inline bool Statistician::CMetricsServer::StartTcp(uint16_t port, const char *address)
+{
+	if (m_stop.load() == false)
+		return false;
+
+	sockaddr_in endpoint;
+	memset(&endpoint, 0, sizeof(endpoint));
+	endpoint.sin_family = AF_INET;
+	endpoint.sin_port = htons(port);
+	if (inet_pton(AF_INET, address, &endpoint.sin_addr) != 1)
+	{
+		std::cout << __FUNCTION__ << " invalid address " << address << std::endl;
+		return false;
+	}
+
+	Detail::socket_type listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener == Detail::c_invalidSocket)
+		return false;
+
+#ifndef _WIN32
+	// restart right away, without waiting for connections of the last run in TIME_WAIT.
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+
+	if (bind(listener, reinterpret_cast<sockaddr*>(&endpoint), sizeof(endpoint)) != 0)
+	{
+		std::cout << __FUNCTION__ << " can't bind to " << address << ":" << port << std::endl;
+		Detail::CloseSocket(listener);
+		return false;
+	}
+
+	socklen_t length = sizeof(endpoint);
+	if (getsockname(listener, reinterpret_cast<sockaddr*>(&endpoint), &length) == 0)
+		m_port = ntohs(endpoint.sin_port);
+
+	return Listen(listener);
+}
+
+inline bool Statistician::CMetricsServer::StartUnix(const char *path)
+{
+#ifdef _WIN32
+	std::cout << __FUNCTION__ << " Unix domain sockets are not supported on Windows" << std::endl;
+	return false;
+#else
+	if (m_stop.load() == false)
+		return false;
+
+	sockaddr_un endpoint;
+	memset(&endpoint, 0, sizeof(endpoint));
+	endpoint.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(endpoint.sun_path))
+		return false;
+	strncpy(endpoint.sun_path, path, sizeof(endpoint.sun_path) - 1);
+
+	Detail::socket_type listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == Detail::c_invalidSocket)
+		return false;
+
+	// a socket file left behind by a previous run would make bind fail.
+	unlink(path);
+	if (bind(listener, reinterpret_cast<sockaddr*>(&endpoint), sizeof(endpoint)) != 0)
+	{
+		std::cout << __FUNCTION__ << " can't bind to " << path << std::endl;
+		Detail::CloseSocket(listener);
+		return false;
+	}
+
+	m_unixPath = path;
+	return Listen(listener);
+#endif
+}
+
+inline bool Statistician::CMetricsServer::Listen(Detail::socket_type listener)
+{
+	if (listen(listener, SOMAXCONN) != 0 || Detail::SetNonBlocking(listener) == false)
+	{
+		Detail::CloseSocket(listener);
+		return false;
+	}
+
+	m_listener = listener;
+	m_stop.store(false);
+	m_thread = std::thread(&Statistician::CMetricsServer::Run, this);
+	return true;
+}
+
+inline bool Statistician::CMetricsServer::Stop()
+{
+	m_stop.store(true);
+	if (m_thread.joinable())
+		m_thread.join();
+
+	for (size_t i = 0; i < m_connections.size(); i++)
+		Detail::CloseSocket(m_connections[i].socket);
+	m_connections.clear();
+
+	if (m_listener != Detail::c_invalidSocket)
+	{
+		Detail::CloseSocket(m_listener);
+		m_listener = Detail::c_invalidSocket;
+	}
+
+#ifndef _WIN32
+	if (m_unixPath.empty() == false)
+	{
+		unlink(m_unixPath.c_str());
+		m_unixPath.clear();
+	}
+#endif
+	return true;
+}
+
+inline void Statistician::CMetricsServer::SetIdleTimeout(std::chrono::milliseconds timeout)
+{
+	m_idleTimeout = timeout;
+}
+
+inline uint16_t Statistician::CMetricsServer::GetPort() const
+{
+	return m_port;
+}
+
+inline uint64_t Statistician::CMetricsServer::GetRequestCount() const
+{
+	return m_requests.load();
+}
+
+inline void Statistician::CMetricsServer::Run()
+{
+	std::vector<Detail::pollfd_type> fds;
+
+	while (m_stop.load() == false)
+	{
+		fds.resize(m_connections.size() + 1);
+		fds[0].fd = m_listener;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		for (size_t i = 0; i < m_connections.size(); i++)
+		{
+			fds[i + 1].fd = m_connections[i].socket;
+			fds[i + 1].events = (m_connections[i].written < m_connections[i].output.size()) ? POLLOUT : POLLIN;
+			fds[i + 1].revents = 0;
+		}
+
+		// the timeout bounds how long Stop() waits, and how late idle connections are closed.
+		int ready = Detail::PollSockets(&fds[0], fds.size(), 100);
+		if (ready < 0)
+			continue;
+
+		// connections accepted below are not in fds yet, so handle the existing ones first.
+		size_t count = m_connections.size();
+		std::vector<bool> isOpen(count, true);
+		for (size_t i = 0; i < count && ready > 0; i++)
+		{
+			short revents = fds[i + 1].revents;
+			SConnection &connection = m_connections[i];
+			if ((revents & (POLLERR | POLLNVAL)) != 0)
+				isOpen[i] = false;
+			else if ((revents & POLLOUT) != 0)
+				isOpen[i] = Send(connection);
+			else if ((revents & (POLLIN | POLLHUP)) != 0)
+				isOpen[i] = Receive(connection) && Send(connection);
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; i++)
+		{
+			if (now - m_connections[i].lastActivity > m_idleTimeout)
+				isOpen[i] = false;
+		}
+
+		for (size_t i = count; i-- > 0;)
+		{
+			if (isOpen[i] == false)
+			{
+				Detail::CloseSocket(m_connections[i].socket);
+				m_connections.erase(m_connections.begin() + i);
+			}
+		}
+
+		if (ready > 0 && (fds[0].revents & POLLIN) != 0)
+			Accept();
+	}
+}
+
+inline void Statistician::CMetricsServer::Accept()
+{
+	for (;;)
+	{
+		Detail::socket_type socket = accept(m_listener, NULL, NULL);
+		if (socket == Detail::c_invalidSocket)
+			return; // nothing more to accept (or an error the next poll will show again)
+
+		if (m_connections.size() >= c_maxConnections || Detail::SetNonBlocking(socket) == false)
+		{
+			Detail::CloseSocket(socket);
+			continue;
+		}
+
+		SConnection connection;
+		connection.socket = socket;
+		connection.written = 0;
+		connection.closeAfterWrite = false;
+		connection.lastActivity = std::chrono::steady_clock::now();
+		m_connections.push_back(connection);
+	}
+}
+
+inline bool Statistician::CMetricsServer::Receive(SConnection &connection)
+{
+	char buffer[4096];
+	for (;;)
+	{
+		int received = static_cast<int>(recv(connection.socket, buffer, sizeof(buffer), 0));
+		if (received == 0)
+			return false; // closed by the peer
+		if (received < 0)
+		{
+			if (Detail::WouldBlock() == false)
+				return false;
+			break;
+		}
+		connection.input.append(buffer, static_cast<size_t>(received));
+		connection.lastActivity = std::chrono::steady_clock::now();
+		if (connection.input.size() > c_maxRequestLength)
+			break;
+	}
+
+	// requests are GETs without a body, so a request ends at the empty line.
+	size_t end;
+	while (connection.closeAfterWrite == false && (end = connection.input.find("\r\n\r\n")) != std::string::npos)
+	{
+		HandleRequest(connection, connection.input.substr(0, end));
+		connection.input.erase(0, end + 4);
+	}
+
+	if (connection.input.size() > c_maxRequestLength)
+	{
+		const char *message = "request too long\n";
+		AppendResponse(connection, "431 Request Header Fields Too Large", "text/plain", message, strlen(message), false);
+		connection.closeAfterWrite = true;
+		connection.input.clear();
+	}
+	return true;
+}
+
+inline bool Statistician::CMetricsServer::Send(SConnection &connection)
+{
+	while (connection.written < connection.output.size())
+	{
+		int sent = static_cast<int>(send(connection.socket, &connection.output[connection.written], static_cast<int>(connection.output.size() - connection.written), Detail::c_sendFlags));
+		if (sent < 0)
+			return Detail::WouldBlock(); // poll tells when there is room again
+		connection.written += static_cast<size_t>(sent);
+		connection.lastActivity = std::chrono::steady_clock::now();
+	}
+
+	connection.output.clear();
+	connection.written = 0;
+	return connection.closeAfterWrite == false;
+}
+
+inline void Statistician::CMetricsServer::HandleRequest(SConnection &connection, const std::string &request)
+{
+	m_requests.fetch_add(1);
+
+	// request line: "<method> <target> HTTP/1.x"
+	size_t methodEnd = request.find(' ');
+	size_t targetEnd = (methodEnd != std::string::npos) ? request.find(' ', methodEnd + 1) : std::string::npos;
+	size_t lineEnd = request.find("\r\n");
+	if (targetEnd == std::string::npos || (lineEnd != std::string::npos && targetEnd > lineEnd))
+	{
+		const char *message = "bad request\n";
+		AppendResponse(connection, "400 Bad Request", "text/plain", message, strlen(message), false);
+		connection.closeAfterWrite = true;
+		return;
+	}
+
+	std::string method = request.substr(0, methodEnd);
+	std::string target = request.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+	std::string version = request.substr(targetEnd + 1, (lineEnd != std::string::npos ? lineEnd : request.size()) - targetEnd - 1);
+	target = target.substr(0, target.find('?'));
+
+	// HTTP/1.1 keeps the connection unless asked not to, HTTP/1.0 closes it unless asked to keep it.
+	std::string headers = request.substr(lineEnd != std::string::npos ? lineEnd : request.size());
+	for (size_t i = 0; i < headers.size(); i++)
+		headers[i] = static_cast<char>(tolower(static_cast<unsigned char>(headers[i])));
+	if (version == "HTTP/1.0")
+		connection.closeAfterWrite = (headers.find("\nconnection: keep-alive") == std::string::npos);
+	else
+		connection.closeAfterWrite = (headers.find("\nconnection: close") != std::string::npos);
+
+	bool isHead = (method == "HEAD");
+	if (method != "GET" && isHead == false)
+	{
+		const char *message = "only GET and HEAD are supported\n";
+		AppendResponse(connection, "405 Method Not Allowed", "text/plain", message, strlen(message), false);
+		return;
+	}
+
+	if (target == "/metrics")
+	{
+		const SRendering &rendering = Render(OutputFormat_Prometheus);
+		AppendResponse(connection, "200 OK", "text/plain; version=0.0.4; charset=utf-8", &rendering.body[0], rendering.length, isHead);
+	}
+	else if (target == "/metrics.json")
+	{
+		const SRendering &rendering = Render(OutputFormat_Json);
+		AppendResponse(connection, "200 OK", "application/json", &rendering.body[0], rendering.length, isHead);
+	}
+	else if (target == "/")
+	{
+		const char *message = "/metrics       Prometheus text format\n/metrics.json  JSON\n";
+		AppendResponse(connection, "200 OK", "text/plain", message, strlen(message), isHead);
+	}
+	else
+	{
+		const char *message = "not found\n";
+		AppendResponse(connection, "404 Not Found", "text/plain", message, strlen(message), isHead);
+	}
+}
+
+inline void Statistician::CMetricsServer::AppendResponse(SConnection &connection, const char *status, const char *contentType, const char *body, size_t length, bool isHead)
+{
+	char header[256];
+	CTextWriter writer(header, sizeof(header));
+	writer.Append("HTTP/1.1 ");
+	writer.Append(status);
+	writer.Append("\r\nContent-Type: ");
+	writer.Append(contentType);
+	writer.Append("\r\nContent-Length: ");
+	writer.AppendUnsigned(length);
+	writer.Append(connection.closeAfterWrite ? "\r\nConnection: close\r\n\r\n" : "\r\nConnection: keep-alive\r\n\r\n");
+	size_t headerLength = std::min(writer.Finish(), sizeof(header) - 1);
+
+	connection.output.insert(connection.output.end(), header, header + headerLength);
+	if (isHead == false)
+		connection.output.insert(connection.output.end(), body, body + length);
+}
+
+inline const Statistician::CMetricsServer::SRendering &Statistician::CMetricsServer::Render(EOutputFormat format)
+{
+	// gather the snapshots; the pools are locked only while looking up their cameras.
+	size_t count = m_sources.size();
+	for (size_t i = 0; i < m_pools.size(); i++)
+		count += m_pools[i]->GetSize();
+
+	m_snapshots.resize(count);
+	m_names.resize(count);
+	m_namePointers.resize(count);
+
+	size_t n = 0;
+	for (size_t i = 0; i < m_sources.size(); i++, n++)
+	{
+		m_sources[i]->GetSnapshot(m_snapshots[n]);
+		m_names[n] = m_sourceNames[i];
+	}
+	for (size_t i = 0; i < m_pools.size(); i++)
+	{
+		// a camera registered since the count was taken is served by the next request.
+		for (size_t j = 0; j < m_pools[i]->GetSize() && n < count; j++)
+		{
+			if (m_pools[i]->GetSnapshot(j, m_snapshots[n]) == false)
+				continue; // unregistered
+			m_names[n] = m_pools[i]->GetName(j);
+			n++;
+		}
+	}
+	count = n;
+	for (size_t i = 0; i < count; i++)
+		m_namePointers[i] = m_names[i].c_str();
+
+	// reuse the last rendering if no camera published a sample since.
+	SRendering &rendering = m_renderings[(format == OutputFormat_Json) ? 1 : 0];
+	bool isCurrent = (rendering.length > 0 && rendering.sequences.size() == count);
+	for (size_t i = 0; i < count && isCurrent == true; i++)
+		isCurrent = (rendering.sequences[i] == m_snapshots[i].sequence);
+	if (isCurrent == true)
+		return rendering;
+
+	rendering.sequences.resize(count);
+	for (size_t i = 0; i < count; i++)
+		rendering.sequences[i] = m_snapshots[i].sequence;
+
+	if (rendering.body.empty())
+		rendering.body.resize(64 * 1024);
+
+	const StatisticsSnapshot *snapshots = (count > 0) ? &m_snapshots[0] : NULL;
+	const char *const *names = (count > 0) ? &m_namePointers[0] : NULL;
+	rendering.length = FormatStatistics(snapshots, names, count, format, &rendering.body[0], rendering.body.size());
+	if (rendering.length >= rendering.body.size())
+	{
+		rendering.body.resize(rendering.length + 1);
+		rendering.length = FormatStatistics(snapshots, names, count, format, &rendering.body[0], rendering.body.size());
+	}
+	return rendering;
+}
+
+// *********************************************************************************************************
+#endif
@@ -14,6 +14,15 @@ strongly recommends reading the Migration topic in the pylon C++ API documentati
 #endif
 
 #include "Statistician.h"
+#include "StatisticsAlerts.h"
+#include "FrameStatistics.h"
+#include "LinkAggregator.h"
+#include "StreamAdvisor.h"
+#include "SamplingBenchmark.h"
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
 
 // Namespace for using pylon objects.
 using namespace Pylon;
@@ -24,6 +33,95 @@ using namespace std;
 // Number of images to be grabbed.
 static const uint32_t c_countOfImagesToGrab = 1000;
 
+// Prints alerts as they happen. Called on the alert engine's own thread.
+class CPrintAlerts : public Statistician::IAlertHandler
+{
+public:
+	void OnAlert(const Statistician::SAlert &alert)
+	{
+		cout << "Alert " << (alert.raised ? "raised" : "cleared") << ": " << alert.ruleName << " (" << alert.value << ")" << endl;
+	}
+};
+
+// Brings a removed camera back once it is plugged in again. The statistician only notices that
+// it is back (see CStatistician::SetReconnect()); the removed device is destroyed once the
+// statistician has stopped reading it.
+static void ReattachCamera(CInstantCamera &camera, Statistician::CStatistician &statistician)
+{
+	cout << "Camera removed, waiting for it to come back" << endl;
+	while (statistician.GetSnapshot().lifecycle.connected == true)
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	CDeviceInfo info;
+	info.SetSerialNumber(camera.GetDeviceInfo().GetSerialNumber());
+	camera.DestroyDevice();
+	while (camera.IsPylonDeviceAttached() == false)
+	{
+		try
+		{
+			camera.Attach(CTlFactory::GetInstance().CreateFirstDevice(info));
+		}
+		catch (GenICam::GenericException &/*e*/)
+		{
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+	camera.Open();
+	GenApi::CEnumerationPtr(camera.GetNodeMap().GetNode("PixelFormat"))->FromString("Mono8");
+}
+
+// Grabs c_countOfImagesToGrab images once per sampling mode and prints what the statistics cost
+// the acquisition (see SamplingBenchmark.h).
+static void RunBenchmark(CInstantCamera &camera)
+{
+	Statistician::CSamplingBenchmark benchmark;
+	GenApi::CIntegerPtr ptrTickFrequency = camera.GetNodeMap().GetNode("GevTimestampTickFrequency");
+	for (int i = 0; i < Statistician::SamplingMode_Count; i++)
+	{
+		Statistician::ESamplingMode mode = static_cast<Statistician::ESamplingMode>(i);
+		std::unique_ptr<Statistician::CStatistician> statistician;
+		if (mode != Statistician::SamplingMode_Off)
+		{
+			statistician.reset(new Statistician::CStatistician());
+			Statistician::ConfigureSamplingMode(*statistician, mode);
+			statistician->Initialize(camera);
+			statistician->Start();
+		}
+
+		Statistician::CFrameStatistics frameStatistics;
+		if (GenApi::IsReadable(ptrTickFrequency))
+			frameStatistics.SetTimestampTickFrequency(static_cast<double>(ptrTickFrequency->GetValue()));
+
+		CGrabResultPtr ptrGrabResult;
+		uint64_t bytes = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		camera.StartGrabbing(c_countOfImagesToGrab);
+		while (camera.IsGrabbing())
+		{
+			camera.RetrieveResult(5000, ptrGrabResult, TimeoutHandling_ThrowException);
+			frameStatistics.OnGrabResult(ptrGrabResult);
+			if (ptrGrabResult->GrabSucceeded())
+				bytes += ptrGrabResult->GetPayloadSize();
+		}
+		double seconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1e6;
+
+		Statistician::StatisticsSnapshot snapshot;
+		size_t snapshotCount = 0;
+		if (statistician)
+		{
+			statistician->Stop();
+			statistician->GetSnapshot(snapshot);
+			snapshotCount = 1;
+		}
+		benchmark.AddResult(mode, seconds, bytes, frameStatistics, &snapshot, snapshotCount);
+		cout << "Benchmarked " << Statistician::GetSamplingModeName(mode) << endl;
+	}
+
+	char table[4096];
+	benchmark.Print(table, sizeof(table));
+	cout << table;
+}
+
 int main(int argc, char* argv[])
 {
 	// The exit code of the sample application.
@@ -33,7 +131,8 @@ int main(int argc, char* argv[])
 	// is initialized during the lifetime of this object.
 	Pylon::PylonAutoInitTerm autoInitTerm;
 
-	Statistician::CStatistician myStatistician;
+	// --benchmark compares the sampling modes instead of the acquisition below.
+	bool runBenchmark = (argc > 1 && std::string(argv[1]) == "--benchmark");
 
 	try
 	{
@@ -49,7 +148,49 @@ int main(int argc, char* argv[])
 		// open the camera so we can configure the physical device itself.
 		camera.Open();
 
+		if (runBenchmark == true)
+		{
+			RunBenchmark(camera);
+			cerr << endl << "Press Enter to exit." << endl;
+			while (cin.get() != '\n');
+			return exitCode;
+		}
+
+		// Alert rules. Rules and handlers are set up before the camera is added as a source.
+		// The alerts and the statistician are declared after the camera, so they are destroyed
+		// before it on every way out of this block; the statistician, which reads the camera and
+		// calls the alerts, goes first.
+		CPrintAlerts printAlerts;
+		Statistician::CStatisticsAlerts myAlerts;
+		myAlerts.AddThreshold("failed buffers", Statistician::Statistic_FailedBuffers, Statistician::AlertRule_Above, 0);
+		myAlerts.AddThreshold("buffer underruns", Statistician::Statistic_BufferUnderruns, Statistician::AlertRule_Above, 0);
+		myAlerts.AddThreshold("missed frames", Statistician::Statistic_MissedFrameCount, Statistician::AlertRule_Above, 0);
+		myAlerts.AddRate("resend requests", Statistician::Statistic_ResendRequests, 10.0, std::chrono::seconds(5));
+		myAlerts.AddEdge("critical temperature", Statistician::Statistic_CriticalTemp, Statistician::AlertRule_Rising);
+		myAlerts.AddEdge("over temperature", Statistician::Statistic_OverTemp, Statistician::AlertRule_Rising);
+		myAlerts.AddHandler(&printAlerts);
+
+		Statistician::CStatistician myStatistician;
+
+		// read the grabber counters every 20 ms while they show trouble (see AdaptiveSampling.h).
+		myStatistician.SetAdaptiveSampling(Statistician::StatisticGroup_Grabber, std::chrono::milliseconds(20));
+
+		// time every node and port read, to see what the statistics cost (printed at the end).
+		myStatistician.SetProfiling(true);
+
+		// if the camera goes away, keep the statistics and try to get it back every second.
+		myStatistician.SetReconnect(std::chrono::seconds(1));
+
+		// Initialize() turns on the camera events it uses, so it comes before StartGrabbing().
 		myStatistician.Initialize(camera);
+		for (int i = 0; i < Statistician::Statistic_Count; i++)
+		{
+			Statistician::EStatisticMechanism mechanism = myStatistician.GetStatisticMechanism(static_cast<Statistician::EStatistic>(i));
+			if (mechanism == Statistician::StatisticMechanism_CameraEvent || mechanism == Statistician::StatisticMechanism_NodeCallback)
+				cout << Statistician::GetStatisticInfo(static_cast<Statistician::EStatistic>(i)).label << " is updated by " << Statistician::GetStatisticMechanismName(mechanism) << endl;
+		}
+		myStatistician.AddListener(myAlerts.AddSource(camera.GetDeviceInfo().GetSerialNumber()));
+		myAlerts.Start();
 
 		// set original pixel format from camera
 		GenApi::CEnumerationPtr(camera.GetNodeMap().GetNode("PixelFormat"))->FromString("Mono8");
@@ -57,16 +198,42 @@ int main(int argc, char* argv[])
 		// This smart pointer will receive the grab result data.
 		CGrabResultPtr ptrGrabResult;
 
+		// per-frame timing and BlockID gaps, recorded in the grab loop below.
+		Statistician::CFrameStatistics frameStatistics;
+		GenApi::CIntegerPtr ptrTickFrequency = camera.GetNodeMap().GetNode("GevTimestampTickFrequency");
+		if (GenApi::IsReadable(ptrTickFrequency))
+			frameStatistics.SetTimestampTickFrequency(static_cast<double>(ptrTickFrequency->GetValue()));
+
 		myStatistician.Start();
 
 		// Start the grabbing of c_countOfImagesToGrab images.
 		camera.StartGrabbing(c_countOfImagesToGrab);
+		uint32_t imagesGrabbed = 0;
 
-		while (camera.IsGrabbing())
+		while (camera.IsGrabbing() || camera.IsCameraDeviceRemoved())
 		{
+			// if the camera is unplugged, grab the rest of the images once it is back.
+			if (camera.IsCameraDeviceRemoved())
+			{
+				ReattachCamera(camera, myStatistician);
+				camera.StartGrabbing(c_countOfImagesToGrab - imagesGrabbed);
+				continue;
+			}
+
 			// Wait for an image and then retrieve it. A timeout of 5000 ms is used.
 			// Camera.StopGrabbing() is called automatically by RetrieveResult() when c_countOfImagesToGrab have been grabbed.
-			camera.RetrieveResult(5000, ptrGrabResult, TimeoutHandling_ThrowException);
+			try
+			{
+				camera.RetrieveResult(5000, ptrGrabResult, TimeoutHandling_ThrowException);
+			}
+			catch (GenICam::GenericException &/*e*/)
+			{
+				if (camera.IsCameraDeviceRemoved())
+					continue;
+				throw;
+			}
+			frameStatistics.OnGrabResult(ptrGrabResult);
+			imagesGrabbed++;
 
 			// Image grabbed successfully?
 			if (ptrGrabResult->GrabSucceeded())
@@ -84,54 +251,59 @@ int main(int argc, char* argv[])
 		}
 
 		myStatistician.Stop();
+		myAlerts.Stop();
 
 		// *************************************************************************************************
 		// Show Statistics
-		//mtx.lock();
-		cout  << " Final Statistics:"  << endl;
+		cout << myStatistician.PrintStatistics();
+
+		char frameText[2048];
+		frameStatistics.Print(frameText, sizeof(frameText));
+		cout << frameText;
 
-		if (camera.GetDeviceInfo().GetDeviceClass() == BaslerUsbDeviceClass)
+		// cost of the register statistics (USB only). Use SetRegisterCoalescing(-1, 0) before
+		// Initialize() to compare against one transaction per register.
+		Statistician::SRegisterReadStatistics registerReads = myStatistician.GetSnapshot().registerReads;
+		if (registerReads.passes > 0)
 		{
-			cout  << "  Grab Engine:"  << endl;
-			cout << "   Total Processed Buffers                : " << myStatistician.totalBuffers  << endl;
-			cout << "   Total Failed Buffers                   : " << myStatistician.failedBuffers  << endl;
-			cout << "   Last BlockID (starts at 0)             : " << myStatistician.lastBlockID << endl;
-			cout << "   Total Missed Frames                    : " << myStatistician.missedFrameCount  << endl;
-			cout << "   Last Failed Buffer Status              : " << myStatistician.lastFailedBufferStatus << endl;
-			cout << "   Last Failed Buffer Status Text         : " << myStatistician.lastFailedBufferStatusText.substr(0, myStatistician.lastFailedBufferStatusText.size() - 1) << endl; // remove the newline built into this error message string.
-			for (std::set<Pylon::String_t>::iterator it = myStatistician.lastFailedBufferStatusTextList.begin(); it != myStatistician.lastFailedBufferStatusTextList.end(); ++it)
-				cout << "   Other Failed Buffer Status Text logged : " << *it; // newline is built into this error message string.
-
-			cout  << "  Transport Layer:"  << endl;
-			cout << "   Read Pipe Reset Count                  : " << myStatistician.readPipeResetCount << endl;
-			cout << "   Write Pipe Reset Count                 : " << myStatistician.writePipeResetCount << endl;
-			cout << "   Read Operations Failed Count           : " << myStatistician.readOperationsFailedCount << endl;
-			cout << "   Write Operations Failed Count          : " << myStatistician.writeOperationsFailedCount << endl;
-			cout << "   Last Error Status                      : " << myStatistician.tlLastErrorStatus << endl;
-			cout << "   Last Error Status Text                 : " << myStatistician.tlLastErrorStatusText.substr(0, myStatistician.tlLastErrorStatusText.size() - 1) << endl; // remove the newline built into this error message string.
-			for (std::set<Pylon::String_t>::iterator it = myStatistician.tlLastErrorStatusTextList.begin(); it != myStatistician.tlLastErrorStatusTextList.end(); ++it)
-				cout << "   Other Error Status Text logged         : " << *it; // newline is built into this error message string.
+			cout << "Register reads         : " << registerReads.transactions << " transactions in " << registerReads.passes << " passes ("
+				<< registerReads.blocks << " per pass), " << registerReads.totalPassUs / static_cast<int64_t>(registerReads.passes)
+				<< " us average, " << registerReads.maxPassUs << " us max" << endl;
 		}
 
-		if (camera.GetDeviceInfo().GetDeviceClass() == BaslerGigEDeviceClass)
+		Statistician::SProfilingStatistics profile = myStatistician.GetSnapshot().profile;
+		if (profile.passes > 0)
 		{
-			cout  << "  Camera:"  << endl;
-			cout << "   Last Error                             : " << myStatistician.lastError.substr(0, myStatistician.tlLastErrorStatusText.size() - 1) << endl;
-			for (std::set<Pylon::String_t>::iterator it = myStatistician.lastErrorList.begin(); it != myStatistician.lastErrorList.end(); ++it)
-				cout << "   Other Errors logged                    : " << *it; // newline is built into this error message string.
-			cout  << "  Grab Engine:"  << endl;
-			cout << "   Total Frames Received                  : " << myStatistician.totalBuffers  << endl;
-			cout << "   Total Failed Buffers                   : " << myStatistician.failedBuffers  << endl;
-			cout << "   Total buffer underruns                 : " << myStatistician.bufferUnderruns  << endl;
-
-			cout  << "  Transport Layer:"  << endl;
-			cout << "   Total Packets Received                 : " << myStatistician.totalPackets  << endl;
-			cout << "   Total Packet Resend Requests           : " << myStatistician.resendRequests  << endl;
-			cout << "   Total Resent Packets                   : " << myStatistician.resendPackets  << endl;
-			// TODO Issue #22
-			// I get failed packets = 0 even when results fail?
-			cout << "   Total Failed (unrecoverable) Packets   : " << myStatistician.failedPackets  << endl;
+			cout << "Sampling passes        : " << profile.passes << ", " << profile.passNs / 1000 / static_cast<int64_t>(profile.passes) << " us average, "
+				<< profile.maxPassNs / 1000 << " us max, " << profile.cpuNs / 1000000 << " ms CPU" << endl;
+			cout << "Device transactions    : " << profile.transactions << " (" << profile.nodeReads << " node reads, " << profile.portReads << " port reads), "
+				<< profile.nodeLookups << " node lookups" << endl;
+			if (profile.nodeReads > 0)
+				cout << "Node read time         : " << profile.nodeReadNs / 1000 / static_cast<int64_t>(profile.nodeReads) << " us average, " << profile.maxNodeReadNs / 1000 << " us max" << endl;
 		}
+
+		Statistician::SLifecycleStatistics lifecycle = myStatistician.GetSnapshot().lifecycle;
+		if (lifecycle.removals > 0 || lifecycle.resetCount > 0)
+		{
+			cout << "Camera removals        : " << lifecycle.removals << ", " << lifecycle.reconnects << " reconnects, "
+				<< lifecycle.resetCount << " counter resets" << endl;
+		}
+
+		// stream settings the statistics of this acquisition suggest (GigE only). Tune() would
+		// write them before the next acquisition and check that the errors went down.
+		Statistician::CPylonStreamSettings streamSettings(camera);
+		Statistician::CStreamAdvisor advisor;
+		Statistician::SStreamAdvice advice;
+		advisor.AddCamera(Statistician::CLinkAggregator::GetLinkName(camera.GetDeviceInfo()).c_str(), myStatistician, streamSettings);
+		if (advisor.Advise(0, advice) == true)
+		{
+			cout << "Link utilization       : " << advice.utilization * 100.0 << " %, error ratio " << advice.errorRatio << endl;
+			cout << "Recommended settings   : packet size " << advice.recommended.packetSize << ", inter-packet delay " << advice.recommended.interPacketDelay
+				<< ", frame transmission delay " << advice.recommended.frameTransmissionDelay << ", buffers " << advice.recommended.bufferCount << endl;
+		}
+
+		// done with the camera: remove the statistician's callbacks and events while it is alive.
+		myStatistician.Detach();
 		// *************************************************************************************************
 	}
 	catch (GenICam::GenericException &e)
@@ -140,8 +312,6 @@ int main(int argc, char* argv[])
 		cerr << "An exception occurred." << endl
 			<< e.GetDescription() << endl;
 		exitCode = 1;
-
-		myStatistician.Stop();
 	}
 
 	// Comment the following two lines to disable waiting on exit.
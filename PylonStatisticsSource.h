@@ -0,0 +1,673 @@
+// PylonStatisticsSource.h
+// Reads statistics from a pylon camera
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PYLONSTATISTICSSOURCE_H
+#define PYLONSTATISTICSSOURCE_H
+
+#include <pylon/PylonIncludes.h>
+#include "StatisticsSource.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+
+namespace Statistician
+{
+	// A GenApi node, with its interface pointer looked up once.
+	// A subscribed node is its own camera event handler, so every subscription has its own
+	// registration and can be removed on its own.
+	class CPylonStatisticNode : public IStatisticNode, public Pylon::CCameraEventHandler
+	{
+	private:
+		friend class CPylonStatisticsSource;
+
+		GenApi::INode *m_node;
+		GenApi::IInteger *m_integerNode;
+		GenApi::IBoolean *m_booleanNode;
+		GenApi::IString *m_stringNode;
+		GenApi::IEnumeration *m_enumerationNode;
+
+		// subscription, set up and torn down by the source
+		IStatisticChangeObserver *m_observer;
+		size_t m_cookie;
+		EStatisticMechanism m_mechanism;
+		GenApi::CallbackHandleType m_callback;
+		std::string m_eventNode;	// the event data node the handler is registered for
+
+		void OnNodeChanged(GenApi::INode *node);
+
+	public:
+		CPylonStatisticNode(GenApi::INode *node, GenApi::IInteger *integerNode, GenApi::IBoolean *booleanNode, GenApi::IString *stringNode, GenApi::IEnumeration *enumerationNode);
+		virtual bool IsReadable();
+		virtual int64_t GetInteger();
+		virtual bool GetBoolean();
+		virtual void GetText(char *text, size_t size);
+
+		// Pylon::CCameraEventHandler
+		virtual void OnCameraEvent(Pylon::CInstantCamera &camera, intptr_t userProvidedId, GenApi::INode *node);
+	};
+
+	// Tells the removal observer of a source when pylon reports the camera removed, and
+	// remembers it until the source has let go of the device. Called on pylon's removal
+	// monitoring thread.
+	class CPylonRemovalHandler : public Pylon::CConfigurationEventHandler
+	{
+	private:
+		std::mutex m_mtx;		// so no call is made once the observer was cleared
+		IStatisticChangeObserver *m_observer;
+		std::atomic<bool> m_isRemoved;
+
+	public:
+		CPylonRemovalHandler();
+		void SetObserver(IStatisticChangeObserver *observer);
+		IStatisticChangeObserver *GetObserver();
+		bool IsRemoved() const;
+		void ClearRemoved();
+
+		// Pylon::CConfigurationEventHandler
+		virtual void OnCameraDeviceRemoved(Pylon::CInstantCamera &camera);
+	};
+
+	class CPylonRegisterPort : public IRegisterPort
+	{
+	private:
+		GenApi::CPortPtr m_port;
+
+	public:
+		CPylonRegisterPort(GenApi::CPortPtr port);
+		virtual void Read(void *buffer, int64_t address, int64_t length);
+	};
+
+	// The node maps and device port of a CInstantCamera. The camera must be open and must
+	// outlive the source.
+	//
+	// Subscribe() prefers camera events: it turns on the event's notification on the camera and
+	// GrabCameraEvents on the instant camera, which only takes effect when grabbing starts.
+	// Events are delivered while grabbing, when RetrieveResult() processes them. Otherwise a node
+	// with a polling time in the camera description gets a GenApi callback, and IsOpen() polls
+	// the node maps so GenApi invalidates it when the polling time is up. Events turned on here
+	// are turned off again by Unsubscribe().
+	//
+	// The source never attaches, opens or destroys a device; the camera stays the application's.
+	// After a removal the application brings the camera back itself (DestroyDevice(), Attach()
+	// and Open()), and Reconnect() only checks whether it is back: attached, open and with the
+	// serial number the source was made for. It does not block, so it is fine on a pool worker.
+	class CPylonStatisticsSource : public IStatisticsSource
+	{
+	private:
+		Pylon::CInstantCamera &m_camera;
+		unsigned m_deviceClass;
+		std::vector<std::unique_ptr<CPylonStatisticNode> > m_nodes;
+		std::unique_ptr<CPylonRegisterPort> m_port;
+		std::vector<std::string> m_enabledEvents;		// EventSelector entries turned on by Subscribe()
+		std::vector<GenApi::INodeMap*> m_polledMaps;	// maps with a node callback on a polled node
+		std::chrono::steady_clock::time_point m_lastPoll;
+		Pylon::String_t m_serialNumber;				// a device with another one is not taken for this camera
+		Pylon::IPylonDevice *m_device;				// the device the nodes and the port belong to
+		CPylonRemovalHandler m_removal;
+
+		GenApi::INodeMap *GetNodeMap(ENodeMap nodeMap);
+		bool IsDeviceGone();
+		void ForgetNodes(bool isDeviceGone);
+		void OpenPort();
+		bool EnableEvent(const char *eventName, std::string &eventNode);
+		void DisableEvent(const std::string &eventName);
+		void Unsubscribe(CPylonStatisticNode &node);
+
+	public:
+		CPylonStatisticsSource(Pylon::CInstantCamera &camera);
+		~CPylonStatisticsSource();
+		Pylon::CInstantCamera &GetCamera();
+		virtual bool IsOpen();
+		virtual unsigned GetDeviceClassMask();
+		virtual IStatisticNode *GetNode(ENodeMap nodeMap, const char *name, EStatisticType type);
+		virtual IRegisterPort *GetRegisterPort();
+		virtual EStatisticMechanism Subscribe(IStatisticNode *node, const char *eventName, IStatisticChangeObserver *observer, size_t cookie);
+		virtual void Unsubscribe(IStatisticChangeObserver *observer);
+		virtual void WatchRemoval(IStatisticChangeObserver *observer);
+		virtual bool Reconnect();
+	};
+
+	// The stream settings of a GigE camera, through its device node map and MaxNumBuffer. The
+	// camera must be open and must outlive the object.
+	class CPylonStreamSettings : public IStreamSettings
+	{
+	private:
+		Pylon::CInstantCamera &m_camera;
+
+		static int64_t GetInteger(GenApi::INodeMap &map, const char *name, int64_t defaultValue);
+		static void SetInteger(GenApi::INodeMap &map, const char *name, int64_t value);
+
+	public:
+		CPylonStreamSettings(Pylon::CInstantCamera &camera);
+		virtual bool GetStreamSettings(SStreamSettings &settings);
+		virtual void SetStreamSettings(const SStreamSettings &settings);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CPylonStatisticNode::CPylonStatisticNode(GenApi::INode *node, GenApi::IInteger *integerNode, GenApi::IBoolean *booleanNode, GenApi::IString *stringNode, GenApi::IEnumeration *enumerationNode)
+	: m_node(node)
+	, m_integerNode(integerNode)
+	, m_booleanNode(booleanNode)
+	, m_stringNode(stringNode)
+	, m_enumerationNode(enumerationNode)
+	, m_observer(NULL)
+	, m_cookie(0)
+	, m_mechanism(StatisticMechanism_Polled)
+	, m_callback(0)
+{
+}
+
+inline bool Statistician::CPylonStatisticNode::IsReadable()
+{
+	// access mode is cached by GenApi, so this is cheap compared to a lookup by name.
+	return GenApi::IsReadable(m_node);
+}
+
+inline int64_t Statistician::CPylonStatisticNode::GetInteger()
+{
+	return m_integerNode->GetValue();
+}
+
+inline bool Statistician::CPylonStatisticNode::GetBoolean()
+{
+	return m_booleanNode->GetValue();
+}
+
+inline void Statistician::CPylonStatisticNode::GetText(char *text, size_t size)
+{
+	// text statistics are either string nodes or enumerations, depending on the node.
+	GenICam::gcstring value = (m_stringNode != NULL) ? m_stringNode->GetValue() : m_enumerationNode->ToString();
+	strncpy(text, value.c_str(), size - 1);
+	text[size - 1] = '\0';
+}
+
+inline void Statistician::CPylonStatisticNode::OnNodeChanged(GenApi::INode * /*node*/)
+{
+	m_observer->OnStatisticChanged(m_cookie);
+}
+
+inline void Statistician::CPylonStatisticNode::OnCameraEvent(Pylon::CInstantCamera & /*camera*/, intptr_t /*userProvidedId*/, GenApi::INode * /*node*/)
+{
+	// the event says the value changed, but the node may still hold the cached one.
+	m_node->InvalidateNode();
+	m_observer->OnStatisticChanged(m_cookie);
+}
+
+inline Statistician::CPylonRemovalHandler::CPylonRemovalHandler()
+	: m_observer(NULL)
+	, m_isRemoved(false)
+{
+}
+
+inline void Statistician::CPylonRemovalHandler::SetObserver(IStatisticChangeObserver *observer)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_observer = observer;
+}
+
+inline Statistician::IStatisticChangeObserver *Statistician::CPylonRemovalHandler::GetObserver()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_observer;
+}
+
+inline bool Statistician::CPylonRemovalHandler::IsRemoved() const
+{
+	return m_isRemoved.load();
+}
+
+inline void Statistician::CPylonRemovalHandler::ClearRemoved()
+{
+	m_isRemoved.store(false);
+}
+
+inline void Statistician::CPylonRemovalHandler::OnCameraDeviceRemoved(Pylon::CInstantCamera & /*camera*/)
+{
+	m_isRemoved.store(true);
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_observer != NULL)
+		m_observer->OnSourceRemoved();
+}
+
+inline Statistician::CPylonRegisterPort::CPylonRegisterPort(GenApi::CPortPtr port)
+	: m_port(port)
+{
+}
+
+inline void Statistician::CPylonRegisterPort::Read(void *buffer, int64_t address, int64_t length)
+{
+	try
+	{
+		m_port->Read(buffer, address, length);
+	}
+	catch (GenICam::GenericException &e)
+	{
+		// IRegisterPort users only know std::exception.
+		throw std::runtime_error(e.GetDescription());
+	}
+}
+
+inline Statistician::CPylonStatisticsSource::CPylonStatisticsSource(Pylon::CInstantCamera &camera)
+	: m_camera(camera)
+	, m_deviceClass(0)
+	, m_device(camera.GetDevice())
+{
+	Pylon::String_t deviceClass = camera.GetDeviceInfo().GetDeviceClass();
+	if (deviceClass == Pylon::BaslerUsbDeviceClass)
+		m_deviceClass = DeviceClass_Usb;
+	else if (deviceClass == Pylon::BaslerGigEDeviceClass)
+		m_deviceClass = DeviceClass_GigE;
+	m_serialNumber = camera.GetDeviceInfo().GetSerialNumber();
+
+	OpenPort();
+	m_camera.RegisterConfiguration(&m_removal, Pylon::RegistrationMode_Append, Pylon::Cleanup_None);
+}
+
+inline Statistician::CPylonStatisticsSource::~CPylonStatisticsSource()
+{
+	try
+	{
+		m_camera.DeregisterConfiguration(&m_removal);
+		if (IsDeviceGone() == true)
+		{
+			ForgetNodes(true);
+			return;
+		}
+
+		for (size_t i = 0; i < m_nodes.size(); i++)
+			Unsubscribe(*m_nodes[i]);
+		for (size_t i = 0; i < m_enabledEvents.size(); i++)
+			DisableEvent(m_enabledEvents[i]);
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
+	}
+}
+
+inline Pylon::CInstantCamera &Statistician::CPylonStatisticsSource::GetCamera()
+{
+	return m_camera;
+}
+
+inline bool Statistician::CPylonStatisticsSource::IsOpen()
+{
+	if (m_camera.IsOpen() == false || m_camera.IsCameraDeviceRemoved() == true)
+		return false;
+
+	if (m_polledMaps.empty() == false)
+	{
+		// invalidates the nodes whose polling time is up, which calls their callbacks.
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		int64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastPoll).count();
+		if (elapsedMs > 0)
+		{
+			for (size_t i = 0; i < m_polledMaps.size(); i++)
+				m_polledMaps[i]->Poll(elapsedMs);
+			m_lastPoll += std::chrono::milliseconds(elapsedMs);
+		}
+	}
+	return true;
+}
+
+inline unsigned Statistician::CPylonStatisticsSource::GetDeviceClassMask()
+{
+	return m_deviceClass;
+}
+
+inline GenApi::INodeMap *Statistician::CPylonStatisticsSource::GetNodeMap(ENodeMap nodeMap)
+{
+	switch (nodeMap)
+	{
+	case NodeMap_Device: return &m_camera.GetNodeMap();
+	case NodeMap_StreamGrabber: return &m_camera.GetStreamGrabberNodeMap();
+	case NodeMap_TransportLayer: return &m_camera.GetTLNodeMap();
+	default: return NULL;
+	}
+}
+
+inline Statistician::IStatisticNode *Statistician::CPylonStatisticsSource::GetNode(ENodeMap nodeMap, const char *name, EStatisticType type)
+{
+	GenApi::INodeMap *map = GetNodeMap(nodeMap);
+	if (map == NULL || name == NULL)
+		return NULL;
+
+	GenApi::INode *node = map->GetNode(name);
+	CPylonStatisticNode *statisticNode = NULL;
+
+	if (type == StatisticType_Integer)
+	{
+		GenApi::CIntegerPtr ptrInteger = node;
+		if (GenApi::IsReadable(ptrInteger))
+			statisticNode = new CPylonStatisticNode(ptrInteger->GetNode(), ptrInteger, NULL, NULL, NULL);
+	}
+	else if (type == StatisticType_Boolean)
+	{
+		GenApi::CBooleanPtr ptrBool = node;
+		if (GenApi::IsReadable(ptrBool))
+			statisticNode = new CPylonStatisticNode(ptrBool->GetNode(), NULL, ptrBool, NULL, NULL);
+	}
+	else if (type == StatisticType_Text)
+	{
+		GenApi::CStringPtr ptrString = node;
+		GenApi::CEnumerationPtr ptrEnumeration = node;
+		if (GenApi::IsReadable(ptrString))
+			statisticNode = new CPylonStatisticNode(ptrString->GetNode(), NULL, NULL, ptrString, NULL);
+		else if (GenApi::IsReadable(ptrEnumeration))
+			statisticNode = new CPylonStatisticNode(ptrEnumeration->GetNode(), NULL, NULL, NULL, ptrEnumeration);
+	}
+
+	if (statisticNode == NULL)
+		return NULL; // not supported by this device
+
+	m_nodes.push_back(std::unique_ptr<CPylonStatisticNode>(statisticNode));
+	return statisticNode;
+}
+
+inline Statistician::IRegisterPort *Statistician::CPylonStatisticsSource::GetRegisterPort()
+{
+	return m_port.get();
+}
+
+inline Statistician::EStatisticMechanism Statistician::CPylonStatisticsSource::Subscribe(IStatisticNode *node, const char *eventName, IStatisticChangeObserver *observer, size_t cookie)
+{
+	// nodes handed to Subscribe() come from GetNode().
+	CPylonStatisticNode *statisticNode = static_cast<CPylonStatisticNode*>(node);
+	if (statisticNode == NULL || observer == NULL || statisticNode->m_observer != NULL)
+		return StatisticMechanism_Polled;
+
+	statisticNode->m_observer = observer;
+	statisticNode->m_cookie = cookie;
+
+	try
+	{
+		std::string eventNode;
+		if (eventName != NULL && EnableEvent(eventName, eventNode) == true)
+		{
+			statisticNode->m_eventNode = eventNode;
+			statisticNode->m_mechanism = StatisticMechanism_CameraEvent;
+			m_camera.RegisterCameraEventHandler(statisticNode, eventNode.c_str(), 0, Pylon::RegistrationMode_Append, Pylon::Cleanup_None);
+			return StatisticMechanism_CameraEvent;
+		}
+
+		// without a polling time, nothing in GenApi would ever invalidate the node.
+		if (statisticNode->m_node->GetPollingTime() > 0)
+		{
+			GenApi::INodeMap *map = statisticNode->m_node->GetNodeMap();
+			if (m_polledMaps.empty())
+				m_lastPoll = std::chrono::steady_clock::now();
+			if (std::find(m_polledMaps.begin(), m_polledMaps.end(), map) == m_polledMaps.end())
+				m_polledMaps.push_back(map);
+
+			statisticNode->m_mechanism = StatisticMechanism_NodeCallback;
+			statisticNode->m_callback = GenApi::Register(statisticNode->m_node, *statisticNode, &CPylonStatisticNode::OnNodeChanged);
+			return StatisticMechanism_NodeCallback;
+		}
+	}
+	catch (GenICam::GenericException &e)
+	{
+		// e.g. the event can't be configured while grabbing; polling still works.
+		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
+		Unsubscribe(*statisticNode);
+	}
+
+	statisticNode->m_observer = NULL;
+	statisticNode->m_mechanism = StatisticMechanism_Polled;
+	return StatisticMechanism_Polled;
+}
+
+inline void Statistician::CPylonStatisticsSource::Unsubscribe(IStatisticChangeObserver *observer)
+{
+	if (m_removal.GetObserver() == observer)
+		m_removal.SetObserver(NULL);
+
+	bool anySubscribed = false;
+	for (size_t i = 0; i < m_nodes.size(); i++)
+	{
+		if (m_nodes[i]->m_observer == observer)
+			Unsubscribe(*m_nodes[i]);
+		else if (m_nodes[i]->m_observer != NULL)
+			anySubscribed = true;
+	}
+
+	if (anySubscribed == false)
+	{
+		for (size_t i = 0; i < m_enabledEvents.size(); i++)
+			DisableEvent(m_enabledEvents[i]);
+		m_enabledEvents.clear();
+		m_polledMaps.clear();
+	}
+}
+
+inline void Statistician::CPylonStatisticsSource::Unsubscribe(CPylonStatisticNode &node)
+{
+	if (node.m_mechanism == StatisticMechanism_CameraEvent)
+		m_camera.DeregisterCameraEventHandler(&node, node.m_eventNode.c_str());
+	else if (node.m_mechanism == StatisticMechanism_NodeCallback)
+		node.m_node->DeregisterCallback(node.m_callback);
+
+	node.m_observer = NULL;
+	node.m_mechanism = StatisticMechanism_Polled;
+	node.m_callback = 0;
+	node.m_eventNode.clear();
+}
+
+inline void Statistician::CPylonStatisticsSource::WatchRemoval(IStatisticChangeObserver *observer)
+{
+	m_removal.SetObserver(observer);
+}
+
+inline bool Statistician::CPylonStatisticsSource::Reconnect()
+{
+	try
+	{
+		// the application may already have destroyed the removed device and attached a new one;
+		// either way, the nodes and the port of the old one went with its node maps.
+		if (m_device != NULL && IsDeviceGone() == true)
+		{
+			ForgetNodes(true);
+			m_port.reset();
+			m_device = NULL;
+		}
+
+		if (m_camera.IsPylonDeviceAttached() == false || m_camera.IsCameraDeviceRemoved() == true || m_camera.IsOpen() == false)
+			return false;
+		if (m_camera.GetDeviceInfo().GetSerialNumber() != m_serialNumber)
+			return false;
+
+		// resolved again by the caller, whether the device is new or not.
+		ForgetNodes(false);
+		m_device = m_camera.GetDevice();
+		m_removal.ClearRemoved();
+		OpenPort();
+		return true;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		// the application is still bringing the camera back; try again later.
+		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
+		return false;
+	}
+}
+
+inline bool Statistician::CPylonStatisticsSource::IsDeviceGone()
+{
+	if (m_removal.IsRemoved() == true)
+		return true;
+	if (m_camera.IsPylonDeviceAttached() == false || m_camera.IsCameraDeviceRemoved() == true)
+		return true;
+	return m_camera.GetDevice() != m_device;
+}
+
+inline void Statistician::CPylonStatisticsSource::ForgetNodes(bool isDeviceGone)
+{
+	// the camera event handlers are registered with the instant camera, which stays. The node
+	// callbacks of a removed device went with its node maps.
+	for (size_t i = 0; i < m_nodes.size(); i++)
+	{
+		if (isDeviceGone == false)
+			Unsubscribe(*m_nodes[i]);
+		else if (m_nodes[i]->m_mechanism == StatisticMechanism_CameraEvent)
+			m_camera.DeregisterCameraEventHandler(m_nodes[i].get(), m_nodes[i]->m_eventNode.c_str());
+	}
+	m_nodes.clear();
+	m_enabledEvents.clear();
+	m_polledMaps.clear();
+}
+
+inline void Statistician::CPylonStatisticsSource::OpenPort()
+{
+	m_port.reset();
+	GenApi::CPortPtr port = m_camera.GetNodeMap().GetNode("Device");
+	if (port.IsValid())
+		m_port.reset(new CPylonRegisterPort(port));
+}
+
+inline bool Statistician::CPylonStatisticsSource::EnableEvent(const char *eventName, std::string &eventNode)
+{
+	// events only reach the node map if the instant camera grabs them, which it decides when
+	// grabbing starts.
+	if (m_camera.IsGrabbing() == true && m_camera.GrabCameraEvents.GetValue() == false)
+		return false;
+
+	GenApi::INodeMap &map = m_camera.GetNodeMap();
+	GenApi::CEnumerationPtr selector = map.GetNode("EventSelector");
+	GenApi::CEnumerationPtr notification = map.GetNode("EventNotification");
+	if (GenApi::IsWritable(selector) == false || GenApi::IsWritable(notification) == false)
+		return false;
+
+	// USB cameras name the event "CriticalTemperature" and its data "EventCriticalTemperatureTimestamp",
+	// GigE cameras may use "CriticalTemperatureEvent" and "CriticalTemperatureEventTimestamp".
+	std::string entries[2] = { eventName, std::string(eventName) + "Event" };
+	std::string dataNodes[2] = { "Event" + std::string(eventName) + "Timestamp", std::string(eventName) + "EventTimestamp" };
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (GenApi::IsAvailable(selector->GetEntryByName(entries[i].c_str())) == false)
+			continue;
+
+		for (int j = 0; j < 2; j++)
+		{
+			if (map.GetNode(dataNodes[j].c_str()) == NULL)
+				continue;
+
+			selector->FromString(entries[i].c_str());
+			if (GenApi::IsAvailable(notification->GetEntryByName("On")))
+				notification->FromString("On");
+			else if (GenApi::IsAvailable(notification->GetEntryByName("GenICamEvent")))
+				notification->FromString("GenICamEvent");
+			else
+				return false;
+
+			if (std::find(m_enabledEvents.begin(), m_enabledEvents.end(), entries[i]) == m_enabledEvents.end())
+				m_enabledEvents.push_back(entries[i]);
+			m_camera.GrabCameraEvents = true;
+			eventNode = dataNodes[j];
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void Statistician::CPylonStatisticsSource::DisableEvent(const std::string &eventName)
+{
+	GenApi::INodeMap &map = m_camera.GetNodeMap();
+	GenApi::CEnumerationPtr selector = map.GetNode("EventSelector");
+	GenApi::CEnumerationPtr notification = map.GetNode("EventNotification");
+	if (GenApi::IsWritable(selector) && GenApi::IsWritable(notification))
+	{
+		selector->FromString(eventName.c_str());
+		notification->FromString("Off");
+	}
+}
+
+inline Statistician::CPylonStreamSettings::CPylonStreamSettings(Pylon::CInstantCamera &camera)
+	: m_camera(camera)
+{
+}
+
+inline int64_t Statistician::CPylonStreamSettings::GetInteger(GenApi::INodeMap &map, const char *name, int64_t defaultValue)
+{
+	GenApi::CIntegerPtr node = map.GetNode(name);
+	return GenApi::IsReadable(node) ? node->GetValue() : defaultValue;
+}
+
+inline void Statistician::CPylonStreamSettings::SetInteger(GenApi::INodeMap &map, const char *name, int64_t value)
+{
+	GenApi::CIntegerPtr node = map.GetNode(name);
+	if (GenApi::IsWritable(node) == false)
+		throw std::runtime_error(std::string(name) + " is not writable");
+
+	// the camera only takes multiples of the increment, within its range.
+	int64_t increment = std::max<int64_t>(1, node->GetInc());
+	value = std::min(std::max(value, node->GetMin()), node->GetMax());
+	value -= (value - node->GetMin()) % increment;
+	if (node->GetValue() != value)
+		node->SetValue(value);
+}
+
+inline bool Statistician::CPylonStreamSettings::GetStreamSettings(SStreamSettings &settings)
+{
+	if (m_camera.GetDeviceInfo().GetDeviceClass() != Pylon::BaslerGigEDeviceClass)
+		return false;
+
+	GenApi::INodeMap &map = m_camera.GetNodeMap();
+	GenApi::CIntegerPtr packetSize = map.GetNode("GevSCPSPacketSize");
+	GenApi::CIntegerPtr interPacketDelay = map.GetNode("GevSCPD");
+	if (GenApi::IsReadable(packetSize) == false || GenApi::IsReadable(interPacketDelay) == false)
+		return false;
+
+	settings.packetSize = packetSize->GetValue();
+	settings.maxPacketSize = packetSize->GetMax();
+	settings.interPacketDelay = interPacketDelay->GetValue();
+	settings.maxInterPacketDelay = interPacketDelay->GetMax();
+	settings.frameTransmissionDelay = GetInteger(map, "GevSCFTD", 0);
+	settings.bufferCount = static_cast<int64_t>(m_camera.MaxNumBuffer.GetValue());
+	settings.payloadSize = GetInteger(map, "PayloadSize", 0);
+	settings.linkSpeedMbps = GetInteger(map, "GevLinkSpeed", 1000);
+	settings.tickFrequency = GetInteger(map, "GevTimestampTickFrequency", 125000000);
+
+	// older cameras name it with the Abs suffix (SFNC 1.x).
+	GenApi::CFloatPtr frameRate = map.GetNode("ResultingFrameRateAbs");
+	if (GenApi::IsReadable(frameRate) == false)
+		frameRate = map.GetNode("ResultingFrameRate");
+	settings.frameRate = GenApi::IsReadable(frameRate) ? frameRate->GetValue() : 0.0;
+	return true;
+}
+
+inline void Statistician::CPylonStreamSettings::SetStreamSettings(const SStreamSettings &settings)
+{
+	GenApi::INodeMap &map = m_camera.GetNodeMap();
+	SetInteger(map, "GevSCPSPacketSize", settings.packetSize);
+	SetInteger(map, "GevSCPD", settings.interPacketDelay);
+	if (GenApi::IsAvailable(map.GetNode("GevSCFTD")))
+		SetInteger(map, "GevSCFTD", settings.frameTransmissionDelay);
+	m_camera.MaxNumBuffer.SetValue(settings.bufferCount);
+}
+
+// *********************************************************************************************************
+#endif
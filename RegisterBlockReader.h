@@ -0,0 +1,285 @@
+// RegisterBlockReader.h
+// Reads a set of device registers with as few port transactions as possible
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef REGISTERBLOCKREADER_H
+#define REGISTERBLOCKREADER_H
+
+#include "StatisticsSource.h"
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+
+namespace Statistician
+{
+	// Every IPort::Read is a separate control transfer, and on USB it shares the link with the
+	// image data. This reader merges registers that lie close together into blocks and reads
+	// each block with one transaction, then decodes the registers out of the block.
+	//
+	// Registers are merged when the gap between them is at most the maximum gap and the block
+	// stays within the maximum block length. Windows force a range to be read as one block,
+	// whatever the gaps inside. A negative maximum gap reads every register on its own.
+	// If the device rejects a block, that block is read per register from then on.
+	//
+	// A block reads its gaps too, and an address the device does not define may be refused, or
+	// read as anything. So the default maximum gap is 0: only registers that follow each other
+	// are merged. The USB error registers PE to LR (0xAFFB0004 to 0xAFFB0017) are one block, and
+	// EPR (0xAFFB0020) is a second one, since 0xAFFB0018 to 0xAFFB001F are not documented. Use a
+	// larger gap or a window only for ranges that are known to be readable.
+	//
+	// Add registers and windows, then call Read() as often as needed. Read() does not allocate.
+	// Not thread safe; the owner serializes access.
+	class CRegisterBlockReader
+	{
+	private:
+		struct SRegister
+		{
+			int64_t address;
+			uint32_t size;			// 1 to 8 bytes, little endian
+			uint64_t *destination;
+		};
+
+		struct SBlock
+		{
+			int64_t address;
+			int64_t length;
+			size_t firstRegister;
+			size_t registerCount;
+			bool split;				// the device rejected the block read, read per register
+		};
+
+		std::vector<SRegister> m_registers;	// sorted by address once planned
+		std::vector<std::pair<int64_t, int64_t> > m_windows;
+		int64_t m_maxGap;
+		int64_t m_maxBlockLength;
+		std::vector<SBlock> m_blocks;
+		std::vector<uint8_t> m_buffer;
+		bool m_planned;
+		SRegisterReadStatistics m_statistics;
+		void Plan();
+		bool IsInWindow(int64_t begin, int64_t end) const;
+		void ReadRegister(IRegisterPort &port, const SRegister &reg);
+		static void Decode(const SRegister &reg, const uint8_t *data);
+
+	public:
+		CRegisterBlockReader();
+		void Clear();	// removes the registers; windows and limits are kept
+		void AddRegister(int64_t address, uint32_t size, uint64_t *destination);
+		void AddWindow(int64_t address, int64_t length);
+		void SetMaxGap(int64_t bytes);
+		void SetMaxBlockLength(int64_t bytes);
+		size_t GetRegisterCount() const;
+		size_t GetBlockCount();
+		void Read(IRegisterPort &port);
+		const SRegisterReadStatistics &GetStatistics() const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CRegisterBlockReader::CRegisterBlockReader()
+	: m_maxGap(0)
+	, m_maxBlockLength(256)
+	, m_planned(false)
+{
+	memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+inline void Statistician::CRegisterBlockReader::Clear()
+{
+	m_registers.clear();
+	m_blocks.clear();
+	m_planned = false;
+	memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+inline void Statistician::CRegisterBlockReader::AddRegister(int64_t address, uint32_t size, uint64_t *destination)
+{
+	if (size == 0 || size > 8 || destination == NULL)
+		return;
+
+	SRegister reg;
+	reg.address = address;
+	reg.size = size;
+	reg.destination = destination;
+	m_registers.push_back(reg);
+	m_planned = false;
+}
+
+inline void Statistician::CRegisterBlockReader::AddWindow(int64_t address, int64_t length)
+{
+	if (length > 0)
+	{
+		m_windows.push_back(std::make_pair(address, address + length));
+		m_planned = false;
+	}
+}
+
+inline void Statistician::CRegisterBlockReader::SetMaxGap(int64_t bytes)
+{
+	m_maxGap = bytes;
+	m_planned = false;
+}
+
+inline void Statistician::CRegisterBlockReader::SetMaxBlockLength(int64_t bytes)
+{
+	m_maxBlockLength = bytes;
+	m_planned = false;
+}
+
+inline size_t Statistician::CRegisterBlockReader::GetRegisterCount() const
+{
+	return m_registers.size();
+}
+
+inline size_t Statistician::CRegisterBlockReader::GetBlockCount()
+{
+	if (m_planned == false)
+		Plan();
+	return m_blocks.size();
+}
+
+inline const Statistician::SRegisterReadStatistics &Statistician::CRegisterBlockReader::GetStatistics() const
+{
+	return m_statistics;
+}
+
+inline bool Statistician::CRegisterBlockReader::IsInWindow(int64_t begin, int64_t end) const
+{
+	for (size_t i = 0; i < m_windows.size(); i++)
+	{
+		if (begin >= m_windows[i].first && end <= m_windows[i].second)
+			return true;
+	}
+	return false;
+}
+
+inline void Statistician::CRegisterBlockReader::Plan()
+{
+	std::stable_sort(m_registers.begin(), m_registers.end(), [](const SRegister &a, const SRegister &b) { return a.address < b.address; });
+
+	m_blocks.clear();
+	int64_t longestBlock = 0;
+	for (size_t i = 0; i < m_registers.size(); i++)
+	{
+		const SRegister &reg = m_registers[i];
+		int64_t end = reg.address + reg.size;
+
+		if (m_blocks.empty() == false && m_maxGap >= 0)
+		{
+			SBlock &block = m_blocks.back();
+			int64_t blockEnd = block.address + block.length;
+			int64_t mergedEnd = std::max(blockEnd, end);
+
+			// windows merge whatever is inside them; everything else merges by gap and length.
+			bool merge = IsInWindow(block.address, mergedEnd)
+				|| (reg.address - blockEnd <= m_maxGap && mergedEnd - block.address <= m_maxBlockLength);
+
+			if (merge == true)
+			{
+				block.length = mergedEnd - block.address;
+				block.registerCount++;
+				longestBlock = std::max(longestBlock, block.length);
+				continue;
+			}
+		}
+
+		SBlock block;
+		block.address = reg.address;
+		block.length = reg.size;
+		block.firstRegister = i;
+		block.registerCount = 1;
+		block.split = false;
+		m_blocks.push_back(block);
+		longestBlock = std::max(longestBlock, block.length);
+	}
+
+	m_buffer.resize(static_cast<size_t>(longestBlock));
+	m_statistics.blocks = static_cast<uint32_t>(m_blocks.size());
+	m_planned = true;
+}
+
+inline void Statistician::CRegisterBlockReader::Decode(const SRegister &reg, const uint8_t *data)
+{
+	uint64_t value = 0;
+	for (uint32_t i = 0; i < reg.size; i++)
+		value |= static_cast<uint64_t>(data[i]) << (8 * i);
+	*reg.destination = value;
+}
+
+inline void Statistician::CRegisterBlockReader::ReadRegister(IRegisterPort &port, const SRegister &reg)
+{
+	uint8_t data[8];
+	port.Read(data, reg.address, reg.size);
+	m_statistics.transactions++;
+	m_statistics.bytesRead += reg.size;
+	Decode(reg, data);
+}
+
+inline void Statistician::CRegisterBlockReader::Read(IRegisterPort &port)
+{
+	if (m_planned == false)
+		Plan();
+
+	if (m_blocks.empty())
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (size_t b = 0; b < m_blocks.size(); b++)
+	{
+		SBlock &block = m_blocks[b];
+
+		if (block.split == false && block.registerCount > 1)
+		{
+			try
+			{
+				port.Read(&m_buffer[0], block.address, block.length);
+				m_statistics.transactions++;
+				m_statistics.bytesRead += block.length;
+
+				for (size_t r = block.firstRegister; r < block.firstRegister + block.registerCount; r++)
+					Decode(m_registers[r], &m_buffer[static_cast<size_t>(m_registers[r].address - block.address)]);
+				continue;
+			}
+			catch (std::exception &)
+			{
+				// some devices refuse reads that span unmapped addresses. Fall back to single
+				// registers; if the device is gone, the single reads throw again.
+				m_statistics.transactions++;
+				m_statistics.failedTransactions++;
+				block.split = true;
+				m_statistics.blocks += static_cast<uint32_t>(block.registerCount - 1);
+			}
+		}
+
+		for (size_t r = block.firstRegister; r < block.firstRegister + block.registerCount; r++)
+			ReadRegister(port, m_registers[r]);
+	}
+
+	int64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	m_statistics.passes++;
+	m_statistics.lastPassUs = elapsedUs;
+	m_statistics.totalPassUs += elapsedUs;
+	if (elapsedUs > m_statistics.maxPassUs)
+		m_statistics.maxPassUs = elapsedUs;
+}
+
+// *********************************************************************************************************
+#endif
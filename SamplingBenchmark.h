@@ -0,0 +1,249 @@
+// SamplingBenchmark.h
+// Compares the frame rate and latency of a grab loop with statistics off, polled, paced and event-driven
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SAMPLINGBENCHMARK_H
+#define SAMPLINGBENCHMARK_H
+
+#include "Statistician.h"
+#include "FrameStatistics.h"
+#include "StatisticsFormatter.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+// The benchmark itself is the caller's grab loop: run it once per mode, with a statistician set up
+// by ConfigureSamplingMode() (none for SamplingMode_Off), record every frame in a CFrameStatistics,
+// and add the result. The table shows each mode next to the run without statistics, so the cost of
+// sampling shows as lost frames per second and added latency, next to what the profiler measured
+// (see SamplingProfiler.h). StatisticsBenchmark runs it against simulated cameras, the pylon sample
+// with --benchmark against a real one.
+namespace Statistician
+{
+	enum ESamplingMode
+	{
+		SamplingMode_Off,			// no statistician, the baseline
+		SamplingMode_Polling,		// every statistic is read when its group is due
+		SamplingMode_Paced,			// polling, and fast samples while a group finds trouble, within a read budget
+		SamplingMode_EventDriven,	// statistics that rarely change are read when the camera reports a change
+		SamplingMode_Count
+	};
+
+	const char *GetSamplingModeName(ESamplingMode mode);
+
+	// Sets a statistician up for a mode, with profiling on. Call it before Initialize().
+	void ConfigureSamplingMode(CStatistician &statistician, ESamplingMode mode);
+
+	// What one run did to the grab loop, and what sampling cost.
+	struct SBenchmarkResult
+	{
+		ESamplingMode mode;
+		double seconds;
+		uint64_t frames;
+		uint64_t droppedFrames;		// failed frames and BlockID gaps
+		uint64_t bytes;				// image data the grab loop processed
+		uint64_t latencyP50Ns;
+		uint64_t latencyP99Ns;
+		uint64_t latencyMaxNs;
+		SProfilingStatistics profile;	// summed over the cameras
+	};
+
+	class CSamplingBenchmark
+	{
+	private:
+		std::vector<SBenchmarkResult> m_results;
+		static void AppendColumn(CTextWriter &out, const char *text, size_t width);
+		static void AppendColumn(CTextWriter &out, double value, int decimals, size_t width, bool sign = false);
+
+	public:
+		static const int c_pacedFastPeriodMs = 20;
+		static const int c_pacedReadsPerSecond = 200;
+
+		// One run of 'seconds'. 'snapshots' are the statistics of the cameras at the end of the run,
+		// none for SamplingMode_Off. With several grab loops, frames add up and the latency is that
+		// of the worst loop.
+		void AddResult(ESamplingMode mode, double seconds, uint64_t bytes, const CFrameStatistics &frames, const StatisticsSnapshot *snapshots, size_t count);
+		void AddResult(ESamplingMode mode, double seconds, uint64_t bytes, const CFrameStatistics *const *frames, size_t frameCount, const StatisticsSnapshot *snapshots, size_t count);
+		const std::vector<SBenchmarkResult> &GetResults() const;
+		void Clear();
+
+		// One line per run, compared with the first SamplingMode_Off run, into a caller-provided
+		// buffer like FormatStatistics(). Latencies are in microseconds, CPU in % of one core for
+		// all cameras together. Returns the length of the complete output.
+		size_t Print(char *buffer, size_t size) const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline const char *Statistician::GetSamplingModeName(ESamplingMode mode)
+{
+	switch (mode)
+	{
+	case SamplingMode_Off: return "off";
+	case SamplingMode_Polling: return "polling";
+	case SamplingMode_Paced: return "paced";
+	case SamplingMode_EventDriven: return "event-driven";
+	default: return "unknown";
+	}
+}
+
+inline void Statistician::ConfigureSamplingMode(CStatistician &statistician, ESamplingMode mode)
+{
+	statistician.SetProfiling(true);
+	statistician.SetChangeNotification(mode == SamplingMode_EventDriven);
+	if (mode == SamplingMode_Paced)
+	{
+		statistician.SetAdaptiveSampling(StatisticGroup_Grabber, std::chrono::milliseconds(CSamplingBenchmark::c_pacedFastPeriodMs));
+		statistician.SetAdaptiveSampling(StatisticGroup_Transport, std::chrono::milliseconds(CSamplingBenchmark::c_pacedFastPeriodMs));
+		statistician.SetReadBudget(CSamplingBenchmark::c_pacedReadsPerSecond);
+	}
+}
+
+inline void Statistician::CSamplingBenchmark::AddResult(ESamplingMode mode, double seconds, uint64_t bytes, const CFrameStatistics &frames, const StatisticsSnapshot *snapshots, size_t count)
+{
+	const CFrameStatistics *loop = &frames;
+	AddResult(mode, seconds, bytes, &loop, 1, snapshots, count);
+}
+
+inline void Statistician::CSamplingBenchmark::AddResult(ESamplingMode mode, double seconds, uint64_t bytes, const CFrameStatistics *const *frames, size_t frameCount, const StatisticsSnapshot *snapshots, size_t count)
+{
+	SBenchmarkResult result;
+	memset(&result, 0, sizeof(result));
+	result.mode = mode;
+	result.seconds = seconds;
+	result.bytes = bytes;
+	for (size_t i = 0; i < frameCount; i++)
+	{
+		result.frames += frames[i]->GetFrameCount();
+		result.droppedFrames += frames[i]->GetFailedFrameCount() + frames[i]->GetMissingFrameCount();
+
+		const CHdrHistogram &latency = frames[i]->GetHistogram(FrameHistogram_Latency);
+		result.latencyP50Ns = std::max(result.latencyP50Ns, latency.GetPercentile(50.0));
+		result.latencyP99Ns = std::max(result.latencyP99Ns, latency.GetPercentile(99.0));
+		result.latencyMaxNs = std::max(result.latencyMaxNs, latency.GetMax());
+	}
+
+	SProfilingStatistics &profile = result.profile;
+	for (size_t i = 0; i < count; i++)
+	{
+		const SProfilingStatistics &camera = snapshots[i].profile;
+		profile.nodeLookups += camera.nodeLookups;
+		profile.nodeLookupNs += camera.nodeLookupNs;
+		profile.maxNodeLookupNs = std::max(profile.maxNodeLookupNs, camera.maxNodeLookupNs);
+		profile.nodeReads += camera.nodeReads;
+		profile.nodeReadNs += camera.nodeReadNs;
+		profile.maxNodeReadNs = std::max(profile.maxNodeReadNs, camera.maxNodeReadNs);
+		profile.portReads += camera.portReads;
+		profile.portReadNs += camera.portReadNs;
+		profile.maxPortReadNs = std::max(profile.maxPortReadNs, camera.maxPortReadNs);
+		profile.transactions += camera.transactions;
+		profile.passes += camera.passes;
+		profile.passNs += camera.passNs;
+		profile.lastPassNs = std::max(profile.lastPassNs, camera.lastPassNs);
+		profile.maxPassNs = std::max(profile.maxPassNs, camera.maxPassNs);
+		profile.cpuNs += camera.cpuNs;
+	}
+
+	m_results.push_back(result);
+}
+
+inline const std::vector<Statistician::SBenchmarkResult> &Statistician::CSamplingBenchmark::GetResults() const
+{
+	return m_results;
+}
+
+inline void Statistician::CSamplingBenchmark::Clear()
+{
+	m_results.clear();
+}
+
+inline void Statistician::CSamplingBenchmark::AppendColumn(CTextWriter &out, const char *text, size_t width)
+{
+	// right-aligned, so the digits line up.
+	out.Append(' ');
+	for (size_t length = strlen(text); length < width; length++)
+		out.Append(' ');
+	out.Append(text);
+}
+
+inline void Statistician::CSamplingBenchmark::AppendColumn(CTextWriter &out, double value, int decimals, size_t width, bool sign)
+{
+	char text[32];
+	CTextWriter number(text, sizeof(text));
+	if (sign == true && value >= 0)
+		number.Append('+');
+	number.AppendFixed(value, decimals);
+	number.Finish();
+	AppendColumn(out, text, width);
+}
+
+inline size_t Statistician::CSamplingBenchmark::Print(char *buffer, size_t size) const
+{
+	CTextWriter out(buffer, size);
+	const SBenchmarkResult *baseline = NULL;
+	for (size_t i = 0; i < m_results.size() && baseline == NULL; i++)
+	{
+		if (m_results[i].mode == SamplingMode_Off)
+			baseline = &m_results[i];
+	}
+
+	const char *labels[] = { "Frames/s", "vs off", "MB/s", "Dropped", "p50 us", "p99 us", "max us", "p99 vs off", "Passes/s", "Reads/s", "us/read", "CPU %" };
+	const size_t widths[] = { 9, 8, 7, 8, 8, 8, 8, 11, 9, 8, 8, 7 };
+	out.AppendPadded("Mode", 12);
+	for (size_t column = 0; column < sizeof(labels) / sizeof(labels[0]); column++)
+		AppendColumn(out, labels[column], widths[column]);
+	out.Append('\n');
+
+	for (size_t i = 0; i < m_results.size(); i++)
+	{
+		const SBenchmarkResult &result = m_results[i];
+		const SProfilingStatistics &profile = result.profile;
+		double seconds = (result.seconds > 0) ? result.seconds : 1.0;
+		double framesPerSecond = result.frames / seconds;
+		double baselineFramesPerSecond = (baseline != NULL && baseline->seconds > 0) ? baseline->frames / baseline->seconds : 0.0;
+		uint64_t reads = profile.nodeReads + profile.portReads;
+
+		out.AppendPadded(GetSamplingModeName(result.mode), 12);
+		AppendColumn(out, framesPerSecond, 1, widths[0]);
+		if (baselineFramesPerSecond > 0)
+			AppendColumn(out, (framesPerSecond / baselineFramesPerSecond - 1.0) * 100.0, 2, widths[1] - 1, true);
+		else
+			AppendColumn(out, "-", widths[1] - 1);
+		out.Append('%');
+		AppendColumn(out, result.bytes / seconds / 1e6, 1, widths[2]);
+		AppendColumn(out, static_cast<double>(result.droppedFrames), 0, widths[3]);
+		AppendColumn(out, result.latencyP50Ns / 1000.0, 0, widths[4]);
+		AppendColumn(out, result.latencyP99Ns / 1000.0, 0, widths[5]);
+		AppendColumn(out, result.latencyMaxNs / 1000.0, 0, widths[6]);
+		if (baseline != NULL)
+			AppendColumn(out, (static_cast<double>(result.latencyP99Ns) - static_cast<double>(baseline->latencyP99Ns)) / 1000.0, 0, widths[7], true);
+		else
+			AppendColumn(out, "-", widths[7]);
+		AppendColumn(out, profile.passes / seconds, 1, widths[8]);
+		AppendColumn(out, reads / seconds, 0, widths[9]);
+		AppendColumn(out, (reads > 0) ? (profile.nodeReadNs + profile.portReadNs) / 1000.0 / reads : 0.0, 2, widths[10]);
+		AppendColumn(out, profile.cpuNs / seconds / 1e7, 3, widths[11]);
+		out.Append('\n');
+	}
+
+	return out.Finish();
+}
+
+// *********************************************************************************************************
+#endif
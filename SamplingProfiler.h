@@ -0,0 +1,246 @@
+// SamplingProfiler.h
+// Measures what sampling costs: node lookups, node reads, port reads, sample passes and CPU time
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SAMPLINGPROFILER_H
+#define SAMPLINGPROFILER_H
+
+#include "StatisticsSource.h"
+#include "StatisticsSnapshot.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#ifdef _WIN32
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    ifndef NOMINMAX
+#        define NOMINMAX	// included by Statistician.h, whose definitions use std::min
+#    endif
+#    include <windows.h>
+#else
+#    include <time.h>
+#endif
+
+// No pylon dependency.
+//
+// Counting is always on and costs an increment per call. Timing costs two clock reads per call,
+// tens of nanoseconds, which is small against a node read from a real camera (a register read
+// over the link, tens to hundreds of microseconds) but not against a cached node, so it is off
+// until enabled. The times include the node map's own work, not just the transfer.
+namespace Statistician
+{
+	// CPU time (user and kernel) of the calling thread in nanoseconds, 0 if the platform can't tell.
+	int64_t GetThreadCpuTimeNs();
+
+	// Fills an SProfilingStatistics. Used by the sampling thread only, except SetEnabled().
+	class CSamplingProfiler
+	{
+	private:
+		SProfilingStatistics *m_statistics;
+		std::atomic<bool> m_enabled;
+		int64_t m_passBeginNs;		// 0 if the pass is not timed
+		int64_t m_passBeginCpuNs;
+		static int64_t Now();
+		static void Add(int64_t begin, int64_t &total, int64_t &maximum);
+
+	public:
+		CSamplingProfiler();
+
+		// The statistics to fill. Set before anything is measured; counting starts from its values.
+		void Attach(SProfilingStatistics &statistics);
+
+		// Can be changed at any time; a call or pass that began before is counted but not timed.
+		void SetEnabled(bool enable);
+		bool IsEnabled() const;
+
+		// Returns the time a call begins, to pass to the matching End function; 0 while disabled.
+		int64_t Begin() const;
+		void EndNodeLookup(int64_t begin);
+		void EndNodeRead(int64_t begin);
+		void EndPortRead(int64_t begin);
+
+		// Around a sample pass. EndPass() only for a pass that read something.
+		void BeginPass();
+		void EndPass();
+	};
+
+	// Passes port reads through to the device port and profiles them.
+	class CProfiledRegisterPort : public IRegisterPort
+	{
+	private:
+		IRegisterPort *m_port;
+		CSamplingProfiler &m_profiler;
+
+	public:
+		explicit CProfiledRegisterPort(CSamplingProfiler &profiler);
+		void SetPort(IRegisterPort *port);
+		virtual void Read(void *buffer, int64_t address, int64_t length);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline int64_t Statistician::GetThreadCpuTimeNs()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user) == FALSE)
+		return 0;
+
+	// 100 ns units.
+	uint64_t kernelTicks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+	uint64_t userTicks = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+	return static_cast<int64_t>((kernelTicks + userTicks) * 100);
+#else
+	timespec time;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+		return 0;
+
+	return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+#endif
+}
+
+inline Statistician::CSamplingProfiler::CSamplingProfiler()
+	: m_statistics(NULL)
+	, m_enabled(false)
+	, m_passBeginNs(0)
+	, m_passBeginCpuNs(0)
+{
+}
+
+inline void Statistician::CSamplingProfiler::Attach(SProfilingStatistics &statistics)
+{
+	m_statistics = &statistics;
+	m_passBeginNs = 0;
+}
+
+inline void Statistician::CSamplingProfiler::SetEnabled(bool enable)
+{
+	m_enabled.store(enable);
+}
+
+inline bool Statistician::CSamplingProfiler::IsEnabled() const
+{
+	return m_enabled.load();
+}
+
+inline int64_t Statistician::CSamplingProfiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void Statistician::CSamplingProfiler::Add(int64_t begin, int64_t &total, int64_t &maximum)
+{
+	int64_t duration = Now() - begin;
+	total += duration;
+	if (duration > maximum)
+		maximum = duration;
+}
+
+inline int64_t Statistician::CSamplingProfiler::Begin() const
+{
+	return (m_enabled.load(std::memory_order_relaxed) == true) ? Now() : 0;
+}
+
+inline void Statistician::CSamplingProfiler::EndNodeLookup(int64_t begin)
+{
+	if (m_statistics == NULL)
+		return;
+
+	m_statistics->nodeLookups++;
+	if (begin != 0)
+		Add(begin, m_statistics->nodeLookupNs, m_statistics->maxNodeLookupNs);
+}
+
+inline void Statistician::CSamplingProfiler::EndNodeRead(int64_t begin)
+{
+	if (m_statistics == NULL)
+		return;
+
+	m_statistics->nodeReads++;
+	m_statistics->transactions++;
+	if (begin != 0)
+		Add(begin, m_statistics->nodeReadNs, m_statistics->maxNodeReadNs);
+}
+
+inline void Statistician::CSamplingProfiler::EndPortRead(int64_t begin)
+{
+	if (m_statistics == NULL)
+		return;
+
+	m_statistics->portReads++;
+	m_statistics->transactions++;
+	if (begin != 0)
+		Add(begin, m_statistics->portReadNs, m_statistics->maxPortReadNs);
+}
+
+inline void Statistician::CSamplingProfiler::BeginPass()
+{
+	m_passBeginNs = Begin();
+	if (m_passBeginNs != 0)
+		m_passBeginCpuNs = GetThreadCpuTimeNs();
+}
+
+inline void Statistician::CSamplingProfiler::EndPass()
+{
+	if (m_statistics == NULL)
+		return;
+
+	m_statistics->passes++;
+	if (m_passBeginNs == 0)
+		return;
+
+	int64_t duration = Now() - m_passBeginNs;
+	m_statistics->passNs += duration;
+	m_statistics->lastPassNs = duration;
+	if (duration > m_statistics->maxPassNs)
+		m_statistics->maxPassNs = duration;
+	m_statistics->cpuNs += GetThreadCpuTimeNs() - m_passBeginCpuNs;
+	m_passBeginNs = 0;
+}
+
+inline Statistician::CProfiledRegisterPort::CProfiledRegisterPort(CSamplingProfiler &profiler)
+	: m_port(NULL)
+	, m_profiler(profiler)
+{
+}
+
+inline void Statistician::CProfiledRegisterPort::SetPort(IRegisterPort *port)
+{
+	m_port = port;
+}
+
+inline void Statistician::CProfiledRegisterPort::Read(void *buffer, int64_t address, int64_t length)
+{
+	// a read the device rejects throws; it still went to the device, so it is counted.
+	int64_t begin = m_profiler.Begin();
+	try
+	{
+		m_port->Read(buffer, address, length);
+	}
+	catch (...)
+	{
+		m_profiler.EndPortRead(begin);
+		throw;
+	}
+	m_profiler.EndPortRead(begin);
+}
+
+// *********************************************************************************************************
+#endif
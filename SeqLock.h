@@ -0,0 +1,117 @@
+// SeqLock.h
+// Single-writer, many-reader publication of a trivially copyable value without locks
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cstdint>
+
+namespace Statistician
+{
+	// The writer never waits. A reader copies the value and retries if the writer published
+	// a new one in the meantime, so a reader never sees a torn value and never takes a mutex.
+	// The payload is held in atomic words (copied with relaxed loads and stores), so there is
+	// no data race in the C++ memory model sense and thread sanitizers stay quiet.
+	// Only one thread may call Store().
+	template <typename T>
+	class CSeqLock
+	{
+	private:
+		static const size_t c_wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+		std::atomic<uint64_t> m_sequence; // odd while a store is in progress
+		std::atomic<uint64_t> m_words[c_wordCount];
+
+	public:
+		CSeqLock();
+		void Store(const T &value);
+		bool TryLoad(T &value) const;
+		void Load(T &value) const;
+		uint64_t GetSequence() const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename T>
+inline Statistician::CSeqLock<T>::CSeqLock()
+	: m_sequence(0)
+{
+	for (size_t i = 0; i < c_wordCount; i++)
+		m_words[i].store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+inline void Statistician::CSeqLock<T>::Store(const T &value)
+{
+	const char *source = reinterpret_cast<const char*>(&value);
+	uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+
+	m_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (size_t i = 0; i < c_wordCount; i++)
+	{
+		uint64_t word = 0;
+		size_t offset = i * sizeof(uint64_t);
+		size_t length = (sizeof(T) - offset < sizeof(uint64_t)) ? sizeof(T) - offset : sizeof(uint64_t);
+		memcpy(&word, source + offset, length);
+		m_words[i].store(word, std::memory_order_relaxed);
+	}
+
+	m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+template <typename T>
+inline bool Statistician::CSeqLock<T>::TryLoad(T &value) const
+{
+	char *destination = reinterpret_cast<char*>(&value);
+	uint64_t before = m_sequence.load(std::memory_order_acquire);
+	if (before & 1)
+		return false;
+
+	for (size_t i = 0; i < c_wordCount; i++)
+	{
+		uint64_t word = m_words[i].load(std::memory_order_relaxed);
+		size_t offset = i * sizeof(uint64_t);
+		size_t length = (sizeof(T) - offset < sizeof(uint64_t)) ? sizeof(T) - offset : sizeof(uint64_t);
+		memcpy(destination + offset, &word, length);
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t after = m_sequence.load(std::memory_order_relaxed);
+	return before == after;
+}
+
+template <typename T>
+inline void Statistician::CSeqLock<T>::Load(T &value) const
+{
+	while (TryLoad(value) == false)
+		std::this_thread::yield();
+}
+
+template <typename T>
+inline uint64_t Statistician::CSeqLock<T>::GetSequence() const
+{
+	return m_sequence.load(std::memory_order_acquire) / 2;
+}
+
+// *********************************************************************************************************
+#endif
@@ -0,0 +1,822 @@
+// SimulatedCamera.h
+// A scriptable camera that produces statistics without hardware
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SIMULATEDCAMERA_H
+#define SIMULATEDCAMERA_H
+
+#include "StatisticsSource.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+
+// This header has no pylon dependency.
+//
+// The simulated camera grabs at a frame rate, loses packets (GigE) or frames (USB) at a loss rate,
+// warms up towards a target temperature and reports the texts of the errors it has. Everything
+// is driven by the simulated time and a seeded random generator, so a run with the same seed,
+// script and clock steps always gives the same statistics.
+//
+// Script: one event per line, "<time in ms> <command> [arguments]". Empty lines and lines
+// starting with '#' are skipped.
+//   fps <frames per second>
+//   loss <fraction>                  lost packets (GigE) or missed frames (USB), 0 to 1
+//   error <text>                     LastError, until the next error or 'clear'
+//   clear                            clears LastError
+//   burst <count> <interval ms> <text>   'count' errors "<text> 1", "<text> 2", ...
+//   tlerror <code> <text>            transport layer last error status and text
+//   temperature <degrees C>          the camera warms up or cools down towards it at 1 C/s
+//   congestion <fraction>            other traffic on the GigE link, 0 to 1; packets sent faster
+//                                    than the rest of the link leaves room for are dropped
+//   hold <ms>                        the application keeps every buffer this long; frames that
+//                                    find no free buffer are buffer underruns
+//   remove                           the camera is removed; every read after this throws
+//   reconnect                        the removed camera is back, counting from zero; the nodes
+//                                    returned before it was removed throw
+//   reset                            the stream grabber and transport layer counters start from zero
+//
+// The stream settings (IStreamSettings) shape the GigE traffic: the packet size sets the number of
+// packets per frame, the inter-packet delay lowers the rate the camera sends at while congested,
+// and the buffer count limits the frames that can be held. The frame transmission delay is kept
+// but changes nothing, as a simulated camera has no neighbours to collide with.
+//
+// Subscribed statistics are reported when their value changes, as a camera event if the
+// statistic has one, otherwise as a node callback.
+namespace Statistician
+{
+	enum ESimulationClock
+	{
+		SimulationClock_Steady,		// simulated time follows the steady clock
+		SimulationClock_Manual		// simulated time only moves with Advance()
+	};
+
+	enum ESimulationEvent
+	{
+		SimulationEvent_FrameRate,
+		SimulationEvent_LossRate,
+		SimulationEvent_Error,
+		SimulationEvent_ClearError,
+		SimulationEvent_TransportError,
+		SimulationEvent_Temperature,
+		SimulationEvent_Remove,
+		SimulationEvent_Congestion,
+		SimulationEvent_BufferHold,
+		SimulationEvent_Reconnect,
+		SimulationEvent_ResetCounters
+	};
+
+	struct SSimulationEvent
+	{
+		int64_t timeUs;
+		ESimulationEvent type;
+		double value;
+		std::string text;
+	};
+
+	class CSimulatedCamera;
+
+	class CSimulatedNode : public IStatisticNode
+	{
+	private:
+		friend class CSimulatedCamera;
+
+		CSimulatedCamera &m_camera;
+		const char *m_field;		// in the camera's state
+		EStatisticType m_type;
+		IStatisticChangeObserver *m_observer;
+		size_t m_cookie;
+		char m_reported[c_maxTextLength];	// the value the observer was last told about
+		bool m_stale;						// from before the camera was removed
+
+		bool HasChanged();	// and remembers the value
+
+	public:
+		CSimulatedNode(CSimulatedCamera &camera, const char *field, EStatisticType type);
+		virtual bool IsReadable();
+		virtual int64_t GetInteger();
+		virtual bool GetBoolean();
+		virtual void GetText(char *text, size_t size);
+	};
+
+	class CSimulatedCamera : public IStatisticsSource, public IRegisterPort, public IStreamSettings
+	{
+	private:
+		friend class CSimulatedNode;
+
+		unsigned m_deviceClass;
+		ESimulationClock m_clock;
+		std::chrono::steady_clock::time_point m_start;
+		std::atomic<int64_t> m_manualTimeUs;
+		std::vector<SSimulationEvent> m_events;	// sorted by time once sampling starts
+		size_t m_nextEvent;
+		bool m_eventsSorted;
+		std::vector<std::string> m_hiddenNodes;
+		std::vector<std::unique_ptr<CSimulatedNode> > m_nodes;
+		bool m_rejectBlockReads;
+		int64_t m_readCostNs;
+
+		// what the camera currently reports. Only touched by the sampling thread.
+		StatisticsSnapshot m_state;
+		int64_t m_timeUs;
+		uint64_t m_random;
+		double m_frameRate;
+		double m_lossRate;
+		double m_temperature;
+		double m_targetTemperature;
+		double m_frameFraction;
+		bool m_removed;
+		IStatisticChangeObserver *m_removalObserver;
+		double m_congestion;
+		double m_bufferHoldSeconds;
+		SStreamSettings m_stream;	// also changed by SetStreamSettings(), between sample passes
+		uint64_t m_nodeReads;
+		uint64_t m_portReads;
+
+		void Update(int64_t timeUs);
+		void Integrate(int64_t timeUs);
+		void Apply(const SSimulationEvent &event);
+		void GrabFrame();
+		double GetCongestionLoss() const;
+		double NextRandom();	// [0, 1)
+		void CheckRemoved();
+		void ResetCounters();
+		void SpendReadCost();
+		void NotifyChanges();
+		static void SetText(char *destination, const char *source);
+
+	public:
+		static const int64_t c_packetsPerFrame = 64;			// at the default packet size
+		static const int64_t c_defaultPacketSize = 1500;
+		static const int64_t c_packetHeaderSize = 36;			// IP, UDP and GVSP headers, part of the packet size
+		static const int64_t c_payloadSize = c_packetsPerFrame * (c_defaultPacketSize - c_packetHeaderSize);
+
+		CSimulatedCamera(unsigned deviceClass = DeviceClass_Usb, uint64_t seed = 1);
+
+		void SetClock(ESimulationClock clock);
+		void Advance(std::chrono::microseconds time);	// manual clock only; safe while sampling
+
+		// Events and hidden nodes are set up before the camera is sampled.
+		void AddEvent(std::chrono::milliseconds time, ESimulationEvent type, double value = 0, const char *text = "");
+		bool LoadScript(const char *script);		// false if a line can't be parsed (nothing is added then)
+		void HideNode(const char *name);			// the camera does not have this node
+		void SetRejectBlockReads(bool reject);	// port reads longer than one register throw
+
+		// CPU time every node and port read takes, spent spinning on the reading thread, like the
+		// node map and transport layer of a real camera do. 0 by default.
+		void SetReadCost(std::chrono::nanoseconds cost);
+
+		// Diagnostics, read by the sampling thread or after sampling stopped.
+		uint64_t GetNodeReadCount() const;
+		uint64_t GetPortReadCount() const;
+		size_t GetNodeCount() const;			// nodes GetNode() handed out that the camera still keeps
+
+		// IStatisticsSource
+		virtual bool IsOpen();
+		virtual unsigned GetDeviceClassMask();
+		virtual IStatisticNode *GetNode(ENodeMap nodeMap, const char *name, EStatisticType type);
+		virtual IRegisterPort *GetRegisterPort();
+		virtual EStatisticMechanism Subscribe(IStatisticNode *node, const char *eventName, IStatisticChangeObserver *observer, size_t cookie);
+		virtual void Unsubscribe(IStatisticChangeObserver *observer);
+		virtual void WatchRemoval(IStatisticChangeObserver *observer);
+
+		// IRegisterPort
+		virtual void Read(void *buffer, int64_t address, int64_t length);
+
+		// IStreamSettings
+		virtual bool GetStreamSettings(SStreamSettings &settings);
+		virtual void SetStreamSettings(const SStreamSettings &settings);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CSimulatedNode::CSimulatedNode(CSimulatedCamera &camera, const char *field, EStatisticType type)
+	: m_camera(camera)
+	, m_field(field)
+	, m_type(type)
+	, m_observer(NULL)
+	, m_cookie(0)
+	, m_stale(false)
+{
+	memset(m_reported, 0, sizeof(m_reported));
+}
+
+inline bool Statistician::CSimulatedNode::HasChanged()
+{
+	size_t size = (m_type == StatisticType_Integer) ? sizeof(int64_t) : (m_type == StatisticType_Boolean) ? sizeof(bool) : c_maxTextLength;
+	if (memcmp(m_reported, m_field, size) == 0)
+		return false;
+
+	memcpy(m_reported, m_field, size);
+	return true;
+}
+
+inline bool Statistician::CSimulatedNode::IsReadable()
+{
+	return m_camera.m_removed == false && m_stale == false;
+}
+
+inline int64_t Statistician::CSimulatedNode::GetInteger()
+{
+	m_camera.CheckRemoved();
+	if (m_stale == true)
+		throw std::runtime_error("simulated camera: node of a removed device");
+	m_camera.m_nodeReads++;
+	m_camera.SpendReadCost();
+	int64_t value;
+	memcpy(&value, m_field, sizeof(value));
+	return value;
+}
+
+inline bool Statistician::CSimulatedNode::GetBoolean()
+{
+	m_camera.CheckRemoved();
+	if (m_stale == true)
+		throw std::runtime_error("simulated camera: node of a removed device");
+	m_camera.m_nodeReads++;
+	m_camera.SpendReadCost();
+	return *reinterpret_cast<const bool*>(m_field);
+}
+
+inline void Statistician::CSimulatedNode::GetText(char *text, size_t size)
+{
+	m_camera.CheckRemoved();
+	if (m_stale == true)
+		throw std::runtime_error("simulated camera: node of a removed device");
+	m_camera.m_nodeReads++;
+	m_camera.SpendReadCost();
+	strncpy(text, m_field, size - 1);
+	text[size - 1] = '\0';
+}
+
+inline Statistician::CSimulatedCamera::CSimulatedCamera(unsigned deviceClass, uint64_t seed)
+	: m_deviceClass(deviceClass)
+	, m_clock(SimulationClock_Steady)
+	, m_start(std::chrono::steady_clock::now())
+	, m_manualTimeUs(0)
+	, m_nextEvent(0)
+	, m_eventsSorted(false)
+	, m_rejectBlockReads(false)
+	, m_readCostNs(0)
+	, m_timeUs(0)
+	, m_random(seed != 0 ? seed : 1)
+	, m_frameRate(100.0)
+	, m_lossRate(0.0)
+	, m_temperature(40.0)
+	, m_targetTemperature(40.0)
+	, m_frameFraction(0.0)
+	, m_removed(false)
+	, m_removalObserver(NULL)
+	, m_congestion(0.0)
+	, m_bufferHoldSeconds(0.0)
+	, m_nodeReads(0)
+	, m_portReads(0)
+{
+	memset(&m_state, 0, sizeof(m_state));
+	m_state.currentTemperature = 40;
+	SetText(m_state.temperatureState, "Ok");
+
+	m_stream.packetSize = c_defaultPacketSize;
+	m_stream.interPacketDelay = 0;
+	m_stream.frameTransmissionDelay = 0;
+	m_stream.bufferCount = 10;
+	m_stream.maxPacketSize = 9000;
+	m_stream.maxInterPacketDelay = 65535;
+	m_stream.payloadSize = c_payloadSize;
+	m_stream.frameRate = m_frameRate;
+	m_stream.linkSpeedMbps = 1000;
+	m_stream.tickFrequency = 125000000;
+}
+
+inline void Statistician::CSimulatedCamera::SetClock(ESimulationClock clock)
+{
+	m_clock = clock;
+	m_start = std::chrono::steady_clock::now();
+}
+
+inline void Statistician::CSimulatedCamera::Advance(std::chrono::microseconds time)
+{
+	m_manualTimeUs.fetch_add(time.count());
+}
+
+inline void Statistician::CSimulatedCamera::AddEvent(std::chrono::milliseconds time, ESimulationEvent type, double value, const char *text)
+{
+	SSimulationEvent event;
+	event.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+	event.type = type;
+	event.value = value;
+	event.text = (text != NULL) ? text : "";
+	m_events.push_back(event);
+	m_eventsSorted = false;
+}
+
+inline bool Statistician::CSimulatedCamera::LoadScript(const char *script)
+{
+	std::vector<SSimulationEvent> events;
+	std::istringstream lines(script);
+	std::string line;
+
+	while (std::getline(lines, line))
+	{
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+
+		std::istringstream words(line);
+		std::string command;
+		double timeMs = 0;
+		if (!(words >> timeMs >> command))
+			return false;
+
+		SSimulationEvent event;
+		event.timeUs = static_cast<int64_t>(timeMs * 1000.0);
+		event.value = 0;
+
+		if (command == "fps" || command == "loss" || command == "temperature")
+		{
+			if (!(words >> event.value))
+				return false;
+			event.type = (command == "fps") ? SimulationEvent_FrameRate : (command == "loss") ? SimulationEvent_LossRate : SimulationEvent_Temperature;
+			events.push_back(event);
+		}
+		else if (command == "congestion" || command == "hold")
+		{
+			if (!(words >> event.value))
+				return false;
+			event.type = (command == "congestion") ? SimulationEvent_Congestion : SimulationEvent_BufferHold;
+			events.push_back(event);
+		}
+		else if (command == "error")
+		{
+			std::getline(words >> std::ws, event.text);
+			event.type = SimulationEvent_Error;
+			events.push_back(event);
+		}
+		else if (command == "clear")
+		{
+			event.type = SimulationEvent_ClearError;
+			events.push_back(event);
+		}
+		else if (command == "tlerror")
+		{
+			if (!(words >> event.value))
+				return false;
+			std::getline(words >> std::ws, event.text);
+			event.type = SimulationEvent_TransportError;
+			events.push_back(event);
+		}
+		else if (command == "remove" || command == "reconnect" || command == "reset")
+		{
+			event.type = (command == "remove") ? SimulationEvent_Remove : (command == "reconnect") ? SimulationEvent_Reconnect : SimulationEvent_ResetCounters;
+			events.push_back(event);
+		}
+		else if (command == "burst")
+		{
+			int count = 0;
+			double intervalMs = 0;
+			std::string text;
+			if (!(words >> count >> intervalMs) || count <= 0)
+				return false;
+			std::getline(words >> std::ws, text);
+
+			for (int i = 0; i < count; i++)
+			{
+				SSimulationEvent error = event;
+				error.timeUs += static_cast<int64_t>(i * intervalMs * 1000.0);
+				error.type = SimulationEvent_Error;
+				error.text = text + " " + std::to_string(static_cast<long long>(i + 1));
+				events.push_back(error);
+			}
+		}
+		else
+			return false;
+	}
+
+	m_events.insert(m_events.end(), events.begin(), events.end());
+	m_eventsSorted = false;
+	return true;
+}
+
+inline void Statistician::CSimulatedCamera::HideNode(const char *name)
+{
+	m_hiddenNodes.push_back(name);
+}
+
+inline void Statistician::CSimulatedCamera::SetRejectBlockReads(bool reject)
+{
+	m_rejectBlockReads = reject;
+}
+
+inline void Statistician::CSimulatedCamera::SetReadCost(std::chrono::nanoseconds cost)
+{
+	m_readCostNs = cost.count();
+}
+
+inline void Statistician::CSimulatedCamera::SpendReadCost()
+{
+	if (m_readCostNs <= 0)
+		return;
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(m_readCostNs);
+	while (std::chrono::steady_clock::now() < end)
+	{
+	}
+}
+
+inline uint64_t Statistician::CSimulatedCamera::GetNodeReadCount() const
+{
+	return m_nodeReads;
+}
+
+inline uint64_t Statistician::CSimulatedCamera::GetPortReadCount() const
+{
+	return m_portReads;
+}
+
+inline size_t Statistician::CSimulatedCamera::GetNodeCount() const
+{
+	return m_nodes.size();
+}
+
+inline bool Statistician::CSimulatedCamera::IsOpen()
+{
+	int64_t now = (m_clock == SimulationClock_Manual)
+		? m_manualTimeUs.load()
+		: std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+
+	Update(now);
+	return m_removed == false;
+}
+
+inline unsigned Statistician::CSimulatedCamera::GetDeviceClassMask()
+{
+	return m_deviceClass;
+}
+
+inline Statistician::IStatisticNode *Statistician::CSimulatedCamera::GetNode(ENodeMap nodeMap, const char *name, EStatisticType type)
+{
+	if (name == NULL || m_removed == true)
+		return NULL;
+
+	// the first lookup after a reconnect starts resolving the nodes again, and whoever resolves
+	// them has let go of the old ones (see IStatisticsSource::Reconnect), so the stale nodes go.
+	// They are all stale then; nodes handed out since the reconnect come after them.
+	if (m_nodes.empty() == false && m_nodes.front()->m_stale == true)
+		m_nodes.clear();
+
+	for (size_t i = 0; i < m_hiddenNodes.size(); i++)
+	{
+		if (m_hiddenNodes[i] == name)
+			return NULL;
+	}
+
+	// the camera has every node the statistic table lists for its device class.
+	for (int i = 0; i < Statistic_Count; i++)
+	{
+		const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+		if ((info.deviceClasses & m_deviceClass) == 0 || info.nodeMap != nodeMap || info.type != type || info.nodeName == NULL || strcmp(info.nodeName, name) != 0)
+			continue;
+
+		m_nodes.push_back(std::unique_ptr<CSimulatedNode>(new CSimulatedNode(*this, reinterpret_cast<const char*>(&m_state) + info.offset, type)));
+		return m_nodes.back().get();
+	}
+	return NULL;
+}
+
+inline Statistician::IRegisterPort *Statistician::CSimulatedCamera::GetRegisterPort()
+{
+	return (m_deviceClass & DeviceClass_Usb) != 0 ? this : NULL;
+}
+
+inline Statistician::EStatisticMechanism Statistician::CSimulatedCamera::Subscribe(IStatisticNode *node, const char *eventName, IStatisticChangeObserver *observer, size_t cookie)
+{
+	// nodes handed to Subscribe() come from GetNode().
+	CSimulatedNode *simulatedNode = static_cast<CSimulatedNode*>(node);
+	if (simulatedNode == NULL || observer == NULL)
+		return StatisticMechanism_Polled;
+
+	simulatedNode->m_observer = observer;
+	simulatedNode->m_cookie = cookie;
+	simulatedNode->HasChanged(); // the subscriber reads the current value itself
+	return (eventName != NULL) ? StatisticMechanism_CameraEvent : StatisticMechanism_NodeCallback;
+}
+
+inline void Statistician::CSimulatedCamera::Unsubscribe(IStatisticChangeObserver *observer)
+{
+	if (m_removalObserver == observer)
+		m_removalObserver = NULL;
+	for (size_t i = 0; i < m_nodes.size(); i++)
+	{
+		if (m_nodes[i]->m_observer == observer)
+			m_nodes[i]->m_observer = NULL;
+	}
+}
+
+inline void Statistician::CSimulatedCamera::WatchRemoval(IStatisticChangeObserver *observer)
+{
+	m_removalObserver = observer;
+}
+
+inline void Statistician::CSimulatedCamera::NotifyChanges()
+{
+	for (size_t i = 0; i < m_nodes.size(); i++)
+	{
+		CSimulatedNode &node = *m_nodes[i];
+		if (node.m_observer != NULL && node.HasChanged() == true)
+			node.m_observer->OnStatisticChanged(node.m_cookie);
+	}
+}
+
+inline void Statistician::CSimulatedCamera::Read(void *buffer, int64_t address, int64_t length)
+{
+	CheckRemoved();
+	m_portReads++;
+	SpendReadCost();
+	if (m_rejectBlockReads == true && length > 4)
+		throw std::runtime_error("simulated camera: block read rejected");
+
+	// registers are 4 bytes, little endian; addresses without a register read 0.
+	uint8_t *bytes = static_cast<uint8_t*>(buffer);
+	memset(bytes, 0, static_cast<size_t>(length));
+	for (int i = 0; i < Statistic_Count; i++)
+	{
+		const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+		if (info.type != StatisticType_Register || info.address < address || info.address + 4 > address + length)
+			continue;
+
+		uint64_t value;
+		memcpy(&value, reinterpret_cast<const char*>(&m_state) + info.offset, sizeof(value));
+		for (int b = 0; b < 4; b++)
+			bytes[info.address - address + b] = static_cast<uint8_t>(value >> (8 * b));
+	}
+}
+
+inline bool Statistician::CSimulatedCamera::GetStreamSettings(SStreamSettings &settings)
+{
+	if ((m_deviceClass & DeviceClass_GigE) == 0)
+		return false;
+
+	CheckRemoved();
+	settings = m_stream;
+	settings.frameRate = m_frameRate;
+	return true;
+}
+
+inline void Statistician::CSimulatedCamera::SetStreamSettings(const SStreamSettings &settings)
+{
+	CheckRemoved();
+	if (settings.packetSize <= c_packetHeaderSize || settings.packetSize > m_stream.maxPacketSize)
+		throw std::runtime_error("simulated camera: packet size out of range");
+	if (settings.interPacketDelay < 0 || settings.interPacketDelay > m_stream.maxInterPacketDelay || settings.frameTransmissionDelay < 0 || settings.bufferCount <= 0)
+		throw std::runtime_error("simulated camera: stream setting out of range");
+
+	m_stream.packetSize = settings.packetSize;
+	m_stream.interPacketDelay = settings.interPacketDelay;
+	m_stream.frameTransmissionDelay = settings.frameTransmissionDelay;
+	m_stream.bufferCount = settings.bufferCount;
+}
+
+inline void Statistician::CSimulatedCamera::CheckRemoved()
+{
+	if (m_removed == true)
+		throw std::runtime_error("simulated camera: device removed");
+}
+
+inline void Statistician::CSimulatedCamera::ResetCounters()
+{
+	for (int i = 0; i < Counter_Count; i++)
+	{
+		const SCounterInfo &info = GetCounterInfo(static_cast<ECounter>(i));
+		if (info.cumulative == true)
+			m_state.*info.field = 0;
+	}
+}
+
+inline void Statistician::CSimulatedCamera::Update(int64_t timeUs)
+{
+	if (m_eventsSorted == false)
+	{
+		std::stable_sort(m_events.begin() + m_nextEvent, m_events.end(), [](const SSimulationEvent &a, const SSimulationEvent &b) { return a.timeUs < b.timeUs; });
+		m_eventsSorted = true;
+	}
+
+	// counters change piecewise between events, so integrate up to each event before applying it.
+	// A removed camera grabs nothing, but takes events until it is back.
+	while (m_nextEvent < m_events.size() && m_events[m_nextEvent].timeUs <= timeUs)
+	{
+		if (m_removed == false)
+			Integrate(m_events[m_nextEvent].timeUs);
+		Apply(m_events[m_nextEvent]);
+		m_nextEvent++;
+	}
+
+	if (m_removed == false)
+	{
+		Integrate(timeUs);
+		NotifyChanges();
+	}
+}
+
+inline void Statistician::CSimulatedCamera::Integrate(int64_t timeUs)
+{
+	if (timeUs <= m_timeUs)
+		return;
+
+	double seconds = (timeUs - m_timeUs) / 1e6;
+	m_timeUs = timeUs;
+
+	m_frameFraction += m_frameRate * seconds;
+	while (m_frameFraction >= 1.0)
+	{
+		GrabFrame();
+		m_frameFraction -= 1.0;
+	}
+
+	double step = seconds * 1.0; // degrees per second
+	if (m_temperature < m_targetTemperature)
+		m_temperature = std::min(m_temperature + step, m_targetTemperature);
+	else
+		m_temperature = std::max(m_temperature - step, m_targetTemperature);
+
+	m_state.currentTemperature = static_cast<int64_t>(m_temperature);
+	m_state.criticalTemp = m_temperature >= 72.0;
+	m_state.overTemp = m_temperature >= 80.0;
+	SetText(m_state.temperatureState, m_state.overTemp ? "Error" : m_state.criticalTemp ? "Critical" : "Ok");
+}
+
+inline double Statistician::CSimulatedCamera::GetCongestionLoss() const
+{
+	if (m_congestion <= 0.0)
+		return 0.0;
+
+	// while sending a frame the camera uses 'peak' of the link: the wire time of a packet (with the
+	// Ethernet framing) over that plus the inter-packet delay. What doesn't fit next to the other
+	// traffic queues up in the switch, which drops one in twenty of those packets.
+	double wireSeconds = (m_stream.packetSize + 38) * 8.0 / (m_stream.linkSpeedMbps * 1e6);
+	double delaySeconds = static_cast<double>(m_stream.interPacketDelay) / m_stream.tickFrequency;
+	double peak = wireSeconds / (wireSeconds + delaySeconds);
+	double excess = peak + m_congestion - 1.0;
+	return (excess > 0.0) ? 0.05 * excess / peak : 0.0;
+}
+
+inline void Statistician::CSimulatedCamera::GrabFrame()
+{
+	bool failed = false;
+
+	// frames that come in while every buffer is held by the application are lost.
+	if (m_bufferHoldSeconds > 0.0)
+	{
+		double held = m_frameRate * m_bufferHoldSeconds;
+		if (held > m_stream.bufferCount && NextRandom() < (held - m_stream.bufferCount) / held)
+		{
+			m_state.bufferUnderruns++;
+			return;
+		}
+	}
+
+	if ((m_deviceClass & DeviceClass_GigE) != 0)
+	{
+		int64_t payloadPerPacket = m_stream.packetSize - c_packetHeaderSize;
+		int64_t packets = (c_payloadSize + payloadPerPacket - 1) / payloadPerPacket;
+		double lossRate = m_lossRate;
+		double congestionLoss = GetCongestionLoss();
+		if (congestionLoss > 0.0)
+			lossRate = 1.0 - (1.0 - lossRate) * (1.0 - congestionLoss);
+
+		// lost packets are resent; one in eight resends doesn't make it in time.
+		int64_t lost = static_cast<int64_t>(packets * lossRate + NextRandom());
+		int64_t unrecovered = 0;
+		for (int64_t i = 0; i < lost; i++)
+		{
+			if (NextRandom() < 0.125)
+				unrecovered++;
+		}
+
+		m_state.totalPackets += packets;
+		m_state.resendRequests += (lost > 0) ? 1 : 0;
+		m_state.resendPackets += lost - unrecovered;
+		m_state.failedPackets += unrecovered;
+		failed = unrecovered > 0;
+		if (failed == true)
+		{
+			m_state.lastFailedBufferStatus = static_cast<int64_t>(0xE1000014);
+			SetText(m_state.lastFailedBufferStatusText, "The buffer was incompletely grabbed. This can be caused by performance problems of the network hardware used.");
+		}
+	}
+	else
+	{
+		failed = NextRandom() < m_lossRate;
+		if (failed == true)
+		{
+			m_state.missedFrameCount++;
+			m_state.PE++;
+			if (NextRandom() < 0.25)
+				m_state.resyncCount++;
+			m_state.lastFailedBufferStatus = static_cast<int64_t>(0xE1000014);
+			SetText(m_state.lastFailedBufferStatusText, "Payload data has been discarded. Payload data can be discarded by the camera device if the available bandwidth is insufficient.");
+		}
+		m_state.lastBlockID = m_state.totalBuffers;
+	}
+
+	m_state.totalBuffers++;
+	if (failed == true)
+		m_state.failedBuffers++;
+}
+
+inline void Statistician::CSimulatedCamera::Apply(const SSimulationEvent &event)
+{
+	switch (event.type)
+	{
+	case SimulationEvent_FrameRate:
+		m_frameRate = std::max(0.0, event.value);
+		break;
+	case SimulationEvent_LossRate:
+		m_lossRate = std::min(1.0, std::max(0.0, event.value));
+		break;
+	case SimulationEvent_Error:
+		SetText(m_state.lastError, event.text.c_str());
+		break;
+	case SimulationEvent_ClearError:
+		SetText(m_state.lastError, "");
+		break;
+	case SimulationEvent_TransportError:
+		m_state.tlLastErrorStatus = static_cast<int64_t>(event.value);
+		SetText(m_state.tlLastErrorStatusText, event.text.c_str());
+		if ((m_deviceClass & DeviceClass_Usb) != 0)
+			m_state.readOperationsFailedCount++;
+		break;
+	case SimulationEvent_Temperature:
+		m_targetTemperature = event.value;
+		break;
+	case SimulationEvent_Remove:
+		if (m_removed == false && m_removalObserver != NULL)
+			m_removalObserver->OnSourceRemoved();
+		m_removed = true;
+		break;
+	case SimulationEvent_Reconnect:
+		if (m_removed == false)
+			break;
+
+		// a new device: the nodes resolved before are gone, and so are their subscriptions. They
+		// are freed when the nodes are resolved again.
+		for (size_t i = 0; i < m_nodes.size(); i++)
+		{
+			m_nodes[i]->m_stale = true;
+			m_nodes[i]->m_observer = NULL;
+		}
+		ResetCounters();
+		m_state.lastBlockID = 0;
+		SetText(m_state.lastError, "");
+		m_frameFraction = 0.0;
+		m_timeUs = event.timeUs;	// nothing was grabbed while it was gone
+		m_removed = false;
+		break;
+	case SimulationEvent_ResetCounters:
+		ResetCounters();
+		break;
+	case SimulationEvent_Congestion:
+		m_congestion = std::min(1.0, std::max(0.0, event.value));
+		break;
+	case SimulationEvent_BufferHold:
+		m_bufferHoldSeconds = std::max(0.0, event.value / 1000.0);
+		break;
+	}
+}
+
+inline double Statistician::CSimulatedCamera::NextRandom()
+{
+	// xorshift64*: fast, and the same sequence for the same seed on every platform.
+	m_random ^= m_random >> 12;
+	m_random ^= m_random << 25;
+	m_random ^= m_random >> 27;
+	return static_cast<double>((m_random * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+inline void Statistician::CSimulatedCamera::SetText(char *destination, const char *source)
+{
+	strncpy(destination, source, c_maxTextLength - 1);
+	destination[c_maxTextLength - 1] = '\0';
+}
+
+// *********************************************************************************************************
+#endif
@@ -19,127 +19,353 @@
 #ifndef STATISTICIAN_H
 #define STATISTICIAN_H
 
+#ifndef STATISTICIAN_NO_PYLON
 #include <pylon/PylonIncludes.h>
+#include "PylonStatisticsSource.h"
+#endif
+#include "StatisticsSource.h"
+#include "SeqLock.h"
+#include "StatisticsSnapshot.h"
+#include "StatisticsHistory.h"
+#include "StatisticsFormatter.h"
+#include "RegisterBlockReader.h"
+#include "ErrorDictionary.h"
+#include "AdaptiveSampling.h"
+#include "SamplingProfiler.h"
+#include "DerivedMetrics.h"
+#include <iostream>
+#include <string>
+#include <memory>
 #include <thread>
 #include <atomic>
 #include <set>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 
 namespace Statistician
 {
-	class CStatistician
+	// Receives every published snapshot, on the sampling thread, right after it is published.
+	// Implementations must return quickly; anything slow belongs on their own thread.
+	class IStatisticsListener
+	{
+	public:
+		virtual ~IStatisticsListener() {}
+		virtual void OnStatistics(const StatisticsSnapshot &snapshot) = 0;
+	};
+
+	// One resolved statistic node and where its value goes.
+	// The probe plan is a flat table of these, built once in Initialize() and ordered by group.
+	struct SProbe
+	{
+		EStatistic statistic;
+		EStatisticGroup group;
+		EStatisticType type;
+		IStatisticNode *node;	// owned by the source
+		union
+		{
+			int64_t *integerValue;
+			bool *booleanValue;
+			char *textValue; // c_maxTextLength bytes
+		};
+		bool logged;			// texts other than "no error" go to the error log
+		uint64_t textHash;		// of the last logged text read, 0 before the first read
+		bool trouble;			// a change is trouble for adaptive sampling
+		bool hasValue;			// read at least once
+	};
+
+	class CStatistician : private IStatisticChangeObserver
 	{
 	private:
-		Pylon::CInstantCamera *m_camera;
-		Pylon::String_t m_deviceClass;
-		GenApi::CPortPtr m_devicePort;
+		IStatisticsSource *m_source;
+		std::unique_ptr<IStatisticsSource> m_ownedSource;	// set when initialized with a camera
+		IRegisterPort *m_registerPort;
 		std::thread m_tstats;
 		std::atomic<bool> m_stop;
-		std::stringstream m_strStatistics;
+		std::mutex m_mtxSchedule;
+		std::condition_variable m_cvSchedule;
+		bool m_scheduleChanged;
+		std::atomic<uint64_t> m_changed;			// one bit per EStatistic, set by change notifications
+		bool m_changeNotification;
+		EStatisticMechanism m_mechanism[Statistic_Count];
+		std::chrono::milliseconds m_samplingPeriod[StatisticGroup_Count];
+		std::chrono::steady_clock::time_point m_nextDue[StatisticGroup_Count];
+		std::vector<SProbe> m_probePlan;
+		CRegisterBlockReader m_registerReader;		// register statistics, read through the device port
+		size_t m_probeGroupBegin[StatisticGroup_Count + 1];
+		uint32_t m_groupReads[StatisticGroup_Count];	// node reads and port transactions of a group sample
+		CAdaptiveSampling m_adaptive;
+		std::vector<uint64_t*> m_troubleRegisters;		// register statistics that are trouble, and their last values
+		std::vector<uint64_t> m_troubleRegisterValues;
+		StatisticsSnapshot m_current;				// written by the sampling thread only
+		CErrorDictionary m_errors;					// fills m_current.errorLog
+		CSamplingProfiler m_profiler;				// fills m_current.profile
+		CProfiledRegisterPort m_profiledPort;		// m_registerPort, as the register reader sees it
+		CDerivedMetrics m_derived;					// fills m_current.derived
+		uint32_t m_sampledGroups;					// bit (1 << EStatisticGroup) per group read since the last publish
+		char m_textBuffer[c_maxTextLength];			// logged texts are read here, and copied only if they changed
+		int64_t m_sampleTimeUs;						// of the current sample pass
+		CSeqLock<StatisticsSnapshot> m_published;	// what readers see
+		size_t m_historyCapacity;
+		CStatisticsHistory m_history;				// one entry per published sample
+		mutable std::mutex m_mtxHistory;
+		std::vector<IStatisticsListener*> m_listeners;
+		std::vector<char> m_printBuffer;
 		bool m_isInitialized;
-		bool CheckStatistics();		
+		std::atomic<bool> m_removed;				// set by the source's removal notification
+		bool m_connected;
+		bool m_deviceLost;							// the camera went away, not just a sample pass
+		std::chrono::milliseconds m_reconnectPeriod;
+		std::chrono::steady_clock::time_point m_nextReconnect;
+		bool m_stitching;
+		int64_t m_lastRaw[Counter_Count];			// the camera's own value of each counter at the last publish
+		bool CheckStatistics();
+		bool IsWoken() const;
+		bool SampleGroup(EStatisticGroup group);
+		void SampleChanged(uint64_t changed);
+		bool SampleProbe(SProbe &probe);
+		void BuildProbePlan();
+		void AddProbe(EStatistic statistic);
+		void Publish(std::chrono::steady_clock::time_point now);
+		void Stitch(int64_t *values);
+		void AddCounterReset(uint32_t counters, ECounterReset reason);
+		bool OnFailed(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup);
+		bool OnRemoved(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup);
+		bool TryReconnect(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup);
+		virtual void OnStatisticChanged(size_t cookie);
+		virtual void OnSourceRemoved();
+		static void SetText(char *destination, const char *source);
 
 	public:
 		//CStatistician(Pylon::CInstantCamera &camera);
 		CStatistician();
 		~CStatistician();
+#ifndef STATISTICIAN_NO_PYLON
 		void Initialize(Pylon::CInstantCamera &camera);
+#endif
+		// Samples any source, e.g. a CSimulatedCamera. The source must outlive the statistician.
+		void Initialize(IStatisticsSource &source);
 		bool Start();
 		bool Stop();
+
+		// Stops sampling and lets go of the camera: removes the node callbacks and camera events
+		// and, when initialized with a camera, destroys the source that reads it. Call it while the
+		// camera is still alive; the destructor does the same, so a statistician destroyed before
+		// its camera needs no call. The last snapshot and the history stay readable; Initialize()
+		// starts over.
+		void Detach();
 		std::string PrintStatistics();
 
-		// possible available statistics
-		int64_t totalBuffers;
-		int64_t failedBuffers;
-		int64_t bufferUnderruns;
-		int64_t totalPackets;
-		int64_t resendRequests;
-		int64_t resendPackets;
-		int64_t failedPackets;
-		int64_t lastFailedBufferStatus;
-		Pylon::String_t lastFailedBufferStatusText;
-		std::set<Pylon::String_t> lastFailedBufferStatusTextList;
-		int64_t missedFrameCount;
-		int64_t resyncCount;
-		int64_t lastBlockID;
-		Pylon::String_t lastError;
-		std::set<Pylon::String_t> lastErrorList;
-		int64_t currentTemperature;
-		Pylon::String_t temperatureState;
-		bool criticalTemp;
-		bool overTemp;
-		int64_t readPipeResetCount;
-		int64_t writePipeResetCount;
-		int64_t readOperationsFailedCount;
-		int64_t writeOperationsFailedCount;
-		int64_t tlLastErrorStatus;
-		Pylon::String_t tlLastErrorStatusText;
-		std::set<Pylon::String_t> tlLastErrorStatusTextList;
-		uint64_t EPU;
-		uint64_t PE;
-		uint64_t UR;
-		uint64_t EPR;
-		uint64_t LE;
-		uint64_t LR;
+		// Formats the last published statistics into a caller-provided buffer without allocating.
+		// Returns the length of the complete output; if it is >= size, the output was cut off.
+		size_t PrintStatistics(char *buffer, size_t size, EOutputFormat format = OutputFormat_Text, const char *source = NULL) const;
+
+		// Sampling period of a statistic group. A period of zero disables the group.
+		// Can be changed while sampling is running; the new period takes effect immediately.
+		void SetSamplingPeriod(EStatisticGroup group, std::chrono::milliseconds period);
+		std::chrono::milliseconds GetSamplingPeriod(EStatisticGroup group);
+
+		// Samples every group that is due at 'now' and publishes the result. 'wakeup' receives the
+		// next deadline (time_point::max() if every group is disabled). Returns false if the camera
+		// can no longer be sampled. Used by Start()'s thread and by CStatisticianPool; a
+		// statistician must be driven by only one of them.
+		bool SampleDue(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup);
+
+		// Returns the statistics of the last sample pass. Safe to call from any thread at any time;
+		// never blocks the sampling thread and never takes a lock.
+		StatisticsSnapshot GetSnapshot() const;
+		void GetSnapshot(StatisticsSnapshot &snapshot) const;
+
+		// Listeners are called after every published sample. Register them before Start().
+		void AddListener(IStatisticsListener *listener);
+		void RemoveListener(IStatisticsListener *listener);
+
+		// Number of samples kept per counter. Memory is allocated by Initialize(), so set this before it.
+		void SetHistoryCapacity(size_t samples);
+
+		// Per-second rate between the two newest samples, and delta / rate over the newest samples
+		// within 'window'. Only samples that read the counter's group count. A counter that is not
+		// available reports 0.
+		double GetRate(ECounter counter) const;
+		double GetRate(ECounter counter, std::chrono::milliseconds window) const;
+		int64_t GetDelta(ECounter counter, std::chrono::milliseconds window) const;
+
+		// Copies up to maxSamples of the newest samples that read a counter, oldest first.
+		// Timestamps are steady clock microseconds. Returns the number of samples copied.
+		size_t CopyHistory(ECounter counter, int64_t *timestampsUs, int64_t *values, size_t maxSamples) const;
+
+		// How register statistics are merged into port transactions (see CRegisterBlockReader).
+		// Registers at most maxGap bytes apart (0 by default) are read together, up to
+		// maxBlockLength bytes (256) per read; a negative maxGap reads every register on its own.
+		// A window is always read as one block. Set these before Initialize(). The cost of the reads is in the snapshot.
+		void SetRegisterCoalescing(int64_t maxGap, int64_t maxBlockLength);
+		void AddRegisterWindow(int64_t address, int64_t length);
+
+		// Statistics that rarely change (StatisticUpdate_OnChange) are read when the camera reports
+		// a change instead of every time their group is due, if the source can report it; they are
+		// then sampled in StatisticGroup_OnChange, whose period is only a fallback. Start()'s thread
+		// reads them right away, CStatisticianPool on the next sample pass. With a pylon camera this
+		// turns on the statistics' camera events and GrabCameraEvents, so initialize before
+		// StartGrabbing(). Set this before Initialize(); the default is on.
+		void SetChangeNotification(bool enable);
+
+		// How a statistic is kept up to date, as chosen by Initialize().
+		EStatisticMechanism GetStatisticMechanism(EStatistic statistic) const;
+
+		// Adaptive sampling (see AdaptiveSampling.h). While a group finds trouble (a failure counter
+		// went up, an error text changed), it is sampled every 'fastPeriod' instead of its sampling
+		// period, until it was quiet for 'hold'; then its period grows by 'backoff' per sample back
+		// to the sampling period. A fast period of zero, the default, turns it off for the group.
+		// The effective rates are in StatisticsSnapshot::sampling. Set these before Start().
+		void SetAdaptiveSampling(EStatisticGroup group, std::chrono::milliseconds fastPeriod);
+		void SetAdaptiveBackoff(std::chrono::milliseconds hold, double backoff);
+
+		// Caps the node reads and port transactions of this camera, and of all cameras sharing
+		// 'linkBudget' (e.g. one per network interface; it must outlive the statistician). Fast
+		// samples are skipped while a budget is used up; samples at the sampling period never are.
+		// 0 reads per second means no cap. The camera budget can be changed while sampling.
+		void SetReadBudget(double readsPerSecond, std::chrono::milliseconds burst = std::chrono::milliseconds(100));
+		void SetLinkBudget(CSamplingBudget *linkBudget);
+
+		// Times every node lookup, node read, port read and sample pass, and the CPU time of the
+		// passes, into StatisticsSnapshot::profile (see SamplingProfiler.h); the counts there are
+		// kept either way. Can be changed while sampling; set it before Initialize() to time the
+		// node lookups too. Off by default.
+		void SetProfiling(bool enable);
+
+		// What happens when the camera is removed or a sample pass fails. With a retry period of
+		// zero, the default, sampling ends: SampleDue() returns false and Start()'s thread exits.
+		// Otherwise the statistician keeps its snapshot and history, asks the source every
+		// 'retryPeriod' whether the camera is back (see IStatisticsSource::Reconnect()) and resolves
+		// the statistics again once it is. The application brings the camera back itself; it
+		// destroys the removed device only after the snapshot shows lifecycle.connected false, as
+		// nothing reads the camera from then on. StatisticsSnapshot::lifecycle counts removals and
+		// reconnects. Set this before Start().
+		void SetReconnect(std::chrono::milliseconds retryPeriod);
+
+		// Keeps the cumulative counters going up when the camera counts from zero again, after a
+		// reconnect or when the stream grabber or transport layer is reset (see
+		// SLifecycleStatistics). Set this before Initialize(); the default is on.
+		void SetCounterStitching(bool enable);
 	};
 }
 
 // *********************************************************************************************************
 // DEFINITIONS
 inline Statistician::CStatistician::CStatistician()
+	: m_source(NULL)
+	, m_registerPort(NULL)
+	, m_stop(true)
+	, m_scheduleChanged(false)
+	, m_changed(0)
+	, m_changeNotification(true)
+	, m_profiledPort(m_profiler)
+	, m_sampledGroups(0)
+	, m_sampleTimeUs(0)
+	, m_historyCapacity(1024)
+	, m_isInitialized(false)
+	, m_removed(false)
+	, m_connected(true)
+	, m_deviceLost(false)
+	, m_reconnectPeriod(0)
+	, m_stitching(true)
 {
+	m_samplingPeriod[StatisticGroup_Grabber] = std::chrono::milliseconds(100);
+	m_samplingPeriod[StatisticGroup_Transport] = std::chrono::milliseconds(250);
+	m_samplingPeriod[StatisticGroup_Temperature] = std::chrono::milliseconds(1000);
+	m_samplingPeriod[StatisticGroup_UsbErrorRegisters] = std::chrono::milliseconds(1000);
+	m_samplingPeriod[StatisticGroup_OnChange] = std::chrono::milliseconds(10000);
+
+	for (int i = 0; i < Statistic_Count; i++)
+		m_mechanism[i] = StatisticMechanism_Unavailable;
 }
 
 inline Statistician::CStatistician::~CStatistician()
+{
+	Detach();
+}
+
+inline void Statistician::CStatistician::Detach()
 {
 	this->Stop();
+
+	try
+	{
+		if (m_source != NULL)
+			m_source->Unsubscribe(this);
+	}
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << e.what() << std::endl;
+	}
+
+	// nothing may point into the source any more.
+	m_isInitialized = false;
+	m_probePlan.clear();
+	m_registerReader.Clear();
+	m_registerPort = NULL;
+	m_profiledPort.SetPort(NULL);
+	m_source = NULL;
+	m_ownedSource.reset();
 }
 
+#ifndef STATISTICIAN_NO_PYLON
 inline void Statistician::CStatistician::Initialize(Pylon::CInstantCamera &camera)
+{
+	try
+	{
+		std::unique_ptr<IStatisticsSource> source(new CPylonStatisticsSource(camera));
+		Initialize(*source);
+		m_ownedSource = std::move(source);
+	}
+	catch (GenICam::GenericException &e)
+	{
+		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
+		m_isInitialized = false;
+	}
+}
+#endif
+
+inline void Statistician::CStatistician::Initialize(IStatisticsSource &source)
 {
 	try
 	{
 		m_stop.store(true);
 
-		criticalTemp = false;
-		overTemp = false;
-		totalBuffers = -1;
-		failedBuffers = -1;
-		bufferUnderruns = -1;
-		totalPackets = -1;
-		resendRequests = -1;
-		resendPackets = -1;
-		failedPackets = -1;
-		lastFailedBufferStatus = -1;
-		readPipeResetCount = -1;
-		writePipeResetCount = -1;
-		readOperationsFailedCount = -1;
-		writeOperationsFailedCount = -1;
-		tlLastErrorStatus = -1;
-		missedFrameCount = -1;
-		resyncCount = -1;
-		lastBlockID = -1;
-		currentTemperature = -1;
-		lastFailedBufferStatusText = "-1";
-		lastError = "-1";
-		temperatureState = "-1";
-		tlLastErrorStatusText = "-1";
-		EPU = 0;
-		PE = 0;
-		UR = 0;
-		EPR = 0;
-		LE = 0;
-		LR = 0;
-
-		m_camera = &camera;
-		m_deviceClass = m_camera->GetDeviceInfo().GetDeviceClass();
-		m_devicePort = camera.GetNodeMap().GetNode("Device");
+		ResetStatisticsSnapshot(m_current);
+		m_errors.Attach(m_current.errorLog);
+		m_profiler.Attach(m_current.profile);
+		m_published.Store(m_current);
+		{
+			std::lock_guard<std::mutex> lock(m_mtxHistory);
+			m_history.Initialize(Counter_Count, m_historyCapacity);
+		}
+		m_scheduleChanged = true; // start every group's deadline at the first sample
+		m_removed.store(false);
+		m_connected = true;
+		m_current.lifecycle.connected = true;
+		memset(m_lastRaw, 0, sizeof(m_lastRaw));
+
+		if (m_source != NULL && m_source != &source)
+			m_source->Unsubscribe(this);
+		m_source = &source;
+		m_registerPort = source.GetRegisterPort();
+		m_profiledPort.SetPort(m_registerPort);
+		BuildProbePlan();
+		m_derived.Compile(source.GetDeviceClassMask());
+		m_sampledGroups = 0;
 		m_isInitialized = true;
 	}
+#ifndef STATISTICIAN_NO_PYLON
 	catch (GenICam::GenericException &e)
 	{
 		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
 		m_isInitialized = false;
 	}
+#endif
 	catch (std::exception &e)
 	{
 		std::cout << __FUNCTION__ << e.what() << std::endl;
@@ -147,164 +373,677 @@ inline void Statistician::CStatistician::Initialize(Pylon::CInstantCamera &camer
 	}
 }
 inline bool Statistician::CStatistician::CheckStatistics()
+{
+	std::unique_lock<std::mutex> lock(m_mtxSchedule);
+	while (m_stop.load() == false)
+	{
+		lock.unlock();
+		std::chrono::steady_clock::time_point wakeup;
+		if (SampleDue(std::chrono::steady_clock::now(), wakeup) == false)
+			return false;
+		lock.lock();
+
+		if (wakeup != std::chrono::steady_clock::time_point::max())
+			m_cvSchedule.wait_until(lock, wakeup, [this] { return IsWoken(); });
+		else
+			m_cvSchedule.wait(lock, [this] { return IsWoken(); });
+	}
+	return true;
+}
+
+inline bool Statistician::CStatistician::IsWoken() const
+{
+	// called with m_mtxSchedule held. While the camera is gone, changes and new periods wait for
+	// the reconnect; only the next try is due.
+	if (m_stop.load() == true || m_removed.load() == true)
+		return true;
+	return m_connected == true && (m_scheduleChanged == true || m_changed.load() != 0);
+}
+
+inline bool Statistician::CStatistician::SampleDue(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup)
 {
 	try
 	{
-		if (m_camera->IsOpen())
+		wakeup = std::chrono::steady_clock::time_point::max();
+		m_sampleTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+		std::chrono::steady_clock::time_point busyStart = std::chrono::steady_clock::now();
+		m_profiler.BeginPass();
+
+		if (m_isInitialized == false)
+			return false;
+		if (m_connected == false)
+			return TryReconnect(now, wakeup);
+		if (m_removed.exchange(false) == true || m_source->IsOpen() == false)
 		{
-			GenApi::INodeMap& m_control = m_camera->GetNodeMap();
-			GenApi::INodeMap& m_grabber = m_camera->GetStreamGrabberNodeMap();
-			GenApi::INodeMap& m_transport = m_camera->GetTLNodeMap();
+			m_deviceLost = true;
+			return OnRemoved(now, wakeup);
+		}
 
-			GenApi::CIntegerPtr ptrInteger;
-			GenApi::CStringPtr ptrString;
-			GenApi::CEnumerationPtr ptrEnumeration;
-			GenApi::CBooleanPtr ptrBool;
+		std::chrono::milliseconds period[StatisticGroup_Count];
+		{
+			std::lock_guard<std::mutex> lock(m_mtxSchedule);
+			for (int i = 0; i < StatisticGroup_Count; i++)
+				period[i] = m_samplingPeriod[i];
 
-			while (m_stop.load() == false)
+			if (m_scheduleChanged == true)
 			{
-				ptrInteger = m_grabber.GetNode("Statistic_Last_Failed_Buffer_Status");
-				if (GenApi::IsReadable(ptrInteger))
-					lastFailedBufferStatus = ptrInteger->GetValue();
-
-				ptrInteger = m_grabber.GetNode("Statistic_Total_Buffer_Count");
-				if (GenApi::IsReadable(ptrInteger))
-					totalBuffers = ptrInteger->GetValue();
-
-				ptrInteger = m_grabber.GetNode("Statistic_Failed_Buffer_Count");
-				if (GenApi::IsReadable(ptrInteger))
-					failedBuffers = ptrInteger->GetValue();
+				// periods were changed, so restart every group from now.
+				m_scheduleChanged = false;
+				for (int i = 0; i < StatisticGroup_Count; i++)
+					m_nextDue[i] = now;
+				m_adaptive.Reset();
+			}
+		}
 
-				ptrInteger = m_control.GetNode("TemperatureAbs");
-				if (GenApi::IsReadable(ptrInteger))
-					currentTemperature = ptrInteger->GetValue();
+		// taken after IsOpen(), so changes the source found while updating are read in this pass.
+		uint64_t changed = m_changed.exchange(0);
 
-				ptrInteger = m_transport.GetNode("Statistic_Last_Error_Status");
-				if (GenApi::IsReadable(ptrInteger))
-					tlLastErrorStatus = ptrInteger->GetValue();
+		// Each group is due at a fixed deadline. Deadlines advance by whole periods from the
+		// previous deadline (not from the time the sample finished), so the timing does not drift.
+		// The period is the group's sampling period, or shorter while adaptive sampling is fast.
+		SSamplingStatistics &sampling = m_current.sampling;
+		bool anySampled = false;
+		for (int i = 0; i < StatisticGroup_Count; i++)
+		{
+			if (period[i].count() <= 0)
+			{
+				sampling.periodUs[i] = 0;
+				continue;
+			}
 
-				GenApi::CStringPtr ptrTLLastErrorStatusText;
-				ptrTLLastErrorStatusText = m_transport.GetNode("Statistic_Last_Error_Status_Text");
-				if (GenApi::IsReadable(ptrTLLastErrorStatusText))
+			if (m_nextDue[i] <= now)
+			{
+				EStatisticGroup group = static_cast<EStatisticGroup>(i);
+				int64_t basePeriodUs = std::chrono::duration_cast<std::chrono::microseconds>(period[i]).count();
+				int64_t periodUs = basePeriodUs;
+				bool isFast = false;
+				if (m_adaptive.Admit(group, basePeriodUs, m_groupReads[i], m_sampleTimeUs, isFast) == true)
 				{
-					tlLastErrorStatusText = ptrTLLastErrorStatusText->GetValue();
-					if (tlLastErrorStatusText == "")
-						tlLastErrorStatusText = "(no error)\n";
-					else
-						tlLastErrorStatusTextList.insert(tlLastErrorStatusText);
-				}
+					bool trouble = SampleGroup(group);
+					anySampled = true;
+					m_sampledGroups |= static_cast<uint32_t>(1) << i;
+					if (i == StatisticGroup_OnChange)
+						changed = 0; // read them all already
 
-				ptrString = m_grabber.GetNode("Statistic_Last_Failed_Buffer_Status_Text");
-				if (GenApi::IsReadable(ptrString))
-				{
-					lastFailedBufferStatusText = ptrString->GetValue();
-					if (lastFailedBufferStatusText == "")
-						lastFailedBufferStatusText = "(no error)\n";
-					else
-						lastFailedBufferStatusTextList.insert(lastFailedBufferStatusText);
+					sampling.samples[i]++;
+					if (isFast == true)
+						sampling.fastSamples[i]++;
+					if (trouble == true)
+						sampling.troubleSamples[i]++;
+					periodUs = m_adaptive.Update(group, basePeriodUs, trouble, m_sampleTimeUs);
 				}
-
-				ptrEnumeration = m_grabber.GetNode("LastError");
-				if (GenApi::IsReadable(ptrEnumeration))
+				else
 				{
-					lastError = ptrEnumeration->ToString();
-					lastErrorList.insert(lastError);
+					sampling.deniedSamples[i]++;
+					periodUs = m_adaptive.GetPeriodUs(group, basePeriodUs);
 				}
+				sampling.periodUs[i] = periodUs;
 
-				ptrEnumeration = m_control.GetNode("TemperatureState");
-				if (GenApi::IsReadable(ptrEnumeration))
-					temperatureState = ptrEnumeration->ToString();
+				// skip any deadlines we missed instead of sampling in a burst to catch up.
+				std::chrono::microseconds groupPeriod(periodUs);
+				m_nextDue[i] += groupPeriod * ((now - m_nextDue[i]) / groupPeriod + 1);
+			}
 
-				ptrBool = m_control.GetNode("CriticalTemperature");
-				if (GenApi::IsReadable(ptrBool))
-					criticalTemp = ptrBool->GetValue();
+			if (m_nextDue[i] < wakeup)
+				wakeup = m_nextDue[i];
+		}
 
-				ptrBool = m_control.GetNode("OverTemperature");
-				if (GenApi::IsReadable(ptrBool))
-					overTemp = ptrBool->GetValue();
+		if (changed != 0)
+		{
+			SampleChanged(changed);
+			anySampled = true;
+			m_sampledGroups |= static_cast<uint32_t>(1) << StatisticGroup_OnChange;
+		}
 
-				if (m_deviceClass == Pylon::BaslerGigEDeviceClass)
-				{
-					ptrInteger = m_grabber.GetNode("Statistic_Buffer_Underrun_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						bufferUnderruns = ptrInteger->GetValue();
+		if (anySampled == true)
+		{
+			sampling.busyUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - busyStart).count();
+			m_profiler.EndPass();
+			Publish(now);
+		}
+
+		return true;
+	}
+#ifndef STATISTICIAN_NO_PYLON
+	catch (const GenICam::GenericException &/*e*/)
+	{
+		// really the only exception would be due to camera removal, and we'll catch that in main().
+		//	Utility_ParseError(e.GetDescription(), "CheckStatistics()");
+		//std::cout << __FUNCTION__ << e.GetDescription() << std::endl; // just to satisfy compilier warning about unreferenced local variable.
+		return OnFailed(now, wakeup);
+	}
+#endif
+	catch (const std::exception &/*e*/)
+	{
+		// really the only exception would be due to camera removal, and we'll catch that in main().
+		//	Utility_ParseError(e.what(), "CheckStatistics()");
+		//std::cout << __FUNCTION__ << e.what() << std::endl; // just to satisfy compilier warning about unreferenced local variable.
+		return OnFailed(now, wakeup);
+	}
+}
+
+inline bool Statistician::CStatistician::OnFailed(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup)
+{
+	// a pass that failed on a camera that is still there leaves its counters as they were.
+	try
+	{
+		m_deviceLost = (m_removed.load() == true || m_source->IsOpen() == false);
+	}
+	catch (...)
+	{
+		m_deviceLost = true;
+	}
+	return OnRemoved(now, wakeup);
+}
 
-					ptrInteger = m_grabber.GetNode("Statistic_Total_Packet_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						totalPackets = ptrInteger->GetValue();
+inline bool Statistician::CStatistician::OnRemoved(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup)
+{
+	// the last values stay published, so readers see what the camera had until it went away.
+	m_connected = false;
+	m_removed.store(false);
+	m_changed.store(0); // the nodes that reported them are read again after a reconnect
+	SLifecycleStatistics &lifecycle = m_current.lifecycle;
+	lifecycle.connected = false;
+	lifecycle.removals++;
+	lifecycle.lastRemovalUs = m_sampleTimeUs;
+	Publish(now);
 
-					ptrInteger = m_grabber.GetNode("Statistic_Resend_Request_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						resendRequests = ptrInteger->GetValue();
+	wakeup = std::chrono::steady_clock::time_point::max();
+	if (m_reconnectPeriod.count() <= 0)
+		return false;
 
-					ptrInteger = m_grabber.GetNode("Statistic_Resend_Packet_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						resendPackets = ptrInteger->GetValue();
+	m_nextReconnect = now + m_reconnectPeriod;
+	wakeup = m_nextReconnect;
+	return true;
+}
 
-					ptrInteger = m_grabber.GetNode("Statistic_Failed_Packet_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						failedPackets = ptrInteger->GetValue();
-				}
+inline bool Statistician::CStatistician::TryReconnect(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &wakeup)
+{
+	m_removed.store(false);
+	m_changed.store(0);
+	if (now < m_nextReconnect)
+	{
+		wakeup = m_nextReconnect;
+		return true;
+	}
 
-				if (m_deviceClass == Pylon::BaslerUsbDeviceClass)
-				{
-					ptrInteger = m_grabber.GetNode("Statistic_Missed_Frame_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						missedFrameCount = ptrInteger->GetValue();
-
-					ptrInteger = m_grabber.GetNode("Statistic_Resynchronization_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						resyncCount = ptrInteger->GetValue();
-
-					ptrInteger = m_grabber.GetNode("Statistic_Last_Block_Id");
-					if (GenApi::IsReadable(ptrInteger))
-						lastBlockID = ptrInteger->GetValue();
-
-					ptrInteger = m_transport.GetNode("Statistic_Read_Pipe_Reset_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						readPipeResetCount = ptrInteger->GetValue();
-
-					ptrInteger = m_transport.GetNode("Statistic_Write_Pipe_Reset_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						writePipeResetCount = ptrInteger->GetValue();
-
-					ptrInteger = m_transport.GetNode("Statistic_Read_Operations_Failed_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						readOperationsFailedCount = ptrInteger->GetValue();
-
-					ptrInteger = m_transport.GetNode("Statistic_Write_Operations_Failed_Count");
-					if (GenApi::IsReadable(ptrInteger))
-						writeOperationsFailedCount = ptrInteger->GetValue();
-
-					m_devicePort->Read(reinterpret_cast<char*>(&EPU), 0xAFFB0010, 4);
-					m_devicePort->Read(reinterpret_cast<char*>(&PE), 0xAFFB0004, 4);
-					m_devicePort->Read(reinterpret_cast<char*>(&UR), 0xAFFB000C, 4);
-					m_devicePort->Read(reinterpret_cast<char*>(&EPR), 0xAFFB0020, 4);
-					m_devicePort->Read(reinterpret_cast<char*>(&LE), 0xAFFB0008, 4);
-					m_devicePort->Read(reinterpret_cast<char*>(&LR), 0xAFFB0014, 4);
-				}
-			}
+	// every try goes out to the device, so tries are spaced by whole periods like the groups.
+	m_nextReconnect += m_reconnectPeriod * ((now - m_nextReconnect) / m_reconnectPeriod + 1);
+	wakeup = m_nextReconnect;
+	m_current.lifecycle.reconnectAttempts++;
+
+	// the port and the nodes may have gone with the device; nothing reads them until they are
+	// resolved again.
+	m_registerPort = NULL;
+	m_profiledPort.SetPort(NULL);
+	try
+	{
+		if (m_source->Reconnect() == false)
 			return true;
+
+		m_registerPort = m_source->GetRegisterPort();
+		m_profiledPort.SetPort(m_registerPort);
+		BuildProbePlan();
+	}
+#ifndef STATISTICIAN_NO_PYLON
+	catch (GenICam::GenericException &e)
+	{
+		std::cout << __FUNCTION__ << e.GetDescription() << std::endl;
+		return true;
+	}
+#endif
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << e.what() << std::endl;
+		return true;
+	}
+
+	// a camera that was gone counts from zero; the last values it had carry over into the
+	// offsets, and what it reports from now on adds to them.
+	SLifecycleStatistics &lifecycle = m_current.lifecycle;
+	if (m_stitching == true && m_deviceLost == true)
+	{
+		uint32_t rebased = 0;
+		for (int i = 0; i < Counter_Count; i++)
+		{
+			const SCounterInfo &info = GetCounterInfo(static_cast<ECounter>(i));
+			if (info.cumulative == false || m_current.*info.field < 0)
+				continue;
+
+			lifecycle.offsets[i] += m_lastRaw[i];
+			m_lastRaw[i] = 0;
+			m_current.*info.field = 0;
+			rebased |= static_cast<uint32_t>(1) << i;
 		}
-		else
+		AddCounterReset(rebased, CounterReset_Reconnect);
+	}
+
+	m_connected = true;
+	m_deviceLost = false;
+	lifecycle.connected = true;
+	lifecycle.reconnects++;
+	lifecycle.lastReconnectUs = m_sampleTimeUs;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxSchedule);
+		m_scheduleChanged = true; // every group is sampled right away
+	}
+	wakeup = now;
+	Publish(now);
+	return true;
+}
+
+inline void Statistician::CStatistician::AddProbe(EStatistic statistic)
+{
+	const SStatisticInfo &info = GetStatisticInfo(statistic);
+	char *field = reinterpret_cast<char*>(&m_current) + info.offset;
+
+	if (info.type == StatisticType_Register)
+	{
+		if (m_registerPort == NULL)
+			return;
+
+		m_registerReader.AddRegister(info.address, 4, reinterpret_cast<uint64_t*>(field));
+		if (info.trouble == true)
+			m_troubleRegisters.push_back(reinterpret_cast<uint64_t*>(field));
+		m_current.available |= static_cast<uint64_t>(1) << statistic;
+		m_mechanism[statistic] = StatisticMechanism_Polled;
+		return;
+	}
+
+	SProbe probe;
+	probe.statistic = statistic;
+	probe.group = info.group;
+	probe.type = info.type;
+	int64_t lookupBegin = m_profiler.Begin();
+	probe.node = m_source->GetNode(info.nodeMap, info.nodeName, info.type);
+	m_profiler.EndNodeLookup(lookupBegin);
+	probe.logged = info.logged;
+	probe.textHash = 0;
+	probe.trouble = info.trouble;
+	probe.hasValue = false;
+	if (probe.node == NULL)
+		return; // not supported by this device
+
+	if (info.type == StatisticType_Integer)
+		probe.integerValue = reinterpret_cast<int64_t*>(field);
+	else if (info.type == StatisticType_Boolean)
+		probe.booleanValue = reinterpret_cast<bool*>(field);
+	else
+		probe.textValue = field;
+
+	m_mechanism[statistic] = StatisticMechanism_Polled;
+	if (info.update == StatisticUpdate_OnChange && m_changeNotification == true)
+	{
+		m_mechanism[statistic] = m_source->Subscribe(probe.node, info.eventName, this, statistic);
+		if (m_mechanism[statistic] != StatisticMechanism_Polled)
+			probe.group = StatisticGroup_OnChange;
+	}
+
+	m_probePlan.push_back(probe);
+	m_current.available |= static_cast<uint64_t>(1) << statistic;
+}
+
+inline void Statistician::CStatistician::BuildProbePlan()
+{
+	// Resolve every statistic node once, so sampling never looks nodes up by name.
+	m_source->Unsubscribe(this);
+	m_source->WatchRemoval(this);
+	m_probePlan.clear();
+	m_registerReader.Clear();
+	m_troubleRegisters.clear();
+	m_current.available = 0;
+	m_changed.store(0);
+	for (int i = 0; i < Statistic_Count; i++)
+		m_mechanism[i] = StatisticMechanism_Unavailable;
+
+	unsigned deviceClass = m_source->GetDeviceClassMask();
+	for (int i = 0; i < Statistic_Count; i++)
+	{
+		const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+		if ((info.deviceClasses & deviceClass) != 0)
+			AddProbe(static_cast<EStatistic>(i));
+	}
+
+	// plan the register blocks now, so sampling does not allocate.
+	m_current.registerReads.blocks = static_cast<uint32_t>(m_registerReader.GetBlockCount());
+	m_troubleRegisterValues.assign(m_troubleRegisters.size(), 0);
+
+	// order the table by group so each group is one contiguous run.
+	std::stable_sort(m_probePlan.begin(), m_probePlan.end(), [](const SProbe &a, const SProbe &b) { return a.group < b.group; });
+
+	size_t i = 0;
+	for (int group = 0; group <= StatisticGroup_Count; group++)
+	{
+		while (i < m_probePlan.size() && m_probePlan[i].group < group)
+			i++;
+		m_probeGroupBegin[group] = i;
+	}
+
+	// what a sample of each group costs, for the read budgets.
+	for (int group = 0; group < StatisticGroup_Count; group++)
+		m_groupReads[group] = static_cast<uint32_t>(m_probeGroupBegin[group + 1] - m_probeGroupBegin[group]);
+	m_groupReads[StatisticGroup_UsbErrorRegisters] += m_current.registerReads.blocks;
+}
+
+inline void Statistician::CStatistician::SetText(char *destination, const char *source)
+{
+	size_t length = std::min(strlen(source), c_maxTextLength - 1);
+	memcpy(destination, source, length);
+	destination[length] = '\0';
+}
+
+inline void Statistician::CStatistician::Publish(std::chrono::steady_clock::time_point now)
+{
+	m_current.sequence++;
+	m_current.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+
+	int64_t values[Counter_Count];
+	int64_t raw[Counter_Count];
+	for (int i = 0; i < Counter_Count; i++)
+	{
+		values[i] = m_current.*GetCounterInfo(static_cast<ECounter>(i)).field;
+		raw[i] = values[i];
+	}
+
+	// readers see the stitched counters; m_current gets back what the camera reported, which
+	// the next sample pass compares its reads with.
+	if (m_stitching == true)
+	{
+		Stitch(values);
+		for (int i = 0; i < Counter_Count; i++)
+			m_current.*GetCounterInfo(static_cast<ECounter>(i)).field = values[i];
+	}
+	// the history only takes the counters of the groups that were read as new samples.
+	uint32_t readCounters = 0;
+	for (int i = 0; i < Counter_Count; i++)
+	{
+		if ((m_sampledGroups & (static_cast<uint32_t>(1) << GetCounterInfo(static_cast<ECounter>(i)).group)) != 0)
+			readCounters |= static_cast<uint32_t>(1) << i;
+	}
+	m_derived.Update(values, m_current.timestampUs, m_sampledGroups, m_current.derived);
+	m_current.sampledGroups = m_sampledGroups;
+	m_sampledGroups = 0;
+	m_published.Store(m_current);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mtxHistory);
+		m_history.Append(m_current.timestampUs, values, readCounters);
+	}
+
+	for (size_t i = 0; i < m_listeners.size(); i++)
+		m_listeners[i]->OnStatistics(m_current);
+
+	for (int i = 0; i < Counter_Count; i++)
+		m_current.*GetCounterInfo(static_cast<ECounter>(i)).field = raw[i];
+}
+
+inline void Statistician::CStatistician::Stitch(int64_t *values)
+{
+	// a cumulative counter only goes down when whatever keeps it starts from zero again.
+	uint32_t rebased = 0;
+	SLifecycleStatistics &lifecycle = m_current.lifecycle;
+	for (int i = 0; i < Counter_Count; i++)
+	{
+		if (GetCounterInfo(static_cast<ECounter>(i)).cumulative == false || values[i] < 0)
+			continue;
+
+		if (values[i] < m_lastRaw[i])
 		{
-			return false;
+			lifecycle.offsets[i] += m_lastRaw[i];
+			rebased |= static_cast<uint32_t>(1) << i;
 		}
+		m_lastRaw[i] = values[i];
+		values[i] += lifecycle.offsets[i];
 	}
-	catch (GenICam::GenericException /*&e*/)
+
+	if (rebased != 0)
+		AddCounterReset(rebased, CounterReset_Decrease);
+}
+
+inline void Statistician::CStatistician::AddCounterReset(uint32_t counters, ECounterReset reason)
+{
+	SLifecycleStatistics &lifecycle = m_current.lifecycle;
+	SCounterReset &reset = lifecycle.resets[lifecycle.resetCount % c_resetLogLength];
+	reset.timestampUs = m_sampleTimeUs;
+	reset.counters = counters;
+	reset.reason = reason;
+	lifecycle.resetCount++;
+}
+
+inline void Statistician::CStatistician::AddListener(IStatisticsListener *listener)
+{
+	if (listener != NULL && std::find(m_listeners.begin(), m_listeners.end(), listener) == m_listeners.end())
+		m_listeners.push_back(listener);
+}
+
+inline void Statistician::CStatistician::RemoveListener(IStatisticsListener *listener)
+{
+	m_listeners.erase(std::remove(m_listeners.begin(), m_listeners.end(), listener), m_listeners.end());
+}
+
+inline Statistician::StatisticsSnapshot Statistician::CStatistician::GetSnapshot() const
+{
+	StatisticsSnapshot snapshot;
+	m_published.Load(snapshot);
+	return snapshot;
+}
+
+inline void Statistician::CStatistician::GetSnapshot(StatisticsSnapshot &snapshot) const
+{
+	m_published.Load(snapshot);
+}
+
+inline void Statistician::CStatistician::SetHistoryCapacity(size_t samples)
+{
+	m_historyCapacity = samples;
+}
+
+inline double Statistician::CStatistician::GetRate(ECounter counter) const
+{
+	std::lock_guard<std::mutex> lock(m_mtxHistory);
+	return m_history.GetRate(counter);
+}
+
+inline double Statistician::CStatistician::GetRate(ECounter counter, std::chrono::milliseconds window) const
+{
+	std::lock_guard<std::mutex> lock(m_mtxHistory);
+	return m_history.GetRate(counter, std::chrono::duration_cast<std::chrono::microseconds>(window).count());
+}
+
+inline int64_t Statistician::CStatistician::GetDelta(ECounter counter, std::chrono::milliseconds window) const
+{
+	std::lock_guard<std::mutex> lock(m_mtxHistory);
+	return m_history.GetDelta(counter, std::chrono::duration_cast<std::chrono::microseconds>(window).count());
+}
+
+inline size_t Statistician::CStatistician::CopyHistory(ECounter counter, int64_t *timestampsUs, int64_t *values, size_t maxSamples) const
+{
+	std::lock_guard<std::mutex> lock(m_mtxHistory);
+	return m_history.CopySamples(counter, timestampsUs, values, maxSamples);
+}
+
+inline void Statistician::CStatistician::SetRegisterCoalescing(int64_t maxGap, int64_t maxBlockLength)
+{
+	m_registerReader.SetMaxGap(maxGap);
+	m_registerReader.SetMaxBlockLength(maxBlockLength);
+}
+
+inline void Statistician::CStatistician::AddRegisterWindow(int64_t address, int64_t length)
+{
+	m_registerReader.AddWindow(address, length);
+}
+
+inline bool Statistician::CStatistician::SampleGroup(EStatisticGroup group)
+{
+	bool trouble = false;
+	for (size_t i = m_probeGroupBegin[group]; i < m_probeGroupBegin[group + 1]; i++)
+		trouble |= SampleProbe(m_probePlan[i]);
+
+	if (group == StatisticGroup_UsbErrorRegisters)
 	{
-		// really the only exception would be due to camera removal, and we'll catch that in main().
-		//	Utility_ParseError(e.GetDescription(), "CheckStatistics()");
-		//std::cout << __FUNCTION__ << e.GetDescription() << std::endl; // just to satisfy compilier warning about unreferenced local variable.
-		return false;
+		if (m_registerReader.GetRegisterCount() > 0)
+		{
+			m_registerReader.Read(m_profiledPort);
+			m_current.registerReads = m_registerReader.GetStatistics();
+
+			for (size_t i = 0; i < m_troubleRegisters.size(); i++)
+			{
+				trouble |= (m_current.registerReads.passes > 1 && *m_troubleRegisters[i] != m_troubleRegisterValues[i]);
+				m_troubleRegisterValues[i] = *m_troubleRegisters[i];
+			}
+		}
 	}
-	catch (std::exception /*&e*/)
+	return trouble;
+}
+
+inline void Statistician::CStatistician::SampleChanged(uint64_t changed)
+{
+	for (size_t i = m_probeGroupBegin[StatisticGroup_OnChange]; i < m_probeGroupBegin[StatisticGroup_OnChange + 1]; i++)
 	{
-		// really the only exception would be due to camera removal, and we'll catch that in main().
-		//	Utility_ParseError(e.what(), "CheckStatistics()");
-		//std::cout << __FUNCTION__ << e.what() << std::endl; // just to satisfy compilier warning about unreferenced local variable.
+		if ((changed & (static_cast<uint64_t>(1) << m_probePlan[i].statistic)) != 0)
+			SampleProbe(m_probePlan[i]);
+	}
+}
+
+inline bool Statistician::CStatistician::SampleProbe(SProbe &probe)
+{
+	if (probe.node->IsReadable() == false)
 		return false;
+
+	// only a change between two reads is trouble, not the first value.
+	bool changed = false;
+	m_current.sampling.nodeReads++;
+	int64_t readBegin = m_profiler.Begin();
+	switch (probe.type)
+	{
+	case StatisticType_Integer:
+		{
+			int64_t value = probe.node->GetInteger();
+			m_profiler.EndNodeRead(readBegin);
+			changed = (value != *probe.integerValue);
+			*probe.integerValue = value;
+		}
+		break;
+
+	case StatisticType_Boolean:
+		{
+			bool value = probe.node->GetBoolean();
+			m_profiler.EndNodeRead(readBegin);
+			changed = (value != *probe.booleanValue);
+			*probe.booleanValue = value;
+		}
+		break;
+
+	case StatisticType_Text:
+		if (probe.logged == false)
+		{
+			probe.node->GetText(probe.textValue, c_maxTextLength);
+			m_profiler.EndNodeRead(readBegin);
+			break;
+		}
+
+		{
+			// an unchanged error text costs a hash, not a string comparison.
+			probe.node->GetText(m_textBuffer, c_maxTextLength);
+			m_profiler.EndNodeRead(readBegin);
+			uint64_t hash = CErrorDictionary::Hash(m_textBuffer);
+			if (hash == probe.textHash)
+				break;
+
+			bool isFirstRead = (probe.textHash == 0);
+			probe.textHash = hash;
+			changed = true;
+			if (m_textBuffer[0] == '\0')
+			{
+				SetText(probe.textValue, "(no error)\n");
+				if (isFirstRead == false)
+					m_errors.OnNoError(probe.statistic, m_sampleTimeUs);
+			}
+			else
+			{
+				SetText(probe.textValue, m_textBuffer);
+				m_errors.OnText(probe.statistic, m_textBuffer, hash, m_sampleTimeUs);
+			}
+		}
+		break;
+
+	default:
+		break;
 	}
+
+	bool trouble = (probe.trouble == true && probe.hasValue == true && changed == true);
+	probe.hasValue = true;
+	return trouble;
+}
+
+inline void Statistician::CStatistician::OnStatisticChanged(size_t cookie)
+{
+	m_changed.fetch_or(static_cast<uint64_t>(1) << cookie);
+
+	{
+		// an empty critical section, so a sampling thread about to wait can't miss the wakeup.
+		std::lock_guard<std::mutex> lock(m_mtxSchedule);
+	}
+	m_cvSchedule.notify_all();
+}
+
+inline void Statistician::CStatistician::OnSourceRemoved()
+{
+	m_removed.store(true);
+
+	{
+		// an empty critical section, so a sampling thread about to wait can't miss the wakeup.
+		std::lock_guard<std::mutex> lock(m_mtxSchedule);
+	}
+	m_cvSchedule.notify_all();
+}
+
+inline void Statistician::CStatistician::SetChangeNotification(bool enable)
+{
+	m_changeNotification = enable;
+}
+
+inline Statistician::EStatisticMechanism Statistician::CStatistician::GetStatisticMechanism(EStatistic statistic) const
+{
+	if (statistic < 0 || statistic >= Statistic_Count)
+		return StatisticMechanism_Unavailable;
+
+	return m_mechanism[statistic];
+}
+
+inline void Statistician::CStatistician::SetAdaptiveSampling(EStatisticGroup group, std::chrono::milliseconds fastPeriod)
+{
+	m_adaptive.SetFastPeriod(group, fastPeriod);
+}
+
+inline void Statistician::CStatistician::SetAdaptiveBackoff(std::chrono::milliseconds hold, double backoff)
+{
+	m_adaptive.SetBackoff(hold, backoff);
+}
+
+inline void Statistician::CStatistician::SetReadBudget(double readsPerSecond, std::chrono::milliseconds burst)
+{
+	m_adaptive.GetBudget().SetLimit(readsPerSecond, burst);
+}
+
+inline void Statistician::CStatistician::SetLinkBudget(CSamplingBudget *linkBudget)
+{
+	m_adaptive.SetLinkBudget(linkBudget);
+}
+
+inline void Statistician::CStatistician::SetProfiling(bool enable)
+{
+	m_profiler.SetEnabled(enable);
+}
+
+inline void Statistician::CStatistician::SetReconnect(std::chrono::milliseconds retryPeriod)
+{
+	m_reconnectPeriod = retryPeriod;
+}
+
+inline void Statistician::CStatistician::SetCounterStitching(bool enable)
+{
+	m_stitching = enable;
 }
 
 inline bool Statistician::CStatistician::Start()
@@ -321,82 +1060,70 @@ inline bool Statistician::CStatistician::Start()
 
 inline bool Statistician::CStatistician::Stop()
 {
-	m_stop.store(true);
+	{
+		// set the flag under the schedule lock so the sampling thread can't miss the wakeup.
+		std::lock_guard<std::mutex> lock(m_mtxSchedule);
+		m_stop.store(true);
+	}
+	m_cvSchedule.notify_all();
+
 	if (m_tstats.joinable())
 		m_tstats.join();
 
 	return true;
 }
 
+inline void Statistician::CStatistician::SetSamplingPeriod(EStatisticGroup group, std::chrono::milliseconds period)
+{
+	if (group < 0 || group >= StatisticGroup_Count)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mtxSchedule);
+		m_samplingPeriod[group] = period;
+		m_scheduleChanged = true;
+	}
+	m_cvSchedule.notify_all();
+}
+
+inline std::chrono::milliseconds Statistician::CStatistician::GetSamplingPeriod(EStatisticGroup group)
+{
+	if (group < 0 || group >= StatisticGroup_Count)
+		return std::chrono::milliseconds(0);
+
+	std::lock_guard<std::mutex> lock(m_mtxSchedule);
+	return m_samplingPeriod[group];
+}
+
 inline std::string Statistician::CStatistician::PrintStatistics()
 {
 	try
 	{
-		std::stringstream().swap(m_strStatistics);
-		m_strStatistics << " Statistics:" << std::endl;
-
-		if (m_deviceClass == Pylon::BaslerUsbDeviceClass)
-		{
-			m_strStatistics << "  Grab Engine:" << std::endl;
-			m_strStatistics << "   Total Processed Buffers                : " << totalBuffers << std::endl;
-			m_strStatistics << "   Total Failed Buffers                   : " << failedBuffers << std::endl;
-			m_strStatistics << "   Last BlockID (starts at 0)             : " << lastBlockID << std::endl;
-			m_strStatistics << "   Total Missed Frames                    : " << missedFrameCount << std::endl;
-			m_strStatistics << "   Last Failed Buffer Status              : " << lastFailedBufferStatus << std::endl;
-			m_strStatistics << "   Last Failed Buffer Status Text         : " << lastFailedBufferStatusText.substr(0, lastFailedBufferStatusText.size() - 1) << std::endl; // remove the newline built into this error message string.
-			for (std::set<Pylon::String_t>::iterator it = lastFailedBufferStatusTextList.begin(); it != lastFailedBufferStatusTextList.end(); ++it)
-				m_strStatistics << "   Other Failed Buffer Status Text logged : " << *it; // newline is built into this error message string.
-
-			m_strStatistics << "  Transport Layer:" << std::endl;
-			m_strStatistics << "   Read Pipe Reset Count                  : " << readPipeResetCount << std::endl;
-			m_strStatistics << "   Write Pipe Reset Count                 : " << writePipeResetCount << std::endl;
-			m_strStatistics << "   Read Operations Failed Count           : " << readOperationsFailedCount << std::endl;
-			m_strStatistics << "   Write Operations Failed Count          : " << writeOperationsFailedCount << std::endl;
-			m_strStatistics << "   Last Error Status                      : " << tlLastErrorStatus << std::endl;
-			m_strStatistics << "   Last Error Status Text                 : " << tlLastErrorStatusText.substr(0, tlLastErrorStatusText.size() - 1) << std::endl; // remove the newline built into this error message string.
-			for (std::set<Pylon::String_t>::iterator it = tlLastErrorStatusTextList.begin(); it != tlLastErrorStatusTextList.end(); ++it)
-				m_strStatistics << "   Other Error Status Text logged     : " << *it; // newline is built into this error message string.
-			m_strStatistics << "   EPU                                    : " << EPU << std::endl;
-			m_strStatistics << "   PE                                     : " << PE << std::endl;
-			m_strStatistics << "   UR                                     : " << UR << std::endl;
-			m_strStatistics << "   EPR                                    : " << EPR << std::endl;
-			m_strStatistics << "   LE                                     : " << LE << std::endl;
-			m_strStatistics << "   LR                                     : " << LR << std::endl;
-		}
+		if (m_printBuffer.empty())
+			m_printBuffer.resize(16 * 1024);
 
-		if (m_deviceClass == Pylon::BaslerGigEDeviceClass)
+		size_t length = PrintStatistics(&m_printBuffer[0], m_printBuffer.size());
+		if (length >= m_printBuffer.size())
 		{
-			m_strStatistics << "  Camera:" << std::endl;
-			m_strStatistics << "   Last Error                             : " << lastError.substr(0, tlLastErrorStatusText.size() - 1) << std::endl;
-			for (std::set<Pylon::String_t>::iterator it = lastErrorList.begin(); it != lastErrorList.end(); ++it)
-				m_strStatistics << "   Other Errors logged                    : " << *it; // newline is built into this error message string.
-			m_strStatistics << "  Grab Engine:" << std::endl;
-			m_strStatistics << "   Total Frames Received                  : " << totalBuffers << std::endl;
-			m_strStatistics << "   Total Failed Buffers                   : " << failedBuffers << std::endl;
-			m_strStatistics << "   Total buffer underruns                 : " << bufferUnderruns << std::endl;
-
-			m_strStatistics << "  Transport Layer:" << std::endl;
-			m_strStatistics << "   Total Packets Received                 : " << totalPackets << std::endl;
-			m_strStatistics << "   Total Packet Resend Requests           : " << resendRequests << std::endl;
-			m_strStatistics << "   Total Resent Packets                   : " << resendPackets << std::endl;
-			// TODO Issue #22
-			// I get failed packets = 0 even when results fail?
-			m_strStatistics << "   Total Failed (unrecoverable) Packets   : " << failedPackets << std::endl;
+			m_printBuffer.resize(length + 1);
+			length = PrintStatistics(&m_printBuffer[0], m_printBuffer.size());
 		}
 
-		return m_strStatistics.str();
-	}
-	catch (GenICam::GenericException& e)
-	{
-		std::cout << __FUNCTION__ << e.GetDescription() << std::endl; // just to satisfy compilier warning about unreferenced local variable.
-		return m_strStatistics.str();
+		return std::string(&m_printBuffer[0], std::min(length, m_printBuffer.size() - 1));
 	}
 	catch (std::exception& e)
 	{
 		std::cout << __FUNCTION__ << e.what() << std::endl; // just to satisfy compilier warning about unreferenced local variable.
-		return m_strStatistics.str();
+		return std::string();
 	}
 }
 
+inline size_t Statistician::CStatistician::PrintStatistics(char *buffer, size_t size, EOutputFormat format, const char *source) const
+{
+	StatisticsSnapshot stats;
+	GetSnapshot(stats);
+	return FormatStatistics(stats, format, buffer, size, source);
+}
+
 // *********************************************************************************************************
 #endif
\ No newline at end of file
@@ -0,0 +1,435 @@
+// StatisticianPool.h
+// Collects statistics from many cameras with a small, shared set of sampling threads
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICIANPOOL_H
+#define STATISTICIANPOOL_H
+
+#include "Statistician.h"
+#include <memory>
+#include <queue>
+#include <functional>
+#include <string>
+#include <stdexcept>
+
+namespace Statistician
+{
+	// Statistics of every camera in a pool, plus fleet-wide totals of every cumulative counter
+	// and boolean of the schema. Totals only include cameras that report the counter (counters of
+	// -1 are skipped).
+	struct StatisticsFleetSnapshot
+	{
+		std::vector<StatisticsSnapshot> cameras;	// same order as registration; unregistered cameras are left out
+		size_t camerasSampling;						// cameras still being sampled
+		int64_t totals[Counter_Count];				// per ECounter; -1 for counters that are not cumulative (gauges)
+		size_t camerasTrue[Statistic_Count];		// per boolean EStatistic, cameras where it is true; 0 for the others
+	};
+
+	class CStatisticianHandle;
+
+	// Samples many cameras with a small number of worker threads. Every camera keeps its own
+	// per-group sampling periods (see CStatistician::SetSamplingPeriod). Cameras wait in a
+	// deadline-ordered timer queue; whichever worker is free takes the camera that is due next,
+	// so the thread count depends on the number of cores, not on the number of cameras.
+	class CStatisticianPool
+	{
+	private:
+		typedef std::chrono::steady_clock clock_type;
+		typedef std::pair<clock_type::time_point, size_t> due_type; // deadline, camera index
+
+		std::vector<std::unique_ptr<CStatistician> > m_statisticians;	// NULL once unregistered
+		std::vector<std::string> m_names;
+		std::vector<bool> m_sampling;
+		std::vector<bool> m_busy;					// a worker is sampling the camera
+		std::priority_queue<due_type, std::vector<due_type>, std::greater<due_type> > m_timerQueue;
+		std::vector<std::thread> m_workers;
+		size_t m_maxWorkers;						// workers are added up to this as cameras are registered
+		mutable size_t m_readers;					// snapshot copies in progress without the lock
+		mutable std::mutex m_mtx;
+		std::condition_variable m_cv;
+		mutable std::condition_variable m_cvIdle;	// a camera is no longer sampled or read
+		bool m_stop;
+		void Work();
+		size_t Add(std::unique_ptr<CStatistician> statistician, const char *name);
+		void AddWorkers();
+		CStatistician *BeginRead(size_t index) const;
+		void EndRead(size_t reads) const;
+		friend class CStatisticianHandle;
+
+	public:
+		CStatisticianPool();
+		~CStatisticianPool();
+
+		// Creates and initializes a statistician for an open camera. Returns its index in the pool.
+		// Cameras can be registered while the pool is running. A camera is named by its serial
+		// number, a source by 'name' or else "camera<index>".
+#ifndef STATISTICIAN_NO_PYLON
+		size_t Register(Pylon::CInstantCamera &camera);
+		void Register(Pylon::CInstantCameraArray &cameras);
+#endif
+		size_t Register(IStatisticsSource &source, const char *name = NULL);
+
+		// Stops sampling a camera and destroys its statistician, which lets go of the camera or
+		// source; it can be closed or destroyed afterwards. Waits for a worker that is sampling it,
+		// so it must not be called from a listener of the pool's cameras. The index is not reused. Returns false if the index was never registered or is gone.
+		bool Unregister(size_t index);
+
+		// Indices run from 0 to GetSize() - 1, including unregistered cameras.
+		size_t GetSize() const;
+		bool IsRegistered(size_t index) const;
+		std::string GetName(size_t index) const;
+		bool GetSnapshot(size_t index, StatisticsSnapshot &snapshot) const;	// false if unregistered
+
+		// Starts the workers. With workerCount 0 the count is derived from the number of cores and
+		// grows with the cameras registered, also those registered after Start().
+		bool Start(size_t workerCount = 0);
+		bool Stop();
+
+		StatisticsFleetSnapshot GetFleetSnapshot() const;
+	};
+
+	// Access to the statistician of a camera in a pool, e.g. to change its sampling periods:
+	//   CStatisticianHandle statistician(pool, index);
+	//   if (statistician.IsValid() == true)
+	//       statistician->SetSamplingPeriod(StatisticGroup_Temperature, std::chrono::seconds(10));
+	// The statistician stays alive while the handle exists: Unregister() waits for the handle to be
+	// destroyed, so keep handles short-lived and never call Unregister() while holding one.
+	class CStatisticianHandle
+	{
+	private:
+		const CStatisticianPool &m_pool;
+		CStatistician *m_statistician;			// NULL if the camera was not registered
+
+		// not copyable
+		CStatisticianHandle(const CStatisticianHandle&);
+		CStatisticianHandle &operator=(const CStatisticianHandle&);
+
+	public:
+		CStatisticianHandle(const CStatisticianPool &pool, size_t index);	// throws std::out_of_range if never registered
+		~CStatisticianHandle();
+		bool IsValid() const;					// false if the camera was unregistered
+		CStatistician *operator->() const;
+		CStatistician &operator*() const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CStatisticianPool::CStatisticianPool()
+	: m_maxWorkers(0)
+	, m_readers(0)
+	, m_stop(true)
+{
+}
+
+inline Statistician::CStatisticianPool::~CStatisticianPool()
+{
+	this->Stop();
+}
+
+#ifndef STATISTICIAN_NO_PYLON
+inline size_t Statistician::CStatisticianPool::Register(Pylon::CInstantCamera &camera)
+{
+	std::unique_ptr<CStatistician> statistician(new CStatistician());
+	statistician->Initialize(camera);
+	return Add(std::move(statistician), camera.GetDeviceInfo().GetSerialNumber().c_str());
+}
+
+inline void Statistician::CStatisticianPool::Register(Pylon::CInstantCameraArray &cameras)
+{
+	for (size_t i = 0; i < cameras.GetSize(); i++)
+		Register(cameras[i]);
+}
+#endif
+
+inline size_t Statistician::CStatisticianPool::Register(IStatisticsSource &source, const char *name)
+{
+	std::unique_ptr<CStatistician> statistician(new CStatistician());
+	statistician->Initialize(source);
+	return Add(std::move(statistician), name);
+}
+
+inline size_t Statistician::CStatisticianPool::Add(std::unique_ptr<CStatistician> statistician, const char *name)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	size_t index = m_statisticians.size();
+	m_statisticians.push_back(std::move(statistician));
+	m_names.push_back((name != NULL) ? name : "camera" + std::to_string(static_cast<unsigned long long>(index)));
+	m_sampling.push_back(true);
+	m_busy.push_back(false);
+	m_timerQueue.push(due_type(clock_type::now(), index));
+	AddWorkers();
+	m_cv.notify_one();
+	return index;
+}
+
+inline void Statistician::CStatisticianPool::AddWorkers()
+{
+	// called with the lock held; more workers than cameras is pointless.
+	if (m_stop == true)
+		return;
+
+	size_t workerCount = std::min(m_maxWorkers, std::max<size_t>(1, m_statisticians.size()));
+	while (m_workers.size() < workerCount)
+		m_workers.push_back(std::thread(&Statistician::CStatisticianPool::Work, this));
+}
+
+inline bool Statistician::CStatisticianPool::Unregister(size_t index)
+{
+	std::unique_ptr<CStatistician> statistician;
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		if (index >= m_statisticians.size() || m_statisticians[index] == NULL)
+			return false;
+
+		// the camera leaves the timer queue when a worker takes it next; until then, its
+		// statistician has to stay for whoever samples or reads it now.
+		statistician = std::move(m_statisticians[index]);
+		m_sampling[index] = false;
+		m_cvIdle.wait(lock, [this, index] { return m_busy[index] == false && m_readers == 0; });
+	}
+
+	// destroyed without the lock: it stops its own thread and lets go of the camera.
+	statistician.reset();
+	return true;
+}
+
+inline size_t Statistician::CStatisticianPool::GetSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_statisticians.size();
+}
+
+inline bool Statistician::CStatisticianPool::IsRegistered(size_t index) const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return index < m_statisticians.size() && m_statisticians[index] != NULL;
+}
+
+inline std::string Statistician::CStatisticianPool::GetName(size_t index) const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_names.at(index);
+}
+
+inline Statistician::CStatistician *Statistician::CStatisticianPool::BeginRead(size_t index) const
+{
+	// called with the lock held. Unregister() waits for EndRead() before destroying anything.
+	CStatistician *statistician = m_statisticians.at(index).get();
+	if (statistician != NULL)
+		m_readers++;
+	return statistician;
+}
+
+inline void Statistician::CStatisticianPool::EndRead(size_t reads) const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_readers -= reads;
+	if (m_readers == 0)
+		m_cvIdle.notify_all();
+}
+
+inline bool Statistician::CStatisticianPool::GetSnapshot(size_t index, StatisticsSnapshot &snapshot) const
+{
+	const CStatistician *statistician = NULL;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		statistician = BeginRead(index);
+	}
+	if (statistician == NULL)
+		return false;
+
+	// snapshots are lock-free, so no pool lock is held while copying.
+	statistician->GetSnapshot(snapshot);
+	EndRead(1);
+	return true;
+}
+
+inline bool Statistician::CStatisticianPool::Start(size_t workerCount)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_stop == false)
+		return false;
+
+	m_stop = false;
+	if (workerCount == 0)
+	{
+		// sampling threads spend most of their time waiting on the transport layer,
+		// so a quarter of the cores is plenty. Register() adds workers up to that.
+		m_maxWorkers = std::max<size_t>(1, std::thread::hardware_concurrency() / 4);
+		AddWorkers();
+	}
+	else
+	{
+		m_maxWorkers = workerCount;
+		while (m_workers.size() < workerCount)
+			m_workers.push_back(std::thread(&Statistician::CStatisticianPool::Work, this));
+	}
+
+	return true;
+}
+
+inline bool Statistician::CStatisticianPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		if (m_workers[i].joinable())
+			m_workers[i].join();
+	}
+	m_workers.clear();
+
+	return true;
+}
+
+inline void Statistician::CStatisticianPool::Work()
+{
+	std::unique_lock<std::mutex> lock(m_mtx);
+	while (m_stop == false)
+	{
+		if (m_timerQueue.empty())
+		{
+			m_cv.wait(lock);
+			continue;
+		}
+
+		due_type due = m_timerQueue.top();
+		if (due.first > clock_type::now())
+		{
+			// another worker may take an earlier deadline in the meantime; we get notified then.
+			m_cv.wait_until(lock, due.first);
+			continue;
+		}
+
+		// the camera leaves the queue while it is sampled, so no two workers sample it at once.
+		m_timerQueue.pop();
+		CStatistician *statistician = m_statisticians[due.second].get();
+		if (statistician == NULL)
+			continue; // unregistered while it waited
+		m_busy[due.second] = true;
+		lock.unlock();
+
+		clock_type::time_point wakeup;
+		bool isSampling = statistician->SampleDue(clock_type::now(), wakeup);
+
+		// with every group disabled, look again later in case a period was set in the meantime.
+		if (wakeup == clock_type::time_point::max())
+			wakeup = clock_type::now() + std::chrono::seconds(1);
+
+		lock.lock();
+		m_busy[due.second] = false;
+		if (m_statisticians[due.second] == NULL)
+		{
+			// Unregister() waits for this sample to end before it destroys the statistician.
+			m_cvIdle.notify_all();
+			continue;
+		}
+
+		m_sampling[due.second] = isSampling;
+		if (isSampling == true)
+		{
+			m_timerQueue.push(due_type(wakeup, due.second));
+			m_cv.notify_one();
+		}
+	}
+}
+
+inline Statistician::StatisticsFleetSnapshot Statistician::CStatisticianPool::GetFleetSnapshot() const
+{
+	StatisticsFleetSnapshot fleet;
+	fleet.camerasSampling = 0;
+	for (int i = 0; i < Counter_Count; i++)
+		fleet.totals[i] = (GetCounterInfo(static_cast<ECounter>(i)).cumulative == true) ? 0 : -1;
+	for (int i = 0; i < Statistic_Count; i++)
+		fleet.camerasTrue[i] = 0;
+
+	std::vector<const CStatistician*> statisticians;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		statisticians.reserve(m_statisticians.size());
+		for (size_t i = 0; i < m_statisticians.size(); i++)
+		{
+			const CStatistician *statistician = BeginRead(i);
+			if (statistician == NULL)
+				continue;
+			statisticians.push_back(statistician);
+			if (m_sampling[i] == true)
+				fleet.camerasSampling++;
+		}
+	}
+
+	// snapshots are lock-free, so no pool lock is held while copying them.
+	fleet.cameras.resize(statisticians.size());
+	for (size_t i = 0; i < statisticians.size(); i++)
+	{
+		const StatisticsSnapshot &stats = fleet.cameras[i];
+		statisticians[i]->GetSnapshot(fleet.cameras[i]);
+
+		for (int counter = 0; counter < Counter_Count; counter++)
+		{
+			const SCounterInfo &info = GetCounterInfo(static_cast<ECounter>(counter));
+			if (info.cumulative == true)
+				fleet.totals[counter] += std::max<int64_t>(0, stats.*info.field);
+		}
+		for (int statistic = 0; statistic < Statistic_Count; statistic++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(statistic));
+			if (info.type == StatisticType_Boolean && *reinterpret_cast<const bool*>(reinterpret_cast<const char*>(&stats) + info.offset) == true)
+				fleet.camerasTrue[statistic]++;
+		}
+	}
+
+	EndRead(statisticians.size());
+	return fleet;
+}
+
+inline Statistician::CStatisticianHandle::CStatisticianHandle(const CStatisticianPool &pool, size_t index)
+	: m_pool(pool)
+	, m_statistician(NULL)
+{
+	std::lock_guard<std::mutex> lock(pool.m_mtx);
+	m_statistician = pool.BeginRead(index);
+}
+
+inline Statistician::CStatisticianHandle::~CStatisticianHandle()
+{
+	if (m_statistician != NULL)
+		m_pool.EndRead(1);
+}
+
+inline bool Statistician::CStatisticianHandle::IsValid() const
+{
+	return m_statistician != NULL;
+}
+
+inline Statistician::CStatistician *Statistician::CStatisticianHandle::operator->() const
+{
+	return m_statistician;
+}
+
+inline Statistician::CStatistician &Statistician::CStatisticianHandle::operator*() const
+{
+	return *m_statistician;
+}
+
+// *********************************************************************************************************
+#endif
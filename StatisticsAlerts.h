@@ -0,0 +1,495 @@
+// StatisticsAlerts.h
+// Evaluates alert rules on every sample and calls handlers on a separate thread
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSALERTS_H
+#define STATISTICSALERTS_H
+
+#include "Statistician.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+
+namespace Statistician
+{
+	enum EAlertRule
+	{
+		AlertRule_Above,		// value > threshold
+		AlertRule_Below,		// value < threshold
+		AlertRule_RateAbove,	// change per second over the window > threshold
+		AlertRule_Anomaly,		// value (gauges) or rate between two reads (counters) strays from its EWMA
+		AlertRule_Rising,		// value goes from 0 to non-zero (booleans: false to true)
+		AlertRule_Falling		// value goes from non-zero to 0
+	};
+
+	// One raised or cleared alert, as handed to the handlers.
+	struct SAlert
+	{
+		size_t rule;			// id returned by Add...()
+		const char *ruleName;	// owned by the engine
+		size_t source;			// in order of AddSource()
+		const char *sourceName;	// owned by the engine
+		bool raised;			// false: the condition no longer holds (never for edge rules)
+		EStatistic statistic;
+		double value;			// what the rule looked at: value, rate, or deviation from the EWMA
+		double threshold;		// anomaly rules: the number of deviations
+		int64_t timestampUs;	// of the sample that changed the alert
+	};
+
+	class IAlertHandler
+	{
+	public:
+		virtual ~IAlertHandler() {}
+		virtual void OnAlert(const SAlert &alert) = 0;
+	};
+
+	// Rules are checked on the sampling thread, right after a sample is published, against the
+	// compiled rule table: a field offset, a type and a few numbers per rule, plus a small state
+	// per rule and source. Nothing is parsed, looked up or allocated per sample. Alerts go into a
+	// bounded queue; a dispatch thread calls the handlers, so a slow handler never delays sampling.
+	// If the queue is full, alerts are dropped and counted (see GetDroppedCount()).
+	//
+	// A counter only changes when its group is read, and the groups have their own periods. So
+	// counter rules only look at snapshots that read the counter's group
+	// (StatisticsSnapshot::sampledGroups); the others would show a rate of 0 and then one that is
+	// too high.
+	//
+	// Add rules and handlers first, then sources, then Start():
+	//   alerts.AddRate("resends", Statistic_ResendRequests, 50.0, std::chrono::seconds(5));
+	//   alerts.AddEdge("over temperature", Statistic_OverTemp, AlertRule_Rising);
+	//   alerts.AddHandler(&myHandler);
+	//   myStatistician.AddListener(alerts.AddSource(serialNumber));
+	//   alerts.Start();
+	// Only integer, boolean and register statistics can have rules.
+	class CStatisticsAlerts
+	{
+	private:
+		class CSourceListener : public IStatisticsListener
+		{
+		private:
+			CStatisticsAlerts *m_alerts;
+			size_t m_source;
+		public:
+			CSourceListener(CStatisticsAlerts *alerts, size_t source) : m_alerts(alerts), m_source(source) {}
+			void OnStatistics(const StatisticsSnapshot &snapshot) { m_alerts->Evaluate(snapshot, m_source); }
+		};
+
+		// A rule, compiled.
+		struct SRule
+		{
+			EAlertRule type;
+			EStatistic statistic;
+			EStatisticType valueType;
+			bool isCounter;
+			EStatisticGroup group;	// counters: the group that reads them
+			size_t offset;
+			double threshold;
+			int64_t windowUs;		// rate rules
+			double alpha;			// anomaly rules
+			double deviations;		// anomaly rules
+			double minDeviation;	// anomaly rules
+			std::string name;
+		};
+
+		static const size_t c_rateSamples = 128;	// per rate rule and source; older samples fall out of the window
+
+		// What a rule remembers about one source.
+		struct SRuleState
+		{
+			bool active;
+			bool hasPrevious;
+			double previous;
+			int64_t previousUs;
+			double mean;			// anomaly: EWMA of the value
+			double variance;		// anomaly: EWMA of the squared deviation
+			uint32_t samples;		// anomaly: samples seen, for the warm-up
+			size_t first;			// rate: ring of samples inside the window
+			size_t count;
+		};
+
+		struct SRateSample
+		{
+			int64_t timestampUs;
+			double value;
+		};
+
+		struct SSource
+		{
+			std::string name;
+			std::vector<SRuleState> states;			// one per rule
+			std::vector<SRateSample> rateSamples;	// c_rateSamples per rule
+		};
+
+		static const size_t c_queueSize = 1024;
+
+		std::vector<SRule> m_rules;
+		std::vector<IAlertHandler*> m_handlers;
+		std::vector<std::unique_ptr<SSource> > m_sources;
+		std::vector<std::unique_ptr<CSourceListener> > m_listeners;
+		std::vector<SAlert> m_queue;		// ring of c_queueSize alerts
+		size_t m_queueFirst;
+		size_t m_queueCount;
+		uint64_t m_dropped;
+		std::thread m_dispatcher;
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		bool m_stop;
+
+		size_t AddRule(const SRule &rule);
+		void Evaluate(const StatisticsSnapshot &snapshot, size_t source);
+		bool Check(const SRule &rule, SRuleState &state, SRateSample *rateSamples, double value, int64_t timestampUs, double &observed);
+		void Post(const SRule &rule, size_t ruleIndex, const SSource &source, size_t sourceIndex, bool raised, double observed, int64_t timestampUs);
+		void Dispatch();
+		static double GetValue(const StatisticsSnapshot &snapshot, const SRule &rule, bool &valid);
+
+	public:
+		CStatisticsAlerts();
+		~CStatisticsAlerts();
+
+		// Each returns the rule id, or (size_t)-1 if the statistic can't have rules or sources
+		// were already added.
+		size_t AddThreshold(const char *name, EStatistic statistic, EAlertRule compare, double threshold);
+		size_t AddRate(const char *name, EStatistic statistic, double perSecond, std::chrono::milliseconds window);
+		size_t AddAnomaly(const char *name, EStatistic statistic, double alpha = 0.1, double deviations = 4.0, double minDeviation = 1.0);
+		size_t AddEdge(const char *name, EStatistic statistic, EAlertRule edge);
+
+		void AddHandler(IAlertHandler *handler);
+
+		// Declares a source (camera) and returns a listener to register with its statistician.
+		// The engine owns the listener.
+		IStatisticsListener *AddSource(const char *name);
+
+		bool Start();
+		void Stop();
+
+		uint64_t GetDroppedCount();
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CStatisticsAlerts::CStatisticsAlerts()
+	: m_queueFirst(0)
+	, m_queueCount(0)
+	, m_dropped(0)
+	, m_stop(true)
+{
+	m_queue.resize(c_queueSize);
+}
+
+inline Statistician::CStatisticsAlerts::~CStatisticsAlerts()
+{
+	this->Stop();
+}
+
+inline size_t Statistician::CStatisticsAlerts::AddRule(const SRule &rule)
+{
+	const SStatisticInfo &info = GetStatisticInfo(rule.statistic);
+	if (m_sources.empty() == false || info.type == StatisticType_Text)
+		return static_cast<size_t>(-1);
+
+	m_rules.push_back(rule);
+	SRule &compiled = m_rules.back();
+	compiled.valueType = info.type;
+	compiled.isCounter = (info.kind == StatisticKind_Counter);
+	compiled.group = info.group;
+	compiled.offset = info.offset;
+	return m_rules.size() - 1;
+}
+
+inline size_t Statistician::CStatisticsAlerts::AddThreshold(const char *name, EStatistic statistic, EAlertRule compare, double threshold)
+{
+	if (compare != AlertRule_Above && compare != AlertRule_Below)
+		return static_cast<size_t>(-1);
+
+	SRule rule = SRule();
+	rule.type = compare;
+	rule.statistic = statistic;
+	rule.threshold = threshold;
+	rule.name = name;
+	return AddRule(rule);
+}
+
+inline size_t Statistician::CStatisticsAlerts::AddRate(const char *name, EStatistic statistic, double perSecond, std::chrono::milliseconds window)
+{
+	SRule rule = SRule();
+	rule.type = AlertRule_RateAbove;
+	rule.statistic = statistic;
+	rule.threshold = perSecond;
+	rule.windowUs = std::chrono::duration_cast<std::chrono::microseconds>(window).count();
+	rule.name = name;
+	return AddRule(rule);
+}
+
+inline size_t Statistician::CStatisticsAlerts::AddAnomaly(const char *name, EStatistic statistic, double alpha, double deviations, double minDeviation)
+{
+	if (alpha <= 0.0 || alpha > 1.0)
+		return static_cast<size_t>(-1);
+
+	SRule rule = SRule();
+	rule.type = AlertRule_Anomaly;
+	rule.statistic = statistic;
+	rule.threshold = deviations;
+	rule.alpha = alpha;
+	rule.deviations = deviations;
+	rule.minDeviation = minDeviation;
+	rule.name = name;
+	return AddRule(rule);
+}
+
+inline size_t Statistician::CStatisticsAlerts::AddEdge(const char *name, EStatistic statistic, EAlertRule edge)
+{
+	if (edge != AlertRule_Rising && edge != AlertRule_Falling)
+		return static_cast<size_t>(-1);
+
+	SRule rule = SRule();
+	rule.type = edge;
+	rule.statistic = statistic;
+	rule.name = name;
+	return AddRule(rule);
+}
+
+inline void Statistician::CStatisticsAlerts::AddHandler(IAlertHandler *handler)
+{
+	if (handler != NULL)
+		m_handlers.push_back(handler);
+}
+
+inline Statistician::IStatisticsListener *Statistician::CStatisticsAlerts::AddSource(const char *name)
+{
+	std::unique_ptr<SSource> source(new SSource());
+	source->name = (name != NULL) ? name : "";
+	source->states.assign(m_rules.size(), SRuleState());
+	source->rateSamples.resize(m_rules.size() * c_rateSamples);
+
+	m_sources.push_back(std::move(source));
+	m_listeners.push_back(std::unique_ptr<CSourceListener>(new CSourceListener(this, m_sources.size() - 1)));
+	return m_listeners.back().get();
+}
+
+inline bool Statistician::CStatisticsAlerts::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_stop == false)
+		return false;
+
+	m_stop = false;
+	m_dispatcher = std::thread(&Statistician::CStatisticsAlerts::Dispatch, this);
+	return true;
+}
+
+inline void Statistician::CStatisticsAlerts::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	if (m_dispatcher.joinable())
+		m_dispatcher.join();
+}
+
+inline uint64_t Statistician::CStatisticsAlerts::GetDroppedCount()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_dropped;
+}
+
+inline double Statistician::CStatisticsAlerts::GetValue(const StatisticsSnapshot &snapshot, const SRule &rule, bool &valid)
+{
+	const char *field = reinterpret_cast<const char*>(&snapshot) + rule.offset;
+	valid = IsStatisticAvailable(snapshot, rule.statistic);
+
+	if (rule.valueType == StatisticType_Boolean)
+		return *reinterpret_cast<const bool*>(field) ? 1.0 : 0.0;
+
+	if (rule.valueType == StatisticType_Register)
+		return static_cast<double>(*reinterpret_cast<const uint64_t*>(field));
+
+	int64_t value = *reinterpret_cast<const int64_t*>(field);
+	if (value < 0 && rule.isCounter == true)
+		valid = false; // not read yet
+	return static_cast<double>(value);
+}
+
+inline void Statistician::CStatisticsAlerts::Evaluate(const StatisticsSnapshot &snapshot, size_t sourceIndex)
+{
+	// called by the source's sampling thread; only this thread touches the source's state.
+	SSource &source = *m_sources[sourceIndex];
+
+	for (size_t i = 0; i < m_rules.size(); i++)
+	{
+		const SRule &rule = m_rules[i];
+		if (rule.isCounter == true && (snapshot.sampledGroups & (static_cast<uint32_t>(1) << rule.group)) == 0)
+			continue;
+
+		bool valid = false;
+		double value = GetValue(snapshot, rule, valid);
+		if (valid == false)
+			continue;
+
+		SRuleState &state = source.states[i];
+		double observed = value;
+		bool active = Check(rule, state, &source.rateSamples[i * c_rateSamples], value, snapshot.timestampUs, observed);
+
+		if (rule.type == AlertRule_Rising || rule.type == AlertRule_Falling)
+		{
+			// edges only raise.
+			if (active == true)
+				Post(rule, i, source, sourceIndex, true, observed, snapshot.timestampUs);
+		}
+		else if (active != state.active)
+		{
+			state.active = active;
+			Post(rule, i, source, sourceIndex, active, observed, snapshot.timestampUs);
+		}
+	}
+}
+
+inline bool Statistician::CStatisticsAlerts::Check(const SRule &rule, SRuleState &state, SRateSample *rateSamples, double value, int64_t timestampUs, double &observed)
+{
+	bool active = false;
+
+	switch (rule.type)
+	{
+	case AlertRule_Above:
+		active = value > rule.threshold;
+		break;
+
+	case AlertRule_Below:
+		active = value < rule.threshold;
+		break;
+
+	case AlertRule_Rising:
+		active = state.hasPrevious == true && state.previous == 0.0 && value != 0.0;
+		break;
+
+	case AlertRule_Falling:
+		active = state.hasPrevious == true && state.previous != 0.0 && value == 0.0;
+		break;
+
+	case AlertRule_RateAbove:
+	{
+		// samples arrive in time order, so the window is a ring that drops from the front.
+		if (state.count == c_rateSamples)
+		{
+			state.first = (state.first + 1) % c_rateSamples;
+			state.count--;
+		}
+		SRateSample &newest = rateSamples[(state.first + state.count) % c_rateSamples];
+		newest.timestampUs = timestampUs;
+		newest.value = value;
+		state.count++;
+
+		while (state.count > 2 && timestampUs - rateSamples[(state.first + 1) % c_rateSamples].timestampUs >= rule.windowUs)
+		{
+			state.first = (state.first + 1) % c_rateSamples;
+			state.count--;
+		}
+
+		const SRateSample &oldest = rateSamples[state.first];
+		observed = 0.0;
+		if (state.count >= 2 && timestampUs > oldest.timestampUs)
+			observed = (value - oldest.value) * 1e6 / static_cast<double>(timestampUs - oldest.timestampUs);
+		active = observed > rule.threshold;
+		break;
+	}
+
+	case AlertRule_Anomaly:
+	{
+		// counters are judged by their rate between samples, gauges by their value.
+		double x = value;
+		if (rule.isCounter == true)
+		{
+			if (state.hasPrevious == false || timestampUs <= state.previousUs)
+				break;
+			x = (value - state.previous) * 1e6 / static_cast<double>(timestampUs - state.previousUs);
+		}
+
+		if (state.samples == 0)
+			state.mean = x;
+
+		double deviation = x - state.mean;
+		double limit = std::max(rule.deviations * std::sqrt(state.variance), rule.minDeviation);
+		observed = deviation;
+
+		// the EWMA needs about 1/alpha samples before it means anything.
+		active = state.samples >= static_cast<uint32_t>(1.0 / rule.alpha) && std::fabs(deviation) > limit;
+
+		state.mean += rule.alpha * deviation;
+		state.variance = (1.0 - rule.alpha) * (state.variance + rule.alpha * deviation * deviation);
+		state.samples++;
+		break;
+	}
+	}
+
+	state.hasPrevious = true;
+	state.previous = value;
+	state.previousUs = timestampUs;
+	return active;
+}
+
+inline void Statistician::CStatisticsAlerts::Post(const SRule &rule, size_t ruleIndex, const SSource &source, size_t sourceIndex, bool raised, double observed, int64_t timestampUs)
+{
+	SAlert alert;
+	alert.rule = ruleIndex;
+	alert.ruleName = rule.name.c_str();
+	alert.source = sourceIndex;
+	alert.sourceName = source.name.c_str();
+	alert.raised = raised;
+	alert.statistic = rule.statistic;
+	alert.value = observed;
+	alert.threshold = rule.threshold;
+	alert.timestampUs = timestampUs;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		if (m_queueCount == c_queueSize)
+		{
+			m_dropped++;
+			return;
+		}
+		m_queue[(m_queueFirst + m_queueCount) % c_queueSize] = alert;
+		m_queueCount++;
+	}
+	m_cv.notify_one();
+}
+
+inline void Statistician::CStatisticsAlerts::Dispatch()
+{
+	std::unique_lock<std::mutex> lock(m_mtx);
+	while (true)
+	{
+		m_cv.wait(lock, [this] { return m_stop == true || m_queueCount > 0; });
+		if (m_queueCount == 0)
+			return; // stopped, and everything is delivered
+
+		SAlert alert = m_queue[m_queueFirst];
+		m_queueFirst = (m_queueFirst + 1) % c_queueSize;
+		m_queueCount--;
+
+		lock.unlock();
+		for (size_t i = 0; i < m_handlers.size(); i++)
+			m_handlers[i]->OnAlert(alert);
+		lock.lock();
+	}
+}
+
+// *********************************************************************************************************
+#endif
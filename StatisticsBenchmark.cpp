@@ -0,0 +1,545 @@
+// StatisticsBenchmark.cpp
+// Measures what sampling statistics costs a grab loop, with simulated cameras
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Usage: StatisticsBenchmark [options]
+//   --gige              simulate GigE cameras (default: USB)
+//   --cameras <n>       number of cameras, each with its own grab thread (default 1)
+//   --seconds <s>       run time of each mode (default 5)
+//   --fps <n>           frame rate of every camera (default 100)
+//   --work <n>          checksum passes over every frame, the grab loop's image processing (default 20)
+//   --buffers <n>       frames the grab loop may fall behind before frames are dropped (default 10)
+//   --read-cost <us>    CPU time of every simulated node and port read (default 20)
+//   --period <ms>       sampling period of the grabber and transport groups (default: the statistician's)
+//   --script <file>     events for every camera (see SimulatedCamera.h)
+//   --seed <n>          random seed of the first camera; camera i uses seed + i (default 1)
+//   --micro <name>      run a microbenchmark instead of the grab loops:
+//                         probes     cost of reading the statistic nodes of a sample, looked up by
+//                                    name every time and from the probe plan; --read-cost 0 shows
+//                                    the lookups alone
+//                         frames     cost of CFrameStatistics::OnFrame() per frame, with the host
+//                                    time given and read by OnFrame() itself
+//                         formatter  cost of one FormatStatistics() call per output format, called
+//                                    at 1 kHz
+//                         registers  latency of one read of the USB error registers, per register,
+//                                    in blocks around the undocumented addresses (the default) and
+//                                    as one 32-byte block
+//   --iterations <n>    passes of a microbenchmark (default 10000; frames: 1000000;
+//                       formatter: 1000, one second)
+//
+// Every mode (see SamplingBenchmark.h) runs for --seconds in real time: off, polling, paced and
+// event-driven. A frame arrives every 1/fps; the grab loop waits for it, processes it and records
+// the time from arrival to the end of processing as its latency. Sampling competes with the grab
+// loops for the CPU, so its cost shows as lower frame rates, dropped frames and higher latency.
+
+// No pylon dependency: the statistician samples simulated cameras only.
+#define STATISTICIAN_NO_PYLON
+#include "Statistician.h"
+#include "SamplingBenchmark.h"
+#include "SimulatedCamera.h"
+#include "StatisticsFormatter.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+using namespace Statistician;
+
+// What one grab thread did.
+struct SGrabLoop
+{
+	CFrameStatistics frames;
+	uint64_t bytes;
+	uint32_t checksum;		// kept, so the processing is not optimized away
+};
+
+// Receives frames at 'fps' from 'start' to 'end', like RetrieveResult() in a grab loop. A frame
+// that arrives while the loop is more than 'bufferCount' frames behind finds no free buffer and is
+// dropped, which shows as a BlockID gap.
+static void Grab(SGrabLoop *loop, double fps, int workPasses, int64_t bufferCount, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+	vector<uint32_t> image(static_cast<size_t>(CSimulatedCamera::c_payloadSize / 4), 1);
+	const int64_t periodNs = static_cast<int64_t>(1e9 / fps);
+	const chrono::nanoseconds maxBehind(periodNs * bufferCount);
+	loop->bytes = 0;
+	loop->checksum = 0;
+
+	for (uint64_t blockId = 0;; blockId++)
+	{
+		chrono::steady_clock::time_point arrival = start + chrono::nanoseconds(static_cast<int64_t>(blockId) * periodNs);
+		if (arrival >= end)
+			break;
+
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now < arrival)
+			this_thread::sleep_until(arrival);
+		else if (now - arrival > maxBehind)
+			continue;
+
+		for (int pass = 0; pass < workPasses; pass++)
+		{
+			uint32_t sum = static_cast<uint32_t>(pass);
+			for (size_t i = 0; i < image.size(); i++)
+				sum = sum * 31 + image[i];
+			loop->checksum ^= sum;
+		}
+		loop->bytes += image.size() * sizeof(uint32_t);
+
+		// the camera timestamp is the arrival time, on a 1 GHz clock.
+		int64_t hostNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+		loop->frames.OnFrame(blockId * static_cast<uint64_t>(periodNs), blockId, true, hostNs);
+	}
+}
+
+// Prints the mean, median, 99th percentile and maximum of the pass durations, in microseconds
+// or, for passes that take nanoseconds, in nanoseconds.
+static void PrintLatency(const char *label, vector<int64_t> &passNs, bool inNanoseconds = false)
+{
+	if (passNs.empty())
+		return;
+
+	sort(passNs.begin(), passNs.end());
+	int64_t totalNs = 0;
+	for (size_t i = 0; i < passNs.size(); i++)
+		totalNs += passNs[i];
+
+	const double divisor = inNanoseconds ? 1.0 : 1000.0;
+	const char *unit = inNanoseconds ? " ns" : " us";
+	cout << "  " << label << ": " << static_cast<double>(totalNs) / static_cast<double>(passNs.size()) / divisor << unit << " average, "
+		<< static_cast<double>(passNs[passNs.size() / 2]) / divisor << unit << " median, "
+		<< static_cast<double>(passNs[passNs.size() * 99 / 100]) / divisor << unit << " p99, "
+		<< static_cast<double>(passNs.back()) / divisor << unit << " max" << endl;
+}
+
+// Reads a node into its snapshot field, like CStatistician::SampleProbe().
+static void ReadNode(IStatisticNode *node, EStatisticType type, char *field)
+{
+	switch (type)
+	{
+	case StatisticType_Integer:
+		*reinterpret_cast<int64_t*>(field) = node->GetInteger();
+		break;
+	case StatisticType_Boolean:
+		*reinterpret_cast<bool*>(field) = node->GetBoolean();
+		break;
+	case StatisticType_Text:
+		node->GetText(field, c_maxTextLength);
+		break;
+	default:
+		break;
+	}
+}
+
+// Reads every statistic node of the camera 'iterations' times, once looking each node up by name
+// as the sampler did before the probe plan, and once walking a resolved table as
+// CStatistician::BuildProbePlan() makes it. The names are kept in a std::map per node map, which is
+// how GenApi's INodeMap::GetNode() finds a node.
+static void RunProbeMicro(unsigned deviceClass, size_t iterations, double readCostUs, uint64_t seed)
+{
+	struct SResolvedNode
+	{
+		const SStatisticInfo *info;
+		IStatisticNode *node;
+	};
+
+	CSimulatedCamera camera(deviceClass, seed);
+	camera.SetClock(SimulationClock_Steady);
+	camera.SetReadCost(chrono::nanoseconds(static_cast<int64_t>(readCostUs * 1000.0)));
+
+	map<string, IStatisticNode*> nodeMaps[NodeMap_TransportLayer + 1];
+	vector<SResolvedNode> plan;
+	for (int i = 0; i < Statistic_Count; i++)
+	{
+		const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+		if (info.nodeName == NULL || (info.deviceClasses & deviceClass) == 0)
+			continue;
+
+		IStatisticNode *node = camera.GetNode(info.nodeMap, info.nodeName, info.type);
+		if (node == NULL)
+			continue;
+
+		nodeMaps[info.nodeMap][info.nodeName] = node;
+		SResolvedNode resolved;
+		resolved.info = &info;
+		resolved.node = node;
+		plan.push_back(resolved);
+	}
+
+	unique_ptr<StatisticsSnapshot> snapshot(new StatisticsSnapshot());
+	char *fields = reinterpret_cast<char*>(snapshot.get());
+	vector<int64_t> byNameNs;
+	vector<int64_t> planNs;
+	byNameNs.reserve(iterations);
+	planNs.reserve(iterations);
+
+	cout << (deviceClass == DeviceClass_GigE ? "GigE" : "USB") << " statistic nodes, " << plan.size() << " per sample, " << iterations << " samples, "
+		<< readCostUs << " us per read" << endl;
+	for (size_t i = 0; i < iterations; i++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int s = 0; s < Statistic_Count; s++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(s));
+			if (info.nodeName == NULL || (info.deviceClasses & deviceClass) == 0)
+				continue;
+
+			map<string, IStatisticNode*>::const_iterator found = nodeMaps[info.nodeMap].find(info.nodeName);
+			if (found != nodeMaps[info.nodeMap].end() && found->second->IsReadable() == true)
+				ReadNode(found->second, info.type, fields + info.offset);
+		}
+		byNameNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+
+		start = chrono::steady_clock::now();
+		for (size_t p = 0; p < plan.size(); p++)
+		{
+			if (plan[p].node->IsReadable() == true)
+				ReadNode(plan[p].node, plan[p].info->type, fields + plan[p].info->offset);
+		}
+		planNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+	}
+
+	PrintLatency("by name", byNameNs);
+	PrintLatency("probe plan", planNs);
+}
+
+// Records 'iterations' frames of a 500 fps camera that loses one frame in 1000, first with the host
+// time given to OnFrame() and then with OnFrame() reading the clock. A single call is too short to
+// time on its own, so frames are timed in batches of 100 and the cost per frame of every batch is
+// printed, together with the share of a 500 fps frame period it takes.
+static void RunFrameMicro(size_t iterations)
+{
+	const size_t c_batchSize = 100;
+	const uint64_t c_periodNs = 2000000;
+	const char *labels[] = { "host time given", "host time read" };
+
+	cout << "Frame statistics, " << iterations << " frames at 500 fps" << endl;
+	for (int readsClock = 0; readsClock < 2; readsClock++)
+	{
+		unique_ptr<CFrameStatistics> frames(new CFrameStatistics());
+		vector<int64_t> frameNs;
+		frameNs.reserve(iterations / c_batchSize + 1);
+		int64_t totalNs = 0;
+
+		for (size_t first = 0; first < iterations; first += c_batchSize)
+		{
+			size_t count = min(c_batchSize, iterations - first);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			for (size_t frame = first; frame < first + count; frame++)
+			{
+				uint64_t blockId = frame + frame / 1000;
+				uint64_t timestamp = blockId * c_periodNs;
+				if (readsClock == 0)
+					frames->OnFrame(timestamp, blockId, true, static_cast<int64_t>(timestamp) + static_cast<int64_t>(frame % 7) * 1000);
+				else
+					frames->OnFrame(timestamp, blockId, true);
+			}
+			int64_t batchNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+			totalNs += batchNs;
+			frameNs.push_back(batchNs / static_cast<int64_t>(count));
+		}
+
+		cout << labels[readsClock] << ": " << frames->GetFrameCount() << " frames, " << frames->GetMissingFrameCount() << " missing, "
+			<< static_cast<double>(totalNs) / static_cast<double>(iterations) / static_cast<double>(c_periodNs) * 100.0 << "% of a frame period" << endl;
+		PrintLatency("frame", frameNs, true);
+	}
+}
+
+// Formats the snapshot of a sampled camera 'iterations' times per output format, one call every
+// millisecond as a 1 kHz monitoring loop would, and prints the cost of a call. The buffer is
+// allocated once; a call never allocates.
+static void RunFormatterMicro(unsigned deviceClass, size_t iterations, uint64_t seed)
+{
+	struct SFormat
+	{
+		const char *label;
+		EOutputFormat format;
+	};
+	const SFormat formats[] =
+	{
+		{ "text", OutputFormat_Text },
+		{ "json", OutputFormat_Json },
+		{ "csv", OutputFormat_Csv },
+		{ "prometheus", OutputFormat_Prometheus },
+	};
+
+	// two sample passes 100 ms apart, so the rates have a value.
+	CSimulatedCamera camera(deviceClass, seed);
+	camera.SetClock(SimulationClock_Steady);
+	CStatistician statistician;
+	statistician.Initialize(camera);
+	chrono::steady_clock::time_point wakeup;
+	statistician.SampleDue(chrono::steady_clock::now(), wakeup);
+	this_thread::sleep_for(chrono::milliseconds(100));
+	statistician.SampleDue(chrono::steady_clock::now(), wakeup);
+	StatisticsSnapshot snapshot = statistician.GetSnapshot();
+	const char *source = "21234567";
+
+	vector<char> buffer(16384);
+	cout << (deviceClass == DeviceClass_GigE ? "GigE" : "USB") << " snapshot, " << iterations << " calls per format at 1 kHz" << endl;
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+	{
+		size_t length = FormatStatistics(snapshot, formats[f].format, &buffer[0], buffer.size(), source);
+		if (length >= buffer.size())
+			buffer.resize(length + 1);
+
+		vector<int64_t> callNs;
+		callNs.reserve(iterations);
+		chrono::steady_clock::time_point next = chrono::steady_clock::now();
+		for (size_t i = 0; i < iterations; i++)
+		{
+			next += chrono::milliseconds(1);
+			this_thread::sleep_until(next);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			FormatStatistics(snapshot, formats[f].format, &buffer[0], buffer.size(), source);
+			callNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+		}
+
+		cout << formats[f].label << ": " << length << " bytes" << endl;
+		PrintLatency("call", callNs);
+	}
+}
+
+// Reads the USB error registers of the schema 'iterations' times with each block plan, the way
+// CStatistician reads them in a sample pass, and prints the latency of a pass. The simulated port
+// spends the read cost per transaction, whatever its length.
+static void RunRegisterMicro(size_t iterations, double readCostUs, uint64_t seed)
+{
+	struct SPlan
+	{
+		const char *label;
+		int64_t maxGap;
+		int64_t maxBlockLength;
+	};
+	const SPlan plans[] =
+	{
+		{ "per register", -1, 0 },
+		{ "blocks, gap 0 (default)", 0, 256 },
+		{ "one block, gap 16", 16, 256 },
+	};
+
+	CSimulatedCamera camera(DeviceClass_Usb, seed);
+	camera.SetClock(SimulationClock_Steady);
+	camera.SetReadCost(chrono::nanoseconds(static_cast<int64_t>(readCostUs * 1000.0)));
+
+	cout << "USB error register read, " << iterations << " passes, " << readCostUs << " us per transaction" << endl;
+	for (size_t p = 0; p < sizeof(plans) / sizeof(plans[0]); p++)
+	{
+		vector<uint64_t> values(Statistic_Count, 0);
+		CRegisterBlockReader reader;
+		reader.SetMaxGap(plans[p].maxGap);
+		reader.SetMaxBlockLength(plans[p].maxBlockLength);
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			if (info.type == StatisticType_Register && (info.deviceClasses & DeviceClass_Usb) != 0)
+				reader.AddRegister(info.address, 4, &values[i]);
+		}
+
+		vector<int64_t> passNs;
+		passNs.reserve(iterations);
+		for (size_t i = 0; i < iterations; i++)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			reader.Read(camera);
+			passNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+		}
+
+		const SRegisterReadStatistics &statistics = reader.GetStatistics();
+		cout << plans[p].label << ": " << reader.GetRegisterCount() << " registers in " << statistics.blocks << " transaction(s), "
+			<< statistics.bytesRead / iterations << " bytes per pass" << endl;
+		PrintLatency("pass", passNs);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned deviceClass = DeviceClass_Usb;
+	size_t cameraCount = 1;
+	double seconds = 5.0;
+	double fps = 100.0;
+	int workPasses = 20;
+	int64_t bufferCount = 10;
+	double readCostUs = 20.0;
+	int64_t periodMs = 0;
+	string script;
+	uint64_t seed = 1;
+	string micro;
+	size_t iterations = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--gige")
+			deviceClass = DeviceClass_GigE;
+		else if (option == "--cameras" && hasValue)
+			cameraCount = static_cast<size_t>(atoi(argv[++i]));
+		else if (option == "--seconds" && hasValue)
+			seconds = atof(argv[++i]);
+		else if (option == "--fps" && hasValue)
+			fps = atof(argv[++i]);
+		else if (option == "--work" && hasValue)
+			workPasses = atoi(argv[++i]);
+		else if (option == "--buffers" && hasValue)
+			bufferCount = atoi(argv[++i]);
+		else if (option == "--read-cost" && hasValue)
+			readCostUs = atof(argv[++i]);
+		else if (option == "--period" && hasValue)
+			periodMs = atoi(argv[++i]);
+		else if (option == "--seed" && hasValue)
+			seed = strtoull(argv[++i], NULL, 10);
+		else if (option == "--micro" && hasValue)
+			micro = argv[++i];
+		else if (option == "--iterations" && hasValue)
+			iterations = static_cast<size_t>(atoi(argv[++i]));
+		else if (option == "--script" && hasValue)
+		{
+			ifstream file(argv[++i]);
+			if (file.is_open() == false)
+			{
+				cerr << "Cannot open " << argv[i] << endl;
+				return 1;
+			}
+			stringstream text;
+			text << file.rdbuf();
+			script = text.str();
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			cerr << "Usage: " << argv[0] << " [--gige] [--cameras <n>] [--seconds <s>] [--fps <n>] [--work <n>] [--buffers <n>] [--read-cost <us>] [--period <ms>] [--script <file>] [--seed <n>] [--micro probes|frames|formatter|registers] [--iterations <n>]" << endl;
+			return 1;
+		}
+	}
+
+	if (cameraCount == 0 || seconds <= 0 || fps <= 0 || bufferCount <= 0)
+	{
+		cerr << "Need at least one camera and a positive run time, frame rate and buffer count." << endl;
+		return 1;
+	}
+
+	if (micro.empty() == false)
+	{
+		if (iterations == 0)
+			iterations = (micro == "frames") ? 1000000 : (micro == "formatter") ? 1000 : 10000;
+		if (micro == "probes")
+			RunProbeMicro(deviceClass, iterations, readCostUs, seed);
+		else if (micro == "frames")
+			RunFrameMicro(iterations);
+		else if (micro == "formatter")
+			RunFormatterMicro(deviceClass, iterations, seed);
+		else if (micro == "registers")
+			RunRegisterMicro(iterations, readCostUs, seed);
+		else
+		{
+			cerr << "Unknown microbenchmark " << micro << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	cout << cameraCount << (deviceClass == DeviceClass_GigE ? " GigE" : " USB") << " camera(s) at " << fps << " fps, " << seconds << " s per mode, "
+		<< readCostUs << " us per read, " << thread::hardware_concurrency() << " cores" << endl;
+
+	CSamplingBenchmark benchmark;
+	for (int mode = 0; mode < SamplingMode_Count; mode++)
+	{
+		vector<unique_ptr<CSimulatedCamera> > cameras;
+		vector<unique_ptr<CStatistician> > statisticians;
+		for (size_t i = 0; i < cameraCount; i++)
+		{
+			cameras.push_back(unique_ptr<CSimulatedCamera>(new CSimulatedCamera(deviceClass, seed + i)));
+			cameras[i]->SetClock(SimulationClock_Steady);
+			cameras[i]->SetReadCost(chrono::nanoseconds(static_cast<int64_t>(readCostUs * 1000.0)));
+			cameras[i]->AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, fps);
+			if (script.empty() == false && cameras[i]->LoadScript(script.c_str()) == false)
+			{
+				cerr << "The script has a line that can't be parsed." << endl;
+				return 1;
+			}
+			if (mode == SamplingMode_Off)
+				continue;
+
+			statisticians.push_back(unique_ptr<CStatistician>(new CStatistician()));
+			ConfigureSamplingMode(*statisticians[i], static_cast<ESamplingMode>(mode));
+			if (periodMs > 0)
+			{
+				statisticians[i]->SetSamplingPeriod(StatisticGroup_Grabber, chrono::milliseconds(periodMs));
+				statisticians[i]->SetSamplingPeriod(StatisticGroup_Transport, chrono::milliseconds(periodMs));
+			}
+			statisticians[i]->Initialize(*cameras[i]);
+		}
+
+		for (size_t i = 0; i < statisticians.size(); i++)
+			statisticians[i]->Start();
+
+		// one grab thread per camera, all starting together.
+		vector<unique_ptr<SGrabLoop> > loops;
+		vector<thread> threads;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now() + chrono::milliseconds(10);
+		chrono::steady_clock::time_point end = start + chrono::microseconds(static_cast<int64_t>(seconds * 1e6));
+		for (size_t i = 0; i < cameraCount; i++)
+		{
+			loops.push_back(unique_ptr<SGrabLoop>(new SGrabLoop()));
+			threads.push_back(thread(Grab, loops[i].get(), fps, workPasses, bufferCount, start, end));
+		}
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+
+		vector<StatisticsSnapshot> snapshots(statisticians.size());
+		for (size_t i = 0; i < statisticians.size(); i++)
+		{
+			statisticians[i]->Stop();
+			statisticians[i]->GetSnapshot(snapshots[i]);
+		}
+
+		uint64_t bytes = 0;
+		vector<const CFrameStatistics*> frames(cameraCount);
+		for (size_t i = 0; i < cameraCount; i++)
+		{
+			bytes += loops[i]->bytes;
+			frames[i] = &loops[i]->frames;
+		}
+		benchmark.AddResult(static_cast<ESamplingMode>(mode), seconds, bytes, &frames[0], frames.size(), snapshots.empty() ? NULL : &snapshots[0], snapshots.size());
+
+		const SProfilingStatistics &profile = benchmark.GetResults().back().profile;
+		if (profile.passes > 0)
+		{
+			cout << GetSamplingModeName(static_cast<ESamplingMode>(mode)) << ": " << profile.passes << " passes, " << profile.passNs / 1000 / static_cast<int64_t>(profile.passes)
+				<< " us average, " << profile.maxPassNs / 1000 << " us max; " << profile.nodeReads << " node reads, "
+				<< (profile.nodeReads > 0 ? profile.nodeReadNs / static_cast<int64_t>(profile.nodeReads) : 0) << " ns average, " << profile.maxNodeReadNs / 1000 << " us max; "
+				<< profile.portReads << " port reads; " << profile.nodeLookups << " node lookups, "
+				<< (profile.nodeLookups > 0 ? profile.nodeLookupNs / static_cast<int64_t>(profile.nodeLookups) : 0) << " ns average, " << profile.maxNodeLookupNs / 1000 << " us max" << endl;
+		}
+	}
+
+	vector<char> buffer(4096);
+	size_t length = benchmark.Print(&buffer[0], buffer.size());
+	if (length >= buffer.size())
+	{
+		buffer.resize(length + 1);
+		benchmark.Print(&buffer[0], buffer.size());
+	}
+	cout << &buffer[0];
+	return 0;
+}
@@ -0,0 +1,690 @@
+// StatisticsFormatter.h
+// Formats statistics snapshots as text, JSON, CSV or Prometheus exposition without allocating
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSFORMATTER_H
+#define STATISTICSFORMATTER_H
+
+#include "StatisticsSnapshot.h"
+#include "DerivedMetrics.h"
+#include <cstring>
+
+namespace Statistician
+{
+	enum EOutputFormat
+	{
+		OutputFormat_Text,			// the human-readable layout of PrintStatistics()
+		OutputFormat_Json,			// one object per snapshot (an array for several snapshots)
+		OutputFormat_CsvHeader,		// the header row matching OutputFormat_Csv
+		OutputFormat_Csv,			// one row per snapshot; every statistic has a column
+		OutputFormat_Prometheus		// text exposition format, one series per snapshot
+	};
+
+	// Appends to a caller-provided buffer. Output that does not fit is dropped, but the length
+	// keeps counting, so the caller learns how large the buffer must be (like snprintf).
+	class CTextWriter
+	{
+	private:
+		char *m_buffer;
+		size_t m_size;
+		size_t m_length;
+
+	public:
+		CTextWriter(char *buffer, size_t size);
+		void Append(char c);
+		void Append(const char *text);
+		void Append(const char *text, size_t length);
+		void AppendInteger(int64_t value);
+		void AppendUnsigned(uint64_t value);
+		void AppendFixed(double value, int decimals);		// rounded, 0 to 9 decimals
+		void AppendPadded(const char *text, size_t width);
+		void AppendLine(const char *text);					// up to the first newline
+		void AppendJsonString(const char *text);
+		void AppendCsvString(const char *text);
+		void AppendLabelValue(const char *text);			// Prometheus label value, without quotes
+		void AppendSnakeCase(const char *name);				// lastBlockID -> last_block_id
+		size_t Finish();									// terminates the text, returns the full length
+	};
+
+	// Formats 'count' snapshots into buffer (always terminated if size > 0). 'sources' names each
+	// snapshot (camera serial number, for example) and may be NULL. Returns the length of the complete
+	// output without the terminator; if that is >= size, the output was cut off.
+	inline size_t FormatStatistics(const StatisticsSnapshot *snapshots, const char *const *sources, size_t count, EOutputFormat format, char *buffer, size_t size);
+	inline size_t FormatStatistics(const StatisticsSnapshot &snapshot, EOutputFormat format, char *buffer, size_t size, const char *source = NULL);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CTextWriter::CTextWriter(char *buffer, size_t size)
+	: m_buffer(buffer)
+	, m_size(size)
+	, m_length(0)
+{
+}
+
+inline void Statistician::CTextWriter::Append(char c)
+{
+	// keep the last byte for the terminator.
+	if (m_size > 0 && m_length < m_size - 1)
+		m_buffer[m_length] = c;
+	m_length++;
+}
+
+inline void Statistician::CTextWriter::Append(const char *text)
+{
+	Append(text, strlen(text));
+}
+
+inline void Statistician::CTextWriter::Append(const char *text, size_t length)
+{
+	if (m_size > 0 && m_length < m_size - 1)
+	{
+		size_t room = m_size - 1 - m_length;
+		memcpy(m_buffer + m_length, text, (length < room) ? length : room);
+	}
+	m_length += length;
+}
+
+inline void Statistician::CTextWriter::AppendUnsigned(uint64_t value)
+{
+	char digits[20];
+	size_t count = 0;
+	do
+	{
+		digits[count++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	while (count > 0)
+		Append(digits[--count]);
+}
+
+inline void Statistician::CTextWriter::AppendInteger(int64_t value)
+{
+	if (value < 0)
+	{
+		Append('-');
+		AppendUnsigned(0 - static_cast<uint64_t>(value));
+	}
+	else
+		AppendUnsigned(static_cast<uint64_t>(value));
+}
+
+inline void Statistician::CTextWriter::AppendFixed(double value, int decimals)
+{
+	if (value < 0)
+	{
+		Append('-');
+		value = -value;
+	}
+
+	uint64_t scale = 1;
+	for (int i = 0; i < decimals && i < 9; i++)
+		scale *= 10;
+	uint64_t scaled = static_cast<uint64_t>(value * static_cast<double>(scale) + 0.5);
+
+	AppendUnsigned(scaled / scale);
+	if (scale == 1)
+		return;
+
+	Append('.');
+	for (uint64_t digit = scale / 10; digit > 0; digit /= 10)
+		Append(static_cast<char>('0' + scaled / digit % 10));
+}
+
+inline void Statistician::CTextWriter::AppendPadded(const char *text, size_t width)
+{
+	size_t length = strlen(text);
+	Append(text, length);
+	for (; length < width; length++)
+		Append(' ');
+}
+
+inline void Statistician::CTextWriter::AppendLine(const char *text)
+{
+	Append(text, strcspn(text, "\r\n"));
+}
+
+inline void Statistician::CTextWriter::AppendJsonString(const char *text)
+{
+	static const char hex[] = "0123456789abcdef";
+	Append('"');
+	for (; *text != '\0'; text++)
+	{
+		unsigned char c = static_cast<unsigned char>(*text);
+		if (c == '"' || c == '\\')
+		{
+			Append('\\');
+			Append(static_cast<char>(c));
+		}
+		else if (c == '\n')
+			Append("\\n", 2);
+		else if (c < 0x20)
+		{
+			Append("\\u00", 4);
+			Append(hex[c >> 4]);
+			Append(hex[c & 0xF]);
+		}
+		else
+			Append(static_cast<char>(c));
+	}
+	Append('"');
+}
+
+inline void Statistician::CTextWriter::AppendCsvString(const char *text)
+{
+	Append('"');
+	for (; *text != '\0'; text++)
+	{
+		if (*text == '"')
+			Append("\"\"", 2);
+		else if (*text != '\n' && *text != '\r')
+			Append(*text);
+	}
+	Append('"');
+}
+
+inline void Statistician::CTextWriter::AppendLabelValue(const char *text)
+{
+	for (; *text != '\0'; text++)
+	{
+		if (*text == '"' || *text == '\\')
+		{
+			Append('\\');
+			Append(*text);
+		}
+		else if (*text == '\n')
+			Append("\\n", 2);
+		else
+			Append(*text);
+	}
+}
+
+inline void Statistician::CTextWriter::AppendSnakeCase(const char *name)
+{
+	for (size_t i = 0; name[i] != '\0'; i++)
+	{
+		char c = name[i];
+		bool isUpper = (c >= 'A' && c <= 'Z');
+		if (isUpper && i > 0)
+		{
+			char previous = name[i - 1];
+			char next = name[i + 1];
+			bool previousIsUpper = (previous >= 'A' && previous <= 'Z');
+			bool nextIsLower = (next >= 'a' && next <= 'z');
+			if (previousIsUpper == false || nextIsLower == true)
+				Append('_');
+		}
+		Append(isUpper ? static_cast<char>(c - 'A' + 'a') : c);
+	}
+}
+
+inline size_t Statistician::CTextWriter::Finish()
+{
+	if (m_size > 0)
+		m_buffer[(m_length < m_size) ? m_length : m_size - 1] = '\0';
+	return m_length;
+}
+
+namespace Statistician
+{
+	namespace Detail
+	{
+		inline const char *FieldText(const StatisticsSnapshot &snapshot, const SStatisticInfo &info)
+		{
+			return reinterpret_cast<const char*>(&snapshot) + info.offset;
+		}
+
+		// The first logged text of a statistic with an ID >= 'error', c_maxErrorTexts if there is none.
+		// Logged texts come in order of first occurrence.
+		inline uint32_t NextLoggedText(const StatisticsSnapshot &snapshot, int statistic, uint32_t error)
+		{
+			const StatisticsErrorLog &log = snapshot.errorLog;
+			for (; error < log.errorCount && error < c_maxErrorTexts; error++)
+			{
+				if (log.errors[error].statistic == static_cast<uint32_t>(statistic))
+					return error;
+			}
+			return static_cast<uint32_t>(c_maxErrorTexts);
+		}
+
+		// Writes a number-like value (integer, boolean as 0/1, register).
+		inline void AppendNumber(CTextWriter &writer, const StatisticsSnapshot &snapshot, const SStatisticInfo &info)
+		{
+			const char *field = reinterpret_cast<const char*>(&snapshot) + info.offset;
+			switch (info.type)
+			{
+			case StatisticType_Integer:
+				writer.AppendInteger(*reinterpret_cast<const int64_t*>(field));
+				break;
+			case StatisticType_Boolean:
+				writer.Append(*reinterpret_cast<const bool*>(field) ? '1' : '0');
+				break;
+			case StatisticType_Register:
+				writer.AppendUnsigned(*reinterpret_cast<const uint64_t*>(field));
+				break;
+			default:
+				break;
+			}
+		}
+
+		inline bool IsDerivedMetricAvailable(const StatisticsSnapshot &snapshot, int metric)
+		{
+			return (snapshot.derived.available & (static_cast<uint32_t>(1) << metric)) != 0;
+		}
+
+		inline void FormatText(CTextWriter &writer, const StatisticsSnapshot &snapshot, const char *source)
+		{
+			static const size_t c_labelWidth = 39;
+
+			writer.Append(" Statistics");
+			if (source != NULL)
+			{
+				writer.Append(" (");
+				writer.Append(source);
+				writer.Append(')');
+			}
+			writer.Append(":\n");
+
+			for (int section = 0; section < StatisticSection_Count; section++)
+			{
+				bool hasHeading = false;
+				for (int i = 0; i < Statistic_Count; i++)
+				{
+					const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+					if (info.section != section || IsStatisticAvailable(snapshot, static_cast<EStatistic>(i)) == false)
+						continue;
+
+					if (hasHeading == false)
+					{
+						writer.Append("  ");
+						writer.Append(GetStatisticSectionName(info.section));
+						writer.Append(":\n");
+						hasHeading = true;
+					}
+
+					writer.Append("   ");
+					writer.AppendPadded(info.label, c_labelWidth);
+					writer.Append(": ");
+					if (info.type == StatisticType_Text)
+						writer.AppendLine(FieldText(snapshot, info));
+					else if (info.type == StatisticType_Boolean)
+						writer.Append(*reinterpret_cast<const bool*>(FieldText(snapshot, info)) ? "true" : "false");
+					else
+						AppendNumber(writer, snapshot, info);
+					writer.Append('\n');
+
+					for (uint32_t j = NextLoggedText(snapshot, i, 0); info.logged == true && j < c_maxErrorTexts; j = NextLoggedText(snapshot, i, j + 1))
+					{
+						writer.Append("   ");
+						writer.AppendPadded(info.listLabel, c_labelWidth);
+						writer.Append(": ");
+						writer.AppendLine(snapshot.errorLog.errors[j].text);
+						writer.Append('\n');
+					}
+				}
+			}
+
+			// the last interval, and since the first sample in brackets.
+			if (snapshot.derived.available != 0)
+				writer.Append("  Derived:\n");
+			for (int i = 0; i < DerivedMetric_Count; i++)
+			{
+				const SDerivedMetricInfo &info = GetDerivedMetricInfo(static_cast<EDerivedMetric>(i));
+				if (IsDerivedMetricAvailable(snapshot, i) == false)
+					continue;
+
+				writer.Append("   ");
+				writer.AppendPadded(info.label, c_labelWidth);
+				writer.Append(": ");
+				writer.AppendFixed(snapshot.derived.values[i], info.decimals);
+				writer.Append(" (");
+				writer.AppendFixed(snapshot.derived.totals[i], info.decimals);
+				writer.Append(" overall)\n");
+			}
+		}
+
+		inline void FormatJson(CTextWriter &writer, const StatisticsSnapshot &snapshot, const char *source)
+		{
+			writer.Append('{');
+			if (source != NULL)
+			{
+				writer.Append("\"source\":");
+				writer.AppendJsonString(source);
+				writer.Append(',');
+			}
+			writer.Append("\"sequence\":");
+			writer.AppendUnsigned(snapshot.sequence);
+			writer.Append(",\"timestampUs\":");
+			writer.AppendInteger(snapshot.timestampUs);
+
+			for (int i = 0; i < Statistic_Count; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				if (IsStatisticAvailable(snapshot, static_cast<EStatistic>(i)) == false)
+					continue;
+
+				writer.Append(",\"");
+				writer.Append(info.name);
+				writer.Append("\":");
+				if (info.type == StatisticType_Text)
+					writer.AppendJsonString(FieldText(snapshot, info));
+				else if (info.type == StatisticType_Boolean)
+					writer.Append(*reinterpret_cast<const bool*>(FieldText(snapshot, info)) ? "true" : "false");
+				else
+					AppendNumber(writer, snapshot, info);
+
+				if (info.logged == true)
+				{
+					writer.Append(",\"");
+					writer.Append(info.name);
+					writer.Append("List\":[");
+					uint32_t first = NextLoggedText(snapshot, i, 0);
+					for (uint32_t j = first; j < c_maxErrorTexts; j = NextLoggedText(snapshot, i, j + 1))
+					{
+						if (j != first)
+							writer.Append(',');
+						writer.AppendJsonString(snapshot.errorLog.errors[j].text);
+					}
+					writer.Append(']');
+				}
+			}
+
+			for (int i = 0; i < DerivedMetric_Count; i++)
+			{
+				const SDerivedMetricInfo &info = GetDerivedMetricInfo(static_cast<EDerivedMetric>(i));
+				if (IsDerivedMetricAvailable(snapshot, i) == false)
+					continue;
+
+				writer.Append(",\"");
+				writer.Append(info.name);
+				writer.Append("\":");
+				writer.AppendFixed(snapshot.derived.values[i], info.decimals);
+				writer.Append(",\"");
+				writer.Append(info.name);
+				writer.Append("Overall\":");
+				writer.AppendFixed(snapshot.derived.totals[i], info.decimals);
+			}
+			writer.Append('}');
+		}
+
+		inline void FormatCsvHeader(CTextWriter &writer)
+		{
+			writer.Append("source,sequence,timestampUs");
+			for (int i = 0; i < Statistic_Count; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				writer.Append(',');
+				writer.Append(info.name);
+				if (info.logged == true)
+				{
+					writer.Append(',');
+					writer.Append(info.name);
+					writer.Append("List");
+				}
+			}
+			for (int i = 0; i < DerivedMetric_Count; i++)
+			{
+				const SDerivedMetricInfo &info = GetDerivedMetricInfo(static_cast<EDerivedMetric>(i));
+				writer.Append(',');
+				writer.Append(info.name);
+				writer.Append(',');
+				writer.Append(info.name);
+				writer.Append("Overall");
+			}
+			writer.Append('\n');
+		}
+
+		inline void FormatCsv(CTextWriter &writer, const StatisticsSnapshot &snapshot, const char *source)
+		{
+			writer.AppendCsvString(source != NULL ? source : "");
+			writer.Append(',');
+			writer.AppendUnsigned(snapshot.sequence);
+			writer.Append(',');
+			writer.AppendInteger(snapshot.timestampUs);
+
+			// every statistic has a column, so rows of different cameras line up. Unavailable ones stay empty.
+			for (int i = 0; i < Statistic_Count; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				bool isAvailable = IsStatisticAvailable(snapshot, static_cast<EStatistic>(i));
+
+				writer.Append(',');
+				if (isAvailable == true && info.type == StatisticType_Text)
+					writer.AppendCsvString(FieldText(snapshot, info));
+				else if (isAvailable == true)
+					AppendNumber(writer, snapshot, info);
+
+				if (info.logged == true)
+				{
+					writer.Append(",\"");
+					uint32_t first = NextLoggedText(snapshot, i, 0);
+					for (uint32_t j = first; isAvailable == true && j < c_maxErrorTexts; j = NextLoggedText(snapshot, i, j + 1))
+					{
+						if (j != first)
+							writer.Append(" | ");
+						for (const char *c = snapshot.errorLog.errors[j].text; *c != '\0'; c++)
+						{
+							if (*c == '"')
+								writer.Append("\"\"", 2);
+							else if (*c != '\n' && *c != '\r')
+								writer.Append(*c);
+						}
+					}
+					writer.Append('"');
+				}
+			}
+
+			for (int i = 0; i < DerivedMetric_Count; i++)
+			{
+				const SDerivedMetricInfo &info = GetDerivedMetricInfo(static_cast<EDerivedMetric>(i));
+				bool isAvailable = IsDerivedMetricAvailable(snapshot, i);
+				writer.Append(',');
+				if (isAvailable == true)
+					writer.AppendFixed(snapshot.derived.values[i], info.decimals);
+				writer.Append(',');
+				if (isAvailable == true)
+					writer.AppendFixed(snapshot.derived.totals[i], info.decimals);
+			}
+			writer.Append('\n');
+		}
+
+		inline void AppendPrometheusName(CTextWriter &writer, const SStatisticInfo &info, const char *suffix)
+		{
+			writer.Append("statistician_");
+			writer.AppendSnakeCase(info.name);
+			writer.Append(suffix);
+		}
+
+		inline void AppendPrometheusLabels(CTextWriter &writer, const char *source, size_t index, const char *value)
+		{
+			writer.Append("{source=\"");
+			if (source != NULL)
+				writer.AppendLabelValue(source);
+			else
+				writer.AppendUnsigned(index);
+			writer.Append('"');
+			if (value != NULL)
+			{
+				writer.Append(",value=\"");
+				writer.AppendLabelValue(value);
+				writer.Append('"');
+			}
+			writer.Append("} ");
+		}
+
+		// All series of a metric are written together under one TYPE line, as the format requires.
+		inline void FormatPrometheus(CTextWriter &writer, const StatisticsSnapshot *snapshots, const char *const *sources, size_t count)
+		{
+			for (int i = 0; i < Statistic_Count; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				bool isCounter = (info.kind == StatisticKind_Counter);
+				bool isText = (info.type == StatisticType_Text);
+				const char *suffix = isCounter ? "_total" : (isText ? "_info" : "");
+
+				bool hasType = false;
+				for (size_t n = 0; n < count; n++)
+				{
+					const StatisticsSnapshot &snapshot = snapshots[n];
+					if (IsStatisticAvailable(snapshot, static_cast<EStatistic>(i)) == false)
+						continue;
+
+					if (hasType == false)
+					{
+						writer.Append("# TYPE ");
+						AppendPrometheusName(writer, info, suffix);
+						writer.Append(isCounter ? " counter\n" : " gauge\n");
+						hasType = true;
+					}
+
+					const char *source = (sources != NULL) ? sources[n] : NULL;
+					AppendPrometheusName(writer, info, suffix);
+					if (isText)
+					{
+						char line[c_maxTextLength];
+						const char *text = FieldText(snapshot, info);
+						size_t length = strcspn(text, "\r\n");
+						memcpy(line, text, length);
+						line[length] = '\0';
+						AppendPrometheusLabels(writer, source, n, line);
+						writer.Append("1\n");
+					}
+					else
+					{
+						AppendPrometheusLabels(writer, source, n, NULL);
+						AppendNumber(writer, snapshot, info);
+						writer.Append('\n');
+					}
+				}
+
+				// logged texts: one series per distinct text.
+				if (info.logged == false)
+					continue;
+
+				hasType = false;
+				for (size_t n = 0; n < count; n++)
+				{
+					const StatisticsSnapshot &snapshot = snapshots[n];
+					if (IsStatisticAvailable(snapshot, static_cast<EStatistic>(i)) == false)
+						continue;
+
+					for (uint32_t j = NextLoggedText(snapshot, i, 0); j < c_maxErrorTexts; j = NextLoggedText(snapshot, i, j + 1))
+					{
+						if (hasType == false)
+						{
+							writer.Append("# TYPE ");
+							AppendPrometheusName(writer, info, "_logged");
+							writer.Append(" gauge\n");
+							hasType = true;
+						}
+
+						char line[c_maxTextLength];
+						size_t length = strcspn(snapshot.errorLog.errors[j].text, "\r\n");
+						memcpy(line, snapshot.errorLog.errors[j].text, length);
+						line[length] = '\0';
+						AppendPrometheusName(writer, info, "_logged");
+						AppendPrometheusLabels(writer, (sources != NULL) ? sources[n] : NULL, n, line);
+						writer.Append("1\n");
+					}
+				}
+			}
+
+			// derived metrics are gauges, the last interval and since the first sample.
+			const char *suffixes[2] = { "", "_overall" };
+			for (int i = 0; i < DerivedMetric_Count; i++)
+			{
+				const SDerivedMetricInfo &info = GetDerivedMetricInfo(static_cast<EDerivedMetric>(i));
+				for (int series = 0; series < 2; series++)
+				{
+					bool hasType = false;
+					for (size_t n = 0; n < count; n++)
+					{
+						const StatisticsSnapshot &snapshot = snapshots[n];
+						if (IsDerivedMetricAvailable(snapshot, i) == false)
+							continue;
+
+						if (hasType == false)
+						{
+							writer.Append("# TYPE statistician_");
+							writer.AppendSnakeCase(info.name);
+							writer.Append(suffixes[series]);
+							writer.Append(" gauge\n");
+							hasType = true;
+						}
+						writer.Append("statistician_");
+						writer.AppendSnakeCase(info.name);
+						writer.Append(suffixes[series]);
+						AppendPrometheusLabels(writer, (sources != NULL) ? sources[n] : NULL, n, NULL);
+						writer.AppendFixed((series == 0) ? snapshot.derived.values[i] : snapshot.derived.totals[i], info.decimals);
+						writer.Append('\n');
+					}
+				}
+			}
+		}
+	}
+}
+
+inline size_t Statistician::FormatStatistics(const StatisticsSnapshot *snapshots, const char *const *sources, size_t count, EOutputFormat format, char *buffer, size_t size)
+{
+	CTextWriter writer(buffer, size);
+
+	switch (format)
+	{
+	case OutputFormat_Text:
+		for (size_t n = 0; n < count; n++)
+			Detail::FormatText(writer, snapshots[n], (sources != NULL) ? sources[n] : NULL);
+		break;
+
+	case OutputFormat_Json:
+		if (count != 1)
+			writer.Append('[');
+		for (size_t n = 0; n < count; n++)
+		{
+			if (n > 0)
+				writer.Append(',');
+			Detail::FormatJson(writer, snapshots[n], (sources != NULL) ? sources[n] : NULL);
+		}
+		if (count != 1)
+			writer.Append(']');
+		writer.Append('\n');
+		break;
+
+	case OutputFormat_CsvHeader:
+		Detail::FormatCsvHeader(writer);
+		break;
+
+	case OutputFormat_Csv:
+		for (size_t n = 0; n < count; n++)
+			Detail::FormatCsv(writer, snapshots[n], (sources != NULL) ? sources[n] : NULL);
+		break;
+
+	case OutputFormat_Prometheus:
+		Detail::FormatPrometheus(writer, snapshots, sources, count);
+		break;
+	}
+
+	return writer.Finish();
+}
+
+inline size_t Statistician::FormatStatistics(const StatisticsSnapshot &snapshot, EOutputFormat format, char *buffer, size_t size, const char *source)
+{
+	return FormatStatistics(&snapshot, (source != NULL) ? &source : NULL, 1, format, buffer, size);
+}
+
+// *********************************************************************************************************
+#endif
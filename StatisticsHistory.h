@@ -0,0 +1,253 @@
+// StatisticsHistory.h
+// Fixed-capacity ring buffer of timestamped counter samples
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSHISTORY_H
+#define STATISTICSHISTORY_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Statistician
+{
+	// Keeps the last 'capacity' samples of a fixed set of counters. All memory is allocated
+	// by Initialize(); Append() and the queries never allocate. Values are stored per counter
+	// (one contiguous ring per counter) so a query only touches the counter it asks for.
+	// A sample may leave a counter unread (its group was not due); it then holds the last value
+	// read, and the queries skip it for that counter, so a counter read every other sample does
+	// not show a rate of 0 and then twice its rate. Not thread safe; the owner serializes access.
+	class CStatisticsHistory
+	{
+	private:
+		size_t m_counterCount;
+		size_t m_capacity;
+		size_t m_size;
+		size_t m_newest;						// ring index of the newest sample
+		std::vector<int64_t> m_timestampsUs;	// m_capacity entries
+		std::vector<uint32_t> m_readCounters;	// m_capacity entries, bit (1 << counter) per counter read
+		std::vector<int64_t> m_values;			// m_counterCount rings of m_capacity entries
+		size_t RingIndex(size_t age) const;		// age 0 is the newest sample
+		size_t FindAge(int64_t timestampUs) const;
+		bool IsRead(size_t counter, size_t age) const;
+		size_t FindRead(size_t counter, size_t age) const;	// age of the newest sample from 'age' on that read the counter; m_size if none
+		int64_t GetDelta(size_t counter, int64_t windowUs, int64_t &elapsedUs) const;
+
+	public:
+		CStatisticsHistory();
+		void Initialize(size_t counterCount, size_t capacity);	// at most 32 counters, a bit each in 'readCounters'
+		void Clear();
+		void Append(int64_t timestampUs, const int64_t *values, uint32_t readCounters);
+
+		size_t GetSize() const;
+		size_t GetCapacity() const;
+
+		// Change of a counter per second between the two newest samples that read it. O(1) when
+		// the counter is read in every sample.
+		double GetRate(size_t counter) const;
+
+		// Change of a counter over the newest samples that read it and span at most 'windowUs'.
+		// O(log n) when the counter is read in every sample.
+		int64_t GetDelta(size_t counter, int64_t windowUs) const;
+		double GetRate(size_t counter, int64_t windowUs) const;
+
+		// Copies up to maxSamples of the newest samples that read the counter, oldest first.
+		// Returns the number copied.
+		size_t CopySamples(size_t counter, int64_t *timestampsUs, int64_t *values, size_t maxSamples) const;
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CStatisticsHistory::CStatisticsHistory()
+	: m_counterCount(0)
+	, m_capacity(0)
+	, m_size(0)
+	, m_newest(0)
+{
+}
+
+inline void Statistician::CStatisticsHistory::Initialize(size_t counterCount, size_t capacity)
+{
+	m_counterCount = counterCount;
+	m_capacity = capacity;
+	m_timestampsUs.assign(capacity, 0);
+	m_readCounters.assign(capacity, 0);
+	m_values.assign(counterCount * capacity, 0);
+	Clear();
+}
+
+inline void Statistician::CStatisticsHistory::Clear()
+{
+	m_size = 0;
+	m_newest = 0;
+}
+
+inline void Statistician::CStatisticsHistory::Append(int64_t timestampUs, const int64_t *values, uint32_t readCounters)
+{
+	if (m_capacity == 0)
+		return;
+
+	m_newest = (m_size == 0) ? 0 : (m_newest + 1) % m_capacity;
+	if (m_size < m_capacity)
+		m_size++;
+
+	m_timestampsUs[m_newest] = timestampUs;
+	m_readCounters[m_newest] = readCounters;
+	for (size_t counter = 0; counter < m_counterCount; counter++)
+		m_values[counter * m_capacity + m_newest] = values[counter];
+}
+
+inline size_t Statistician::CStatisticsHistory::GetSize() const
+{
+	return m_size;
+}
+
+inline size_t Statistician::CStatisticsHistory::GetCapacity() const
+{
+	return m_capacity;
+}
+
+inline size_t Statistician::CStatisticsHistory::RingIndex(size_t age) const
+{
+	return (m_newest + m_capacity - age) % m_capacity;
+}
+
+inline size_t Statistician::CStatisticsHistory::FindAge(int64_t timestampUs) const
+{
+	// oldest sample that is not older than timestampUs. Timestamps grow with the ring, so binary search.
+	size_t newer = 0;
+	size_t older = m_size - 1;
+	if (m_timestampsUs[RingIndex(older)] >= timestampUs)
+		return older;
+
+	while (older - newer > 1)
+	{
+		size_t middle = newer + (older - newer) / 2;
+		if (m_timestampsUs[RingIndex(middle)] >= timestampUs)
+			newer = middle;
+		else
+			older = middle;
+	}
+	return newer;
+}
+
+inline bool Statistician::CStatisticsHistory::IsRead(size_t counter, size_t age) const
+{
+	return (m_readCounters[RingIndex(age)] & (static_cast<uint32_t>(1) << counter)) != 0;
+}
+
+inline size_t Statistician::CStatisticsHistory::FindRead(size_t counter, size_t age) const
+{
+	while (age < m_size && IsRead(counter, age) == false)
+		age++;
+	return age;
+}
+
+inline double Statistician::CStatisticsHistory::GetRate(size_t counter) const
+{
+	if (m_size < 2 || counter >= m_counterCount)
+		return 0.0;
+
+	size_t newestAge = FindRead(counter, 0);
+	if (newestAge >= m_size)
+		return 0.0;
+	size_t previousAge = FindRead(counter, newestAge + 1);
+	if (previousAge >= m_size)
+		return 0.0;
+
+	size_t newest = RingIndex(newestAge);
+	size_t previous = RingIndex(previousAge);
+	const int64_t *values = &m_values[counter * m_capacity];
+
+	// counters that are not available (-1) have no rate.
+	if (values[newest] < 0 || values[previous] < 0)
+		return 0.0;
+
+	int64_t elapsedUs = m_timestampsUs[newest] - m_timestampsUs[previous];
+	if (elapsedUs <= 0)
+		return 0.0;
+
+	return static_cast<double>(values[newest] - values[previous]) * 1e6 / static_cast<double>(elapsedUs);
+}
+
+inline int64_t Statistician::CStatisticsHistory::GetDelta(size_t counter, int64_t windowUs) const
+{
+	int64_t elapsedUs = 0;
+	return GetDelta(counter, windowUs, elapsedUs);
+}
+
+inline int64_t Statistician::CStatisticsHistory::GetDelta(size_t counter, int64_t windowUs, int64_t &elapsedUs) const
+{
+	elapsedUs = 0;
+	if (m_size < 2 || counter >= m_counterCount)
+		return 0;
+
+	size_t newestAge = FindRead(counter, 0);
+	if (newestAge >= m_size)
+		return 0;
+
+	// the oldest sample in the window that read the counter; the window ends at the newest one.
+	size_t newest = RingIndex(newestAge);
+	size_t oldestAge = FindAge(m_timestampsUs[newest] - windowUs);
+	while (oldestAge > newestAge && IsRead(counter, oldestAge) == false)
+		oldestAge--;
+	size_t oldest = RingIndex(oldestAge);
+	const int64_t *values = &m_values[counter * m_capacity];
+
+	if (values[newest] < 0 || values[oldest] < 0)
+		return 0;
+
+	elapsedUs = m_timestampsUs[newest] - m_timestampsUs[oldest];
+	return values[newest] - values[oldest];
+}
+
+inline double Statistician::CStatisticsHistory::GetRate(size_t counter, int64_t windowUs) const
+{
+	int64_t elapsedUs = 0;
+	int64_t delta = GetDelta(counter, windowUs, elapsedUs);
+	if (elapsedUs <= 0)
+		return 0.0;
+
+	return static_cast<double>(delta) * 1e6 / static_cast<double>(elapsedUs);
+}
+
+inline size_t Statistician::CStatisticsHistory::CopySamples(size_t counter, int64_t *timestampsUs, int64_t *values, size_t maxSamples) const
+{
+	if (counter >= m_counterCount)
+		return 0;
+
+	// newest first, filled in from the back so the output is oldest first.
+	size_t count = 0;
+	for (size_t age = FindRead(counter, 0); age < m_size && count < maxSamples; age = FindRead(counter, age + 1))
+		count++;
+
+	size_t age = 0;
+	for (size_t i = 0; i < count; i++, age++)
+	{
+		age = FindRead(counter, age);
+		size_t index = RingIndex(age);
+		if (timestampsUs != NULL)
+			timestampsUs[count - 1 - i] = m_timestampsUs[index];
+		if (values != NULL)
+			values[count - 1 - i] = m_values[counter * m_capacity + index];
+	}
+	return count;
+}
+
+// *********************************************************************************************************
+#endif
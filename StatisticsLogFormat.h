@@ -0,0 +1,120 @@
+// StatisticsLogFormat.h
+// Layout and encoding of the binary statistics log written by CStatisticsRecorder
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSLOGFORMAT_H
+#define STATISTICSLOGFORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// This header has no pylon dependency, so tools can read logs without the SDK.
+//
+// File layout:
+//   header   : magic "STATLOG\0", u32 version, u32 integer count, u32 text count,
+//              u32 boolean count, u32 register count, then every integer, text, boolean and
+//              register name as (u8 length, bytes), in that order
+//   records  : u8 record type followed by the record body, until end of file
+//
+// The u32 fields are little endian, whatever the byte order of the machine that wrote the log.
+//
+// Records (all integers are LEB128 varints, signed ones zigzag encoded first):
+//   LogRecord_String : id, length, bytes             -- adds a text to the string table
+//   LogRecord_Source : source, length, bytes         -- names a source (camera)
+//   LogRecord_Sample : source, timestamp delta (us, against the previous sample of this source),
+//                      one signed delta per integer (against the previous sample of this source),
+//                      one string id per text, one bit per boolean (bit 0 is the first boolean),
+//                      one signed delta per register (against the previous sample, modulo 2^64)
+//
+// Texts are stored once in the string table; samples only refer to them by id.
+//
+// Version 1 logs have the counters (ECounter) as integers, and no boolean and register counts or
+// names. Their samples end with a u8 of LogFlag_* bits instead of the booleans, and have no registers.
+namespace Statistician
+{
+	static const char c_logMagic[8] = { 'S', 'T', 'A', 'T', 'L', 'O', 'G', '\0' };
+	static const uint32_t c_logVersion = 2;
+
+	enum ELogRecord
+	{
+		LogRecord_String = 1,
+		LogRecord_Source = 2,
+		LogRecord_Sample = 3
+	};
+
+	// The booleans of a version 1 sample.
+	enum ELogFlag
+	{
+		LogFlag_CriticalTemperature = 0x01,
+		LogFlag_OverTemperature = 0x02
+	};
+
+	// Writes value as a varint to 'out' (at least 10 bytes). Returns the number of bytes written.
+	inline size_t EncodeVarint(uint64_t value, uint8_t *out)
+	{
+		size_t length = 0;
+		while (value >= 0x80)
+		{
+			out[length++] = static_cast<uint8_t>(value | 0x80);
+			value >>= 7;
+		}
+		out[length++] = static_cast<uint8_t>(value);
+		return length;
+	}
+
+	// Reads a varint from [data, end). Returns false if the data ends before the varint does.
+	inline bool DecodeVarint(const uint8_t *&data, const uint8_t *end, uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && data < end; shift += 7)
+		{
+			uint8_t byte = *data++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// Writes a u32 header field to 'out' (4 bytes), least significant byte first.
+	inline void EncodeUint32(uint32_t value, uint8_t *out)
+	{
+		for (int i = 0; i < 4; i++)
+			out[i] = static_cast<uint8_t>(value >> (8 * i));
+	}
+
+	// Reads a u32 header field from 'data' (4 bytes).
+	inline uint32_t DecodeUint32(const uint8_t *data)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++)
+			value |= static_cast<uint32_t>(data[i]) << (8 * i);
+		return value;
+	}
+
+	inline uint64_t ZigZagEncode(int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+
+	inline int64_t ZigZagDecode(uint64_t value)
+	{
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+}
+
+#endif
@@ -0,0 +1,444 @@
+// StatisticsRecorder.h
+// Streams statistics snapshots into a compact binary log for long-duration captures
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSRECORDER_H
+#define STATISTICSRECORDER_H
+
+#include "Statistician.h"
+#include "StatisticsLogFormat.h"
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+namespace Statistician
+{
+	// Appends snapshots to a binary log (see StatisticsLogFormat.h): every statistic of the schema
+	// (StatisticsSchema.h) by its type, the integers, the texts through a string table, the booleans
+	// and the registers. The log header names them, so a log stays readable when the schema changes.
+	// Encoding happens on the
+	// caller's thread into one of two preallocated buffers; a background thread writes the other
+	// buffer to disk, so the sampling thread never waits for the file system. When the disk falls
+	// so far behind that the buffer is full, samples are dropped and counted instead of growing
+	// the buffer, so recording never allocates.
+	// Use StatisticsReplay to dump a log or convert it to CSV.
+	class CStatisticsRecorder
+	{
+	private:
+		// Feeds one statistician's snapshots into the recorder under its source id.
+		class CSourceListener : public IStatisticsListener
+		{
+		private:
+			CStatisticsRecorder *m_recorder;
+			uint32_t m_source;
+			uint32_t m_generation;	// the Open() the source was added after
+		public:
+			CSourceListener(CStatisticsRecorder *recorder, uint32_t source, uint32_t generation) : m_recorder(recorder), m_source(source), m_generation(generation) {}
+			void OnStatistics(const StatisticsSnapshot &snapshot) { m_recorder->Record(snapshot, m_source, m_generation); }
+		};
+
+		// Previous sample of a source, which the next sample is delta encoded against.
+		struct SSourceState
+		{
+			int64_t timestampUs;
+			int64_t integers[c_integerStatisticCount];
+			uint32_t textIds[c_textStatisticCount];
+			char texts[c_textStatisticCount][c_maxTextLength];
+			uint64_t registers[c_registerStatisticCount];
+		};
+
+		static const size_t c_bufferSize = 256 * 1024;	// a full buffer is handed to the writer early
+		static const size_t c_bufferCapacity = c_bufferSize * 2;	// preallocated; samples that do not fit are dropped
+
+		// the longest a sample can get: its varints, and a new string for every text.
+		static const size_t c_maxSampleLength = 1 + 10 * (2 + c_integerStatisticCount + c_textStatisticCount + 1 + c_registerStatisticCount)
+			+ c_textStatisticCount * (1 + 10 + 10 + c_maxTextLength);
+
+		FILE *m_file;
+		std::vector<uint8_t> m_buffers[2];
+		size_t m_active;									// buffer that Record() appends to
+		std::thread m_writer;
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		bool m_stop;
+		std::chrono::milliseconds m_flushInterval;
+		uint64_t m_bytesWritten;
+		uint64_t m_droppedSamples;
+		std::unordered_map<std::string, uint32_t> m_stringTable;
+		std::vector<SSourceState> m_sources;
+		std::vector<std::unique_ptr<CSourceListener> > m_listeners;
+		uint32_t m_generation;								// counts Open(); listeners of an older file record nothing
+
+		void Write();
+		// Appends one sample of a source. Thread safe; sources may be sampled by different threads.
+		void Record(const StatisticsSnapshot &snapshot, uint32_t source, uint32_t generation);
+		void Put(const uint8_t *data, size_t length);
+		void PutVarint(uint64_t value);
+		uint32_t Intern(const char *text);
+		static void PutNames(std::vector<uint8_t> &header, EStatisticType type);
+		static const char *FieldAddress(const StatisticsSnapshot &snapshot, const SStatisticInfo &info);
+
+	public:
+		CStatisticsRecorder();
+		~CStatisticsRecorder();
+
+		// Creates the log file and starts the writer thread. Add sources after opening.
+		// Opening again starts a new log with no sources: the listeners returned before stay valid
+		// but record nothing, so add the sources again and register their new listeners.
+		bool Open(const char *path);
+		void Close();
+		bool IsOpen() const;
+
+		// The longest time a recorded sample waits in memory before it is written out.
+		void SetFlushInterval(std::chrono::milliseconds interval);
+
+		// Declares a new source (camera) and returns a listener to register with its statistician:
+		//   myStatistician.AddListener(recorder.AddSource(camera.GetDeviceInfo().GetSerialNumber()));
+		// The recorder owns the listener.
+		IStatisticsListener *AddSource(const char *name);
+
+		uint64_t GetBytesWritten();
+
+		// Samples Record() dropped because the writer fell behind and the buffer was full.
+		uint64_t GetDroppedSamples();
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CStatisticsRecorder::CStatisticsRecorder()
+	: m_file(NULL)
+	, m_active(0)
+	, m_stop(true)
+	, m_flushInterval(1000)
+	, m_bytesWritten(0)
+	, m_droppedSamples(0)
+	, m_generation(0)
+{
+	static_assert(c_booleanStatisticCount <= 64, "a sample has one varint with a bit per boolean");
+}
+
+inline Statistician::CStatisticsRecorder::~CStatisticsRecorder()
+{
+	this->Close();
+}
+
+inline void Statistician::CStatisticsRecorder::PutNames(std::vector<uint8_t> &header, EStatisticType type)
+{
+	for (int i = 0; i < Statistic_Count; i++)
+	{
+		const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+		if (info.type != type)
+			continue;
+		header.push_back(static_cast<uint8_t>(strlen(info.name)));
+		header.insert(header.end(), info.name, info.name + strlen(info.name));
+	}
+}
+
+inline const char *Statistician::CStatisticsRecorder::FieldAddress(const StatisticsSnapshot &snapshot, const SStatisticInfo &info)
+{
+	return reinterpret_cast<const char*>(&snapshot) + info.offset;
+}
+
+inline bool Statistician::CStatisticsRecorder::Open(const char *path)
+{
+	try
+	{
+		Close();
+
+		m_file = fopen(path, "wb");
+		if (m_file == NULL)
+		{
+			std::cout << __FUNCTION__ << " Cannot create " << path << std::endl;
+			return false;
+		}
+
+		for (int i = 0; i < 2; i++)
+		{
+			m_buffers[i].clear();
+			m_buffers[i].reserve(c_bufferCapacity);
+		}
+		m_active = 0;
+		m_bytesWritten = 0;
+		m_droppedSamples = 0;
+		m_stringTable.clear();
+		m_sources.clear();
+
+		// header: magic, version, and the names of everything a sample contains.
+		std::vector<uint8_t> &header = m_buffers[m_active];
+		header.insert(header.end(), c_logMagic, c_logMagic + sizeof(c_logMagic));
+		uint32_t fields[5] = { c_logVersion, c_integerStatisticCount, c_textStatisticCount, c_booleanStatisticCount, c_registerStatisticCount };
+		for (size_t i = 0; i < 5; i++)
+		{
+			uint8_t field[4];
+			EncodeUint32(fields[i], field);
+			header.insert(header.end(), field, field + 4);
+		}
+		PutNames(header, StatisticType_Integer);
+		PutNames(header, StatisticType_Text);
+		PutNames(header, StatisticType_Boolean);
+		PutNames(header, StatisticType_Register);
+
+		// string id 0 is always the empty text.
+		Intern("");
+
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_generation++;
+			m_stop = false;
+		}
+		m_writer = std::thread(&Statistician::CStatisticsRecorder::Write, this);
+		return true;
+	}
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << e.what() << std::endl;
+		return false;
+	}
+}
+
+inline void Statistician::CStatisticsRecorder::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+
+	if (m_writer.joinable())
+		m_writer.join();
+
+	if (m_file != NULL)
+	{
+		fclose(m_file);
+		m_file = NULL;
+	}
+}
+
+inline bool Statistician::CStatisticsRecorder::IsOpen() const
+{
+	return m_file != NULL;
+}
+
+inline void Statistician::CStatisticsRecorder::SetFlushInterval(std::chrono::milliseconds interval)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_flushInterval = interval;
+}
+
+inline Statistician::IStatisticsListener *Statistician::CStatisticsRecorder::AddSource(const char *name)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	uint32_t source = static_cast<uint32_t>(m_sources.size());
+
+	SSourceState state;
+	memset(&state, 0, sizeof(state));
+	m_sources.push_back(state);
+
+	size_t length = strlen(name);
+	uint8_t type = LogRecord_Source;
+	Put(&type, 1);
+	PutVarint(source);
+	PutVarint(length);
+	Put(reinterpret_cast<const uint8_t*>(name), length);
+
+	m_listeners.push_back(std::unique_ptr<CSourceListener>(new CSourceListener(this, source, m_generation)));
+	return m_listeners.back().get();
+}
+
+inline void Statistician::CStatisticsRecorder::Put(const uint8_t *data, size_t length)
+{
+	std::vector<uint8_t> &buffer = m_buffers[m_active];
+	buffer.insert(buffer.end(), data, data + length);
+}
+
+inline void Statistician::CStatisticsRecorder::PutVarint(uint64_t value)
+{
+	uint8_t encoded[10];
+	Put(encoded, EncodeVarint(value, encoded));
+}
+
+inline uint32_t Statistician::CStatisticsRecorder::Intern(const char *text)
+{
+	// only reached when a text changes, so steady-state samples do no lookups.
+	std::unordered_map<std::string, uint32_t>::iterator it = m_stringTable.find(text);
+	if (it != m_stringTable.end())
+		return it->second;
+
+	uint32_t id = static_cast<uint32_t>(m_stringTable.size());
+	m_stringTable[text] = id;
+
+	size_t length = strlen(text);
+	uint8_t type = LogRecord_String;
+	Put(&type, 1);
+	PutVarint(id);
+	PutVarint(length);
+	Put(reinterpret_cast<const uint8_t*>(text), length);
+	return id;
+}
+
+inline void Statistician::CStatisticsRecorder::Record(const StatisticsSnapshot &snapshot, uint32_t source, uint32_t generation)
+{
+	try
+	{
+		std::unique_lock<std::mutex> lock(m_mtx);
+		if (m_stop == true || generation != m_generation || source >= m_sources.size())
+			return;
+
+		// the writer is still busy with the other buffer; growing this one would allocate here.
+		if (m_buffers[m_active].size() + c_maxSampleLength > c_bufferCapacity)
+		{
+			m_droppedSamples++;
+			lock.unlock();
+			m_cv.notify_all();
+			return;
+		}
+
+		SSourceState &state = m_sources[source];
+
+		// new texts go into the string table before the sample that refers to them.
+		size_t text = 0;
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			if (info.type != StatisticType_Text)
+				continue;
+			const char *value = FieldAddress(snapshot, info);
+			if (strcmp(value, state.texts[text]) != 0)
+			{
+				state.textIds[text] = Intern(value);
+				strcpy(state.texts[text], value);
+			}
+			text++;
+		}
+
+		uint8_t type = LogRecord_Sample;
+		Put(&type, 1);
+		PutVarint(source);
+		PutVarint(ZigZagEncode(snapshot.timestampUs - state.timestampUs));
+		state.timestampUs = snapshot.timestampUs;
+
+		size_t integer = 0;
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			if (info.type != StatisticType_Integer)
+				continue;
+			int64_t value = *reinterpret_cast<const int64_t*>(FieldAddress(snapshot, info));
+			PutVarint(ZigZagEncode(value - state.integers[integer]));
+			state.integers[integer] = value;
+			integer++;
+		}
+
+		for (size_t i = 0; i < c_textStatisticCount; i++)
+			PutVarint(state.textIds[i]);
+
+		uint64_t booleans = 0;
+		size_t boolean = 0;
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			if (info.type != StatisticType_Boolean)
+				continue;
+			if (*reinterpret_cast<const bool*>(FieldAddress(snapshot, info)) == true)
+				booleans |= static_cast<uint64_t>(1) << boolean;
+			boolean++;
+		}
+		PutVarint(booleans);
+
+		size_t reg = 0;
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			if (info.type != StatisticType_Register)
+				continue;
+			uint64_t value = *reinterpret_cast<const uint64_t*>(FieldAddress(snapshot, info));
+			PutVarint(ZigZagEncode(static_cast<int64_t>(value - state.registers[reg])));
+			state.registers[reg] = value;
+			reg++;
+		}
+
+		bool isFull = m_buffers[m_active].size() >= c_bufferSize;
+		lock.unlock();
+
+		if (isFull == true)
+			m_cv.notify_all();
+	}
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << e.what() << std::endl;
+	}
+}
+
+inline void Statistician::CStatisticsRecorder::Write()
+{
+	std::unique_lock<std::mutex> lock(m_mtx);
+	for (;;)
+	{
+		bool isStopping = m_stop;
+		if (isStopping == false)
+		{
+			m_cv.wait_for(lock, m_flushInterval, [this] { return m_stop == true || m_buffers[m_active].size() >= c_bufferSize; });
+			isStopping = m_stop;
+		}
+
+		// swap buffers so recording continues while the full one is written.
+		std::vector<uint8_t> &full = m_buffers[m_active];
+		m_active = 1 - m_active;
+		lock.unlock();
+
+		if (full.empty() == false)
+		{
+			fwrite(&full[0], 1, full.size(), m_file);
+			fflush(m_file);
+		}
+
+		lock.lock();
+		m_bytesWritten += full.size();
+		full.clear();
+
+		if (isStopping == true)
+		{
+			// pick up whatever was recorded while the last buffer was written.
+			std::vector<uint8_t> &rest = m_buffers[m_active];
+			if (rest.empty() == false)
+			{
+				fwrite(&rest[0], 1, rest.size(), m_file);
+				fflush(m_file);
+				m_bytesWritten += rest.size();
+				rest.clear();
+			}
+			return;
+		}
+	}
+}
+
+inline uint64_t Statistician::CStatisticsRecorder::GetBytesWritten()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_bytesWritten;
+}
+
+inline uint64_t Statistician::CStatisticsRecorder::GetDroppedSamples()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_droppedSamples;
+}
+
+// *********************************************************************************************************
+#endif
@@ -0,0 +1,461 @@
+// StatisticsReplay.cpp
+// Dumps, filters or converts a binary statistics log written by CStatisticsRecorder
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Usage: StatisticsReplay <log file> [options]
+//   --csv               write CSV instead of the readable dump
+//   --counter <name>    only show this integer or register (repeatable); texts are dropped unless
+//                       --text is given
+//   --text <name>       only show this text (repeatable)
+//   --source <id>       only show samples of this source
+//   --from <seconds>    skip samples earlier than this, relative to the first sample
+//   --to <seconds>      stop after samples later than this, relative to the first sample
+//   --changes           only show samples where a shown value changed
+
+// No pylon dependency: this tool only needs the log format.
+#include "StatisticsLogFormat.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Statistician;
+
+// Read-only memory mapping of the whole log, so records are decoded in place.
+class CMappedFile
+{
+private:
+	const uint8_t *m_data;
+	size_t m_size;
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_mapping;
+#endif
+
+public:
+	CMappedFile() : m_data(NULL), m_size(0) {}
+	~CMappedFile()
+	{
+#ifdef _WIN32
+		if (m_data != NULL)
+		{
+			UnmapViewOfFile(m_data);
+			CloseHandle(m_mapping);
+			CloseHandle(m_file);
+		}
+#else
+		if (m_data != NULL)
+			munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+	}
+
+	bool Open(const char *path)
+	{
+#ifdef _WIN32
+		m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		GetFileSizeEx(m_file, &size);
+		m_size = static_cast<size_t>(size.QuadPart);
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping == NULL)
+		{
+			CloseHandle(m_file);
+			return false;
+		}
+		m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		return m_data != NULL;
+#else
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+		m_size = static_cast<size_t>(info.st_size);
+		void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+			return false;
+		madvise(data, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const uint8_t*>(data);
+		return true;
+#endif
+	}
+
+	const uint8_t *GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+};
+
+// Last decoded state of one source.
+struct SSource
+{
+	string name;
+	bool isDeclared;			// a source record was read; samples of other ids are a corrupt log
+	bool hasSamples;
+	int64_t timestampUs;
+	vector<int64_t> counters;
+	vector<uint64_t> textIds;
+	uint64_t booleans;			// bit i for booleanNames[i]
+	vector<uint64_t> registers;
+};
+
+static bool ReadName(const uint8_t *&data, const uint8_t *end, string &name)
+{
+	if (data >= end || data + 1 + *data > end)
+		return false;
+	size_t length = *data++;
+	name.assign(reinterpret_cast<const char*>(data), length);
+	data += length;
+	return true;
+}
+
+static string EscapeCsv(const string &text)
+{
+	string escaped = "\"";
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] == '"')
+			escaped += "\"\"";
+		else if (text[i] != '\n' && text[i] != '\r')
+			escaped += text[i];
+	}
+	return escaped + "\"";
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		cerr << "Usage: " << argv[0] << " <log file> [--csv] [--counter <name>]... [--text <name>]... [--source <id>] [--from <s>] [--to <s>] [--changes]" << endl;
+		return 1;
+	}
+
+	bool csv = false;
+	bool changesOnly = false;
+	long long sourceFilter = -1;
+	double from = -1.0;
+	double to = -1.0;
+	vector<string> counterFilter;
+	vector<string> textFilter;
+	for (int i = 2; i < argc; i++)
+	{
+		string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--csv")
+			csv = true;
+		else if (option == "--changes")
+			changesOnly = true;
+		else if (option == "--counter" && hasValue)
+			counterFilter.push_back(argv[++i]);
+		else if (option == "--text" && hasValue)
+			textFilter.push_back(argv[++i]);
+		else if (option == "--source" && hasValue)
+			sourceFilter = atoll(argv[++i]);
+		else if (option == "--from" && hasValue)
+			from = atof(argv[++i]);
+		else if (option == "--to" && hasValue)
+			to = atof(argv[++i]);
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	CMappedFile log;
+	if (log.Open(argv[1]) == false)
+	{
+		cerr << "Cannot open " << argv[1] << endl;
+		return 1;
+	}
+
+	const uint8_t *data = log.GetData();
+	const uint8_t *end = data + log.GetSize();
+
+	// header: version 1 logs have no boolean and register counts (see StatisticsLogFormat.h).
+	uint32_t fields[5] = { 0, 0, 0, 0, 0 };
+	if (log.GetSize() < sizeof(c_logMagic) + 3 * sizeof(uint32_t) || memcmp(data, c_logMagic, sizeof(c_logMagic)) != 0)
+	{
+		cerr << argv[1] << " is not a statistics log." << endl;
+		return 1;
+	}
+	data += sizeof(c_logMagic);
+	uint32_t version = DecodeUint32(data);
+	if (version != 1 && version != c_logVersion)
+	{
+		cerr << "Unsupported log version " << version << endl;
+		return 1;
+	}
+	size_t fieldsLength = (version == 1 ? 3 : 5) * sizeof(uint32_t);
+	if (static_cast<size_t>(end - data) < fieldsLength)
+		return 1;
+	for (size_t i = 0; i < fieldsLength / sizeof(uint32_t); i++)
+		fields[i] = DecodeUint32(data + i * sizeof(uint32_t));
+	data += fieldsLength;
+
+	vector<string> counterNames(fields[1]);
+	vector<string> textNames(fields[2]);
+	vector<string> booleanNames(fields[3]);
+	vector<string> registerNames(fields[4]);
+	for (size_t i = 0; i < counterNames.size(); i++)
+	{
+		if (ReadName(data, end, counterNames[i]) == false)
+			return 1;
+	}
+	for (size_t i = 0; i < textNames.size(); i++)
+	{
+		if (ReadName(data, end, textNames[i]) == false)
+			return 1;
+	}
+	for (size_t i = 0; i < booleanNames.size(); i++)
+	{
+		if (ReadName(data, end, booleanNames[i]) == false)
+			return 1;
+	}
+	for (size_t i = 0; i < registerNames.size(); i++)
+	{
+		if (ReadName(data, end, registerNames[i]) == false)
+			return 1;
+	}
+	if (version == 1)
+	{
+		// the two LogFlag_* bits, in bit order.
+		booleanNames.push_back("criticalTemp");
+		booleanNames.push_back("overTemp");
+	}
+	if (booleanNames.size() > 64)
+	{
+		cerr << "More booleans than a sample has bits for." << endl;
+		return 1;
+	}
+
+	// which columns to show
+	bool filtered = !counterFilter.empty() || !textFilter.empty();
+	vector<size_t> shownCounters;
+	vector<size_t> shownTexts;
+	vector<size_t> shownRegisters;
+	for (size_t i = 0; i < counterNames.size(); i++)
+	{
+		if (filtered == false || find(counterFilter.begin(), counterFilter.end(), counterNames[i]) != counterFilter.end())
+			shownCounters.push_back(i);
+	}
+	for (size_t i = 0; i < registerNames.size(); i++)
+	{
+		if (filtered == false || find(counterFilter.begin(), counterFilter.end(), registerNames[i]) != counterFilter.end())
+			shownRegisters.push_back(i);
+	}
+	for (size_t i = 0; i < textNames.size(); i++)
+	{
+		if (filtered == false || find(textFilter.begin(), textFilter.end(), textNames[i]) != textFilter.end())
+			shownTexts.push_back(i);
+	}
+
+	if (csv == true)
+	{
+		cout << "time_s,source";
+		for (size_t i = 0; i < shownCounters.size(); i++)
+			cout << "," << counterNames[shownCounters[i]];
+		for (size_t i = 0; i < shownTexts.size(); i++)
+			cout << "," << textNames[shownTexts[i]];
+		for (size_t i = 0; i < booleanNames.size(); i++)
+			cout << "," << booleanNames[i];
+		for (size_t i = 0; i < shownRegisters.size(); i++)
+			cout << "," << registerNames[shownRegisters[i]];
+		cout << "\n";
+	}
+
+	vector<string> strings;
+	vector<SSource> sources;
+	bool hasOrigin = false;
+	int64_t originUs = 0;
+	uint64_t sampleCount = 0;
+
+	while (data < end)
+	{
+		uint8_t type = *data++;
+		uint64_t id = 0;
+		uint64_t length = 0;
+
+		if (type == LogRecord_String || type == LogRecord_Source)
+		{
+			if (DecodeVarint(data, end, id) == false || DecodeVarint(data, end, length) == false || length > static_cast<uint64_t>(end - data))
+				break;
+			string text(reinterpret_cast<const char*>(data), static_cast<size_t>(length));
+			data += length;
+
+			if (type == LogRecord_String)
+			{
+				if (strings.size() <= id)
+					strings.resize(static_cast<size_t>(id) + 1);
+				strings[static_cast<size_t>(id)] = text;
+			}
+			else
+			{
+				if (sources.size() <= id)
+					sources.resize(static_cast<size_t>(id) + 1, SSource());
+				SSource &source = sources[static_cast<size_t>(id)];
+				source.name = text;
+				source.isDeclared = true;
+				source.hasSamples = false;
+				source.timestampUs = 0;
+				source.counters.assign(counterNames.size(), 0);
+				source.textIds.assign(textNames.size(), 0);
+				source.booleans = 0;
+				source.registers.assign(registerNames.size(), 0);
+			}
+		}
+		else if (type == LogRecord_Sample)
+		{
+			uint64_t value = 0;
+			if (DecodeVarint(data, end, id) == false)
+				break;
+			if (id >= sources.size() || sources[static_cast<size_t>(id)].isDeclared == false)
+			{
+				cerr << "Sample of undeclared source " << id << ", stopping." << endl;
+				break;
+			}
+			SSource &source = sources[static_cast<size_t>(id)];
+			vector<int64_t> previousCounters = source.counters;
+			vector<uint64_t> previousTexts = source.textIds;
+			uint64_t previousBooleans = source.booleans;
+			vector<uint64_t> previousRegisters = source.registers;
+
+			if (DecodeVarint(data, end, value) == false)
+				break;
+			source.timestampUs += ZigZagDecode(value);
+
+			bool isComplete = true;
+			for (size_t i = 0; i < counterNames.size() && isComplete; i++)
+			{
+				isComplete = DecodeVarint(data, end, value);
+				source.counters[i] += ZigZagDecode(value);
+			}
+			for (size_t i = 0; i < textNames.size() && isComplete; i++)
+				isComplete = DecodeVarint(data, end, source.textIds[i]);
+			if (version == 1 && isComplete == true && data < end)
+			{
+				uint8_t flags = *data++;
+				source.booleans = ((flags & LogFlag_CriticalTemperature) ? 1 : 0) | ((flags & LogFlag_OverTemperature) ? 2 : 0);
+			}
+			else if (version == 1 || isComplete == false)
+				isComplete = false;
+			else
+				isComplete = DecodeVarint(data, end, source.booleans);
+			for (size_t i = 0; i < registerNames.size() && isComplete; i++)
+			{
+				isComplete = DecodeVarint(data, end, value);
+				source.registers[i] += static_cast<uint64_t>(ZigZagDecode(value));
+			}
+			if (isComplete == false)
+				break; // the log was cut off in the middle of a sample
+
+			if (hasOrigin == false)
+			{
+				hasOrigin = true;
+				originUs = source.timestampUs;
+			}
+			double seconds = static_cast<double>(source.timestampUs - originUs) / 1e6;
+			bool isFirst = !source.hasSamples;
+			source.hasSamples = true;
+			sampleCount++;
+
+			if (sourceFilter >= 0 && static_cast<long long>(id) != sourceFilter)
+				continue;
+			if (from >= 0.0 && seconds < from)
+				continue;
+			if (to >= 0.0 && seconds > to)
+				break;
+
+			if (changesOnly == true && isFirst == false)
+			{
+				bool changed = (source.booleans != previousBooleans);
+				for (size_t i = 0; i < shownCounters.size() && !changed; i++)
+					changed = (source.counters[shownCounters[i]] != previousCounters[shownCounters[i]]);
+				for (size_t i = 0; i < shownRegisters.size() && !changed; i++)
+					changed = (source.registers[shownRegisters[i]] != previousRegisters[shownRegisters[i]]);
+				for (size_t i = 0; i < shownTexts.size() && !changed; i++)
+					changed = (source.textIds[shownTexts[i]] != previousTexts[shownTexts[i]]);
+				if (changed == false)
+					continue;
+			}
+
+			if (csv == true)
+			{
+				cout << seconds << "," << id;
+				for (size_t i = 0; i < shownCounters.size(); i++)
+					cout << "," << source.counters[shownCounters[i]];
+				for (size_t i = 0; i < shownTexts.size(); i++)
+				{
+					uint64_t textId = source.textIds[shownTexts[i]];
+					cout << "," << EscapeCsv(textId < strings.size() ? strings[static_cast<size_t>(textId)] : "");
+				}
+				for (size_t i = 0; i < booleanNames.size(); i++)
+					cout << "," << ((source.booleans >> i) & 1);
+				for (size_t i = 0; i < shownRegisters.size(); i++)
+					cout << "," << source.registers[shownRegisters[i]];
+				cout << "\n";
+			}
+			else
+			{
+				cout << "[" << seconds << " s] " << source.name << " (" << id << ")" << "\n";
+				for (size_t i = 0; i < shownCounters.size(); i++)
+					cout << "   " << counterNames[shownCounters[i]] << " : " << source.counters[shownCounters[i]] << "\n";
+				for (size_t i = 0; i < shownTexts.size(); i++)
+				{
+					uint64_t textId = source.textIds[shownTexts[i]];
+					string text = textId < strings.size() ? strings[static_cast<size_t>(textId)] : "";
+					cout << "   " << textNames[shownTexts[i]] << " : " << text.substr(0, text.find('\n')) << "\n";
+				}
+				if (source.booleans != 0)
+				{
+					cout << "   ";
+					for (size_t i = 0; i < booleanNames.size(); i++)
+						cout << (i > 0 ? ", " : "") << booleanNames[i] << " : " << ((source.booleans >> i) & 1);
+					cout << "\n";
+				}
+				for (size_t i = 0; i < shownRegisters.size(); i++)
+					cout << "   " << registerNames[shownRegisters[i]] << " : " << source.registers[shownRegisters[i]] << "\n";
+			}
+		}
+		else
+		{
+			cerr << "Unknown record type " << static_cast<int>(type) << ", stopping." << endl;
+			break;
+		}
+	}
+
+	if (csv == false)
+		cout << sampleCount << " samples, " << sources.size() << " sources, " << strings.size() << " distinct texts" << endl;
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+// StatisticsSchema.h
+// The one list of statistics that the snapshot, the enums and the description tables are generated from
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSSCHEMA_H
+#define STATISTICSSCHEMA_H
+
+// No pylon dependency, and no declarations: the list is a macro that StatisticsSnapshot.h expands
+// into the EStatistic and ECounter enums, the fields of StatisticsSnapshot, the tables behind
+// GetStatisticInfo() and GetCounterInfo(), the number of statistics of each type, and
+// ResetStatisticsSnapshot(). The sampler, the output formats, the recorder, the pool's fleet totals
+// and the history work from those tables, so adding a statistic is one line here: the probe plan
+// picks it up for the device classes it names, every output format prints it and the recorder
+// logs it. The shared-memory segment is a fixed C layout (StatisticsShm.h); it follows the
+// counters and the registers, and needs a new version for any other new statistic.
+//
+// One line per statistic, in the order they are printed:
+//   STATISTIC(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble)
+//     id         Statistic_<id>, and Counter_<id> if 'counter' is true
+//     field      field name in StatisticsSnapshot, also the statistic's name in every output format
+//     counter    true for integers kept in the history and the shared-memory segment (see ECounter); counters of
+//                kind StatisticKind_Counter are also stitched across resets (see SLifecycleStatistics)
+//   The other columns are those of SStatisticInfo.
+
+#define STATISTICIAN_STATISTICS(STATISTIC) \
+	STATISTIC(LastError, lastError, "Last Error", "Other Errors logged", StatisticSection_Camera, StatisticType_Text, StatisticKind_Info, false, DeviceClass_All, StatisticGroup_Grabber, NodeMap_StreamGrabber, "LastError", 0, true, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(CurrentTemperature, currentTemperature, "Current Temperature", NULL, StatisticSection_Camera, StatisticType_Integer, StatisticKind_Gauge, true, DeviceClass_All, StatisticGroup_Temperature, NodeMap_Device, "TemperatureAbs", 0, false, StatisticUpdate_Poll, NULL, false) \
+	STATISTIC(TemperatureState, temperatureState, "Temperature State", NULL, StatisticSection_Camera, StatisticType_Text, StatisticKind_Info, false, DeviceClass_All, StatisticGroup_Temperature, NodeMap_Device, "TemperatureState", 0, false, StatisticUpdate_Poll, NULL, false) \
+	STATISTIC(CriticalTemp, criticalTemp, "Critical Temperature", NULL, StatisticSection_Camera, StatisticType_Boolean, StatisticKind_Gauge, false, DeviceClass_All, StatisticGroup_Temperature, NodeMap_Device, "CriticalTemperature", 0, false, StatisticUpdate_OnChange, "CriticalTemperature", false) \
+	STATISTIC(OverTemp, overTemp, "Over Temperature", NULL, StatisticSection_Camera, StatisticType_Boolean, StatisticKind_Gauge, false, DeviceClass_All, StatisticGroup_Temperature, NodeMap_Device, "OverTemperature", 0, false, StatisticUpdate_OnChange, "OverTemperature", false) \
+	STATISTIC(TotalBuffers, totalBuffers, "Total Processed Buffers", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_All, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Total_Buffer_Count", 0, false, StatisticUpdate_Poll, NULL, false) \
+	STATISTIC(FailedBuffers, failedBuffers, "Total Failed Buffers", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_All, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Failed_Buffer_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(BufferUnderruns, bufferUnderruns, "Total buffer underruns", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_GigE, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Buffer_Underrun_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(LastBlockID, lastBlockID, "Last BlockID (starts at 0)", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Gauge, true, DeviceClass_Usb, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Last_Block_Id", 0, false, StatisticUpdate_Poll, NULL, false) \
+	STATISTIC(MissedFrameCount, missedFrameCount, "Total Missed Frames", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_Usb, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Missed_Frame_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(ResyncCount, resyncCount, "Total Resynchronizations", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_Usb, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Resynchronization_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(LastFailedBufferStatus, lastFailedBufferStatus, "Last Failed Buffer Status", NULL, StatisticSection_GrabEngine, StatisticType_Integer, StatisticKind_Gauge, false, DeviceClass_All, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Last_Failed_Buffer_Status", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(LastFailedBufferStatusText, lastFailedBufferStatusText, "Last Failed Buffer Status Text", "Other Failed Buffer Status Text logged", StatisticSection_GrabEngine, StatisticType_Text, StatisticKind_Info, false, DeviceClass_All, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Last_Failed_Buffer_Status_Text", 0, true, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(TotalPackets, totalPackets, "Total Packets Received", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_GigE, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Total_Packet_Count", 0, false, StatisticUpdate_Poll, NULL, false) \
+	STATISTIC(ResendRequests, resendRequests, "Total Packet Resend Requests", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_GigE, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Resend_Request_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(ResendPackets, resendPackets, "Total Resent Packets", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_GigE, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Resend_Packet_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(FailedPackets, failedPackets, "Total Failed (unrecoverable) Packets", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_GigE, StatisticGroup_Grabber, NodeMap_StreamGrabber, "Statistic_Failed_Packet_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(ReadPipeResetCount, readPipeResetCount, "Read Pipe Reset Count", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_Usb, StatisticGroup_Transport, NodeMap_TransportLayer, "Statistic_Read_Pipe_Reset_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(WritePipeResetCount, writePipeResetCount, "Write Pipe Reset Count", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_Usb, StatisticGroup_Transport, NodeMap_TransportLayer, "Statistic_Write_Pipe_Reset_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(ReadOperationsFailedCount, readOperationsFailedCount, "Read Operations Failed Count", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_Usb, StatisticGroup_Transport, NodeMap_TransportLayer, "Statistic_Read_Operations_Failed_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(WriteOperationsFailedCount, writeOperationsFailedCount, "Write Operations Failed Count", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Counter, true, DeviceClass_Usb, StatisticGroup_Transport, NodeMap_TransportLayer, "Statistic_Write_Operations_Failed_Count", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(TLLastErrorStatus, tlLastErrorStatus, "Last Error Status", NULL, StatisticSection_TransportLayer, StatisticType_Integer, StatisticKind_Gauge, false, DeviceClass_All, StatisticGroup_Transport, NodeMap_TransportLayer, "Statistic_Last_Error_Status", 0, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(TLLastErrorStatusText, tlLastErrorStatusText, "Last Error Status Text", "Other Error Status Text logged", StatisticSection_TransportLayer, StatisticType_Text, StatisticKind_Info, false, DeviceClass_All, StatisticGroup_Transport, NodeMap_TransportLayer, "Statistic_Last_Error_Status_Text", 0, true, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(EPU, EPU, "EPU", NULL, StatisticSection_TransportLayer, StatisticType_Register, StatisticKind_Gauge, false, DeviceClass_Usb, StatisticGroup_UsbErrorRegisters, NodeMap_Device, NULL, 0xAFFB0010, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(PE, PE, "PE", NULL, StatisticSection_TransportLayer, StatisticType_Register, StatisticKind_Gauge, false, DeviceClass_Usb, StatisticGroup_UsbErrorRegisters, NodeMap_Device, NULL, 0xAFFB0004, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(UR, UR, "UR", NULL, StatisticSection_TransportLayer, StatisticType_Register, StatisticKind_Gauge, false, DeviceClass_Usb, StatisticGroup_UsbErrorRegisters, NodeMap_Device, NULL, 0xAFFB000C, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(EPR, EPR, "EPR", NULL, StatisticSection_TransportLayer, StatisticType_Register, StatisticKind_Gauge, false, DeviceClass_Usb, StatisticGroup_UsbErrorRegisters, NodeMap_Device, NULL, 0xAFFB0020, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(LE, LE, "LE", NULL, StatisticSection_TransportLayer, StatisticType_Register, StatisticKind_Gauge, false, DeviceClass_Usb, StatisticGroup_UsbErrorRegisters, NodeMap_Device, NULL, 0xAFFB0008, false, StatisticUpdate_Poll, NULL, true) \
+	STATISTIC(LR, LR, "LR", NULL, StatisticSection_TransportLayer, StatisticType_Register, StatisticKind_Gauge, false, DeviceClass_Usb, StatisticGroup_UsbErrorRegisters, NodeMap_Device, NULL, 0xAFFB0014, false, StatisticUpdate_Poll, NULL, true)
+
+// Picks the argument for a statistic's type, to declare its field in the pass of that type.
+#define STATISTICIAN_BY_TYPE_StatisticType_Integer(integer, boolean, text, reg) integer
+#define STATISTICIAN_BY_TYPE_StatisticType_Boolean(integer, boolean, text, reg) boolean
+#define STATISTICIAN_BY_TYPE_StatisticType_Text(integer, boolean, text, reg) text
+#define STATISTICIAN_BY_TYPE_StatisticType_Register(integer, boolean, text, reg) reg
+
+// Keeps its argument for statistics with 'counter' true.
+#define STATISTICIAN_IF_COUNTER_true(...) __VA_ARGS__
+#define STATISTICIAN_IF_COUNTER_false(...)
+
+#endif
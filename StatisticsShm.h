@@ -0,0 +1,142 @@
+// StatisticsShm.h
+// Layout of the shared-memory statistics segment, and the C reader library that reads it
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSSHM_H
+#define STATISTICSSHM_H
+
+#include <stdint.h>
+
+// Plain C, so monitoring tools in any language with a C FFI can read the segment without the
+// statistician or pylon. CStatisticsShmWriter (StatisticsShmWriter.h) writes it, StatisticsShmReader.c
+// reads it, StatisticsTop shows it.
+//
+// The segment is one header followed by slotCount slots, one per camera. Each slot is a seqlock:
+// its writer makes 'sequence' odd, writes the slot, and makes it even again. A reader copies the
+// slot and keeps the copy only if 'sequence' was even and unchanged across the copy, so reading
+// takes no lock and no system call, and the writer never waits for a reader.
+//
+// Compatibility: a new major version changes the layout. Within a version, fields are only
+// appended to the header or a slot, and readers use headerSize and slotSize to find the slots.
+
+#define STATISTICS_SHM_MAGIC 0x4D485354u	// "TSHM" in memory on little endian
+#define STATISTICS_SHM_VERSION 1u
+#define STATISTICS_SHM_NAME_LENGTH 64
+#define STATISTICS_SHM_TEXT_LENGTH 256		// same as Statistician::c_maxTextLength
+#define STATISTICS_SHM_MAX_COUNTERS 32		// room for more counters without a new version
+#define STATISTICS_SHM_COUNTER_NAME_LENGTH 32
+#define STATISTICS_SHM_REGISTER_COUNT 6
+
+// StatisticsShmSlot::state
+#define STATISTICS_SHM_SLOT_FREE 0u
+#define STATISTICS_SHM_SLOT_ACTIVE 1u		// a camera is published into the slot
+#define STATISTICS_SHM_SLOT_STOPPED 2u		// the writer closed; the slot keeps its last sample
+
+// StatisticsShm_ReadSlot() results
+#define STATISTICS_SHM_OK 0
+#define STATISTICS_SHM_EMPTY 1				// the slot is not used
+#define STATISTICS_SHM_BUSY 2				// the slot was written during every attempt; try again later
+#define STATISTICS_SHM_INVALID 3			// bad reader or slot index
+
+// Ordering of the sequence accesses. GCC and Clang use their atomic builtins. MSVC on x86 and x64
+// gets acquire and release from volatile accesses, and only the compiler must not reorder.
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#    define STATISTICS_SHM_LOAD_ACQUIRE(p) (*(volatile const uint32_t*)(p))
+#    define STATISTICS_SHM_LOAD_RELAXED(p) (*(volatile const uint32_t*)(p))
+#    define STATISTICS_SHM_STORE_RELEASE(p, v) (*(volatile uint32_t*)(p) = (v))
+#    define STATISTICS_SHM_STORE_RELAXED(p, v) (*(volatile uint32_t*)(p) = (v))
+#    define STATISTICS_SHM_ACQUIRE_FENCE() _ReadWriteBarrier()
+#    define STATISTICS_SHM_RELEASE_FENCE() _ReadWriteBarrier()
+#else
+#    define STATISTICS_SHM_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#    define STATISTICS_SHM_LOAD_RELAXED(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#    define STATISTICS_SHM_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#    define STATISTICS_SHM_STORE_RELAXED(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#    define STATISTICS_SHM_ACQUIRE_FENCE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#    define STATISTICS_SHM_RELEASE_FENCE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Written once when the segment is created. 1088 bytes, so the slots start on a cache line.
+typedef struct StatisticsShmHeader
+{
+	uint32_t magic;					// STATISTICS_SHM_MAGIC
+	uint32_t version;				// STATISTICS_SHM_VERSION
+	uint32_t headerSize;			// offset of the first slot
+	uint32_t slotSize;				// distance between slots
+	uint32_t slotCount;
+	uint32_t counterCount;			// used entries of counterNames and StatisticsShmSlot::counters
+	uint32_t textLength;			// STATISTICS_SHM_TEXT_LENGTH
+	uint32_t reserved0;
+	uint64_t writerProcessId;
+	int64_t createdUs;				// writer's steady clock when the segment was created
+	char counterNames[STATISTICS_SHM_MAX_COUNTERS][STATISTICS_SHM_COUNTER_NAME_LENGTH];	// Statistician::GetCounterInfo() names
+	uint8_t reserved1[16];
+} StatisticsShmHeader;
+
+// One camera. 1472 bytes. Every field but 'sequence' is only valid in a copy made by
+// StatisticsShm_ReadSlot(). Counters the device does not provide are -1, texts "-1".
+typedef struct StatisticsShmSlot
+{
+	uint32_t sequence;				// odd while the writer is writing the slot
+	uint32_t state;					// STATISTICS_SHM_SLOT_*
+	char name[STATISTICS_SHM_NAME_LENGTH];
+	uint64_t sampleSequence;		// StatisticsSnapshot::sequence
+	int64_t timestampUs;			// steady clock time of the sample pass, in the writer's process
+	uint64_t available;				// bit (1 << EStatistic) for every statistic the device provides
+	int64_t counters[STATISTICS_SHM_MAX_COUNTERS];	// in the order of StatisticsShmHeader::counterNames
+	int64_t lastFailedBufferStatus;
+	int64_t tlLastErrorStatus;
+	uint64_t usbErrorRegisters[STATISTICS_SHM_REGISTER_COUNT];	// the register statistics in schema order: EPU, PE, UR, EPR, LE, LR
+	uint32_t criticalTemp;
+	uint32_t overTemp;
+	uint32_t errorTextCount;		// distinct error texts seen (see StatisticsErrorLog)
+	uint32_t droppedErrorTexts;
+	char lastError[STATISTICS_SHM_TEXT_LENGTH];
+	char lastFailedBufferStatusText[STATISTICS_SHM_TEXT_LENGTH];
+	char tlLastErrorStatusText[STATISTICS_SHM_TEXT_LENGTH];
+	char temperatureState[STATISTICS_SHM_TEXT_LENGTH];
+	uint8_t reserved[16];
+} StatisticsShmSlot;
+
+// Reader library (StatisticsShmReader.c).
+typedef struct StatisticsShmReader StatisticsShmReader;
+
+// Maps the segment read-only. 'name' is the name given to CStatisticsShmWriter::Create(). Returns
+// NULL if there is no such segment, or it has another version or a broken header.
+StatisticsShmReader *StatisticsShm_Open(const char *name);
+void StatisticsShm_Close(StatisticsShmReader *reader);
+
+// The header in the mapping. It does not change after the segment was created.
+const StatisticsShmHeader *StatisticsShm_GetHeader(const StatisticsShmReader *reader);
+
+// Index of a counter in StatisticsShmSlot::counters, -1 if the writer does not publish it.
+int StatisticsShm_FindCounter(const StatisticsShmReader *reader, const char *counterName);
+
+// Copies a consistent slot into 'slot'. Returns STATISTICS_SHM_OK, or another
+// STATISTICS_SHM_* result; 'slot' is then undefined.
+int StatisticsShm_ReadSlot(const StatisticsShmReader *reader, uint32_t index, StatisticsShmSlot *slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+// StatisticsShmReader.c
+// C reader library of the shared-memory statistics segment (see StatisticsShm.h)
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "StatisticsShm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    include <windows.h>
+#else
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+// Attempts before StatisticsShm_ReadSlot() reports STATISTICS_SHM_BUSY, so a writer that died in
+// the middle of a write can't hang its readers. A write takes well under a microsecond.
+#define STATISTICS_SHM_READ_RETRIES 1000
+
+struct StatisticsShmReader
+{
+	const uint8_t *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+};
+
+// Checks that the header is one this library understands and that the slots fit the mapping.
+static int IsValidHeader(const StatisticsShmHeader *header, size_t size)
+{
+	if (size < sizeof(StatisticsShmHeader))
+		return 0;
+	if (header->magic != STATISTICS_SHM_MAGIC || header->version != STATISTICS_SHM_VERSION)
+		return 0;
+	if (header->headerSize < sizeof(StatisticsShmHeader) || header->slotSize < sizeof(StatisticsShmSlot))
+		return 0;
+	if (header->counterCount > STATISTICS_SHM_MAX_COUNTERS || header->textLength != STATISTICS_SHM_TEXT_LENGTH)
+		return 0;
+	return (uint64_t)header->headerSize + (uint64_t)header->slotSize * header->slotCount <= (uint64_t)size;
+}
+
+StatisticsShmReader *StatisticsShm_Open(const char *name)
+{
+	StatisticsShmReader *reader = (StatisticsShmReader*)calloc(1, sizeof(StatisticsShmReader));
+	if (reader == NULL || name == NULL)
+	{
+		free(reader);
+		return NULL;
+	}
+
+#ifdef _WIN32
+	{
+		MEMORY_BASIC_INFORMATION region;
+		reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, (name[0] == '/') ? name + 1 : name);
+		if (reader->mapping == NULL)
+		{
+			free(reader);
+			return NULL;
+		}
+		reader->data = (const uint8_t*)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+		if (reader->data != NULL && VirtualQuery(reader->data, &region, sizeof(region)) == sizeof(region))
+			reader->size = region.RegionSize;
+	}
+#else
+	{
+		// POSIX names start with a slash; the writer adds it the same way.
+		char path[STATISTICS_SHM_NAME_LENGTH + 2];
+		struct stat status;
+		int fd;
+		path[0] = '/';
+		strncpy(path + 1, (name[0] == '/') ? name + 1 : name, sizeof(path) - 2);
+		path[sizeof(path) - 1] = '\0';
+
+		fd = shm_open(path, O_RDONLY, 0);
+		if (fd < 0)
+		{
+			free(reader);
+			return NULL;
+		}
+		if (fstat(fd, &status) == 0 && status.st_size > 0)
+		{
+			void *data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (data != MAP_FAILED)
+			{
+				reader->data = (const uint8_t*)data;
+				reader->size = (size_t)status.st_size;
+			}
+		}
+		close(fd);
+	}
+#endif
+
+	if (reader->data == NULL || IsValidHeader((const StatisticsShmHeader*)reader->data, reader->size) == 0)
+	{
+		StatisticsShm_Close(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+void StatisticsShm_Close(StatisticsShmReader *reader)
+{
+	if (reader == NULL)
+		return;
+#ifdef _WIN32
+	if (reader->data != NULL)
+		UnmapViewOfFile(reader->data);
+	if (reader->mapping != NULL)
+		CloseHandle(reader->mapping);
+#else
+	if (reader->data != NULL)
+		munmap((void*)reader->data, reader->size);
+#endif
+	free(reader);
+}
+
+const StatisticsShmHeader *StatisticsShm_GetHeader(const StatisticsShmReader *reader)
+{
+	return (reader != NULL) ? (const StatisticsShmHeader*)reader->data : NULL;
+}
+
+int StatisticsShm_FindCounter(const StatisticsShmReader *reader, const char *counterName)
+{
+	const StatisticsShmHeader *header = StatisticsShm_GetHeader(reader);
+	uint32_t i;
+	if (header == NULL || counterName == NULL)
+		return -1;
+	for (i = 0; i < header->counterCount; i++)
+	{
+		if (strncmp(header->counterNames[i], counterName, STATISTICS_SHM_COUNTER_NAME_LENGTH) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+int StatisticsShm_ReadSlot(const StatisticsShmReader *reader, uint32_t index, StatisticsShmSlot *slot)
+{
+	const StatisticsShmHeader *header = StatisticsShm_GetHeader(reader);
+	const StatisticsShmSlot *shared;
+	int retry;
+
+	if (header == NULL || slot == NULL || index >= header->slotCount)
+		return STATISTICS_SHM_INVALID;
+	shared = (const StatisticsShmSlot*)(reader->data + header->headerSize + (size_t)header->slotSize * index);
+
+	// only the part this library knows is copied; a writer of the same version may append fields.
+	for (retry = 0; retry < STATISTICS_SHM_READ_RETRIES; retry++)
+	{
+		uint32_t before = STATISTICS_SHM_LOAD_ACQUIRE(&shared->sequence);
+		if ((before & 1) != 0)
+			continue;
+
+		memcpy(slot, shared, sizeof(StatisticsShmSlot));
+		STATISTICS_SHM_ACQUIRE_FENCE();
+		if (STATISTICS_SHM_LOAD_RELAXED(&shared->sequence) != before)
+			continue;
+
+		if (slot->state == STATISTICS_SHM_SLOT_FREE)
+			return STATISTICS_SHM_EMPTY;
+		slot->name[STATISTICS_SHM_NAME_LENGTH - 1] = '\0';
+		slot->lastError[STATISTICS_SHM_TEXT_LENGTH - 1] = '\0';
+		slot->lastFailedBufferStatusText[STATISTICS_SHM_TEXT_LENGTH - 1] = '\0';
+		slot->tlLastErrorStatusText[STATISTICS_SHM_TEXT_LENGTH - 1] = '\0';
+		slot->temperatureState[STATISTICS_SHM_TEXT_LENGTH - 1] = '\0';
+		return STATISTICS_SHM_OK;
+	}
+	return STATISTICS_SHM_BUSY;
+}
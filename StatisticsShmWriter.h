@@ -0,0 +1,324 @@
+// StatisticsShmWriter.h
+// Publishes statistics snapshots into a shared-memory segment for out-of-process monitoring
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSSHMWRITER_H
+#define STATISTICSSHMWRITER_H
+
+#include "Statistician.h"
+#include "StatisticsShm.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    include <windows.h>
+#else
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+namespace Statistician
+{
+	// Writes the segment described in StatisticsShm.h: one slot per camera, each its own seqlock.
+	// Publishing is a copy of the snapshot's counters and texts into the slot between two stores
+	// of the slot's sequence, on the sampling thread: no lock, no system call, no allocation, and
+	// readers in other processes can't slow it down.
+	//
+	// The slot is a plain C layout that readers in other languages compile against, so it only
+	// changes with STATISTICS_SHM_VERSION. The counters, their names and the registers are copied
+	// from the schema's tables and follow it; the other gauges, booleans and texts have fields of
+	// their own, and a new statistic of those types needs a new version to reach the segment.
+	//
+	//   shm.Create("statistician", cameraCount);
+	//   myStatistician.AddListener(shm.AddSource(serialNumber));
+	//
+	// Read the segment with the C library in StatisticsShmReader.c, or watch it with StatisticsTop.
+	// Stop the statisticians before Close(); slots are then marked stopped and keep their last sample
+	// for readers that still have the segment mapped.
+	class CStatisticsShmWriter
+	{
+	private:
+		// Copies one statistician's snapshots into its slot.
+		class CSlotListener : public IStatisticsListener
+		{
+		private:
+			CStatisticsShmWriter *m_writer;
+			uint32_t m_slot;
+		public:
+			CSlotListener(CStatisticsShmWriter *writer, uint32_t slot) : m_writer(writer), m_slot(slot) {}
+			void OnStatistics(const StatisticsSnapshot &snapshot) { m_writer->Publish(m_slot, snapshot); }
+		};
+
+		uint8_t *m_data;
+		size_t m_size;
+		std::string m_name;
+#ifdef _WIN32
+		HANDLE m_mapping;
+#endif
+		std::mutex m_mtx;			// AddSource() and Close()
+		uint32_t m_usedSlots;
+		std::vector<std::unique_ptr<CSlotListener> > m_listeners;
+
+		StatisticsShmHeader *GetHeader();
+		StatisticsShmSlot *GetSlot(uint32_t slot);
+		static uint32_t BeginWrite(StatisticsShmSlot &slot);
+		static void EndWrite(StatisticsShmSlot &slot, uint32_t sequence);
+		static void CopyText(char *target, const char *text, size_t size);
+		void Publish(uint32_t slot, const StatisticsSnapshot &snapshot);
+
+		// not copyable
+		CStatisticsShmWriter(const CStatisticsShmWriter&);
+		CStatisticsShmWriter &operator=(const CStatisticsShmWriter&);
+
+	public:
+		CStatisticsShmWriter();
+		~CStatisticsShmWriter();
+
+		// Creates the segment with room for 'slotCount' cameras. On POSIX the name is used for
+		// shm_open() with a leading slash; a stale segment of that name is replaced. On Windows it
+		// names a pagefile-backed file mapping, and fails if another process has it open.
+		bool Create(const char *name, uint32_t slotCount);
+		void Close();
+		bool IsOpen() const;
+
+		// Claims the next slot for a camera and returns the listener to register with its
+		// statistician. The writer owns the listener. NULL if the segment is full or not created.
+		IStatisticsListener *AddSource(const char *name);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CStatisticsShmWriter::CStatisticsShmWriter()
+	: m_data(NULL)
+	, m_size(0)
+#ifdef _WIN32
+	, m_mapping(NULL)
+#endif
+	, m_usedSlots(0)
+{
+	static_assert(sizeof(StatisticsShmHeader) == 1088 && sizeof(StatisticsShmSlot) == 1472, "StatisticsShm.h layout changed");
+	static_assert(Counter_Count <= STATISTICS_SHM_MAX_COUNTERS, "more counters than the segment has room for");
+	static_assert(c_registerStatisticCount == STATISTICS_SHM_REGISTER_COUNT, "the register statistics no longer match the segment");
+	static_assert(c_maxTextLength == STATISTICS_SHM_TEXT_LENGTH, "texts would be truncated");
+}
+
+inline Statistician::CStatisticsShmWriter::~CStatisticsShmWriter()
+{
+	this->Close();
+}
+
+inline bool Statistician::CStatisticsShmWriter::Create(const char *name, uint32_t slotCount)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_data != NULL || name == NULL || slotCount == 0)
+		return false;
+
+	m_name = (name[0] == '/') ? name + 1 : name;
+	m_size = sizeof(StatisticsShmHeader) + sizeof(StatisticsShmSlot) * static_cast<size_t>(slotCount);
+
+#ifdef _WIN32
+	m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(m_size), m_name.c_str());
+	if (m_mapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_mapping != NULL)
+		m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, m_size));
+	if (m_data == NULL)
+	{
+		std::cout << __FUNCTION__ << " cannot create " << m_name << " (" << GetLastError() << ")" << std::endl;
+		if (m_mapping != NULL)
+			CloseHandle(m_mapping);
+		m_mapping = NULL;
+		return false;
+	}
+#else
+	// a segment left behind by a writer that crashed is replaced. Readers that still have it
+	// mapped keep the old one.
+	std::string path = "/" + m_name;
+	shm_unlink(path.c_str());
+	int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd >= 0 && ftruncate(fd, static_cast<off_t>(m_size)) == 0)
+	{
+		void *data = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (data != MAP_FAILED)
+			m_data = static_cast<uint8_t*>(data);
+	}
+	if (fd >= 0)
+		close(fd);
+	if (m_data == NULL)
+	{
+		std::cout << __FUNCTION__ << " cannot create " << path << std::endl;
+		shm_unlink(path.c_str());
+		return false;
+	}
+#endif
+
+	memset(m_data, 0, m_size);
+	StatisticsShmHeader *header = GetHeader();
+	header->version = STATISTICS_SHM_VERSION;
+	header->headerSize = sizeof(StatisticsShmHeader);
+	header->slotSize = sizeof(StatisticsShmSlot);
+	header->slotCount = slotCount;
+	header->counterCount = Counter_Count;
+	header->textLength = STATISTICS_SHM_TEXT_LENGTH;
+#ifdef _WIN32
+	header->writerProcessId = GetCurrentProcessId();
+#else
+	header->writerProcessId = static_cast<uint64_t>(getpid());
+#endif
+	header->createdUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	for (int i = 0; i < Counter_Count; i++)
+		CopyText(header->counterNames[i], GetCounterInfo(static_cast<ECounter>(i)).name, STATISTICS_SHM_COUNTER_NAME_LENGTH);
+
+	// the magic goes last, so a reader that opens the segment early rejects it.
+	STATISTICS_SHM_RELEASE_FENCE();
+	header->magic = STATISTICS_SHM_MAGIC;
+	m_usedSlots = 0;
+	return true;
+}
+
+inline void Statistician::CStatisticsShmWriter::Close()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_data == NULL)
+		return;
+
+	for (uint32_t i = 0; i < m_usedSlots; i++)
+	{
+		StatisticsShmSlot &slot = *GetSlot(i);
+		uint32_t sequence = BeginWrite(slot);
+		slot.state = STATISTICS_SHM_SLOT_STOPPED;
+		EndWrite(slot, sequence);
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	m_mapping = NULL;
+#else
+	munmap(m_data, m_size);
+	shm_unlink(("/" + m_name).c_str());
+#endif
+	m_data = NULL;
+	m_size = 0;
+}
+
+inline bool Statistician::CStatisticsShmWriter::IsOpen() const
+{
+	return m_data != NULL;
+}
+
+inline Statistician::IStatisticsListener *Statistician::CStatisticsShmWriter::AddSource(const char *name)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_data == NULL || m_usedSlots >= GetHeader()->slotCount)
+		return NULL;
+
+	uint32_t index = m_usedSlots++;
+	StatisticsShmSlot &slot = *GetSlot(index);
+	uint32_t sequence = BeginWrite(slot);
+	slot.state = STATISTICS_SHM_SLOT_ACTIVE;
+	CopyText(slot.name, (name != NULL) ? name : "", STATISTICS_SHM_NAME_LENGTH);
+	EndWrite(slot, sequence);
+
+	m_listeners.push_back(std::unique_ptr<CSlotListener>(new CSlotListener(this, index)));
+	return m_listeners.back().get();
+}
+
+inline StatisticsShmHeader *Statistician::CStatisticsShmWriter::GetHeader()
+{
+	return reinterpret_cast<StatisticsShmHeader*>(m_data);
+}
+
+inline StatisticsShmSlot *Statistician::CStatisticsShmWriter::GetSlot(uint32_t slot)
+{
+	return reinterpret_cast<StatisticsShmSlot*>(m_data + sizeof(StatisticsShmHeader) + sizeof(StatisticsShmSlot) * static_cast<size_t>(slot));
+}
+
+inline uint32_t Statistician::CStatisticsShmWriter::BeginWrite(StatisticsShmSlot &slot)
+{
+	// one writer per slot, so a relaxed read of the own sequence is enough.
+	uint32_t sequence = STATISTICS_SHM_LOAD_RELAXED(&slot.sequence);
+	STATISTICS_SHM_STORE_RELAXED(&slot.sequence, sequence + 1);
+	STATISTICS_SHM_RELEASE_FENCE();
+	return sequence;
+}
+
+inline void Statistician::CStatisticsShmWriter::EndWrite(StatisticsShmSlot &slot, uint32_t sequence)
+{
+	STATISTICS_SHM_STORE_RELEASE(&slot.sequence, sequence + 2);
+}
+
+inline void Statistician::CStatisticsShmWriter::CopyText(char *target, const char *text, size_t size)
+{
+	// only up to the terminator, so a short text costs a short copy.
+	size_t length = strlen(text);
+	if (length > size - 1)
+		length = size - 1;
+	memcpy(target, text, length);
+	target[length] = '\0';
+}
+
+inline void Statistician::CStatisticsShmWriter::Publish(uint32_t index, const StatisticsSnapshot &snapshot)
+{
+	if (m_data == NULL)
+		return;
+
+	StatisticsShmSlot &slot = *GetSlot(index);
+	uint32_t sequence = BeginWrite(slot);
+
+	slot.sampleSequence = snapshot.sequence;
+	slot.timestampUs = snapshot.timestampUs;
+	slot.available = snapshot.available;
+	for (int i = 0; i < Counter_Count; i++)
+		slot.counters[i] = snapshot.*GetCounterInfo(static_cast<ECounter>(i)).field;
+	slot.lastFailedBufferStatus = snapshot.lastFailedBufferStatus;
+	slot.tlLastErrorStatus = snapshot.tlLastErrorStatus;
+	size_t reg = 0;
+	for (int i = 0; i < Statistic_Count; i++)
+	{
+		const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+		if (info.type == StatisticType_Register)
+			slot.usbErrorRegisters[reg++] = *reinterpret_cast<const uint64_t*>(reinterpret_cast<const char*>(&snapshot) + info.offset);
+	}
+	slot.criticalTemp = snapshot.criticalTemp ? 1 : 0;
+	slot.overTemp = snapshot.overTemp ? 1 : 0;
+	slot.errorTextCount = snapshot.errorLog.errorCount;
+	slot.droppedErrorTexts = snapshot.errorLog.droppedTexts;
+	CopyText(slot.lastError, snapshot.lastError, STATISTICS_SHM_TEXT_LENGTH);
+	CopyText(slot.lastFailedBufferStatusText, snapshot.lastFailedBufferStatusText, STATISTICS_SHM_TEXT_LENGTH);
+	CopyText(slot.tlLastErrorStatusText, snapshot.tlLastErrorStatusText, STATISTICS_SHM_TEXT_LENGTH);
+	CopyText(slot.temperatureState, snapshot.temperatureState, STATISTICS_SHM_TEXT_LENGTH);
+
+	EndWrite(slot, sequence);
+}
+
+// *********************************************************************************************************
+#endif
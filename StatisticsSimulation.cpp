@@ -0,0 +1,624 @@
+// StatisticsSimulation.cpp
+// Runs CStatistician against simulated cameras, to try scripts and to measure sampling overhead
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Usage: StatisticsSimulation [options]
+//   --gige              simulate GigE cameras (default: USB)
+//   --cameras <n>       number of cameras (default 1)
+//   --seconds <s>       simulated run time (default 10)
+//   --step <ms>         simulated time between sample passes (default 10)
+//   --seed <n>          random seed of the first camera; camera i uses seed + i (default 1)
+//   --script <file>     events for every camera (see SimulatedCamera.h)
+//   --format <name>     text, json, csv or prometheus (default text)
+//   --bench             measure the time spent in sampling, instead of printing statistics
+//   --poll              read every statistic when its group is due, without change notification
+//   --adaptive <ms>     sample the grabber and transport groups every <ms> while they find trouble
+//                       (see AdaptiveSampling.h)
+//   --budget <n>        cap the node reads of each camera at n per second
+//   --link-budget <n>   cap the node reads of all cameras together at n per second
+//   --links <n>         spread the cameras round robin over n links and aggregate them every
+//                       100 ms (see LinkAggregator.h); link events and totals are printed
+//   --link-script <file> more events for the cameras of the first link only
+//   --workers <n>       threads of the link aggregation (default: by camera count)
+//   --advise            print the stream settings CStreamAdvisor (StreamAdvisor.h) recommends for
+//                       each GigE camera at the end
+//   --tune <s>          let CStreamAdvisor tune the GigE cameras every <s> simulated seconds, as
+//                       if between acquisitions, and print what it changed
+//   --max-packet <n>    largest packet size the advisor may recommend (default 1500)
+//   --serve <port>      sample in real time and serve the statistics over HTTP on localhost
+//                       (see MetricsServer.h) for --seconds; port 0 picks a free port
+//   --loadtest <n>      with --serve: n clients scrape /metrics back to back, then the scrape
+//                       latency is printed
+//   --shm <name>        sample in real time and publish the statistics into a shared-memory
+//                       segment (see StatisticsShmWriter.h) for --seconds; watch it with StatisticsTop
+//   --reconnect <ms>    keep sampling a removed camera: try to reconnect every <ms> and print the
+//                       removals, reconnects and counter resets of every camera
+//   --record <file>     also write every snapshot into a binary log (see StatisticsRecorder.h);
+//                       dump it with StatisticsReplay
+//
+// The simulated clock is stepped by hand, so the same options always print the same statistics.
+// --serve and --shm run on the steady clock instead.
+
+// No pylon dependency: the statistician samples simulated cameras only.
+#define STATISTICIAN_NO_PYLON
+#include "MetricsServer.h"
+#include "StatisticsShmWriter.h"
+#include "StatisticsRecorder.h"
+#include "Statistician.h"
+#include "LinkAggregator.h"
+#include "StreamAdvisor.h"
+#include "SimulatedCamera.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+using namespace Statistician;
+
+// Prints link-level bursts as they are raised and cleared, in simulated time.
+class CLinkEventPrinter : public ILinkEventHandler
+{
+public:
+	virtual void OnLinkEvent(const SLinkEvent &event)
+	{
+		cout << "Link " << event.link << (event.raised ? " burst at " : " recovered at ") << event.timestampUs / 1000 << " ms: "
+			<< event.burstingCameras << " of " << event.cameras << " cameras with errors, " << event.errors << " errors" << endl;
+	}
+};
+
+static void PrintStreamSettings(const SStreamSettings &settings)
+{
+	cout << "packet size " << settings.packetSize << ", inter-packet delay " << settings.interPacketDelay
+		<< ", frame transmission delay " << settings.frameTransmissionDelay << ", buffers " << settings.bufferCount;
+}
+
+static void PrintStreamAdvice(unsigned advice)
+{
+	if (advice == StreamAdvice_None)
+		cout << "none";
+	for (unsigned bit = 1, first = 1; bit <= StreamAdvice_Bandwidth; bit <<= 1)
+	{
+		if ((advice & bit) == 0)
+			continue;
+		cout << (first ? "" : ", ") << GetStreamAdviceName(static_cast<EStreamAdvice>(bit));
+		first = 0;
+	}
+}
+
+static bool ReadFile(const char *path, string &content)
+{
+	ifstream file(path);
+	if (file.is_open() == false)
+	{
+		cerr << "Cannot open " << path << endl;
+		return false;
+	}
+	stringstream text;
+	text << file.rdbuf();
+	content = text.str();
+	return true;
+}
+
+// Scrapes /metrics over one kept-alive connection until 'stop', recording each latency in ns.
+static void ScrapeMetrics(uint16_t port, const atomic<bool> *stop, vector<int64_t> *latenciesNs, uint64_t *failures)
+{
+	Detail::socket_type client = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in endpoint;
+	memset(&endpoint, 0, sizeof(endpoint));
+	endpoint.sin_family = AF_INET;
+	endpoint.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &endpoint.sin_addr);
+	if (client == Detail::c_invalidSocket || connect(client, reinterpret_cast<sockaddr*>(&endpoint), sizeof(endpoint)) != 0)
+	{
+		(*failures)++;
+		return;
+	}
+
+	const char request[] = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	vector<char> buffer(256 * 1024);
+	while (stop->load() == false)
+	{
+		chrono::steady_clock::time_point before = chrono::steady_clock::now();
+		if (send(client, request, static_cast<int>(sizeof(request) - 1), 0) <= 0)
+		{
+			(*failures)++;
+			break;
+		}
+
+		// read the headers, then as much body as Content-Length says.
+		size_t received = 0;
+		size_t expected = 0;
+		for (;;)
+		{
+			int count = static_cast<int>(recv(client, &buffer[received], static_cast<int>(buffer.size() - received), 0));
+			if (count <= 0)
+				break;
+			received += static_cast<size_t>(count);
+
+			if (expected == 0)
+			{
+				string head(&buffer[0], received);
+				size_t headerEnd = head.find("\r\n\r\n");
+				size_t field = head.find("Content-Length: ");
+				if (headerEnd != string::npos && field != string::npos)
+					expected = headerEnd + 4 + strtoul(head.c_str() + field + 16, NULL, 10);
+			}
+			if (expected > 0 && received >= expected)
+				break;
+		}
+
+		if (expected == 0 || received < expected)
+		{
+			(*failures)++;
+			break;
+		}
+		latenciesNs->push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - before).count());
+	}
+	Detail::CloseSocket(client);
+}
+
+// Samples in real time for 'seconds', serving HTTP if 'port' >= 0 and publishing into shared memory
+// if 'shmName' is not empty.
+static int Serve(vector<unique_ptr<CStatistician> > &statisticians, int port, const string &shmName, size_t clientCount, double seconds)
+{
+	CMetricsServer server;
+	CStatisticsShmWriter shm;
+	if (shmName.empty() == false && shm.Create(shmName.c_str(), static_cast<uint32_t>(statisticians.size())) == false)
+	{
+		cerr << "Cannot create the shared-memory segment " << shmName << endl;
+		return 1;
+	}
+
+	vector<string> names(statisticians.size());
+	for (size_t i = 0; i < statisticians.size(); i++)
+	{
+		names[i] = "sim" + to_string(static_cast<long long>(i));
+		server.AddSource(names[i].c_str(), *statisticians[i]);
+		if (shm.IsOpen() == true)
+			statisticians[i]->AddListener(shm.AddSource(names[i].c_str()));
+		statisticians[i]->Start();
+	}
+
+	if (port >= 0)
+	{
+		if (server.StartTcp(static_cast<uint16_t>(port)) == false)
+		{
+			cerr << "Cannot listen on port " << port << endl;
+			return 1;
+		}
+		cout << "Serving http://127.0.0.1:" << server.GetPort() << "/metrics and /metrics.json for " << seconds << " s" << endl;
+	}
+	if (shm.IsOpen() == true)
+		cout << "Publishing into the shared-memory segment " << shmName << " for " << seconds << " s" << endl;
+
+	atomic<bool> stop(false);
+	vector<vector<int64_t> > latencies(clientCount);
+	vector<uint64_t> failures(clientCount, 0);
+	vector<thread> clients;
+	for (size_t i = 0; i < clientCount; i++)
+	{
+		latencies[i].reserve(1024 * 1024);
+		clients.push_back(thread(ScrapeMetrics, server.GetPort(), &stop, &latencies[i], &failures[i]));
+	}
+
+	this_thread::sleep_for(chrono::milliseconds(static_cast<int64_t>(seconds * 1000.0)));
+	stop.store(true);
+	for (size_t i = 0; i < clients.size(); i++)
+		clients[i].join();
+	server.Stop();
+	for (size_t i = 0; i < statisticians.size(); i++)
+		statisticians[i]->Stop();
+	shm.Close();
+
+	if (clientCount == 0)
+		return 0;
+
+	vector<int64_t> all;
+	uint64_t failed = 0;
+	for (size_t i = 0; i < clientCount; i++)
+	{
+		all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+		failed += failures[i];
+	}
+	sort(all.begin(), all.end());
+
+	cout << "Clients                : " << clientCount << endl;
+	cout << "Scrapes                : " << all.size() << " (" << all.size() / seconds << " per second, " << failed << " failed)" << endl;
+	if (all.empty() == false)
+	{
+		cout << "Latency p50            : " << all[all.size() / 2] / 1000.0 << " us" << endl;
+		cout << "Latency p99            : " << all[all.size() * 99 / 100] / 1000.0 << " us" << endl;
+		cout << "Latency p99.9          : " << all[all.size() * 999 / 1000] / 1000.0 << " us" << endl;
+		cout << "Latency max            : " << all.back() / 1000.0 << " us" << endl;
+	}
+	return 0;
+}
+
+// Prints what changed in the lifecycle of a camera since 'last', in simulated time.
+static void PrintLifecycleChanges(size_t camera, int64_t timeUs, const CStatistician &statistician, SLifecycleStatistics &last)
+{
+	StatisticsSnapshot snapshot;
+	statistician.GetSnapshot(snapshot);
+	const SLifecycleStatistics &lifecycle = snapshot.lifecycle;
+	if (lifecycle.removals != last.removals)
+		cout << "Camera " << camera << " was removed at " << timeUs / 1000 << " ms; reconnecting." << endl;
+	if (lifecycle.reconnects != last.reconnects)
+		cout << "Camera " << camera << " reconnected at " << timeUs / 1000 << " ms after " << lifecycle.reconnectAttempts - last.reconnectAttempts << " attempts." << endl;
+
+	for (uint64_t n = last.resetCount; n < lifecycle.resetCount; n++)
+	{
+		// the log only keeps the newest resets.
+		if (lifecycle.resetCount - n > c_resetLogLength)
+			continue;
+
+		const SCounterReset &reset = lifecycle.resets[n % c_resetLogLength];
+		cout << "Camera " << camera << " counters reset at " << timeUs / 1000 << " ms (" << (reset.reason == CounterReset_Reconnect ? "reconnect" : "decrease") << "):";
+		for (int counter = 0; counter < Counter_Count; counter++)
+		{
+			if ((reset.counters & (static_cast<uint32_t>(1) << counter)) != 0)
+				cout << " " << GetCounterInfo(static_cast<ECounter>(counter)).name << " offset " << lifecycle.offsets[counter];
+		}
+		cout << endl;
+	}
+	last = lifecycle;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned deviceClass = DeviceClass_Usb;
+	size_t cameraCount = 1;
+	double seconds = 10.0;
+	int64_t stepUs = 10000;
+	uint64_t seed = 1;
+	string script;
+	EOutputFormat format = OutputFormat_Text;
+	bool bench = false;
+	bool changeNotification = true;
+	int64_t adaptiveMs = 0;
+	double readBudget = 0.0;
+	double linkReadBudget = 0.0;
+	int servePort = -1;
+	string shmName;
+	size_t loadClients = 0;
+	size_t linkCount = 0;
+	string linkScript;
+	size_t workerCount = 0;
+	bool advise = false;
+	double tuneSeconds = 0.0;
+	int64_t maxPacketSize = 1500;
+	int64_t reconnectMs = 0;
+	string recordPath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--gige")
+			deviceClass = DeviceClass_GigE;
+		else if (option == "--bench")
+			bench = true;
+		else if (option == "--poll")
+			changeNotification = false;
+		else if (option == "--cameras" && hasValue)
+			cameraCount = static_cast<size_t>(atoi(argv[++i]));
+		else if (option == "--seconds" && hasValue)
+			seconds = atof(argv[++i]);
+		else if (option == "--step" && hasValue)
+			stepUs = static_cast<int64_t>(atof(argv[++i]) * 1000.0);
+		else if (option == "--adaptive" && hasValue)
+			adaptiveMs = atoi(argv[++i]);
+		else if (option == "--budget" && hasValue)
+			readBudget = atof(argv[++i]);
+		else if (option == "--link-budget" && hasValue)
+			linkReadBudget = atof(argv[++i]);
+		else if (option == "--serve" && hasValue)
+			servePort = atoi(argv[++i]);
+		else if (option == "--shm" && hasValue)
+			shmName = argv[++i];
+		else if (option == "--loadtest" && hasValue)
+			loadClients = static_cast<size_t>(atoi(argv[++i]));
+		else if (option == "--seed" && hasValue)
+			seed = strtoull(argv[++i], NULL, 10);
+		else if (option == "--script" && hasValue)
+		{
+			if (ReadFile(argv[++i], script) == false)
+				return 1;
+		}
+		else if (option == "--links" && hasValue)
+			linkCount = static_cast<size_t>(atoi(argv[++i]));
+		else if (option == "--link-script" && hasValue)
+		{
+			if (ReadFile(argv[++i], linkScript) == false)
+				return 1;
+		}
+		else if (option == "--workers" && hasValue)
+			workerCount = static_cast<size_t>(atoi(argv[++i]));
+		else if (option == "--advise")
+			advise = true;
+		else if (option == "--tune" && hasValue)
+			tuneSeconds = atof(argv[++i]);
+		else if (option == "--max-packet" && hasValue)
+			maxPacketSize = atoi(argv[++i]);
+		else if (option == "--reconnect" && hasValue)
+			reconnectMs = atoi(argv[++i]);
+		else if (option == "--record" && hasValue)
+			recordPath = argv[++i];
+		else if (option == "--format" && hasValue)
+		{
+			string name = argv[++i];
+			if (name == "json")
+				format = OutputFormat_Json;
+			else if (name == "csv")
+				format = OutputFormat_Csv;
+			else if (name == "prometheus")
+				format = OutputFormat_Prometheus;
+			else
+				format = OutputFormat_Text;
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			cerr << "Usage: " << argv[0] << " [--gige] [--cameras <n>] [--seconds <s>] [--step <ms>] [--seed <n>] [--script <file>] [--format <name>] [--bench] [--poll] [--adaptive <ms>] [--budget <n>] [--link-budget <n>] [--links <n> [--link-script <file>] [--workers <n>]] [--advise] [--tune <s>] [--max-packet <n>] [--serve <port> [--loadtest <n>]] [--shm <name>] [--reconnect <ms>] [--record <file>]" << endl;
+			return 1;
+		}
+	}
+
+	if (cameraCount == 0 || stepUs <= 0)
+	{
+		cerr << "Need at least one camera and a positive step." << endl;
+		return 1;
+	}
+
+	// the recorder owns the listeners of the statisticians, so it is declared first and destroyed last.
+	CStatisticsRecorder recorder;
+	if (recordPath.empty() == false && recorder.Open(recordPath.c_str()) == false)
+		return 1;
+
+	vector<unique_ptr<CSimulatedCamera> > cameras;
+	vector<unique_ptr<CStatistician> > statisticians;
+	CSamplingBudget linkBudget(linkReadBudget);	// the simulated cameras share one link
+	CLinkAggregator links;
+	CLinkEventPrinter linkEvents;
+	CStreamAdvisor advisor;
+	advisor.SetMaxPacketSize(maxPacketSize);
+	for (size_t i = 0; i < cameraCount; i++)
+	{
+		cameras.push_back(unique_ptr<CSimulatedCamera>(new CSimulatedCamera(deviceClass, seed + i)));
+		cameras[i]->SetClock((servePort >= 0 || shmName.empty() == false) ? SimulationClock_Steady : SimulationClock_Manual);
+		if (script.empty() == false && cameras[i]->LoadScript(script.c_str()) == false)
+		{
+			cerr << "The script has a line that can't be parsed." << endl;
+			return 1;
+		}
+		if (linkCount > 0 && i % linkCount == 0 && linkScript.empty() == false && cameras[i]->LoadScript(linkScript.c_str()) == false)
+		{
+			cerr << "The link script has a line that can't be parsed." << endl;
+			return 1;
+		}
+
+		statisticians.push_back(unique_ptr<CStatistician>(new CStatistician()));
+		statisticians[i]->SetChangeNotification(changeNotification);
+		statisticians[i]->SetAdaptiveSampling(StatisticGroup_Grabber, chrono::milliseconds(adaptiveMs));
+		statisticians[i]->SetAdaptiveSampling(StatisticGroup_Transport, chrono::milliseconds(adaptiveMs));
+		statisticians[i]->SetReadBudget(readBudget);
+		statisticians[i]->SetReconnect(chrono::milliseconds(reconnectMs));
+		if (linkReadBudget > 0.0)
+			statisticians[i]->SetLinkBudget(&linkBudget);
+		statisticians[i]->Initialize(*cameras[i]);
+		if (recorder.IsOpen() == true)
+			statisticians[i]->AddListener(recorder.AddSource(("sim" + to_string(static_cast<long long>(i))).c_str()));
+		string link = "link" + to_string(static_cast<long long>((linkCount > 0) ? i % linkCount : 0));
+		if (linkCount > 0)
+			links.AddCamera(link.c_str(), *statisticians[i]);
+		advisor.AddCamera(link.c_str(), *statisticians[i], *cameras[i]);
+	}
+	links.SetWorkerCount(workerCount);
+	if (bench == false)
+		links.AddHandler(&linkEvents);
+
+	if (servePort >= 0 || shmName.empty() == false)
+		return Serve(statisticians, servePort, shmName, loadClients, seconds);
+
+	// every statistician is driven from this thread, on the simulated clock. Snapshot
+	// timestamps are simulated time too, counted from the steady clock's epoch.
+	chrono::steady_clock::time_point start;
+	chrono::steady_clock::duration samplingTime(0);
+	chrono::steady_clock::duration linkTime(0);
+	uint64_t passes = 0;
+	uint64_t linkPasses = 0;
+	const int64_t linkPeriodUs = 100000;
+	const int64_t tunePeriodUs = static_cast<int64_t>(tuneSeconds * 1e6);
+	int64_t endUs = static_cast<int64_t>(seconds * 1e6);
+	vector<bool> sampling(cameraCount, true);
+	vector<SLifecycleStatistics> lifecycles(cameraCount);
+	memset(&lifecycles[0], 0, lifecycles.size() * sizeof(lifecycles[0]));
+
+	for (int64_t timeUs = 0; timeUs <= endUs; timeUs += stepUs)
+	{
+		for (size_t i = 0; i < cameraCount; i++)
+		{
+			if (sampling[i] == false)
+				continue;
+
+			chrono::steady_clock::time_point wakeup;
+			chrono::steady_clock::time_point before = chrono::steady_clock::now();
+			sampling[i] = statisticians[i]->SampleDue(start + chrono::microseconds(timeUs), wakeup);
+			samplingTime += chrono::steady_clock::now() - before;
+			passes++;
+
+			cameras[i]->Advance(chrono::microseconds(stepUs));
+			if (sampling[i] == false && bench == false)
+				cout << "Camera " << i << " was removed at " << timeUs / 1000 << " ms." << endl;
+			if (reconnectMs > 0 && bench == false)
+				PrintLifecycleChanges(i, timeUs, *statisticians[i], lifecycles[i]);
+		}
+
+		if (linkCount > 0 && timeUs % linkPeriodUs == 0)
+		{
+			chrono::steady_clock::time_point before = chrono::steady_clock::now();
+			links.Update(timeUs);
+			linkTime += chrono::steady_clock::now() - before;
+			linkPasses++;
+		}
+
+		// the simulated cameras take new settings between any two sample passes.
+		if (tunePeriodUs > 0 && timeUs > 0 && timeUs % tunePeriodUs == 0)
+		{
+			for (size_t i = 0; i < cameraCount; i++)
+			{
+				if (sampling[i] == false)
+					continue;
+
+				STuningResult result = advisor.Tune(i);
+				if (bench == true || result.state == TuningState_Idle)
+					continue;
+				cout << "Tune sim" << i << " at " << timeUs / 1000 << " ms: ";
+				PrintStreamAdvice(result.advice);
+				cout << " " << GetTuningStateName(result.state) << ", errors " << result.errorsBefore;
+				if (result.state != TuningState_Verifying)
+					cout << " -> " << result.errorsAfter;
+				cout << ", ";
+				PrintStreamSettings(result.settings);
+				cout << endl;
+			}
+		}
+	}
+
+	if (bench == true)
+	{
+		uint64_t nodeReads = 0;
+		uint64_t portReads = 0;
+		for (size_t i = 0; i < cameraCount; i++)
+		{
+			nodeReads += cameras[i]->GetNodeReadCount();
+			portReads += cameras[i]->GetPortReadCount();
+		}
+
+		double totalUs = chrono::duration_cast<chrono::nanoseconds>(samplingTime).count() / 1000.0;
+		double simulatedSeconds = static_cast<double>(endUs) / 1e6;
+		cout << "Sample passes          : " << passes << endl;
+		cout << "Node reads             : " << nodeReads << endl;
+		cout << "Port reads             : " << portReads << endl;
+		cout << "Time per pass          : " << (passes > 0 ? totalUs / passes : 0.0) << " us" << endl;
+		cout << "Time per node read     : " << (nodeReads > 0 ? totalUs * 1000.0 / nodeReads : 0.0) << " ns (including the sampler's own work)" << endl;
+		cout << "CPU per camera         : " << (simulatedSeconds > 0 ? totalUs / 1e4 / simulatedSeconds / cameraCount : 0.0) << " % of one core" << endl;
+		cout << "Node reads per second  : " << (simulatedSeconds > 0 ? nodeReads / simulatedSeconds : 0.0) << endl;
+
+		// effective sampling rate of each group, over all cameras, and what adaptive sampling did.
+		SSamplingStatistics total;
+		memset(&total, 0, sizeof(total));
+		for (size_t i = 0; i < cameraCount; i++)
+		{
+			StatisticsSnapshot snapshot;
+			statisticians[i]->GetSnapshot(snapshot);
+			for (int group = 0; group < StatisticGroup_Count; group++)
+			{
+				total.samples[group] += snapshot.sampling.samples[group];
+				total.fastSamples[group] += snapshot.sampling.fastSamples[group];
+				total.deniedSamples[group] += snapshot.sampling.deniedSamples[group];
+				total.troubleSamples[group] += snapshot.sampling.troubleSamples[group];
+			}
+		}
+		const char *groupNames[StatisticGroup_Count] = { "grabber", "transport", "temperature", "USB registers", "on change" };
+		for (int group = 0; group < StatisticGroup_Count; group++)
+		{
+			if (total.samples[group] == 0)
+				continue;
+			cout << "Rate " << left << setw(18) << groupNames[group] << right << ": " << (simulatedSeconds > 0 ? total.samples[group] / simulatedSeconds / cameraCount : 0.0)
+				<< " per second per camera (" << total.fastSamples[group] << " fast, " << total.deniedSamples[group] << " denied, "
+				<< total.troubleSamples[group] << " found trouble)" << endl;
+		}
+		if (linkPasses > 0)
+		{
+			cout << "Link passes            : " << linkPasses << " over " << linkCount << " links" << endl;
+			cout << "Time per link pass     : " << chrono::duration_cast<chrono::nanoseconds>(linkTime).count() / 1000.0 / linkPasses << " us" << endl;
+		}
+		return 0;
+	}
+
+	// one call for all cameras, so JSON is a single array and Prometheus has one TYPE line per metric.
+	vector<StatisticsSnapshot> snapshots(cameraCount);
+	vector<string> names(cameraCount);
+	vector<const char*> sources(cameraCount);
+	for (size_t i = 0; i < cameraCount; i++)
+	{
+		statisticians[i]->GetSnapshot(snapshots[i]);
+		names[i] = "sim" + to_string(static_cast<long long>(i));
+		sources[i] = names[i].c_str();
+	}
+
+	vector<char> buffer(64 * 1024);
+	if (format == OutputFormat_Csv)
+	{
+		FormatStatistics(&snapshots[0], &sources[0], 1, OutputFormat_CsvHeader, &buffer[0], buffer.size());
+		cout << &buffer[0];
+	}
+
+	size_t length = FormatStatistics(&snapshots[0], &sources[0], cameraCount, format, &buffer[0], buffer.size());
+	if (length >= buffer.size())
+	{
+		buffer.resize(length + 1);
+		FormatStatistics(&snapshots[0], &sources[0], cameraCount, format, &buffer[0], buffer.size());
+	}
+	cout << &buffer[0];
+
+	for (size_t i = 0; advise == true && i < cameraCount; i++)
+	{
+		SStreamAdvice advice;
+		if (advisor.Advise(i, advice) == false)
+		{
+			cout << "Advice for sim" << i << ": none (no stream settings or not enough packets)" << endl;
+			continue;
+		}
+		cout << "Advice for sim" << i << ": ";
+		PrintStreamAdvice(advice.advice);
+		cout << endl << "  utilization " << advice.utilization << " of the link (" << advice.linkUtilization << " with the other cameras, "
+			<< advice.requiredUtilization << " needed), error ratio " << advice.errorRatio << ", " << advice.underrunRate << " underruns per second" << endl;
+		cout << "  current:     ";
+		PrintStreamSettings(advice.current);
+		cout << endl << "  recommended: ";
+		PrintStreamSettings(advice.recommended);
+		cout << endl;
+	}
+
+	for (size_t i = 0; reconnectMs > 0 && i < cameraCount; i++)
+	{
+		const SLifecycleStatistics &lifecycle = snapshots[i].lifecycle;
+		cout << "Lifecycle sim" << i << ": " << (lifecycle.connected ? "connected" : "removed") << ", " << lifecycle.removals << " removals, "
+			<< lifecycle.reconnects << " reconnects in " << lifecycle.reconnectAttempts << " attempts, " << lifecycle.resetCount << " counter resets" << endl;
+	}
+
+	// per link: summed counters, the rates of the last interval and how many bursts there were.
+	vector<StatisticsLinkSnapshot> linkSnapshots = links.GetLinks();
+	for (size_t i = 0; i < linkSnapshots.size(); i++)
+	{
+		const StatisticsLinkSnapshot &link = linkSnapshots[i];
+		cout << "Link " << link.name << ": " << link.cameras << " cameras, " << link.burstCount << " bursts" << endl;
+		for (int counter = 0; counter < LinkCounter_Count; counter++)
+		{
+			const char *name = GetCounterInfo(GetLinkCounterSource(static_cast<ELinkCounter>(counter))).name;
+			cout << "  " << left << setw(18) << name << right << ": " << link.totals[counter] << " (" << link.rates[counter] << " per second)" << endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,376 @@
+// StatisticsSnapshot.h
+// Plain-data statistics snapshot and the description of every statistic in it
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSSNAPSHOT_H
+#define STATISTICSSNAPSHOT_H
+
+#include "StatisticsSchema.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// No pylon dependency, so output formats and tools can use the snapshot without the SDK.
+namespace Statistician
+{
+	// Statistics are sampled in groups. Each group has its own sampling period.
+	enum EStatisticGroup
+	{
+		StatisticGroup_Grabber,				// stream grabber counters and error texts
+		StatisticGroup_Transport,			// transport layer counters and error texts
+		StatisticGroup_Temperature,			// device temperature and temperature state
+		StatisticGroup_UsbErrorRegisters,	// USB error registers read through the device port
+		StatisticGroup_OnChange,			// statistics the camera reports changes of; the period is only a fallback
+		StatisticGroup_Count
+	};
+
+	static const size_t c_maxTextLength = 256;	// error texts longer than this are truncated
+	static const size_t c_maxErrorTexts = 32;	// distinct error texts interned per camera
+	static const size_t c_errorLogLength = 64;	// newest error text changes kept
+	static const uint16_t c_noError = 0xFFFF;	// error ID of "no error"
+	static const uint16_t c_droppedError = 0xFFFE;	// error ID of a text that did not fit in the dictionary
+	static const size_t c_resetLogLength = 16;	// newest counter resets kept
+
+	// An interned error text. Its ID is its index in StatisticsErrorLog::errors.
+	struct SErrorText
+	{
+		uint64_t hash;				// see CErrorDictionary::Hash()
+		uint32_t statistic;			// EStatistic that reported the text
+		uint32_t occurrences;		// times it became the statistic's current text
+		int64_t firstUs;			// steady clock time it first became current
+		int64_t lastUs;				// steady clock time it last became current
+		char text[c_maxTextLength];
+	};
+
+	// A statistic's error text changed to another error ID.
+	struct SErrorTransition
+	{
+		int64_t timestampUs;
+		uint16_t statistic;			// EStatistic
+		uint16_t error;				// ID, c_noError or c_droppedError
+	};
+
+	// Every distinct error text seen so far, in order of first occurrence, and the newest changes.
+	// Filled by CErrorDictionary without allocating.
+	struct StatisticsErrorLog
+	{
+		uint32_t errorCount;
+		uint32_t droppedTexts;		// changes to texts that did not fit in the dictionary
+		SErrorText errors[c_maxErrorTexts];
+		uint64_t transitionCount;	// changes so far; change n is at transitions[n % c_errorLogLength]
+		SErrorTransition transitions[c_errorLogLength];
+	};
+
+	// Cost of the register reads that go through the device port (see CRegisterBlockReader).
+	struct SRegisterReadStatistics
+	{
+		uint64_t passes;				// sample passes that read registers
+		uint64_t transactions;			// IPort::Read calls, in total
+		uint64_t failedTransactions;	// block reads the device rejected (the block is then read per register)
+		uint64_t bytesRead;
+		uint32_t blocks;				// transactions per pass with the current plan
+		int64_t lastPassUs;				// duration of the newest pass
+		int64_t maxPassUs;
+		int64_t totalPassUs;
+	};
+
+	// What the sampler did, per group, to see the effective sampling rates and tune adaptive
+	// sampling (see CAdaptiveSampling). Counts are totals since Initialize().
+	struct SSamplingStatistics
+	{
+		uint64_t samples[StatisticGroup_Count];			// times the group was read
+		uint64_t fastSamples[StatisticGroup_Count];		// of those, sooner than the group's base period
+		uint64_t deniedSamples[StatisticGroup_Count];	// fast samples the read budgets did not allow
+		uint64_t troubleSamples[StatisticGroup_Count];	// samples that found a trouble statistic changed
+		int64_t periodUs[StatisticGroup_Count];			// current period, 0 if the group is disabled
+		uint64_t nodeReads;								// node reads, in total (register reads are in SRegisterReadStatistics)
+		int64_t busyUs;									// time spent reading and publishing, in total
+	};
+
+	// What sampling costs the camera and the host (see CSamplingProfiler). Counts are always kept;
+	// times are in steady clock nanoseconds and only measured while CStatistician::SetProfiling()
+	// is on. Totals since Initialize().
+	struct SProfilingStatistics
+	{
+		uint64_t nodeLookups;		// GetNode() calls, made when the statistics are resolved
+		int64_t nodeLookupNs;
+		int64_t maxNodeLookupNs;
+		uint64_t nodeReads;			// GetInteger(), GetBoolean() and GetText() calls
+		int64_t nodeReadNs;
+		int64_t maxNodeReadNs;
+		uint64_t portReads;			// IPort::Read calls
+		int64_t portReadNs;
+		int64_t maxPortReadNs;
+		uint64_t transactions;		// node reads and port reads: requests that may reach the device (lookups do not)
+		uint64_t passes;			// sample passes that read something
+		int64_t passNs;				// time of the profiled passes, in total
+		int64_t lastPassNs;
+		int64_t maxPassNs;
+		int64_t cpuNs;				// CPU time of the thread that ran the profiled passes
+	};
+
+	// Integer statistics of a StatisticsSnapshot, so they can be handled generically (history, rates).
+	// The statistics with 'counter' true in StatisticsSchema.h, in the same order.
+	enum ECounter
+	{
+#define STATISTICIAN_COUNTER_ENUM(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) STATISTICIAN_IF_COUNTER_##counter(Counter_##id,)
+		STATISTICIAN_STATISTICS(STATISTICIAN_COUNTER_ENUM)
+#undef STATISTICIAN_COUNTER_ENUM
+		Counter_Count
+	};
+	static_assert(Counter_Count <= 32, "SCounterReset::counters has a bit per counter");
+
+	// Why the cumulative counters were rebased (see SLifecycleStatistics).
+	enum ECounterReset
+	{
+		CounterReset_Decrease,		// a counter went down: the stream grabber or transport layer counts from zero again
+		CounterReset_Reconnect		// the camera was removed and came back, so every counter counts from zero again
+	};
+
+	// One rebase of the cumulative counters.
+	struct SCounterReset
+	{
+		int64_t timestampUs;		// steady clock time of the sample that found it
+		uint32_t counters;			// bit (1 << ECounter) for every counter that was rebased
+		uint32_t reason;			// ECounterReset
+	};
+
+	// Removals, reconnects and counter resets of a camera, totals since Initialize().
+	// The cumulative counters of a snapshot (SCounterInfo::cumulative) are stitched: when the camera
+	// counts from zero again, the last value it reported is added to the counter's offset, so the
+	// published counter is a total since Initialize() that never goes down. The camera's own value
+	// is the published one minus the offset.
+	struct SLifecycleStatistics
+	{
+		bool connected;				// false from a removal until the camera is back
+		uint32_t removals;
+		uint32_t reconnects;
+		uint64_t reconnectAttempts;
+		int64_t lastRemovalUs;		// steady clock microseconds, 0 if never
+		int64_t lastReconnectUs;
+		int64_t offsets[Counter_Count];			// 0 for counters that are not cumulative
+		uint64_t resetCount;					// rebases so far; rebase n is at resets[n % c_resetLogLength]
+		SCounterReset resets[c_resetLogLength];
+	};
+
+	// Metrics computed from the counters (see DerivedMetrics.h).
+	enum EDerivedMetric
+	{
+		DerivedMetric_PacketLossRatio,
+		DerivedMetric_ResendRatio,
+		DerivedMetric_EffectiveFrameRate,
+		DerivedMetric_BlockIdGap,
+		DerivedMetric_BufferFailureRate,
+		DerivedMetric_Count
+	};
+
+	// The derived metrics of a camera, updated every time the counters they are computed from are
+	// sampled. 'values' are over the interval since the previous sample, 'totals' since the first.
+	struct SDerivedStatistics
+	{
+		uint32_t available;		// bit (1 << EDerivedMetric) once a metric has been computed
+		double values[DerivedMetric_Count];
+		double totals[DerivedMetric_Count];
+	};
+
+	// A consistent copy of all statistics, taken at the end of a sample pass.
+	// Plain data only, so it can be published without locks (see CSeqLock).
+	// Counters that are not available for the device stay at -1, texts at "-1".
+	struct StatisticsSnapshot
+	{
+		uint64_t sequence;		// number of sample passes published so far
+		int64_t timestampUs;	// steady clock time of the sample pass, in microseconds
+		uint64_t available;		// bit (1 << EStatistic) is set for every statistic the device provides
+		uint32_t sampledGroups;	// bit (1 << EStatisticGroup) per group read for this snapshot; the others keep their last values
+		// the statistics, by type: the integers the sampler and the history work with share a few cache lines
+#define STATISTICIAN_INTEGER_FIELD(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) STATISTICIAN_BY_TYPE_##type(int64_t field;, , , )
+#define STATISTICIAN_REGISTER_FIELD(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) STATISTICIAN_BY_TYPE_##type(, , , uint64_t field;)
+#define STATISTICIAN_BOOLEAN_FIELD(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) STATISTICIAN_BY_TYPE_##type(, bool field;, , )
+#define STATISTICIAN_TEXT_FIELD(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) STATISTICIAN_BY_TYPE_##type(, , char field[c_maxTextLength];, )
+		STATISTICIAN_STATISTICS(STATISTICIAN_INTEGER_FIELD)
+		STATISTICIAN_STATISTICS(STATISTICIAN_REGISTER_FIELD)
+		STATISTICIAN_STATISTICS(STATISTICIAN_BOOLEAN_FIELD)
+		STATISTICIAN_STATISTICS(STATISTICIAN_TEXT_FIELD)
+#undef STATISTICIAN_INTEGER_FIELD
+#undef STATISTICIAN_REGISTER_FIELD
+#undef STATISTICIAN_BOOLEAN_FIELD
+#undef STATISTICIAN_TEXT_FIELD
+		StatisticsErrorLog errorLog;	// texts of the statistics with a listLabel
+		SRegisterReadStatistics registerReads;
+		SSamplingStatistics sampling;
+		SProfilingStatistics profile;
+		SLifecycleStatistics lifecycle;
+		SDerivedStatistics derived;
+	};
+
+	// Every statistic in a StatisticsSnapshot, in the order they are printed.
+	enum EStatistic
+	{
+#define STATISTICIAN_STATISTIC_ENUM(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) Statistic_##id,
+		STATISTICIAN_STATISTICS(STATISTICIAN_STATISTIC_ENUM)
+#undef STATISTICIAN_STATISTIC_ENUM
+		Statistic_Count
+	};
+	static_assert(Statistic_Count <= 64, "StatisticsSnapshot::available has a bit per statistic");
+
+	// Number of statistics of each type, for tables with an entry per statistic of the type, in
+	// schema order. The integers include the counters (ECounter) and the integer gauges that are not.
+#define STATISTICIAN_COUNT_INTEGER(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) + STATISTICIAN_BY_TYPE_##type(1, 0, 0, 0)
+#define STATISTICIAN_COUNT_BOOLEAN(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) + STATISTICIAN_BY_TYPE_##type(0, 1, 0, 0)
+#define STATISTICIAN_COUNT_TEXT(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) + STATISTICIAN_BY_TYPE_##type(0, 0, 1, 0)
+#define STATISTICIAN_COUNT_REGISTER(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) + STATISTICIAN_BY_TYPE_##type(0, 0, 0, 1)
+	static const size_t c_integerStatisticCount = 0 STATISTICIAN_STATISTICS(STATISTICIAN_COUNT_INTEGER);
+	static const size_t c_booleanStatisticCount = 0 STATISTICIAN_STATISTICS(STATISTICIAN_COUNT_BOOLEAN);
+	static const size_t c_textStatisticCount = 0 STATISTICIAN_STATISTICS(STATISTICIAN_COUNT_TEXT);
+	static const size_t c_registerStatisticCount = 0 STATISTICIAN_STATISTICS(STATISTICIAN_COUNT_REGISTER);
+#undef STATISTICIAN_COUNT_INTEGER
+#undef STATISTICIAN_COUNT_BOOLEAN
+#undef STATISTICIAN_COUNT_TEXT
+#undef STATISTICIAN_COUNT_REGISTER
+
+	enum EStatisticType
+	{
+		StatisticType_Integer,		// int64_t, read from an integer node
+		StatisticType_Boolean,		// bool, read from a boolean node
+		StatisticType_Text,			// char[c_maxTextLength], read from a string or enumeration node
+		StatisticType_Register		// uint64_t, 4 bytes read from the device port
+	};
+
+	// How a statistic behaves over time, for output formats that care (Prometheus).
+	enum EStatisticKind
+	{
+		StatisticKind_Counter,		// only grows
+		StatisticKind_Gauge,		// goes up and down, or is a status code
+		StatisticKind_Info			// a text
+	};
+
+	enum ENodeMap
+	{
+		NodeMap_Device,
+		NodeMap_StreamGrabber,
+		NodeMap_TransportLayer
+	};
+
+	enum EStatisticSection
+	{
+		StatisticSection_Camera,
+		StatisticSection_GrabEngine,
+		StatisticSection_TransportLayer,
+		StatisticSection_Count
+	};
+
+	// Device classes a statistic is sampled for.
+	enum EDeviceClassMask
+	{
+		DeviceClass_Usb = 0x01,
+		DeviceClass_GigE = 0x02,
+		DeviceClass_All = 0xFF
+	};
+
+	// How a statistic is kept up to date.
+	enum EStatisticUpdate
+	{
+		StatisticUpdate_Poll,		// changes all the time (counters), read every time its group is due
+		StatisticUpdate_OnChange	// changes rarely; read when the camera reports a change, if the source can
+	};
+
+	// Everything the sampler and the output formats need to know about a statistic.
+	struct SStatisticInfo
+	{
+		const char *name;				// field name in StatisticsSnapshot
+		const char *label;				// for human-readable output
+		const char *listLabel;			// label of the logged texts, for logged texts
+		EStatisticSection section;
+		EStatisticType type;
+		EStatisticKind kind;
+		unsigned deviceClasses;			// EDeviceClassMask
+		EStatisticGroup group;
+		ENodeMap nodeMap;
+		const char *nodeName;			// for registers: NULL
+		uint32_t address;				// for registers: device port address
+		size_t offset;					// of the value in StatisticsSnapshot
+		bool logged;					// texts other than "no error" go to StatisticsSnapshot::errorLog
+		EStatisticUpdate update;
+		const char *eventName;			// camera event (EventSelector entry) that signals a change, NULL if none
+		bool trouble;					// a change between two reads means something went wrong; adaptive sampling speeds up on it
+	};
+
+	inline const SStatisticInfo &GetStatisticInfo(EStatistic statistic)
+	{
+#define STATISTICIAN_STATISTIC_INFO(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) \
+			{ #field, label, listLabel, section, type, kind, deviceClasses, group, nodeMap, nodeName, address, offsetof(StatisticsSnapshot, field), logged, update, eventName, trouble },
+		static const SStatisticInfo info[Statistic_Count] =
+		{
+			STATISTICIAN_STATISTICS(STATISTICIAN_STATISTIC_INFO)
+		};
+#undef STATISTICIAN_STATISTIC_INFO
+		return info[statistic];
+	}
+
+	struct SCounterInfo
+	{
+		const char *name;						// field name in StatisticsSnapshot
+		int64_t StatisticsSnapshot::*field;
+		bool cumulative;						// only goes up while the camera is connected; stitched across resets
+		EStatisticGroup group;					// read when this group is sampled
+	};
+
+	inline const SCounterInfo &GetCounterInfo(ECounter counter)
+	{
+#define STATISTICIAN_COUNTER_INFO(id, field, label, listLabel, section, type, kind, counter, deviceClasses, group, nodeMap, nodeName, address, logged, update, eventName, trouble) \
+			STATISTICIAN_IF_COUNTER_##counter({ #field, &StatisticsSnapshot::field, kind == StatisticKind_Counter, group },)
+		static const SCounterInfo info[Counter_Count] =
+		{
+			STATISTICIAN_STATISTICS(STATISTICIAN_COUNTER_INFO)
+		};
+#undef STATISTICIAN_COUNTER_INFO
+		return info[counter];
+	}
+
+	inline const char *GetStatisticSectionName(EStatisticSection section)
+	{
+		switch (section)
+		{
+		case StatisticSection_Camera: return "Camera";
+		case StatisticSection_GrabEngine: return "Grab Engine";
+		case StatisticSection_TransportLayer: return "Transport Layer";
+		default: return "";
+		}
+	}
+
+	inline bool IsStatisticAvailable(const StatisticsSnapshot &snapshot, EStatistic statistic)
+	{
+		return (snapshot.available & (static_cast<uint64_t>(1) << statistic)) != 0;
+	}
+
+	// Zeroes a snapshot and marks every statistic as not available: integers -1, texts "-1".
+	inline void ResetStatisticsSnapshot(StatisticsSnapshot &snapshot)
+	{
+		memset(&snapshot, 0, sizeof(snapshot));
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			char *value = reinterpret_cast<char*>(&snapshot) + info.offset;
+			if (info.type == StatisticType_Integer)
+				*reinterpret_cast<int64_t*>(value) = -1;
+			else if (info.type == StatisticType_Text)
+				memcpy(value, "-1", 3);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,168 @@
+// StatisticsSource.h
+// What a statistician reads its values from
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STATISTICSSOURCE_H
+#define STATISTICSSOURCE_H
+
+#include "StatisticsSnapshot.h"
+#include <cstdint>
+#include <cstddef>
+
+// This header has no pylon dependency. CPylonStatisticsSource (PylonStatisticsSource.h) reads a real
+// camera, CSimulatedCamera (SimulatedCamera.h) makes one up.
+//
+// Errors are reported by throwing. Any exception while sampling ends sampling of the camera,
+// the same way a removed camera does.
+namespace Statistician
+{
+	// One statistic node, resolved once when the probe plan is built.
+	// Only the Get function of the type the node was resolved as is called.
+	class IStatisticNode
+	{
+	public:
+		virtual ~IStatisticNode() {}
+		virtual bool IsReadable() = 0;
+		virtual int64_t GetInteger() = 0;
+		virtual bool GetBoolean() = 0;
+		virtual void GetText(char *text, size_t size) = 0; // always terminated
+	};
+
+	// How a statistic is actually kept up to date, as chosen when the probe plan is built.
+	enum EStatisticMechanism
+	{
+		StatisticMechanism_Unavailable,	// the camera does not have the statistic
+		StatisticMechanism_Polled,		// read every time its group is due
+		StatisticMechanism_NodeCallback,	// read when a GenApi node callback reports a change
+		StatisticMechanism_CameraEvent	// read when the camera sends the statistic's event
+	};
+
+	inline const char *GetStatisticMechanismName(EStatisticMechanism mechanism)
+	{
+		switch (mechanism)
+		{
+		case StatisticMechanism_Polled: return "polled";
+		case StatisticMechanism_NodeCallback: return "node callback";
+		case StatisticMechanism_CameraEvent: return "camera event";
+		default: return "unavailable";
+		}
+	}
+
+	// Told when a subscribed statistic may have changed. Called on whatever thread the source
+	// learns about the change (e.g. pylon's event processing), so it must only flag the change.
+	class IStatisticChangeObserver
+	{
+	public:
+		virtual ~IStatisticChangeObserver() {}
+		virtual void OnStatisticChanged(size_t cookie) = 0;
+
+		// The camera was removed (see IStatisticsSource::WatchRemoval()).
+		virtual void OnSourceRemoved() {}
+	};
+
+	// Raw access to the device registers.
+	class IRegisterPort
+	{
+	public:
+		virtual ~IRegisterPort() {}
+		virtual void Read(void *buffer, int64_t address, int64_t length) = 0;
+	};
+
+	// The node maps and device port of one camera.
+	class IStatisticsSource
+	{
+	public:
+		virtual ~IStatisticsSource() {}
+
+		// Called once at the start of every sample pass. False once the camera can't be sampled.
+		virtual bool IsOpen() = 0;
+
+		// DeviceClass_* of the camera, 0 if it is neither.
+		virtual unsigned GetDeviceClassMask() = 0;
+
+		// Returns the node of a statistic, or NULL if the camera does not have it or it can't be read.
+		// The node is owned by the source and lives as long as the source.
+		virtual IStatisticNode *GetNode(ENodeMap nodeMap, const char *name, EStatisticType type) = 0;
+
+		// NULL if the camera has no device port.
+		virtual IRegisterPort *GetRegisterPort() = 0;
+
+		// Asks to be told when a node returned by GetNode() changes, through the camera event
+		// 'eventName' if it is not NULL and the camera can send it, otherwise through a node
+		// callback. Returns the mechanism used; StatisticMechanism_Polled means the source can't
+		// tell, and the caller has to keep reading the node.
+		virtual EStatisticMechanism Subscribe(IStatisticNode * /*node*/, const char * /*eventName*/, IStatisticChangeObserver * /*observer*/, size_t /*cookie*/)
+		{
+			return StatisticMechanism_Polled;
+		}
+
+		// Removes every subscription of the observer. No call to it is made after this returns.
+		virtual void Unsubscribe(IStatisticChangeObserver * /*observer*/)
+		{
+		}
+
+		// Asks to be told as soon as the camera is removed, instead of at the next IsOpen(). Ends
+		// with Unsubscribe().
+		virtual void WatchRemoval(IStatisticChangeObserver * /*observer*/)
+		{
+		}
+
+		// Called on the sampling thread after the camera was removed or a sample pass threw, until it
+		// returns true: the camera can be sampled again. It only looks whether the camera is back;
+		// bringing it back is up to whoever owns it, so it must not block or change the device. The
+		// nodes and the port returned before may be gone, so they are resolved again; the camera
+		// counts its statistics from zero.
+		virtual bool Reconnect()
+		{
+			return IsOpen();
+		}
+	};
+
+	// The stream settings of a GigE camera, and what the bandwidth they need depends on.
+	struct SStreamSettings
+	{
+		// writable
+		int64_t packetSize;				// GevSCPSPacketSize, bytes including the IP, UDP and GVSP headers
+		int64_t interPacketDelay;		// GevSCPD, timestamp ticks between two packets
+		int64_t frameTransmissionDelay;	// GevSCFTD, timestamp ticks before a frame is sent
+		int64_t bufferCount;			// buffers queued to the stream grabber (MaxNumBuffer)
+
+		// read only
+		int64_t maxPacketSize;			// the largest packet size the camera accepts
+		int64_t maxInterPacketDelay;
+		int64_t payloadSize;			// bytes per frame
+		double frameRate;				// frames per second with the current settings
+		int64_t linkSpeedMbps;			// GevLinkSpeed
+		int64_t tickFrequency;			// GevTimestampTickFrequency, ticks per second
+	};
+
+	// Reads and changes the stream settings of a camera (see CStreamAdvisor in StreamAdvisor.h).
+	class IStreamSettings
+	{
+	public:
+		virtual ~IStreamSettings() {}
+
+		// False if the camera has no stream settings (it is not a GigE camera).
+		virtual bool GetStreamSettings(SStreamSettings &settings) = 0;
+
+		// Writes the writable settings. Only call it while the camera is not grabbing; the packet
+		// size and the buffer count can't change during an acquisition. Throws if a value is refused.
+		virtual void SetStreamSettings(const SStreamSettings &settings) = 0;
+	};
+}
+
+#endif
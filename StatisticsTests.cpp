@@ -0,0 +1,838 @@
+// StatisticsTests.cpp
+// Tests of the statistician that need no camera
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Usage: StatisticsTests [test ...]
+//   Runs every test, or only the named ones, and prints a line per test. Returns 0 if all passed.
+//
+// The concurrent tests are meant to be run under a thread sanitizer as well, e.g. with gcc or clang:
+//   g++ -std=c++11 -O1 -g -fsanitize=thread -I. StatisticsTests.cpp -o StatisticsTests -lpthread
+// A race shows as a sanitizer report (and a non-zero exit code); a torn snapshot as a failed check.
+
+// No pylon dependency: the tests use simulated cameras only.
+#define STATISTICIAN_NO_PYLON
+#include "MetricsServer.h"
+#include "Statistician.h"
+#include "StatisticianPool.h"
+#include "SeqLock.h"
+#include "SimulatedCamera.h"
+#include "StatisticsAlerts.h"
+#include "StatisticsRecorder.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+using namespace std;
+using namespace Statistician;
+
+// Failed checks of the running test. Checks may fail on any thread.
+static atomic<int> g_failures(0);
+
+#define STATISTICS_CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+static bool Check(bool condition, const char *text, const char *file, int line)
+{
+	if (condition == false)
+	{
+		// only the first few, a failing check in a reader loop would flood the output.
+		if (g_failures++ < 10)
+			cout << "  " << file << "(" << line << "): " << text << " failed" << endl;
+	}
+	return condition;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// Snapshot publishing (CSeqLock, CStatistician::GetSnapshot) and access through a pool (CStatisticianPool)
+
+static const size_t c_readerCount = 8;
+static const chrono::milliseconds c_stressTime(1000);
+
+// As large as a snapshot, and every word holds the same value, so a torn copy has two values.
+struct STestPayload
+{
+	uint64_t words[(sizeof(StatisticsSnapshot) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+};
+
+static void ReadPayloads(const CSeqLock<STestPayload> *published, const atomic<bool> *isDone, uint64_t *distinctValues)
+{
+	unique_ptr<STestPayload> payload(new STestPayload());
+	uint64_t last = 0;
+	*distinctValues = 0;
+	while (isDone->load() == false)
+	{
+		published->Load(*payload);
+		uint64_t value = payload->words[0];
+		bool isWhole = true;
+		for (size_t i = 1; i < sizeof(payload->words) / sizeof(payload->words[0]); i++)
+			isWhole = isWhole && (payload->words[i] == value);
+		STATISTICS_CHECK(isWhole == true);
+		STATISTICS_CHECK(value >= last);
+		if (value != last)
+			(*distinctValues)++;
+		last = value;
+	}
+}
+
+// One writer stores as fast as it can while many readers load; every load must be a whole value,
+// and no reader may see the values go back.
+static void TestSeqLockReaders()
+{
+	unique_ptr<CSeqLock<STestPayload> > published(new CSeqLock<STestPayload>());
+	unique_ptr<STestPayload> payload(new STestPayload());
+	atomic<bool> isDone(false);
+	vector<uint64_t> distinctValues(c_readerCount, 0);
+	vector<thread> readers;
+	for (size_t i = 0; i < c_readerCount; i++)
+		readers.push_back(thread(ReadPayloads, published.get(), &isDone, &distinctValues[i]));
+
+	chrono::steady_clock::time_point end = chrono::steady_clock::now() + c_stressTime;
+	uint64_t value = 0;
+	while (chrono::steady_clock::now() < end)
+	{
+		value++;
+		for (size_t i = 0; i < sizeof(payload->words) / sizeof(payload->words[0]); i++)
+			payload->words[i] = value;
+		published->Store(*payload);
+	}
+	isDone = true;
+	for (size_t i = 0; i < readers.size(); i++)
+		readers[i].join();
+
+	STATISTICS_CHECK(published->GetSequence() == value);
+	for (size_t i = 0; i < c_readerCount; i++)
+		STATISTICS_CHECK(distinctValues[i] > 1);
+}
+
+static void ReadSnapshots(const CStatistician *statistician, const atomic<bool> *isDone, uint64_t *distinctSnapshots)
+{
+	unique_ptr<StatisticsSnapshot> last(new StatisticsSnapshot());
+	unique_ptr<StatisticsSnapshot> snapshot(new StatisticsSnapshot());
+	statistician->GetSnapshot(*last);
+	*distinctSnapshots = 0;
+	while (isDone->load() == false)
+	{
+		statistician->GetSnapshot(*snapshot);
+		if (snapshot->sequence == last->sequence)
+		{
+			// the same pass, so the same bytes.
+			STATISTICS_CHECK(memcmp(snapshot.get(), last.get(), sizeof(StatisticsSnapshot)) == 0);
+			continue;
+		}
+
+		STATISTICS_CHECK(snapshot->sequence > last->sequence);
+		STATISTICS_CHECK(snapshot->timestampUs >= last->timestampUs);
+		STATISTICS_CHECK(snapshot->sampling.nodeReads >= last->sampling.nodeReads);
+		STATISTICS_CHECK(snapshot->registerReads.passes >= last->registerReads.passes);
+		(*distinctSnapshots)++;
+		swap(last, snapshot);
+	}
+}
+
+// The sampling thread publishes every millisecond while many readers take snapshots. Two
+// snapshots of the same pass must be identical, and later passes never count less.
+static void TestSnapshotReaders()
+{
+	for (int deviceClass = 0; deviceClass < 2; deviceClass++)
+	{
+		CSimulatedCamera camera(deviceClass == 0 ? DeviceClass_Usb : DeviceClass_GigE);
+		camera.SetClock(SimulationClock_Steady);
+		camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 1000.0);
+
+		CStatistician statistician;
+		for (int group = 0; group < StatisticGroup_Count; group++)
+			statistician.SetSamplingPeriod(static_cast<EStatisticGroup>(group), chrono::milliseconds(1));
+		statistician.Initialize(camera);
+		statistician.Start();
+
+		atomic<bool> isDone(false);
+		vector<uint64_t> distinctSnapshots(c_readerCount, 0);
+		vector<thread> readers;
+		for (size_t i = 0; i < c_readerCount; i++)
+			readers.push_back(thread(ReadSnapshots, &statistician, &isDone, &distinctSnapshots[i]));
+
+		this_thread::sleep_for(c_stressTime);
+		isDone = true;
+		for (size_t i = 0; i < readers.size(); i++)
+			readers[i].join();
+		statistician.Stop();
+
+		for (size_t i = 0; i < c_readerCount; i++)
+			STATISTICS_CHECK(distinctSnapshots[i] > 1);
+	}
+}
+
+// A statistician taken from a pool stays alive while the handle exists: Unregister() waits for it.
+static void TestPoolHandle()
+{
+	CSimulatedCamera camera(DeviceClass_Usb);
+	CStatisticianPool pool;
+	size_t index = pool.Register(camera, "camera");
+	atomic<bool> isUnregistered(false);
+	thread unregister;
+	{
+		CStatisticianHandle statistician(pool, index);
+		STATISTICS_CHECK(statistician.IsValid() == true);
+		unregister = thread([&pool, index, &isUnregistered] { pool.Unregister(index); isUnregistered = true; });
+		this_thread::sleep_for(chrono::milliseconds(100));
+		STATISTICS_CHECK(isUnregistered == false);
+		statistician->SetSamplingPeriod(StatisticGroup_Temperature, chrono::milliseconds(0));
+	}
+	unregister.join();
+	STATISTICS_CHECK(isUnregistered == true);
+
+	CStatisticianHandle statistician(pool, index);
+	STATISTICS_CHECK(statistician.IsValid() == false && pool.IsRegistered(index) == false);
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// Sampling on the simulated clock (CSimulatedCamera with SimulationClock_Manual)
+
+// Samples like StatisticsSimulation does: a pass every 'stepUs' from 'timeUs' up to and including
+// 'endUs', after which the camera's clock moves on by the step. Snapshot timestamps are the
+// simulated time. Returns false, with 'timeUs' after the pass, as soon as SampleDue() does.
+static bool Simulate(CStatistician &statistician, CSimulatedCamera &camera, int64_t &timeUs, int64_t endUs, int64_t stepUs)
+{
+	for (; timeUs <= endUs; timeUs += stepUs)
+	{
+		chrono::steady_clock::time_point wakeup;
+		bool isSampling = statistician.SampleDue(chrono::steady_clock::time_point() + chrono::microseconds(timeUs), wakeup);
+		camera.Advance(chrono::microseconds(stepUs));
+		if (isSampling == false)
+		{
+			timeUs += stepUs;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every group is read right away, then once per period; a disabled group is never read, and
+// SampleDue() wakes up for the group that is due next. The profile counts the node reads and port
+// reads as device transactions, and the node lookups apart from them.
+static void TestScheduling()
+{
+	CSimulatedCamera camera(DeviceClass_Usb);
+	camera.SetClock(SimulationClock_Manual);
+	CStatistician statistician;
+	statistician.SetSamplingPeriod(StatisticGroup_Temperature, chrono::milliseconds(0));
+	statistician.SetProfiling(true);
+	statistician.Initialize(camera);
+
+	const chrono::steady_clock::time_point epoch;
+	chrono::steady_clock::time_point wakeup;
+	STATISTICS_CHECK(statistician.SampleDue(epoch, wakeup) == true);
+	STATISTICS_CHECK(wakeup == epoch + chrono::milliseconds(100));
+	camera.Advance(chrono::milliseconds(50));
+	STATISTICS_CHECK(statistician.SampleDue(epoch + chrono::milliseconds(50), wakeup) == true);
+	STATISTICS_CHECK(wakeup == epoch + chrono::milliseconds(100));
+	camera.Advance(chrono::milliseconds(50));
+
+	StatisticsSnapshot snapshot = statistician.GetSnapshot();
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_Grabber] == 1);
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_Transport] == 1);
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_UsbErrorRegisters] == 1);
+
+	// 100 ms to 2 s in 1 ms steps.
+	int64_t timeUs = 100000;
+	STATISTICS_CHECK(Simulate(statistician, camera, timeUs, 2000000, 1000) == true);
+	snapshot = statistician.GetSnapshot();
+	STATISTICS_CHECK(snapshot.timestampUs == 2000000);
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_Grabber] == 21);
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_Transport] == 9);
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_UsbErrorRegisters] == 3);
+	STATISTICS_CHECK(snapshot.sampling.samples[StatisticGroup_Temperature] == 0);
+	STATISTICS_CHECK(snapshot.sampling.periodUs[StatisticGroup_Grabber] == 100000);
+	STATISTICS_CHECK(snapshot.sampling.periodUs[StatisticGroup_Temperature] == 0);
+	STATISTICS_CHECK(snapshot.registerReads.passes == 3);
+	STATISTICS_CHECK(snapshot.profile.nodeLookups > 0 && snapshot.profile.nodeReads > 0 && snapshot.profile.portReads > 0);
+	STATISTICS_CHECK(snapshot.profile.transactions == snapshot.profile.nodeReads + snapshot.profile.portReads);
+	STATISTICS_CHECK(snapshot.profile.maxNodeLookupNs > 0 && snapshot.profile.maxNodeLookupNs <= snapshot.profile.nodeLookupNs);
+}
+
+// A camera that counts from zero again is rebased on the last value it reported, so the published
+// counter keeps going up; without stitching it is published as the camera reports it.
+static void TestCounterStitching()
+{
+	for (int isStitching = 0; isStitching < 2; isStitching++)
+	{
+		// 100 fps in 10 ms steps is one frame per step. The counters reset at 505 ms, after the
+		// frames up to 500 ms; the sample at 500 ms is the last to see them.
+		CSimulatedCamera camera(DeviceClass_Usb);
+		camera.SetClock(SimulationClock_Manual);
+		camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+		camera.AddEvent(chrono::milliseconds(505), SimulationEvent_ResetCounters);
+		CStatistician statistician;
+		statistician.SetCounterStitching(isStitching == 1);
+		statistician.Initialize(camera);
+
+		int64_t timeUs = 0;
+		STATISTICS_CHECK(Simulate(statistician, camera, timeUs, 1000000, 10000) == true);
+		StatisticsSnapshot snapshot = statistician.GetSnapshot();
+		if (isStitching == 1)
+		{
+			STATISTICS_CHECK(snapshot.totalBuffers == 100);
+			STATISTICS_CHECK(snapshot.lifecycle.offsets[Counter_TotalBuffers] == 50);
+			STATISTICS_CHECK(snapshot.lifecycle.resetCount == 1);
+			STATISTICS_CHECK(snapshot.lifecycle.resets[0].reason == CounterReset_Decrease);
+			STATISTICS_CHECK(snapshot.lifecycle.resets[0].timestampUs == 600000);
+			STATISTICS_CHECK((snapshot.lifecycle.resets[0].counters & (1u << Counter_TotalBuffers)) != 0);
+		}
+		else
+		{
+			STATISTICS_CHECK(snapshot.totalBuffers == 50);
+			STATISTICS_CHECK(snapshot.lifecycle.offsets[Counter_TotalBuffers] == 0);
+			STATISTICS_CHECK(snapshot.lifecycle.resetCount == 0);
+		}
+	}
+}
+
+// The derived metrics follow the counters of the same snapshot, per interval and in total.
+static void TestDerivedMetrics()
+{
+	// a USB camera that misses no frames, at 100 fps.
+	CSimulatedCamera usb(DeviceClass_Usb);
+	usb.SetClock(SimulationClock_Manual);
+	usb.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+	CStatistician usbStatistician;
+	usbStatistician.Initialize(usb);
+	int64_t timeUs = 0;
+	STATISTICS_CHECK(Simulate(usbStatistician, usb, timeUs, 1000000, 10000) == true);
+
+	StatisticsSnapshot snapshot = usbStatistician.GetSnapshot();
+	const uint32_t usbMetrics = (1u << DerivedMetric_EffectiveFrameRate) | (1u << DerivedMetric_BlockIdGap) | (1u << DerivedMetric_BufferFailureRate);
+	STATISTICS_CHECK(snapshot.derived.available == usbMetrics);
+	STATISTICS_CHECK(snapshot.derived.values[DerivedMetric_EffectiveFrameRate] == 100.0);
+	STATISTICS_CHECK(snapshot.derived.totals[DerivedMetric_EffectiveFrameRate] == 100.0);
+	STATISTICS_CHECK(snapshot.derived.values[DerivedMetric_BlockIdGap] == 0.0);
+	STATISTICS_CHECK(snapshot.derived.totals[DerivedMetric_BufferFailureRate] == 0.0);
+
+	// a GigE camera that loses packets, some of them for good.
+	CSimulatedCamera gige(DeviceClass_GigE, 7);
+	gige.SetClock(SimulationClock_Manual);
+	gige.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+	gige.AddEvent(chrono::milliseconds(0), SimulationEvent_LossRate, 0.05);
+	CStatistician gigeStatistician;
+	gigeStatistician.Initialize(gige);
+	timeUs = 0;
+	STATISTICS_CHECK(Simulate(gigeStatistician, gige, timeUs, 1000000, 10000) == true);
+
+	snapshot = gigeStatistician.GetSnapshot();
+	STATISTICS_CHECK((snapshot.derived.available & (1u << DerivedMetric_PacketLossRatio)) != 0);
+	STATISTICS_CHECK((snapshot.derived.available & (1u << DerivedMetric_BlockIdGap)) == 0);
+	STATISTICS_CHECK(snapshot.totalPackets > 0 && snapshot.failedPackets > 0 && snapshot.resendPackets > 0);
+	STATISTICS_CHECK(snapshot.derived.totals[DerivedMetric_PacketLossRatio] == static_cast<double>(snapshot.failedPackets) / static_cast<double>(snapshot.totalPackets));
+	STATISTICS_CHECK(snapshot.derived.totals[DerivedMetric_ResendRatio] == static_cast<double>(snapshot.resendPackets) / static_cast<double>(snapshot.totalPackets));
+	STATISTICS_CHECK(snapshot.derived.totals[DerivedMetric_BufferFailureRate] == static_cast<double>(snapshot.failedBuffers) / static_cast<double>(snapshot.totalBuffers));
+	STATISTICS_CHECK(snapshot.derived.values[DerivedMetric_EffectiveFrameRate] == 100.0);
+}
+
+// A removed camera ends sampling, unless the statistician retries; then it keeps its snapshot,
+// shows the camera as disconnected until it is back and stitches the counters across. The nodes
+// from before a reconnect are freed when the statistician resolves them again.
+static void TestReconnect()
+{
+	for (int isRetrying = 0; isRetrying < 2; isRetrying++)
+	{
+		// 100 fps in 10 ms steps; removed at 305 ms, after the sample at 300 ms saw 30 frames,
+		// and back at 605 ms, counting from zero. The pass at 310 ms finds it gone; retries follow
+		// every 100 ms, and the one at 610 ms finds it back. The groups are read again from the
+		// next pass on, so the last read, at 920 ms, sees the 31 frames since 605 ms.
+		CSimulatedCamera camera(DeviceClass_Usb);
+		camera.SetClock(SimulationClock_Manual);
+		camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+		camera.AddEvent(chrono::milliseconds(305), SimulationEvent_Remove);
+		camera.AddEvent(chrono::milliseconds(605), SimulationEvent_Reconnect);
+		camera.AddEvent(chrono::milliseconds(1105), SimulationEvent_Remove);
+		camera.AddEvent(chrono::milliseconds(1405), SimulationEvent_Reconnect);
+		CStatistician statistician;
+		if (isRetrying == 1)
+			statistician.SetReconnect(chrono::milliseconds(100));
+		statistician.Initialize(camera);
+		size_t nodeCount = camera.GetNodeCount();
+		STATISTICS_CHECK(nodeCount > 0);
+
+		int64_t timeUs = 0;
+		bool isSampling = Simulate(statistician, camera, timeUs, 500000, 10000);
+		StatisticsSnapshot snapshot = statistician.GetSnapshot();
+		STATISTICS_CHECK(snapshot.lifecycle.connected == false);
+		STATISTICS_CHECK(snapshot.lifecycle.removals == 1);
+		STATISTICS_CHECK(snapshot.lifecycle.lastRemovalUs == 310000);
+		STATISTICS_CHECK(snapshot.totalBuffers == 30);
+		if (isRetrying == 0)
+		{
+			STATISTICS_CHECK(isSampling == false);
+			STATISTICS_CHECK(timeUs == 320000);
+			continue;
+		}
+
+		STATISTICS_CHECK(isSampling == true);
+		STATISTICS_CHECK(Simulate(statistician, camera, timeUs, 1000000, 10000) == true);
+		snapshot = statistician.GetSnapshot();
+		STATISTICS_CHECK(snapshot.lifecycle.connected == true);
+		STATISTICS_CHECK(snapshot.lifecycle.reconnects == 1);
+		STATISTICS_CHECK(snapshot.lifecycle.lastReconnectUs == 610000);
+		STATISTICS_CHECK(snapshot.lifecycle.resetCount == 1);
+		STATISTICS_CHECK(snapshot.lifecycle.resets[0].reason == CounterReset_Reconnect);
+		STATISTICS_CHECK(snapshot.lifecycle.offsets[Counter_TotalBuffers] == 30);
+		STATISTICS_CHECK(snapshot.totalBuffers == 30 + 31);
+		STATISTICS_CHECK(camera.GetNodeCount() == nodeCount);
+
+		STATISTICS_CHECK(Simulate(statistician, camera, timeUs, 2000000, 10000) == true);
+		snapshot = statistician.GetSnapshot();
+		STATISTICS_CHECK(snapshot.lifecycle.connected == true);
+		STATISTICS_CHECK(snapshot.lifecycle.reconnects == 2);
+		STATISTICS_CHECK(camera.GetNodeCount() == nodeCount);
+	}
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// Alert rules (CStatisticsAlerts) on the simulated clock
+
+// Keeps every alert; read it after CStatisticsAlerts::Stop(), which delivers everything queued.
+class CAlertLog : public IAlertHandler
+{
+private:
+	vector<SAlert> m_alerts;
+
+public:
+	virtual void OnAlert(const SAlert &alert) { m_alerts.push_back(alert); }
+
+	size_t Count(size_t rule, bool raised) const
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < m_alerts.size(); i++)
+			count += (m_alerts[i].rule == rule && m_alerts[i].raised == raised) ? 1 : 0;
+		return count;
+	}
+
+	// the first alert of the rule that was raised or cleared, NULL if none.
+	const SAlert *Find(size_t rule, bool raised) const
+	{
+		for (size_t i = 0; i < m_alerts.size(); i++)
+		{
+			if (m_alerts[i].rule == rule && m_alerts[i].raised == raised)
+				return &m_alerts[i];
+		}
+		return NULL;
+	}
+};
+
+// Samples a USB camera with the default periods from 0 to 'endUs' in 10 ms steps, with the
+// rules of 'alerts' checked on every published snapshot.
+static void SimulateAlerts(CSimulatedCamera &camera, CStatisticsAlerts &alerts, CAlertLog &log, int64_t endUs)
+{
+	alerts.AddHandler(&log);
+	camera.SetClock(SimulationClock_Manual);
+	CStatistician statistician;
+	statistician.Initialize(camera);
+	statistician.AddListener(alerts.AddSource("camera"));
+	alerts.Start();
+
+	int64_t timeUs = 0;
+	STATISTICS_CHECK(Simulate(statistician, camera, timeUs, endUs, 10000) == true);
+	alerts.Stop();
+	STATISTICS_CHECK(alerts.GetDroppedCount() == 0);
+}
+
+// Threshold rules raise when the value crosses the threshold and clear when it crosses back.
+// A counter is only checked when its group was read: every 100 ms for the grabber counters.
+static void TestAlertThresholds()
+{
+	CSimulatedCamera camera(DeviceClass_Usb);
+	camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+	CStatisticsAlerts alerts;
+	size_t above = alerts.AddThreshold("above", Statistic_TotalBuffers, AlertRule_Above, 50);
+	size_t below = alerts.AddThreshold("below", Statistic_TotalBuffers, AlertRule_Below, 30);
+	STATISTICS_CHECK(alerts.AddThreshold("text", Statistic_LastError, AlertRule_Above, 0) == static_cast<size_t>(-1));
+	CAlertLog log;
+	SimulateAlerts(camera, alerts, log, 1000000);
+
+	const SAlert *raised = log.Find(above, true);
+	STATISTICS_CHECK(log.Count(above, true) == 1 && log.Count(above, false) == 0);
+	STATISTICS_CHECK(raised != NULL && raised->timestampUs == 600000 && raised->value == 60.0 && raised->statistic == Statistic_TotalBuffers);
+
+	raised = log.Find(below, true);
+	const SAlert *cleared = log.Find(below, false);
+	STATISTICS_CHECK(log.Count(below, true) == 1 && log.Count(below, false) == 1);
+	STATISTICS_CHECK(raised != NULL && raised->timestampUs == 0 && raised->value == 0.0);
+	STATISTICS_CHECK(cleared != NULL && cleared->timestampUs == 300000 && cleared->value == 30.0);
+}
+
+// A rate rule looks at the change over its window. 100 fps is below the 110 per second of the
+// rule; at 1 s the camera goes to 150 fps, and the 500 ms window up to 1.2 s holds 60 frames.
+static void TestAlertRate()
+{
+	CSimulatedCamera camera(DeviceClass_Usb);
+	camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+	camera.AddEvent(chrono::milliseconds(1000), SimulationEvent_FrameRate, 150.0);
+	CStatisticsAlerts alerts;
+	size_t rate = alerts.AddRate("rate", Statistic_TotalBuffers, 110.0, chrono::milliseconds(500));
+	CAlertLog log;
+	SimulateAlerts(camera, alerts, log, 2000000);
+
+	const SAlert *raised = log.Find(rate, true);
+	STATISTICS_CHECK(log.Count(rate, true) == 1 && log.Count(rate, false) == 0);
+	STATISTICS_CHECK(raised != NULL && raised->timestampUs == 1200000 && raised->value == 120.0);
+}
+
+// An anomaly rule on a counter follows its rate between two reads with an EWMA. A steady 100 fps
+// is no anomaly, even though the transport group publishes snapshots in between that do not
+// read the counter; the step to 130 fps at 3 s is one, at the first read after it.
+static void TestAlertAnomaly()
+{
+	CSimulatedCamera camera(DeviceClass_Usb);
+	camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+	camera.AddEvent(chrono::milliseconds(3000), SimulationEvent_FrameRate, 130.0);
+	CStatisticsAlerts alerts;
+	size_t anomaly = alerts.AddAnomaly("anomaly", Statistic_TotalBuffers);
+	CAlertLog log;
+	SimulateAlerts(camera, alerts, log, 4000000);
+
+	const SAlert *raised = log.Find(anomaly, true);
+	STATISTICS_CHECK(raised != NULL && raised->timestampUs == 3100000);
+	STATISTICS_CHECK(raised != NULL && fabs(raised->value - 30.0) <= 10.0 && raised->threshold == 4.0);
+}
+
+// Edge rules raise once per edge. The camera warms from 40 C towards 75 C at 1 C/s, so it is
+// critical (72 C) from 32 s; at 40 s it cools towards 60 C and is no longer critical from 43 s.
+static void TestAlertEdges()
+{
+	CSimulatedCamera camera(DeviceClass_Usb);
+	camera.AddEvent(chrono::milliseconds(0), SimulationEvent_Temperature, 75.0);
+	camera.AddEvent(chrono::milliseconds(40000), SimulationEvent_Temperature, 60.0);
+	CStatisticsAlerts alerts;
+	size_t rising = alerts.AddEdge("rising", Statistic_CriticalTemp, AlertRule_Rising);
+	size_t falling = alerts.AddEdge("falling", Statistic_CriticalTemp, AlertRule_Falling);
+	CAlertLog log;
+	SimulateAlerts(camera, alerts, log, 50000000);
+
+	const SAlert *raised = log.Find(rising, true);
+	STATISTICS_CHECK(log.Count(rising, true) == 1 && log.Count(rising, false) == 0);
+	STATISTICS_CHECK(raised != NULL && llabs(raised->timestampUs - 32000000) <= 10000 && raised->value == 1.0);
+
+	raised = log.Find(falling, true);
+	STATISTICS_CHECK(log.Count(falling, true) == 1 && log.Count(falling, false) == 0);
+	STATISTICS_CHECK(raised != NULL && llabs(raised->timestampUs - 43000000) <= 10000 && raised->value == 0.0);
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// Binary log (CStatisticsRecorder, StatisticsLogFormat.h)
+
+// Keeps every published snapshot.
+class CSnapshotLog : public IStatisticsListener
+{
+public:
+	vector<StatisticsSnapshot> snapshots;
+	virtual void OnStatistics(const StatisticsSnapshot &snapshot) { snapshots.push_back(snapshot); }
+};
+
+static bool ReadLogName(const uint8_t *&data, const uint8_t *end, string &name)
+{
+	if (data == end || static_cast<size_t>(end - data) < 1u + *data)
+		return false;
+	name.assign(reinterpret_cast<const char*>(data) + 1, *data);
+	data += 1 + *data;
+	return true;
+}
+
+// Decodes the log the way StatisticsReplay does and compares every sample with the snapshot the
+// statistician published. The source of a log that was opened before records nothing into the
+// next one, although it is still registered.
+static void TestRecorderRoundTrip()
+{
+	const char *path = "StatisticsTests.log";
+	CSimulatedCamera camera(DeviceClass_Usb);
+	camera.SetClock(SimulationClock_Manual);
+	camera.AddEvent(chrono::milliseconds(0), SimulationEvent_FrameRate, 100.0);
+	camera.AddEvent(chrono::milliseconds(0), SimulationEvent_Temperature, 75.0);
+	CStatistician statistician;
+	statistician.Initialize(camera);
+	CSnapshotLog published;
+	statistician.AddListener(&published);
+
+	CStatisticsRecorder recorder;
+	STATISTICS_CHECK(recorder.Open(path) == true);
+	statistician.AddListener(recorder.AddSource("previous"));
+	STATISTICS_CHECK(recorder.Open(path) == true);
+	statistician.AddListener(recorder.AddSource("camera"));
+	int64_t timeUs = 0;
+	STATISTICS_CHECK(Simulate(statistician, camera, timeUs, 35000000, 10000) == true);
+	recorder.Close();
+	STATISTICS_CHECK(recorder.GetDroppedSamples() == 0);
+
+	vector<uint8_t> log;
+	FILE *file = fopen(path, "rb");
+	if (STATISTICS_CHECK(file != NULL) == false)
+		return;
+	uint8_t chunk[4096];
+	for (size_t length = fread(chunk, 1, sizeof(chunk), file); length > 0; length = fread(chunk, 1, sizeof(chunk), file))
+		log.insert(log.end(), chunk, chunk + length);
+	fclose(file);
+	remove(path);
+	STATISTICS_CHECK(log.size() == recorder.GetBytesWritten());
+
+	// header: the u32 fields are little endian, and the names are in schema order by type.
+	const uint8_t *data = log.empty() ? NULL : &log[0];
+	const uint8_t *end = data + log.size();
+	if (STATISTICS_CHECK(log.size() >= sizeof(c_logMagic) + 5 * 4 && memcmp(data, c_logMagic, sizeof(c_logMagic)) == 0) == false)
+		return;
+	data += sizeof(c_logMagic);
+	STATISTICS_CHECK(data[0] == c_logVersion && data[1] == 0 && data[2] == 0 && data[3] == 0);
+	STATISTICS_CHECK(DecodeUint32(data + 4) == c_integerStatisticCount);
+	STATISTICS_CHECK(DecodeUint32(data + 8) == c_textStatisticCount);
+	STATISTICS_CHECK(DecodeUint32(data + 12) == c_booleanStatisticCount);
+	STATISTICS_CHECK(DecodeUint32(data + 16) == c_registerStatisticCount);
+	data += 5 * 4;
+	const EStatisticType types[4] = { StatisticType_Integer, StatisticType_Text, StatisticType_Boolean, StatisticType_Register };
+	for (int t = 0; t < 4; t++)
+	{
+		for (int i = 0; i < Statistic_Count; i++)
+		{
+			const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+			string name;
+			if (info.type == types[t] && STATISTICS_CHECK(ReadLogName(data, end, name) == true && name == info.name) == false)
+				return;
+		}
+	}
+
+	// records: one source, and a sample for every published snapshot.
+	vector<string> strings;
+	size_t sourceCount = 0;
+	size_t sampleCount = 0;
+	int64_t timestampUs = 0;
+	int64_t integers[c_integerStatisticCount] = {};
+	uint64_t registers[c_registerStatisticCount] = {};
+	bool isWhole = true;
+	while (data < end && isWhole == true)
+	{
+		uint8_t type = *data++;
+		uint64_t id = 0;
+		uint64_t value = 0;
+		string text;
+		isWhole = DecodeVarint(data, end, id);
+		if (type == LogRecord_String)
+		{
+			isWhole = isWhole && id == strings.size() && DecodeVarint(data, end, value) && static_cast<uint64_t>(end - data) >= value;
+			if (isWhole == true)
+			{
+				strings.push_back(string(reinterpret_cast<const char*>(data), static_cast<size_t>(value)));
+				data += value;
+			}
+		}
+		else if (type == LogRecord_Source)
+		{
+			isWhole = isWhole && id == 0 && DecodeVarint(data, end, value) && value == 6 && static_cast<uint64_t>(end - data) >= value;
+			isWhole = isWhole && memcmp(data, "camera", 6) == 0;
+			data += isWhole ? value : 0;
+			sourceCount++;
+		}
+		else if (type == LogRecord_Sample)
+		{
+			isWhole = isWhole && id == 0 && sampleCount < published.snapshots.size() && DecodeVarint(data, end, value);
+			if (isWhole == false)
+				break;
+			const StatisticsSnapshot &snapshot = published.snapshots[sampleCount++];
+			const char *fields = reinterpret_cast<const char*>(&snapshot);
+			timestampUs += ZigZagDecode(value);
+			STATISTICS_CHECK(timestampUs == snapshot.timestampUs);
+
+			size_t integer = 0;
+			size_t reg = 0;
+			for (int i = 0; i < Statistic_Count && isWhole == true; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				if (info.type != StatisticType_Integer)
+					continue;
+				isWhole = DecodeVarint(data, end, value);
+				integers[integer] += ZigZagDecode(value);
+				STATISTICS_CHECK(integers[integer] == *reinterpret_cast<const int64_t*>(fields + info.offset));
+				integer++;
+			}
+			for (int i = 0; i < Statistic_Count && isWhole == true; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				if (info.type != StatisticType_Text)
+					continue;
+				isWhole = DecodeVarint(data, end, value) && value < strings.size();
+				STATISTICS_CHECK(isWhole == true && strings[static_cast<size_t>(value)] == fields + info.offset);
+			}
+			isWhole = isWhole && DecodeVarint(data, end, value);
+			size_t boolean = 0;
+			for (int i = 0; i < Statistic_Count && isWhole == true; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				if (info.type != StatisticType_Boolean)
+					continue;
+				STATISTICS_CHECK(((value >> boolean) & 1) == (*reinterpret_cast<const bool*>(fields + info.offset) ? 1u : 0u));
+				boolean++;
+			}
+			for (int i = 0; i < Statistic_Count && isWhole == true; i++)
+			{
+				const SStatisticInfo &info = GetStatisticInfo(static_cast<EStatistic>(i));
+				if (info.type != StatisticType_Register)
+					continue;
+				isWhole = DecodeVarint(data, end, value);
+				registers[reg] += static_cast<uint64_t>(ZigZagDecode(value));
+				STATISTICS_CHECK(registers[reg] == *reinterpret_cast<const uint64_t*>(fields + info.offset));
+				reg++;
+			}
+		}
+		else
+		{
+			isWhole = false;
+		}
+	}
+
+	STATISTICS_CHECK(isWhole == true && data == end);
+	STATISTICS_CHECK(sourceCount == 1);
+	STATISTICS_CHECK(sampleCount == published.snapshots.size() && sampleCount > 100);
+	STATISTICS_CHECK(published.snapshots.empty() == false && published.snapshots.back().criticalTemp == true);
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// HTTP metrics server (CMetricsServer)
+
+static Detail::socket_type ConnectClient(uint16_t port)
+{
+	Detail::socket_type client = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in endpoint;
+	memset(&endpoint, 0, sizeof(endpoint));
+	endpoint.sin_family = AF_INET;
+	endpoint.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &endpoint.sin_addr);
+	if (client != Detail::c_invalidSocket && connect(client, reinterpret_cast<sockaddr*>(&endpoint), sizeof(endpoint)) != 0)
+	{
+		Detail::CloseSocket(client);
+		client = Detail::c_invalidSocket;
+	}
+	return client;
+}
+
+// Reads whatever the server sends until it closes the connection. False if it is still open
+// after 'timeoutMs'.
+static bool WaitForClose(Detail::socket_type client, int timeoutMs)
+{
+	chrono::steady_clock::time_point end = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+	for (;;)
+	{
+		int remainingMs = static_cast<int>(chrono::duration_cast<chrono::milliseconds>(end - chrono::steady_clock::now()).count());
+		Detail::pollfd_type fd;
+		fd.fd = client;
+		fd.events = POLLIN;
+		fd.revents = 0;
+		if (remainingMs <= 0 || Detail::PollSockets(&fd, 1, remainingMs) <= 0)
+			return false;
+
+		char buffer[4096];
+		if (recv(client, buffer, sizeof(buffer), 0) <= 0)
+			return true;
+	}
+}
+
+// A client that sends nothing, and one that keeps its connection after a scrape, are closed once
+// they have been idle for the idle timeout, so they do not hold connection slots for good.
+static void TestMetricsIdleTimeout()
+{
+	CMetricsServer server;
+	server.SetIdleTimeout(chrono::milliseconds(200));
+	if (STATISTICS_CHECK(server.StartTcp(0) == true) == false)
+		return;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	Detail::socket_type idle = ConnectClient(server.GetPort());
+	Detail::socket_type scraper = ConnectClient(server.GetPort());
+	STATISTICS_CHECK(idle != Detail::c_invalidSocket && scraper != Detail::c_invalidSocket);
+	const char request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	STATISTICS_CHECK(send(scraper, request, static_cast<int>(sizeof(request) - 1), 0) == static_cast<int>(sizeof(request) - 1));
+
+	STATISTICS_CHECK(WaitForClose(idle, 5000) == true);
+	STATISTICS_CHECK(WaitForClose(scraper, 5000) == true);
+	STATISTICS_CHECK(chrono::steady_clock::now() - start >= chrono::milliseconds(200));
+	STATISTICS_CHECK(server.GetRequestCount() == 1);
+	Detail::CloseSocket(idle);
+	Detail::CloseSocket(scraper);
+	server.Stop();
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+struct STest
+{
+	const char *name;
+	void (*run)();
+};
+
+static const STest c_tests[] =
+{
+	{ "seqlock-readers", TestSeqLockReaders },
+	{ "snapshot-readers", TestSnapshotReaders },
+	{ "pool-handle", TestPoolHandle },
+	{ "scheduling", TestScheduling },
+	{ "counter-stitching", TestCounterStitching },
+	{ "derived-metrics", TestDerivedMetrics },
+	{ "reconnect", TestReconnect },
+	{ "alert-thresholds", TestAlertThresholds },
+	{ "alert-rate", TestAlertRate },
+	{ "alert-anomaly", TestAlertAnomaly },
+	{ "alert-edges", TestAlertEdges },
+	{ "recorder-round-trip", TestRecorderRoundTrip },
+	{ "metrics-idle-timeout", TestMetricsIdleTimeout },
+};
+
+int main(int argc, char* argv[])
+{
+	const size_t testCount = sizeof(c_tests) / sizeof(c_tests[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		bool isKnown = false;
+		for (size_t t = 0; t < testCount; t++)
+			isKnown = isKnown || (string(argv[i]) == c_tests[t].name);
+		if (isKnown == false)
+		{
+			cerr << "Unknown test " << argv[i] << endl;
+			cerr << "Usage: " << argv[0] << " [test ...]" << endl;
+			return 1;
+		}
+	}
+
+	int failedTests = 0;
+	int ranTests = 0;
+	for (size_t t = 0; t < testCount; t++)
+	{
+		bool isSelected = (argc == 1);
+		for (int i = 1; i < argc; i++)
+			isSelected = isSelected || (string(argv[i]) == c_tests[t].name);
+		if (isSelected == false)
+			continue;
+
+		g_failures = 0;
+		c_tests[t].run();
+		ranTests++;
+		if (g_failures > 0)
+			failedTests++;
+		cout << (g_failures > 0 ? "FAILED " : "passed ") << c_tests[t].name << endl;
+	}
+
+	cout << ranTests - failedTests << " of " << ranTests << " tests passed" << endl;
+	return failedTests > 0 ? 1 : 0;
+}
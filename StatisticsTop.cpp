@@ -0,0 +1,211 @@
+// StatisticsTop.cpp
+// Shows the cameras of a shared-memory statistics segment, refreshed like top
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Usage: StatisticsTop <segment name> [options]
+//   --interval <ms>     time between refreshes (default 1000)
+//   --count <n>         stop after n refreshes (default: until interrupted)
+//   --once              print one table without clearing the screen (same as --count 1)
+//
+// Rates are computed from the change between two refreshes, so the first table shows none.
+
+// No pylon or statistician dependency: this tool only needs the reader library.
+#include "StatisticsShm.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+
+#ifdef _WIN32
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    include <windows.h>
+#endif
+
+using namespace std;
+
+// Columns, by counter name as published in the segment header.
+static const char *const c_columnCounters[] = { "totalBuffers", "failedBuffers", "bufferUnderruns", "resendRequests", "missedFrameCount", "currentTemperature" };
+static const size_t c_columnCount = sizeof(c_columnCounters) / sizeof(c_columnCounters[0]);
+
+// What the previous refresh read from a slot.
+struct SPrevious
+{
+	bool valid;
+	int64_t totalBuffers;
+	chrono::steady_clock::time_point readTime;
+};
+
+static void ClearScreen()
+{
+#ifdef _WIN32
+	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+	CONSOLE_SCREEN_BUFFER_INFO info;
+	COORD home = { 0, 0 };
+	DWORD written;
+	if (GetConsoleScreenBufferInfo(console, &info) != FALSE)
+	{
+		FillConsoleOutputCharacterA(console, ' ', info.dwSize.X * info.dwSize.Y, home, &written);
+		SetConsoleCursorPosition(console, home);
+	}
+#else
+	cout << "\x1b[H\x1b[2J";
+#endif
+}
+
+static string FormatCounter(int64_t value)
+{
+	return (value < 0) ? string("-") : to_string(static_cast<long long>(value));
+}
+
+// Texts may end in a line break (the statistician's "(no error)" does); the table has one row per camera.
+static string FormatText(const char *text)
+{
+	string line(text);
+	while (line.empty() == false && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+		line.erase(line.size() - 1);
+	return line;
+}
+
+static const char *GetStateName(uint32_t state)
+{
+	switch (state)
+	{
+	case STATISTICS_SHM_SLOT_ACTIVE: return "active";
+	case STATISTICS_SHM_SLOT_STOPPED: return "stopped";
+	default: return "free";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-')
+	{
+		cerr << "Usage: " << argv[0] << " <segment name> [--interval <ms>] [--count <n>] [--once]" << endl;
+		return 1;
+	}
+
+	int64_t intervalMs = 1000;
+	int64_t count = -1;
+	bool clear = true;
+	for (int i = 2; i < argc; i++)
+	{
+		string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--interval" && hasValue)
+			intervalMs = atoll(argv[++i]);
+		else if (option == "--count" && hasValue)
+			count = atoll(argv[++i]);
+		else if (option == "--once")
+		{
+			count = 1;
+			clear = false;
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			return 1;
+		}
+	}
+
+	StatisticsShmReader *reader = StatisticsShm_Open(argv[1]);
+	if (reader == NULL)
+	{
+		cerr << "Cannot open the statistics segment " << argv[1] << " (missing, or another layout version)" << endl;
+		return 1;
+	}
+	const StatisticsShmHeader *header = StatisticsShm_GetHeader(reader);
+
+	int columns[c_columnCount];
+	for (size_t i = 0; i < c_columnCount; i++)
+		columns[i] = StatisticsShm_FindCounter(reader, c_columnCounters[i]);
+
+	vector<SPrevious> previous(header->slotCount);
+	for (size_t i = 0; i < previous.size(); i++)
+		previous[i].valid = false;
+
+	for (int64_t refresh = 0; count < 0 || refresh < count; refresh++)
+	{
+		if (refresh > 0)
+			this_thread::sleep_for(chrono::milliseconds(intervalMs));
+
+		// the whole table is built first and printed at once, so it doesn't flicker.
+		ostringstream table;
+		table << "Segment " << argv[1] << ", writer process " << header->writerProcessId << ", " << header->slotCount << " slots" << endl << endl;
+		table << left << setw(4) << "#" << setw(20) << "Name" << setw(9) << "State" << right << setw(10) << "Samples"
+			<< setw(12) << "Buffers" << setw(9) << "fps" << setw(9) << "Failed" << setw(10) << "Underrun"
+			<< setw(9) << "Resends" << setw(9) << "Missed" << setw(6) << "Temp" << "  " << left << "Last error" << endl;
+
+		uint32_t shown = 0;
+		for (uint32_t i = 0; i < header->slotCount; i++)
+		{
+			StatisticsShmSlot slot;
+			int result = StatisticsShm_ReadSlot(reader, i, &slot);
+			chrono::steady_clock::time_point now = chrono::steady_clock::now();
+			if (result == STATISTICS_SHM_EMPTY)
+				continue;
+			shown++;
+			if (result != STATISTICS_SHM_OK)
+			{
+				table << left << setw(4) << i << "(slot is being written and can't be read)" << endl;
+				previous[i].valid = false;
+				continue;
+			}
+
+			int64_t values[c_columnCount];
+			for (size_t c = 0; c < c_columnCount; c++)
+				values[c] = (columns[c] >= 0) ? slot.counters[columns[c]] : -1;
+
+			string fps = "-";
+			if (previous[i].valid == true && values[0] >= 0 && previous[i].totalBuffers >= 0)
+			{
+				double seconds = chrono::duration<double>(now - previous[i].readTime).count();
+				if (seconds > 0.0)
+				{
+					ostringstream rate;
+					rate << fixed << setprecision(1) << (values[0] - previous[i].totalBuffers) / seconds;
+					fps = rate.str();
+				}
+			}
+			previous[i].valid = true;
+			previous[i].totalBuffers = values[0];
+			previous[i].readTime = now;
+
+			string temperature = FormatCounter(values[5]);
+			if (slot.overTemp != 0 || slot.criticalTemp != 0)
+				temperature += "!";
+
+			table << left << setw(4) << i << setw(20) << string(slot.name).substr(0, 19) << setw(9) << GetStateName(slot.state) << right
+				<< setw(10) << slot.sampleSequence << setw(12) << FormatCounter(values[0]) << setw(9) << fps
+				<< setw(9) << FormatCounter(values[1]) << setw(10) << FormatCounter(values[2]) << setw(9) << FormatCounter(values[3])
+				<< setw(9) << FormatCounter(values[4]) << setw(6) << temperature << "  " << left << FormatText(slot.lastError) << endl;
+		}
+		if (shown == 0)
+			table << "(no cameras)" << endl;
+
+		if (clear == true)
+			ClearScreen();
+		cout << table.str() << flush;
+	}
+
+	StatisticsShm_Close(reader);
+	return 0;
+}
@@ -0,0 +1,592 @@
+// StreamAdvisor.h
+// Recommends GigE stream settings from the collected statistics, and optionally tunes them in a closed loop
+//
+// Copyright (c) 2016-2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STREAMADVISOR_H
+#define STREAMADVISOR_H
+
+#include "Statistician.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+namespace Statistician
+{
+	// What an advice changes, as a bit mask.
+	enum EStreamAdvice
+	{
+		StreamAdvice_None = 0,
+		StreamAdvice_PacketSize = 0x01,				// larger packets: less header overhead, fewer packets to handle
+		StreamAdvice_InterPacketDelay = 0x02,		// packets get lost or resent: send them slower
+		StreamAdvice_FrameTransmissionDelay = 0x04,	// several cameras of one link lose packets: stagger their frames
+		StreamAdvice_BufferCount = 0x08,			// the stream grabber ran out of buffers
+		StreamAdvice_Bandwidth = 0x10				// the link can't carry the frames; lower the frame rate or the image size (not changed by the advisor)
+	};
+
+	inline const char *GetStreamAdviceName(EStreamAdvice advice)
+	{
+		switch (advice)
+		{
+		case StreamAdvice_PacketSize: return "packet size";
+		case StreamAdvice_InterPacketDelay: return "inter-packet delay";
+		case StreamAdvice_FrameTransmissionDelay: return "frame transmission delay";
+		case StreamAdvice_BufferCount: return "buffer count";
+		case StreamAdvice_Bandwidth: return "bandwidth";
+		default: return "none";
+		}
+	}
+
+	struct SStreamAdvice
+	{
+		bool valid;						// the camera has stream settings and the window had enough packets
+		unsigned advice;				// StreamAdvice_* bits
+		double utilization;				// share of the link bandwidth the camera used in the window
+		double linkUtilization;			// used by all cameras of its link
+		double requiredUtilization;		// the camera needs at its frame rate with the recommended packet size
+		double packetRate;				// per second
+		double errorRatio;				// resent and failed packets per packet, plus buffer underruns per frame
+		double underrunRate;			// per second
+		SStreamSettings current;
+		SStreamSettings recommended;
+	};
+
+	enum ETuningState
+	{
+		TuningState_Idle,			// nothing to change, or not enough samples to tell
+		TuningState_Verifying,		// settings were changed; waiting for enough samples to judge them
+		TuningState_Kept,			// the change lowered the error ratio
+		TuningState_RolledBack,		// it did not, so the previous settings were written back
+		TuningState_Failed			// the camera refused the settings
+	};
+
+	inline const char *GetTuningStateName(ETuningState state)
+	{
+		switch (state)
+		{
+		case TuningState_Verifying: return "verifying";
+		case TuningState_Kept: return "kept";
+		case TuningState_RolledBack: return "rolled back";
+		case TuningState_Failed: return "failed";
+		default: return "idle";
+		}
+	}
+
+	struct STuningResult
+	{
+		ETuningState state;
+		unsigned advice;			// StreamAdvice_* bits of the change
+		double errorsBefore;		// error ratio before and after the change
+		double errorsAfter;
+		SStreamSettings settings;	// as written to the camera
+	};
+
+	// Reads the sample history of each camera's statistician (SetHistoryCapacity()) and turns the
+	// packet, resend and underrun counts into stream settings:
+	//  - the packet size goes up to SetMaxPacketSize() (1500 by default: jumbo frames need every
+	//    NIC and switch on the way to take them);
+	//  - while packets get lost or resent, the inter-packet delay limits the rate the camera sends
+	//    at to its share of the link, in proportion to what each camera of the link needs, and to
+	//    at least a quarter less than before, so the closed loop keeps lowering it while errors
+	//    go on (other traffic on the link is not seen);
+	//  - when several cameras of a link have errors, the frame transmission delay staggers their
+	//    frames so they are not sent at the same time;
+	//  - buffer underruns double the buffer count.
+	// A link whose cameras need more than the link minus the headroom is reported, not changed.
+	//
+	// Advise() only recommends. Tune() is the closed loop: it writes the advice, and on a later
+	// call, once the samples taken after the change hold enough packets, keeps it if the error ratio
+	// dropped and writes the previous settings back otherwise. A change that did not help is not
+	// tried again until ResetTuning(). Call Tune() between acquisitions: most settings can't change
+	// while the camera grabs. Counters that restart with an acquisition are handled.
+	//
+	// Not thread safe; one thread calls Advise() and Tune().
+	class CStreamAdvisor
+	{
+	private:
+		struct SCamera
+		{
+			std::string link;
+			size_t rank;						// among the cameras of its link
+			const CStatistician *statistician;
+			IStreamSettings *settings;
+
+			// closed loop
+			ETuningState state;
+			unsigned advice;
+			unsigned rejected;					// advice that did not help
+			SStreamSettings previous;
+			SStreamSettings applied;
+			int64_t changeUs;					// samples from here on were taken with the new settings
+			double errorsBefore;
+			double errorsAfter;
+		};
+
+		// Counter increases over the samples of the window.
+		struct SWindow
+		{
+			bool valid;
+			int64_t lastUs;						// newest sample
+			double seconds;
+			int64_t packets;
+			double packetRate;
+			double packetErrorRatio;			// resent and failed packets per packet
+			double underrunRatio;				// buffer underruns per frame
+			double underrunRate;
+		};
+
+		static const int64_t c_ethernetOverhead = 38;	// header, checksum, preamble and gap per packet, not part of the packet size
+		static const int64_t c_packetHeaderSize = 36;	// IP, UDP and GVSP headers, part of the packet size
+		static const int64_t c_maxBufferCount = 1024;
+		static const size_t c_maxSamples = 4096;
+
+		std::vector<SCamera> m_cameras;
+		int64_t m_windowUs;
+		int64_t m_minPackets;
+		double m_errorThreshold;
+		int64_t m_maxPacketSize;
+		double m_headroom;
+		std::vector<int64_t> m_timestampsUs;		// history copies, so a call doesn't allocate
+		std::vector<int64_t> m_values;
+
+		int64_t GetIncrease(const CStatistician &statistician, ECounter counter, int64_t sinceUs, int64_t &firstUs, int64_t &lastUs);
+		void ReadWindow(const SCamera &camera, int64_t sinceUs, SWindow &window);
+		void Recommend(size_t index, unsigned allowed, SStreamAdvice &advice, SWindow &window);
+		bool Write(SCamera &camera, const SStreamSettings &settings);
+
+	public:
+		CStreamAdvisor();
+
+		// Adds a camera; cameras with the same link name share its bandwidth (see
+		// CLinkAggregator::GetLinkName()). The statistician and the settings must outlive the advisor.
+		// Returns the index of the camera.
+		size_t AddCamera(const char *link, const CStatistician &statistician, IStreamSettings &settings);
+		size_t GetCameraCount() const;
+
+		// The newest samples that span at most 'window' are judged. Default: 10 seconds.
+		void SetWindow(std::chrono::milliseconds window);
+
+		// Fewer packets than this in the window are not enough to judge. Default: 10000.
+		void SetMinPackets(int64_t packets);
+
+		// Error ratios up to this are fine. Default: 0.0001.
+		void SetErrorThreshold(double ratio);
+
+		// The largest packet size the network between camera and host carries. Default: 1500.
+		void SetMaxPacketSize(int64_t bytes);
+
+		// Share of each link that is left free. Default: 0.1.
+		void SetHeadroom(double fraction);
+
+		// Recommends settings for a camera. False if the camera has no stream settings or there
+		// are not enough samples yet; 'advice' then has no recommendation.
+		bool Advise(size_t camera, SStreamAdvice &advice);
+
+		// One step of the closed loop for a camera (see above). Call it between acquisitions.
+		STuningResult Tune(size_t camera);
+
+		// Forgets which advice did not help.
+		void ResetTuning(size_t camera);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline Statistician::CStreamAdvisor::CStreamAdvisor()
+	: m_windowUs(10000000)
+	, m_minPackets(10000)
+	, m_errorThreshold(0.0001)
+	, m_maxPacketSize(1500)
+	, m_headroom(0.1)
+	, m_timestampsUs(c_maxSamples)
+	, m_values(c_maxSamples)
+{
+}
+
+inline size_t Statistician::CStreamAdvisor::AddCamera(const char *link, const CStatistician &statistician, IStreamSettings &settings)
+{
+	SCamera camera;
+	camera.link = (link != NULL) ? link : "";
+	camera.rank = 0;
+	for (size_t i = 0; i < m_cameras.size(); i++)
+	{
+		if (m_cameras[i].link == camera.link)
+			camera.rank++;
+	}
+	camera.statistician = &statistician;
+	camera.settings = &settings;
+	camera.state = TuningState_Idle;
+	camera.advice = StreamAdvice_None;
+	camera.rejected = StreamAdvice_None;
+	memset(&camera.previous, 0, sizeof(camera.previous));
+	memset(&camera.applied, 0, sizeof(camera.applied));
+	camera.changeUs = 0;
+	camera.errorsBefore = 0.0;
+	camera.errorsAfter = 0.0;
+	m_cameras.push_back(camera);
+	return m_cameras.size() - 1;
+}
+
+inline size_t Statistician::CStreamAdvisor::GetCameraCount() const
+{
+	return m_cameras.size();
+}
+
+inline void Statistician::CStreamAdvisor::SetWindow(std::chrono::milliseconds window)
+{
+	m_windowUs = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(window).count());
+}
+
+inline void Statistician::CStreamAdvisor::SetMinPackets(int64_t packets)
+{
+	m_minPackets = std::max<int64_t>(1, packets);
+}
+
+inline void Statistician::CStreamAdvisor::SetErrorThreshold(double ratio)
+{
+	m_errorThreshold = std::max(0.0, ratio);
+}
+
+inline void Statistician::CStreamAdvisor::SetMaxPacketSize(int64_t bytes)
+{
+	m_maxPacketSize = bytes;
+}
+
+inline void Statistician::CStreamAdvisor::SetHeadroom(double fraction)
+{
+	m_headroom = std::min(0.9, std::max(0.0, fraction));
+}
+
+inline int64_t Statistician::CStreamAdvisor::GetIncrease(const CStatistician &statistician, ECounter counter, int64_t sinceUs, int64_t &firstUs, int64_t &lastUs)
+{
+	size_t count = statistician.CopyHistory(counter, &m_timestampsUs[0], &m_values[0], m_values.size());
+	int64_t increase = 0;
+	bool first = true;
+	firstUs = 0;
+	lastUs = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (m_timestampsUs[i] < sinceUs)
+			continue;
+		if (m_values[i] < 0)
+			return -1;
+
+		// a counter that went down was reset (a new acquisition); it counted up from zero since.
+		if (first == false)
+			increase += (m_values[i] >= m_values[i - 1]) ? m_values[i] - m_values[i - 1] : m_values[i];
+		else
+			firstUs = m_timestampsUs[i];
+		first = false;
+		lastUs = m_timestampsUs[i];
+	}
+	return increase;
+}
+
+inline void Statistician::CStreamAdvisor::ReadWindow(const SCamera &camera, int64_t sinceUs, SWindow &window)
+{
+	window.valid = false;
+	window.lastUs = 0;
+	window.seconds = 0.0;
+	window.packets = 0;
+	window.packetRate = 0.0;
+	window.packetErrorRatio = 0.0;
+	window.underrunRatio = 0.0;
+	window.underrunRate = 0.0;
+
+	// the window ends at the newest sample.
+	int64_t firstUs = 0;
+	int64_t lastUs = 0;
+	size_t count = camera.statistician->CopyHistory(Counter_TotalPackets, &m_timestampsUs[0], &m_values[0], m_values.size());
+	if (count < 2)
+		return;
+	sinceUs = std::max(sinceUs, m_timestampsUs[count - 1] - m_windowUs);
+
+	int64_t packets = GetIncrease(*camera.statistician, Counter_TotalPackets, sinceUs, firstUs, lastUs);
+	int64_t resent = GetIncrease(*camera.statistician, Counter_ResendPackets, sinceUs, firstUs, lastUs);
+	int64_t failed = GetIncrease(*camera.statistician, Counter_FailedPackets, sinceUs, firstUs, lastUs);
+	int64_t buffers = GetIncrease(*camera.statistician, Counter_TotalBuffers, sinceUs, firstUs, lastUs);
+	int64_t underruns = GetIncrease(*camera.statistician, Counter_BufferUnderruns, sinceUs, firstUs, lastUs);
+	if (packets < 0 || lastUs <= firstUs)
+		return;
+
+	window.lastUs = lastUs;
+	window.seconds = (lastUs - firstUs) / 1e6;
+	window.packets = packets;
+	window.packetRate = packets / window.seconds;
+	if (packets > 0)
+		window.packetErrorRatio = static_cast<double>(std::max<int64_t>(0, resent) + std::max<int64_t>(0, failed)) / packets;
+	if (underruns > 0)
+	{
+		window.underrunRatio = static_cast<double>(underruns) / (std::max<int64_t>(0, buffers) + underruns);
+		window.underrunRate = underruns / window.seconds;
+	}
+	window.valid = (packets >= m_minPackets);
+}
+
+inline void Statistician::CStreamAdvisor::Recommend(size_t index, unsigned allowed, SStreamAdvice &advice, SWindow &window)
+{
+	SCamera &camera = m_cameras[index];
+	const SStreamSettings &current = advice.current;
+	SStreamSettings &recommended = advice.recommended;
+	recommended = current;
+	advice.advice = StreamAdvice_None;
+
+	ReadWindow(camera, camera.changeUs, window);
+	advice.valid = window.valid;
+	advice.packetRate = window.packetRate;
+	advice.errorRatio = window.packetErrorRatio + window.underrunRatio;
+	advice.underrunRate = window.underrunRate;
+	if (window.valid == false || current.linkSpeedMbps <= 0 || current.tickFrequency <= 0)
+	{
+		advice.valid = false;
+		return;
+	}
+
+	double linkBitsPerSecond = current.linkSpeedMbps * 1e6;
+	advice.utilization = window.packetRate * (current.packetSize + c_ethernetOverhead) * 8.0 / linkBitsPerSecond;
+
+	// what the other cameras of the link use, and how many of them have errors too.
+	double others = 0.0;
+	size_t linkCameras = 1;
+	size_t linkErrorCameras = (window.packetErrorRatio > m_errorThreshold) ? 1 : 0;
+	for (size_t i = 0; i < m_cameras.size(); i++)
+	{
+		if (i == index || m_cameras[i].link != camera.link)
+			continue;
+
+		SStreamSettings settings;
+		SWindow other;
+		linkCameras++;
+		if (m_cameras[i].settings->GetStreamSettings(settings) == false)
+			continue;
+
+		// measured since its settings last changed; right after a change, what its settings need.
+		ReadWindow(m_cameras[i], m_cameras[i].changeUs, other);
+		if (other.valid == true)
+			others += other.packetRate * (settings.packetSize + c_ethernetOverhead) * 8.0 / linkBitsPerSecond;
+		else
+		{
+			int64_t otherPayloadPerPacket = std::max<int64_t>(1, settings.packetSize - c_packetHeaderSize);
+			int64_t otherPackets = (settings.payloadSize + otherPayloadPerPacket - 1) / otherPayloadPerPacket;
+			others += settings.frameRate * otherPackets * (settings.packetSize + c_ethernetOverhead) * 8.0 / linkBitsPerSecond;
+		}
+
+		// errors over the whole window: a camera that was just changed still counts.
+		ReadWindow(m_cameras[i], 0, other);
+		if (other.valid == true && other.packetErrorRatio > m_errorThreshold)
+			linkErrorCameras++;
+	}
+	advice.linkUtilization = advice.utilization + others;
+
+	// packet size first: the bandwidth a frame needs depends on it.
+	int64_t maxPacketSize = std::min(m_maxPacketSize, current.maxPacketSize);
+	if ((allowed & StreamAdvice_PacketSize) != 0 && current.packetSize < maxPacketSize)
+	{
+		recommended.packetSize = maxPacketSize;
+		advice.advice |= StreamAdvice_PacketSize;
+	}
+
+	double packetBits = (recommended.packetSize + c_ethernetOverhead) * 8.0;
+	int64_t payloadPerPacket = std::max<int64_t>(1, recommended.packetSize - c_packetHeaderSize);
+	int64_t packetsPerFrame = (current.payloadSize + payloadPerPacket - 1) / payloadPerPacket;
+	double frameBits = packetsPerFrame * packetBits;
+	advice.requiredUtilization = current.frameRate * frameBits / linkBitsPerSecond;
+	double linkRequired = others + advice.requiredUtilization;
+	double usable = 1.0 - m_headroom;
+	if (linkRequired > usable)
+		advice.advice |= StreamAdvice_Bandwidth;
+
+	if (window.packetErrorRatio > m_errorThreshold)
+	{
+		// the rate the camera sends at while it sends a frame, as a share of the link: its part of
+		// the usable bandwidth, by what it needs, and at least a quarter less than now (traffic
+		// the advisor doesn't see may share the link). Never below what its frames need.
+		double peak = (linkRequired > 0.0) ? usable * advice.requiredUtilization / linkRequired : usable;
+		double currentPacketSeconds = (current.packetSize + c_ethernetOverhead) * 8.0 / linkBitsPerSecond;
+		double currentPeak = currentPacketSeconds / (currentPacketSeconds + static_cast<double>(current.interPacketDelay) / current.tickFrequency);
+		peak = std::min(peak, currentPeak * 0.75);
+		peak = std::max(peak, std::min(1.0, advice.requiredUtilization * 1.05));
+
+		double packetSeconds = packetBits / linkBitsPerSecond;
+		int64_t delay = static_cast<int64_t>((packetSeconds / peak - packetSeconds) * current.tickFrequency);
+		delay = std::min(std::max<int64_t>(0, delay), current.maxInterPacketDelay);
+		if ((allowed & StreamAdvice_InterPacketDelay) != 0 && delay > current.interPacketDelay)
+		{
+			recommended.interPacketDelay = delay;
+			advice.advice |= StreamAdvice_InterPacketDelay;
+		}
+
+		// the cameras of the link take turns: each waits for the frames of the ones before it.
+		if ((allowed & StreamAdvice_FrameTransmissionDelay) != 0 && linkCameras > 1 && linkErrorCameras > 1)
+		{
+			double frameSeconds = frameBits / (peak * linkBitsPerSecond);
+			if (current.frameRate > 0.0)
+				frameSeconds = std::min(frameSeconds, 1.0 / current.frameRate / linkCameras);
+			int64_t frameDelay = static_cast<int64_t>(camera.rank * frameSeconds * current.tickFrequency);
+			if (frameDelay != current.frameTransmissionDelay)
+			{
+				recommended.frameTransmissionDelay = frameDelay;
+				advice.advice |= StreamAdvice_FrameTransmissionDelay;
+			}
+		}
+	}
+
+	if ((allowed & StreamAdvice_BufferCount) != 0 && window.underrunRate > 0.0 && current.bufferCount < c_maxBufferCount)
+	{
+		recommended.bufferCount = std::min(c_maxBufferCount, std::max<int64_t>(1, current.bufferCount) * 2);
+		advice.advice |= StreamAdvice_BufferCount;
+	}
+}
+
+inline bool Statistician::CStreamAdvisor::Advise(size_t index, SStreamAdvice &advice)
+{
+	memset(&advice, 0, sizeof(advice));
+	if (index >= m_cameras.size())
+		return false;
+
+	try
+	{
+		if (m_cameras[index].settings->GetStreamSettings(advice.current) == false)
+			return false;
+
+		SWindow window;
+		Recommend(index, ~0u, advice, window);
+		return advice.valid;
+	}
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << " " << e.what() << std::endl;
+		advice.valid = false;
+		return false;
+	}
+}
+
+inline bool Statistician::CStreamAdvisor::Write(SCamera &camera, const SStreamSettings &settings)
+{
+	try
+	{
+		camera.settings->SetStreamSettings(settings);
+		return true;
+	}
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << " " << e.what() << std::endl;
+		return false;
+	}
+}
+
+inline Statistician::STuningResult Statistician::CStreamAdvisor::Tune(size_t index)
+{
+	STuningResult result;
+	memset(&result, 0, sizeof(result));
+	result.state = TuningState_Idle;
+	if (index >= m_cameras.size())
+		return result;
+
+	SCamera &camera = m_cameras[index];
+	const unsigned settable = StreamAdvice_PacketSize | StreamAdvice_InterPacketDelay | StreamAdvice_FrameTransmissionDelay | StreamAdvice_BufferCount;
+	const unsigned againstErrors = StreamAdvice_InterPacketDelay | StreamAdvice_FrameTransmissionDelay | StreamAdvice_BufferCount;
+
+	if (camera.state == TuningState_Verifying)
+	{
+		SWindow after;
+		ReadWindow(camera, camera.changeUs, after);
+		result.advice = camera.advice;
+		result.errorsBefore = camera.errorsBefore;
+		result.settings = camera.previous;
+		if (after.valid == false)
+		{
+			result.settings = camera.applied;
+			result.state = TuningState_Verifying;
+			return result;
+		}
+
+		// a change against errors must cut them by a tenth (or below the threshold); a larger
+		// packet size only must not make them noticeably worse.
+		camera.errorsAfter = after.packetErrorRatio + after.underrunRatio;
+		bool better = ((camera.advice & againstErrors) != 0)
+			? (camera.errorsAfter <= m_errorThreshold || camera.errorsAfter < camera.errorsBefore * 0.9)
+			: (camera.errorsAfter <= std::max(camera.errorsBefore * 1.25, m_errorThreshold));
+		if (better == true)
+		{
+			camera.state = TuningState_Kept;
+			result.settings = camera.applied;
+		}
+		else
+		{
+			camera.rejected |= camera.advice;
+			camera.state = (Write(camera, camera.previous) == true) ? TuningState_RolledBack : TuningState_Failed;
+			camera.changeUs = after.lastUs + 1;
+		}
+		result.state = camera.state;
+		result.errorsAfter = camera.errorsAfter;
+		return result;
+	}
+
+	SStreamAdvice advice;
+	SWindow before;
+	memset(&advice, 0, sizeof(advice));
+	try
+	{
+		if (camera.settings->GetStreamSettings(advice.current) == false)
+			return result;
+		Recommend(index, settable & ~camera.rejected, advice, before);
+	}
+	catch (std::exception &e)
+	{
+		std::cout << __FUNCTION__ << " " << e.what() << std::endl;
+		return result;
+	}
+
+	if (advice.valid == false || (advice.advice & settable) == 0)
+	{
+		result.state = TuningState_Idle;
+		result.settings = advice.current;
+		return result;
+	}
+
+	camera.advice = advice.advice & settable;
+	camera.previous = advice.current;
+	camera.errorsBefore = advice.errorRatio;
+	camera.errorsAfter = 0.0;
+	camera.applied = advice.recommended;
+	camera.changeUs = before.lastUs + 1;
+	if (Write(camera, advice.recommended) == true)
+		camera.state = TuningState_Verifying;
+	else
+	{
+		camera.rejected |= camera.advice;
+		Write(camera, camera.previous);
+		camera.state = TuningState_Failed;
+	}
+
+	result.state = camera.state;
+	result.advice = camera.advice;
+	result.errorsBefore = camera.errorsBefore;
+	result.settings = advice.recommended;
+	return result;
+}
+
+inline void Statistician::CStreamAdvisor::ResetTuning(size_t index)
+{
+	if (index < m_cameras.size())
+		m_cameras[index].rejected = StreamAdvice_None;
+}
+
+// *********************************************************************************************************
+#endif